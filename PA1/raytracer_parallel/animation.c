@@ -0,0 +1,213 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "animation.h"
+#include "encoder.h"
+#include "lib/stb_image_write.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Frames whose output is on the device at once: the one rendering and the
+// one being read back
+#define FRAMES_IN_FLIGHT 2
+
+SceneCamera orbitCamera(const SceneCamera* camera, float angle) {
+    SceneCamera orbit = *camera;
+    const float x = camera->position[0] - camera->look_at[0];
+    const float z = camera->position[2] - camera->look_at[2];
+    orbit.position[0] = camera->look_at[0] + x * cosf(angle) + z * sinf(angle);
+    orbit.position[2] = camera->look_at[2] - x * sinf(angle) + z * cosf(angle);
+    return orbit;
+}
+
+static void frameName(char* name, size_t size, int frame) {
+    snprintf(name, size, "output_frame_%04d.png", frame);
+}
+
+// Point renderColor at the camera of a frame and the buffer it renders into
+static void setFrame(cl_kernel kernel, Scene* scene, const SceneCamera* camera,
+                     const AnimationSettings* animation, int frame, cl_mem hdr_d) {
+    const float angle = animation->arc * (float)M_PI / 180 * frame / animation->frames;
+    SceneCamera orbit = orbitCamera(camera, angle);
+    setCamera(scene, &orbit);
+    Camera frame_camera = imageCamera(scene);
+
+    cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &hdr_d);
+    err |= clSetKernelArg(kernel, 3, sizeof(Camera), &frame_camera);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting kernel arguments\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Each frame blocks on its kernels, its read and its PNG in turn
+static double renderSerial(cl_command_queue queue, cl_kernel kernel, cl_device_id device,
+                           const ToneMap* tone_map, Scene* scene, const SceneCamera* camera,
+                           const AnimationSettings* animation, cl_mem hdr_d, cl_mem pixels_d,
+                           unsigned char* pixels_h, double* encode_ms) {
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    double kernel_ms = 0;
+    *encode_ms = 0;
+    for (int frame = 0; frame < animation->frames; ++frame) {
+        setFrame(kernel, scene, camera, animation, frame, hdr_d);
+        cl_event rendered = enqueueRender(queue, kernel, device, 0, NULL);
+        cl_event toned = enqueueToneMap(tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f, 0, NULL);
+        clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+        kernel_ms += eventMs(rendered, toned);
+        clReleaseEvent(rendered);
+        clReleaseEvent(toned);
+
+        char name[64];
+        frameName(name, sizeof(name), frame);
+        const double start = wallClockMs();
+        stbi_write_png(name, settings.width, settings.height, 4, pixels_h, settings.width * 4);
+        *encode_ms += wallClockMs() - start;
+    }
+    return kernel_ms;
+}
+
+// Frame k's read is queued behind its kernels on the transfer queue, and
+// only waited for once frame k + 1's kernels are queued, so the device never
+// idles on the host. Frame k + 2 reuses frame k's output buffer after that
+// wait; the HDR buffer is only used between the in-order kernels.
+static double renderPipelined(cl_context context, cl_device_id device, cl_command_queue queue,
+                              cl_kernel kernel, const ToneMap* tone_map, Scene* scene,
+                              const SceneCamera* camera, const AnimationSettings* animation,
+                              cl_mem hdr_d, cl_mem* pixels_d, Encoder* encoder) {
+    cl_int err;
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    cl_command_queue transfer = createQueue(context, device, 0, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating queue\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double kernel_ms = 0;
+    cl_event rendered[FRAMES_IN_FLIGHT];
+    cl_event toned[FRAMES_IN_FLIGHT];
+    cl_event read[FRAMES_IN_FLIGHT];
+    unsigned char* pixels_h[FRAMES_IN_FLIGHT];
+    for (int frame = 0; frame <= animation->frames; ++frame) {
+        const int slot = frame % FRAMES_IN_FLIGHT;
+        if (frame < animation->frames) {
+            setFrame(kernel, scene, camera, animation, frame, hdr_d);
+            rendered[slot] = enqueueRender(queue, kernel, device, 0, NULL);
+            toned[slot] = enqueueToneMap(tone_map, queue, hdr_d, pixels_d[slot], num_pixels, 1.0f, 0, NULL);
+            clFlush(queue);
+
+            pixels_h[slot] = acquireFrame(encoder);
+            err = clEnqueueReadBuffer(transfer, pixels_d[slot], CL_FALSE, 0, num_pixels * 4, pixels_h[slot],
+                                      1, &toned[slot], &read[slot]);
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "Error reading frame %d\n", frame);
+                exit(EXIT_FAILURE);
+            }
+            clFlush(transfer);
+        }
+
+        // The previous frame is done once its read is
+        if (frame > 0) {
+            const int previous = (frame - 1) % FRAMES_IN_FLIGHT;
+            clWaitForEvents(1, &read[previous]);
+            kernel_ms += eventMs(rendered[previous], toned[previous]);
+            clReleaseEvent(rendered[previous]);
+            clReleaseEvent(toned[previous]);
+            clReleaseEvent(read[previous]);
+
+            char name[64];
+            frameName(name, sizeof(name), frame - 1);
+            encodeFrame(encoder, pixels_h[previous], name);
+        }
+    }
+
+    clReleaseCommandQueue(transfer);
+    return kernel_ms;
+}
+
+void renderAnimation(cl_context context, cl_device_id device, cl_command_queue queue,
+                     const ToneMap* tone_map, const char* kernelSrc, Scene* scene,
+                     const SceneCamera* camera, const AnimationSettings* animation) {
+    cl_int err;
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    cl_program program = buildProgram(context, device, kernelSrc, fitsConstant(device, scene));
+    cl_kernel kernel = clCreateKernel(program, "renderColor", &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating kernel\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The scene stays on the device for every frame; only the camera changes
+    DeviceScene device_scene;
+    uploadScene(context, scene, &device_scene);
+    err = clSetKernelArg(kernel, 1, sizeof(cl_int), &settings.width);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_int), &settings.height);
+    err |= setSceneArgs(kernel, 4, scene, &device_scene, scene->num_nodes);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting kernel arguments\n");
+        exit(EXIT_FAILURE);
+    }
+    cl_mem hdr_d = clCreateBuffer(context, CL_MEM_READ_WRITE, num_pixels * sizeof(cl_float4), NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating hdr_d\n");
+        exit(EXIT_FAILURE);
+    }
+    cl_mem pixels_d[FRAMES_IN_FLIGHT];
+    for (int b = 0; b < FRAMES_IN_FLIGHT; ++b) {
+        pixels_d[b] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_pixels * 4, NULL, &err);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error creating pixels_d\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Warm up, so that neither mode pays for the first launch
+    setFrame(kernel, scene, camera, animation, 0, hdr_d);
+    clReleaseEvent(enqueueRender(queue, kernel, device, 0, NULL));
+    clFinish(queue);
+
+    double kernel_ms, wall_ms, encode_ms;
+    int encoders = 0;
+    if (animation->serial) {
+        unsigned char* pixels_h = malloc(num_pixels * 4);
+        const double start = wallClockMs();
+        kernel_ms = renderSerial(queue, kernel, device, tone_map, scene, camera, animation, hdr_d, pixels_d[0],
+                                 pixels_h, &encode_ms);
+        wall_ms = wallClockMs() - start;
+        free(pixels_h);
+    } else {
+        // Leave a processor to the thread driving the device
+        encoders = animation->encoders;
+        if (encoders == 0) {
+            encoders = cpuCount() > 1 ? cpuCount() - 1 : 1;
+        }
+        Encoder encoder;
+        createEncoder(&encoder, encoders, encoders + FRAMES_IN_FLIGHT, settings.width, settings.height);
+        const double start = wallClockMs();
+        kernel_ms = renderPipelined(context, device, queue, kernel, tone_map, scene, camera, animation, hdr_d,
+                                    pixels_d, &encoder);
+        finishEncoder(&encoder);
+        wall_ms = wallClockMs() - start;
+        encode_ms = encoder.encode_ms;
+        destroyEncoder(&encoder);
+    }
+
+    printf("Frames: %d at %dx%d over %.0f degrees, %s", animation->frames, settings.width, settings.height,
+           animation->arc, animation->serial ? "serial\n" : "pipelined");
+    if (!animation->serial) {
+        printf(" with %d encoder thread%s\n", encoders, encoders == 1 ? "" : "s");
+    }
+    printf("Kernel time: %.1f ms (%.2f ms per frame)\n", kernel_ms, kernel_ms / animation->frames);
+    printf("PNG time: %.1f ms (%.2f ms per frame)\n", encode_ms, encode_ms / animation->frames);
+    printf("Total time: %.1f ms, %.1f frames/s, %.2fx the kernel time\n",
+           wall_ms, animation->frames * 1000 / wall_ms, wall_ms / kernel_ms);
+
+    for (int b = 0; b < FRAMES_IN_FLIGHT; ++b) {
+        clReleaseMemObject(pixels_d[b]);
+    }
+    clReleaseMemObject(hdr_d);
+    releaseDeviceScene(&device_scene);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+}
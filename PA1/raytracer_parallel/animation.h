@@ -0,0 +1,24 @@
+#pragma once
+
+#include "render.h"
+#include "tonemap.h"
+
+// A turntable: the camera circles the point it looks at, around the vertical
+typedef struct AnimationSettings {
+    int frames;
+    float arc; // degrees covered over all frames
+    int encoders; // PNG threads, 0 for one per spare processor
+    int serial; // render, read back and write each frame before the next
+} AnimationSettings;
+
+// The camera turned by angle radians about the vertical through its look-at
+SceneCamera orbitCamera(const SceneCamera* camera, float angle);
+
+// Render every frame of the turntable around camera to
+// output_frame_<nnnn>.png and report how close the total time comes to the
+// kernel time alone, tone mapping included. Pipelined, frame k + 1 renders
+// while frame k is read back on a second queue and earlier frames are
+// written on encoder threads.
+void renderAnimation(cl_context context, cl_device_id device, cl_command_queue queue,
+                     const ToneMap* tone_map, const char* kernelSrc, Scene* scene,
+                     const SceneCamera* camera, const AnimationSettings* animation);
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "encoder.h"
+#include "render.h"
+#include "lib/stb_image_write.h"
+
+static void* encodeFrames(void* arg) {
+    Encoder* encoder = arg;
+    pthread_mutex_lock(&encoder->lock);
+    while (1) {
+        while (!encoder->stop && encoder->num_jobs == 0) {
+            pthread_cond_wait(&encoder->job_ready, &encoder->lock);
+        }
+        if (encoder->num_jobs == 0) {
+            break; // stopping and nothing left
+        }
+        const int job = encoder->first_job;
+        unsigned char* pixels = encoder->job_pixels[job];
+        char path[64];
+        memcpy(path, encoder->job_paths[job], sizeof(path));
+        encoder->first_job = (job + 1) % encoder->num_buffers;
+        encoder->num_jobs--;
+        encoder->writing++;
+        pthread_mutex_unlock(&encoder->lock);
+
+        const double start = wallClockMs();
+        if (!stbi_write_png(path, encoder->width, encoder->height, 4, pixels, encoder->width * 4)) {
+            fprintf(stderr, "Error writing %s\n", path);
+        }
+        const double elapsed = wallClockMs() - start;
+
+        pthread_mutex_lock(&encoder->lock);
+        encoder->encode_ms += elapsed;
+        encoder->writing--;
+        encoder->free_buffers[encoder->num_free++] = pixels;
+        pthread_cond_signal(&encoder->buffer_free);
+        if (encoder->num_jobs == 0 && encoder->writing == 0) {
+            pthread_cond_broadcast(&encoder->idle);
+        }
+    }
+    pthread_mutex_unlock(&encoder->lock);
+    return NULL;
+}
+
+void createEncoder(Encoder* encoder, int num_threads, int num_buffers, int width, int height) {
+    encoder->width = width;
+    encoder->height = height;
+    encoder->num_buffers = num_buffers;
+    encoder->buffers = malloc(num_buffers * sizeof(unsigned char*));
+    encoder->free_buffers = malloc(num_buffers * sizeof(unsigned char*));
+    encoder->job_pixels = malloc(num_buffers * sizeof(unsigned char*));
+    encoder->job_paths = malloc(num_buffers * sizeof(*encoder->job_paths));
+    for (int b = 0; b < num_buffers; ++b) {
+        encoder->buffers[b] = malloc((size_t)width * height * 4);
+        encoder->free_buffers[b] = encoder->buffers[b];
+    }
+    encoder->num_free = num_buffers;
+    encoder->first_job = 0;
+    encoder->num_jobs = 0;
+    encoder->writing = 0;
+    encoder->encode_ms = 0;
+    encoder->stop = 0;
+    pthread_mutex_init(&encoder->lock, NULL);
+    pthread_cond_init(&encoder->job_ready, NULL);
+    pthread_cond_init(&encoder->buffer_free, NULL);
+    pthread_cond_init(&encoder->idle, NULL);
+
+    encoder->num_threads = num_threads;
+    encoder->threads = malloc(num_threads * sizeof(pthread_t));
+    for (int t = 0; t < num_threads; ++t) {
+        if (pthread_create(&encoder->threads[t], NULL, encodeFrames, encoder) != 0) {
+            fprintf(stderr, "Error starting encoder thread %d\n", t);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+unsigned char* acquireFrame(Encoder* encoder) {
+    pthread_mutex_lock(&encoder->lock);
+    while (encoder->num_free == 0) {
+        pthread_cond_wait(&encoder->buffer_free, &encoder->lock);
+    }
+    unsigned char* pixels = encoder->free_buffers[--encoder->num_free];
+    pthread_mutex_unlock(&encoder->lock);
+    return pixels;
+}
+
+void encodeFrame(Encoder* encoder, unsigned char* pixels, const char* path) {
+    pthread_mutex_lock(&encoder->lock);
+    // a job per buffer at most, so the ring never overflows
+    const int job = (encoder->first_job + encoder->num_jobs) % encoder->num_buffers;
+    encoder->job_pixels[job] = pixels;
+    snprintf(encoder->job_paths[job], sizeof(encoder->job_paths[job]), "%s", path);
+    encoder->num_jobs++;
+    pthread_cond_signal(&encoder->job_ready);
+    pthread_mutex_unlock(&encoder->lock);
+}
+
+void finishEncoder(Encoder* encoder) {
+    pthread_mutex_lock(&encoder->lock);
+    while (encoder->num_jobs > 0 || encoder->writing > 0) {
+        pthread_cond_wait(&encoder->idle, &encoder->lock);
+    }
+    pthread_mutex_unlock(&encoder->lock);
+}
+
+void destroyEncoder(Encoder* encoder) {
+    pthread_mutex_lock(&encoder->lock);
+    encoder->stop = 1;
+    pthread_cond_broadcast(&encoder->job_ready);
+    pthread_mutex_unlock(&encoder->lock);
+    for (int t = 0; t < encoder->num_threads; ++t) {
+        pthread_join(encoder->threads[t], NULL);
+    }
+
+    for (int b = 0; b < encoder->num_buffers; ++b) {
+        free(encoder->buffers[b]);
+    }
+    free(encoder->buffers);
+    free(encoder->free_buffers);
+    free(encoder->job_pixels);
+    free(encoder->job_paths);
+    free(encoder->threads);
+    pthread_mutex_destroy(&encoder->lock);
+    pthread_cond_destroy(&encoder->job_ready);
+    pthread_cond_destroy(&encoder->buffer_free);
+    pthread_cond_destroy(&encoder->idle);
+}
+
+int cpuCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Writes frames to PNG files on worker threads, so that compression stays
+// off the thread that drives the device. Frames live in a fixed pool of
+// host buffers that go back to the pool once written.
+typedef struct Encoder {
+    pthread_t* threads;
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t buffer_free;
+    pthread_cond_t idle;
+
+    int width;
+    int height;
+    unsigned char** buffers;
+    int num_buffers;
+    unsigned char** free_buffers; // stack of buffers not holding a frame
+    int num_free;
+
+    // ring of frames waiting to be written, at most num_buffers of them
+    unsigned char** job_pixels;
+    char (*job_paths)[64];
+    int first_job;
+    int num_jobs;
+    int writing; // jobs taken by a thread but not finished
+
+    double encode_ms; // summed over all frames and threads
+    int stop;
+} Encoder;
+
+// @param num_threads : threads writing PNGs
+// @param num_buffers : host frames that can be in flight at once
+void createEncoder(Encoder* encoder, int num_threads, int num_buffers, int width, int height);
+
+// A free width * height RGBA buffer; waits for one if all are busy
+unsigned char* acquireFrame(Encoder* encoder);
+
+// Queue a buffer from acquireFrame to be written to path
+void encodeFrame(Encoder* encoder, unsigned char* pixels, const char* path);
+
+// Wait until every queued frame is written
+void finishEncoder(Encoder* encoder);
+void destroyEncoder(Encoder* encoder);
+
+// Number of logical processors
+int cpuCount(void);
@@ -1,82 +1,57 @@
+// Every ray is traced with a unit direction, so t is a distance. Only the
+// index of the closest sphere is kept during the search; its normal and
+// material are looked up once, by finishHit and hitMaterial.
 typedef struct Ray {
     float3 origin;
     float3 dir;
-    float3 normal;
-
-    // Material properties of closest intersection
-    float3 diffuse;
-    float3 specular;
-    float3 ambient;
-    float shininess;
-    
+    float3 normal; // set by finishHit
+    int sphere; // closest hit so far, -1 for none
     float  t;
 } Ray;
 
-typedef struct Sphere {
-    float radius;
-    float3 ambient;
+// Address space of every scene buffer. The host builds with
+// -DSCENE_SPACE=__constant when the whole scene fits in constant memory.
+#ifndef SCENE_SPACE
+#define SCENE_SPACE __global
+#endif
 
-    float3 center;
+// Same layout as Material in lib/geometry/Material.h
+typedef struct Material {
+    float3 ambient;
     float3 diffuse;
     float3 specular;
     float shininess;
-} Sphere;
-
-void intersectSphere(Ray* r_ray, Sphere* sphere) {
-    float3 p0 = r_ray->origin;
-    float3 p1 = r_ray->dir;
-    float3 dir_to_center = p0 - sphere->center;
-
-    // set up quadratic coefficients
-    const float a = dot(p1, p1);
-    const float b = 2 * dot(p1, dir_to_center);
-    const float c = dot(dir_to_center, dir_to_center) - (sphere->radius * sphere->radius);
-
-    const float disc = (b * b) - 4 * a * c;
-
-    // solve ray-sphere system
-    const float t1 = (-b + sqrt(disc)) / (2 * a);
-    const float t2 = (-b - sqrt(disc)) / (2 * a);
-
-    // Do nothing if no intersection
-    if (disc < 0) {
+} Material;
+
+// sphere packs the center in xyz and the radius in w. With a unit direction
+// the quadratic's leading coefficient is 1, and halving b leaves
+// t = -b +- sqrt(b^2 - c).
+void intersectSphere(Ray* r_ray, float4 sphere, int index) {
+    const float3 dir_to_center = r_ray->origin - sphere.xyz;
+    const float b = dot(r_ray->dir, dir_to_center);
+    const float c = dot(dir_to_center, dir_to_center) - (sphere.w * sphere.w);
+
+    // Starting outside and heading away, or missing: no root worth a sqrt
+    if (c > 0 && b > 0) {
         return;
     }
-
-    float final_t = 0.0f;
-
-    // 1 root
-    if (disc == 0) {
-        final_t = t1; 
-    }
-    // lesser root is positive, so use it
-    else if (t2 > 0) {
-       final_t = t2 ;
-    }
-    // lesser root is negative and larger root is positive 
-    // use the positive root
-    else if (t1 > 0) {
-        final_t = t1;
-    }
-    // both roots are negative
-    else {
+    const float disc = b * b - c;
+    if (disc < 0) {
         return;
     }
 
-    float3 intersectPoint = p0 + p1 * final_t;
+    // lesser root unless it is behind the origin
+    const float root = sqrt(disc);
+    float final_t = -b - root;
+    if (final_t <= 0) {
+        final_t = -b + root;
+    }
 
-    // If a closer intersection is found 
-    if (final_t < r_ray-> t) {
+    // If a closer intersection is found
+    if (final_t > 0 && final_t < r_ray->t) {
         r_ray->t = final_t;
-        r_ray->normal = normalize(intersectPoint - sphere->center);
-
-        // keep track of material properties of the new intersection
-        r_ray->ambient = sphere->ambient;
-        r_ray->diffuse = sphere->diffuse;
-        r_ray->specular = sphere->specular;
-        r_ray->shininess = sphere->shininess;
+        r_ray->sphere = index;
     }
-
 }
 
 typedef struct Light {
@@ -84,12 +59,17 @@ typedef struct Light {
     float3 color;
     float3 atten;
     int dir; // track if point light or not (1 if point, 0 if direc)
+    float range; // beyond this a point light adds less than LIGHT_CUTOFF in render.h
 
     //point lights atten (0,0,1)
     //no atten is (1,0,0)
 } Light;
 
+// Light arriving at surfacePos, before shadowing; only point lights fall off
 float3 calcLight(float3 surfacePos, Light light) {
+    if (!light.dir) {
+        return light.color;
+    }
     float3 atten = light.atten;
     const float dist = distance(surfacePos, light.pos);
     const float denom = atten.x + atten.y * dist + atten.z * pown(dist, 2);
@@ -98,13 +78,208 @@ float3 calcLight(float3 surfacePos, Light light) {
     return light.color / denom;
 }
 
-// intesect the ray with every sphere in the scene
-void intersectScene(Sphere spheres[], size_t num_spheres, Ray* r_ray) {
-    for (int s = 0; s < num_spheres; ++s) {
-        intersectSphere(r_ray, &spheres[s]);
+// Whether the light is close enough to surfacePos to be worth a shadow ray
+bool lightInRange(float3 surfacePos, Light light) {
+    return !light.dir || distance(surfacePos, light.pos) <= light.range;
+}
+
+// Same layout as BVHNode in lib/geometry/bvh.h. Interior nodes have their
+// children at left_first and left_first + 1; leaves (count > 0) cover
+// spheres[left_first, left_first + count).
+typedef struct BVHNode {
+    float bounds_min[3];
+    int left_first;
+    float bounds_max[3];
+    int count;
+} BVHNode;
+
+// The host builds trees no deeper than this, so the traversal stack below
+// can never overflow
+#ifndef BVH_MAX_DEPTH
+#define BVH_MAX_DEPTH 32
+#endif
+
+// Everything a ray can hit or be lit by. Spheres are split in two arrays:
+// center and radius for the intersection test, material index for shading.
+typedef struct Scene {
+    SCENE_SPACE const float4* spheres;
+    SCENE_SPACE const int* sphere_materials;
+    int num_spheres;
+    SCENE_SPACE const BVHNode* nodes;
+    int num_nodes; // 0 to test every sphere
+    SCENE_SPACE const Material* materials;
+    SCENE_SPACE const Light* lights;
+    int num_lights;
+} Scene;
+
+// Distance at which the ray enters the node's box, or INFINITY if it misses
+// it before t_max
+float hitBounds(SCENE_SPACE const BVHNode* node, float3 origin, float3 inv_dir, float t_max) {
+    float3 t0 = (vload3(0, node->bounds_min) - origin) * inv_dir;
+    float3 t1 = (vload3(0, node->bounds_max) - origin) * inv_dir;
+    float3 t_small = fmin(t0, t1);
+    float3 t_large = fmax(t0, t1);
+    float t_enter = fmax(fmax(t_small.x, t_small.y), fmax(t_small.z, 0.0f));
+    float t_exit = fmin(fmin(t_large.x, t_large.y), fmin(t_large.z, t_max));
+    return t_enter <= t_exit ? t_enter : INFINITY;
+}
+
+// Closest-hit traversal, nearer child first. Only far children wait on the
+// stack, so it holds at most one entry per level of the tree.
+void intersectBVH(const Scene* scene, Ray* r_ray) {
+    SCENE_SPACE const BVHNode* nodes = scene->nodes;
+    const float3 inv_dir = 1.0f / r_ray->dir;
+
+    int stack_node[BVH_MAX_DEPTH];
+    float stack_t[BVH_MAX_DEPTH];
+    int top = 0;
+
+    int index = 0;
+    if (isinf(hitBounds(&nodes[0], r_ray->origin, inv_dir, r_ray->t))) {
+        return;
+    }
+    while (true) {
+        SCENE_SPACE const BVHNode* node = &nodes[index];
+        if (node->count == 0) {
+            int near_child = node->left_first;
+            int far_child = near_child + 1;
+            float t_near = hitBounds(&nodes[near_child], r_ray->origin, inv_dir, r_ray->t);
+            float t_far = hitBounds(&nodes[far_child], r_ray->origin, inv_dir, r_ray->t);
+            if (t_far < t_near) {
+                int tmp_child = near_child;
+                near_child = far_child;
+                far_child = tmp_child;
+                float tmp_t = t_near;
+                t_near = t_far;
+                t_far = tmp_t;
+            }
+            if (!isinf(t_near)) {
+                if (!isinf(t_far)) {
+                    stack_node[top] = far_child;
+                    stack_t[top] = t_far;
+                    top++;
+                }
+                index = near_child;
+                continue;
+            }
+        } else {
+            for (int s = node->left_first; s < node->left_first + node->count; ++s) {
+                intersectSphere(r_ray, scene->spheres[s], s);
+            }
+        }
+
+        // pop the next subtree that can still hold a closer hit
+        index = -1;
+        while (top > 0) {
+            top--;
+            if (stack_t[top] < r_ray->t) {
+                index = stack_node[top];
+                break;
+            }
+        }
+        if (index < 0) {
+            return;
+        }
+    }
+}
+
+// intesect the ray with the scene, through the BVH unless num_nodes is 0
+void intersectScene(const Scene* scene, Ray* r_ray) {
+    if (scene->num_nodes > 0) {
+        intersectBVH(scene, r_ray);
+        return;
+    }
+    for (int s = 0; s < scene->num_spheres; ++s) {
+        intersectSphere(r_ray, scene->spheres[s], s);
+    }
+}
+
+// Shadow rays ignore occluders closer than this to their origin
+#define SHADOW_EPSILON 1e-4f
+
+// Whether the sphere crosses the ray between SHADOW_EPSILON and its t
+bool blocksRay(Ray ray, float4 sphere) {
+    const float3 dir_to_center = ray.origin - sphere.xyz;
+    const float b = dot(ray.dir, dir_to_center);
+    const float c = dot(dir_to_center, dir_to_center) - (sphere.w * sphere.w);
+    if (c > 0 && b > 0) {
+        return false;
+    }
+    const float disc = b * b - c;
+    if (disc < 0) {
+        return false;
+    }
+    const float root = sqrt(disc);
+    const float t_near = -b - root;
+    const float t_far = -b + root;
+    return (t_near >= SHADOW_EPSILON && t_near < ray.t) || (t_far >= SHADOW_EPSILON && t_far < ray.t);
+}
+
+// Any-hit query for shadow rays: stops at the first sphere that blocks the
+// ray, in whatever order the BVH yields them, instead of looking for the
+// closest. Children are not sorted either, since any hit will do.
+bool occluded(const Scene* scene, Ray ray) {
+    if (scene->num_nodes == 0) {
+        for (int s = 0; s < scene->num_spheres; ++s) {
+            if (blocksRay(ray, scene->spheres[s])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SCENE_SPACE const BVHNode* nodes = scene->nodes;
+    const float3 inv_dir = 1.0f / ray.dir;
+    int stack_node[BVH_MAX_DEPTH];
+    int top = 0;
+
+    int index = 0;
+    if (isinf(hitBounds(&nodes[0], ray.origin, inv_dir, ray.t))) {
+        return false;
+    }
+    while (true) {
+        SCENE_SPACE const BVHNode* node = &nodes[index];
+        if (node->count == 0) {
+            const int left = node->left_first;
+            const bool hit_left = !isinf(hitBounds(&nodes[left], ray.origin, inv_dir, ray.t));
+            const bool hit_right = !isinf(hitBounds(&nodes[left + 1], ray.origin, inv_dir, ray.t));
+            if (hit_left) {
+                if (hit_right) {
+                    stack_node[top++] = left + 1;
+                }
+                index = left;
+                continue;
+            }
+            if (hit_right) {
+                index = left + 1;
+                continue;
+            }
+        } else {
+            for (int s = node->left_first; s < node->left_first + node->count; ++s) {
+                if (blocksRay(ray, scene->spheres[s])) {
+                    return true;
+                }
+            }
+        }
+
+        if (top == 0) {
+            return false;
+        }
+        index = stack_node[--top];
     }
 }
 
+// Surface normal at the closest hit, which intersectScene only records the
+// sphere of
+void finishHit(const Scene* scene, Ray* r_ray) {
+    const float3 hit_point = r_ray->origin + r_ray->dir * r_ray->t;
+    r_ray->normal = normalize(hit_point - scene->spheres[r_ray->sphere].xyz);
+}
+
+Material hitMaterial(const Scene* scene, Ray ray) {
+    return scene->materials[scene->sphere_materials[ray.sphere]];
+}
+
 // reflect the unit vector subject across unit vector mirror
 float3 reflect(float3 subject, float3 mirror) {
     return (2.0f * dot(subject, mirror) * mirror) - subject;
@@ -114,189 +289,224 @@ typedef struct RayHit {
     float3 phong; 
     float3 specular;
 } RayHit;
-// Shades a ray at its nearest intersection position.
-// Assumes the ray has already been intersected with relevant geometry. 
-// The ray is passed by value because we'll need to use all its members anyway.
-float3 shadeRayHit(Ray ray, Light lights[], size_t num_lights, Sphere spheres[], size_t num_spheres) {
-    // return ray.ambient;
-    const float3 hit_point = ray.origin + ray.dir * ray.t;
-    const float3 hit_normal = ray.normal;
 
-    // total incoming light from all lights
-    float3 color = (float3)(0, 0, 0);
-    // accumulate brightness from all lights
-    for (int l = 0; l < num_lights; ++l) {
-        Light curr_light = lights[l];
-
-        // get direction from the hit point to the light
-        float3 hit_to_light;
-        if (curr_light.dir) {
-            hit_to_light = curr_light.pos - hit_point; // point light
-        } else {
-            hit_to_light = -curr_light.pos; // directional light
+// Ray from the hit point to the light, nudged off the surface, for
+// occluded. Its t is the distance to a point light, so only spheres in
+// front of the light can block it.
+Ray shadowRay(float3 hit_point, float3 hit_normal, Light light) {
+    Ray shadow_ray = {
+        .origin = hit_point + (hit_normal * 5.0f * 10e-5f),
+        .sphere = -1,
+        .t = INFINITY
+    };
+    if (light.dir) {
+        // point light
+        const float3 to_light = light.pos - shadow_ray.origin;
+        shadow_ray.t = length(to_light);
+        shadow_ray.dir = to_light / shadow_ray.t;
+    } else {
+        // directional light
+        shadow_ray.dir = normalize(-light.pos);
+    }
+    return shadow_ray;
+}
+
+// The host sets both at build time
+#ifndef LIGHT_SAMPLE_THRESHOLD
+#define LIGHT_SAMPLE_THRESHOLD 8
+#endif
+#ifndef LIGHT_SAMPLES
+#define LIGHT_SAMPLES 4
+#endif
+
+// Walks the lights a hit sends shadow rays to. Lights out of range are
+// culled; if more than LIGHT_SAMPLE_THRESHOLD are left, LIGHT_SAMPLES of
+// them are drawn by luminance, one from each equal slice of the total, and
+// weighted so that the sum over the draws is an unbiased estimate of the
+// sum over every light. Nothing is stored per light, so the same code
+// serves a handful of lights or thousands.
+typedef struct LightSampler {
+    float3 surface_pos;
+    int light; // last light visited
+    int sampling;
+    int draws; // returned so far when sampling
+    float slice; // total luminance / LIGHT_SAMPLES
+    float next; // luminance at which the next draw falls
+    float running; // luminance up to and including the current light
+    float luminance; // of the current light
+} LightSampler;
+
+// Integer hash (lowbias32), for random numbers that only need to differ
+// between pixels and bounces
+uint hashUint(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+float lightLuminance(float3 surfacePos, Light light) {
+    return dot(calcLight(surfacePos, light), (float3)(0.2126f, 0.7152f, 0.0722f));
+}
+
+// @param seed : random bits for the draws
+LightSampler startLights(const Scene* scene, float3 surfacePos, uint seed) {
+    int in_range = 0;
+    float total = 0;
+    for (int l = 0; l < scene->num_lights; ++l) {
+        const Light light = scene->lights[l];
+        if (lightInRange(surfacePos, light)) {
+            in_range++;
+            total += lightLuminance(surfacePos, light);
         }
-        float3 light_direction = normalize(hit_to_light);
+    }
 
-        // create a ray from the hit point to the light
-        Ray shadow_ray = {
-            .origin = hit_point + (hit_normal * 5.0f * 10e-5f), 
-            .dir = hit_to_light, 
-            .t = INFINITY
-        };
+    LightSampler sampler = {
+        .surface_pos = surfacePos,
+        .light = -1,
+        .sampling = in_range > LIGHT_SAMPLE_THRESHOLD,
+        .draws = 0,
+        .slice = total / LIGHT_SAMPLES,
+        .running = 0,
+        .luminance = 0
+    };
+    sampler.next = sampler.slice * (hashUint(seed) >> 8) * (1.0f / 16777216.0f);
+    return sampler;
+}
 
-        // check to see if the ray can reach the current light source
-        intersectScene(spheres, num_spheres, &shadow_ray);
-        bool light_reached;
-        if(curr_light.dir) {
-            // point light 
-            light_reached = shadow_ray.t > 1;
-        } else {
-            // directional light
-            light_reached = isinf(shadow_ray.t);
+// @param weight : set to the factor the light's contribution is scaled by
+// @return the next light to send a shadow ray to, or -1 when done; a light
+//         drawn more than once is returned once per draw
+int nextLight(LightSampler* sampler, const Scene* scene, float* weight) {
+    if (!sampler->sampling) {
+        while (++sampler->light < scene->num_lights) {
+            if (lightInRange(sampler->surface_pos, scene->lights[sampler->light])) {
+                *weight = 1.0f;
+                return sampler->light;
+            }
         }
-        
-        // something blocked the shadow ray from reaching the light
-        if (!light_reached) {
-            continue;
+        return -1;
+    }
+
+    while (sampler->draws < LIGHT_SAMPLES) {
+        if (sampler->light >= 0 && sampler->next < sampler->running) {
+            sampler->draws++;
+            sampler->next += sampler->slice;
+            *weight = sampler->slice / sampler->luminance;
+            return sampler->light;
         }
+        do {
+            sampler->light++;
+        } while (sampler->light < scene->num_lights
+                 && !lightInRange(sampler->surface_pos, scene->lights[sampler->light]));
+        if (sampler->light >= scene->num_lights) {
+            return -1;
+        }
+        sampler->luminance = lightLuminance(sampler->surface_pos, scene->lights[sampler->light]);
+        sampler->running += sampler->luminance;
+    }
+    return -1;
+}
 
-        // the light is reachable so we evaluate the shading model 
-        float3 reflection_direction = reflect(light_direction, hit_normal);
+// Phong diffuse and specular light reflected back along the ray from one
+// light that reaches the hit point
+float3 phongLight(Ray ray, Material material, float3 light_direction, float3 light_color) {
+    float3 reflection_direction = reflect(light_direction, ray.normal);
 
-        // phong shading model
-        float NdotL =  fmax(0, dot(hit_normal, light_direction));
-        float3 color_diffuse = ray.diffuse * NdotL;
+    float NdotL =  fmax(0, dot(ray.normal, light_direction));
+    float3 color_diffuse = material.diffuse * NdotL;
 
-        float3 color_specular = 
-            ray.specular * 
-            pow(fmax(0, dot(reflection_direction, -normalize(ray.dir))), ray.shininess);
-        color = color + ((color_diffuse + color_specular) * curr_light.color);
-    }
-    return color + ray.ambient;
+    float3 color_specular = 
+        material.specular * 
+        pow(fmax(0, dot(reflection_direction, -ray.dir)), material.shininess);
+    return (color_diffuse + color_specular) * light_color;
 }
 
+// Shades a ray at its nearest intersection position.
+// Assumes the ray has already been intersected with relevant geometry and
+// finished with finishHit.
+// The ray is passed by value because we'll need to use all its members anyway.
+// @param seed : random bits for startLights
+float3 shadeRayHit(Ray ray, Material material, const Scene* scene, uint seed) {
+    const float3 hit_point = ray.origin + ray.dir * ray.t;
+    LightSampler sampler = startLights(scene, hit_point, seed);
 
-#define MAX_SPHERES 10 
-#define MAX_LIGHTS 5
-#define MAX_RECURSION_DEPTH 6
+    // total incoming light from the chosen lights
+    float3 color = (float3)(0, 0, 0);
+    float weight;
+    for (int l = nextLight(&sampler, scene, &weight); l >= 0; l = nextLight(&sampler, scene, &weight)) {
+        Light curr_light = scene->lights[l];
 
-//! KERNEL BEGINNING
-__kernel void renderColor(__global unsigned char* output, int img_size, float half_height) {
-    int workitem_id = get_global_id(0);
-
-    int row = workitem_id / img_size;
-    int col = workitem_id % img_size;
-
-    Sphere spheres[MAX_SPHERES];
-    Light lights[MAX_LIGHTS];
-    // hardcode the scene for now
-    spheres[0] = (Sphere){
-        .radius = 1.3f, 
-        .center = (float3){3.4, -1.8, -9},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){.7, 0.0, 0.0}, 
-        
-        .specular = (float3){0.3, 0.1, 0.1}, 
-        .shininess = 100 
-    };
+        // something blocked the shadow ray from reaching the light
+        Ray shadow_ray = shadowRay(hit_point, ray.normal, curr_light);
+        if (occluded(scene, shadow_ray)) {
+            continue;
+        }
 
-    spheres[1] = (Sphere){
-        .radius = 3.0f, 
-        .center = (float3){2, 0, -18},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.7, 0.6, 0.9}, 
-        .specular = (float3){0.6, 0.6, 0.6}, 
-        .shininess =  100 
-    };
+        // the light is reachable so we evaluate the shading model 
+        color = color + weight
+            * phongLight(ray, material, shadow_ray.dir, calcLight(hit_point, curr_light));
+    }
+    return color + material.ambient;
+}
 
-    // Ground sphere
-    spheres[2] = (Sphere){
-        .radius = 2500.0f, 
-        .center = (float3){0, -2501.5, -100},
-        .ambient = (float3){0.1, 0.05, 0.1},
-        .diffuse = (float3){0.5, 0.5, 0.5},     
-        .specular = (float3){0.4, 0.4, 0.4},    
-        .shininess = 20
-    };
+// Color of a ray that leaves the scene
+float3 skyColor(float3 dir) {
+    float3 sky = {0.5 * dir.x + 0.5, 0.5 * dir.y + 0.5, 0.7 * max(dir.z, -dir.z) + 0.3};
+    return sky;
+}
 
-    spheres[3] = (Sphere){
-        .radius = 1.3f, 
-        .center = (float3){-3, -2, -7},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.0, 0.7, 0.7}, 
-        .specular = (float3){0.1, 0.5, 0.1}, 
-        .shininess = 10 
-    };
-    spheres[4] = (Sphere){
-        .radius = 0.5f, 
-        .center = (float3){-1.8, -2.5, -10},
-        .ambient = (float3){0.1, 0.2, 0.2},
-        .diffuse = (float3){0.0, 0.6, 0.5},
-        .specular = (float3){0.1, 0.1, 0.1}, 
-        .shininess = 100 
-    };
-    spheres[5] = (Sphere){
-        .radius = 0.6667f, 
-        .center = (float3){-1.6, -2.7, -6},
-        .ambient = (float3){0, 0, 0.5},
-        .diffuse = (float3){0.0, 0.7, 0.7},
-        .specular = (float3){0.1, 0.1, 0.2}, 
-        .shininess = 0 
-    };
-    spheres[6] = (Sphere){
-        .radius = 0.4f, 
-        .center = (float3){1.5, -2.8, -7.2},
-        .ambient = (float3){0.4, 0, 0.0},
-        .diffuse = (float3){0.7, 0.7, 0.0},
-        .specular = (float3){0.1, 0.1, 0.2}, 
-        .shininess = 0 
-    };
-    spheres[7] = (Sphere){
-        .radius = 0.5f, 
-        .center = (float3){2.4, -2.7, -6.5},
-        .ambient = (float3){0.2, 0.0, 0.2},
-        .diffuse = (float3){0.7, 0.0, 0.4},
-        .specular = (float3){0.1, 0.1, 0.1}, 
-        .shininess = 50 
-    };
-    spheres[8] = (Sphere){
-        .radius = 5.0f, 
-        .center = (float3){-6, 2, -15},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.7, 0.7, 0.7},
-        .specular = (float3){0.4, 0.4, 0.4}, 
-        .shininess = 100 
-    };
-    
-    // don't forget to update this
-    unsigned int num_spheres = 9;
-
-    // Lights
-    lights[0] = (Light){
-        .pos = (float3){8, 4, 7},
-        .color = (float3){0.5, 0.5, 0.5},
-        .atten = (float3){1, 0, 0},  
-        .dir = 1
+// Mirror reflection of a ray off the surface it hit
+Ray reflectedRay(Ray ray) {
+    float3 reflection_direction = reflect(-ray.dir, ray.normal);
+    Ray reflected = {
+        .origin = (ray.origin + (ray.dir * ray.t)) 
+            + (ray.normal * 2.0f * 10e-5f),
+        .dir = reflection_direction,
+        .sphere = -1,
+        .t = INFINITY 
     };
+    return reflected;
+}
 
-    lights[1] = (Light){
-        .pos = (float3){-5, 5, 0},
-        .color = (float3){0.1, 0.1, 0.1},
-        .atten = (float3){1, 0, 0},
-        .dir = 1
-    };
 
-    // dont forget to set the number of spheres/lights
-    unsigned int num_lights = 2; 
+#define MAX_RECURSION_DEPTH 6
 
-     //* ----------------- RAY GENERATION -----------------------------
-    float offset_x = half_height * ((col + 0.5f - img_size/2.0f)/(img_size/2.0f));
-    float offset_y = half_height * ((img_size/2.0f - row - 0.5f)/(img_size/2.0f));
+// Same layout as Camera in main.c
+typedef struct Camera {
+    float3 position;
+    float3 right;
+    float3 up;
+    float3 forward;
+    float half_height; // half the height of the image plane
+    float half_width;
+} Camera;
+
+// Direction of the primary ray through the center of a pixel
+float3 primaryDirection(Camera camera, int col, int row, int width, int height) {
+    float offset_x = camera.half_width * ((col + 0.5f - width/2.0f)/(width/2.0f));
+    float offset_y = camera.half_height * ((height/2.0f - row - 0.5f)/(height/2.0f));
+
+    float3 ray_direction = camera.right * offset_x + camera.up * offset_y + camera.forward;
+    return normalize(ray_direction);
+}
 
-    float3 ray_direction = (float3)(offset_x, offset_y, -1.0f); 
-    ray_direction = normalize(ray_direction);
+// Direction of the ray through the point (x, y) of the image, in pixels
+// from its top left corner
+float3 imageDirection(Camera camera, float x, float y, int width, int height) {
+    float offset_x = camera.half_width * ((x - width/2.0f)/(width/2.0f));
+    float offset_y = camera.half_height * ((height/2.0f - y)/(height/2.0f));
 
-    //* ----------------- RECURSIVE RAY TRACING -----------------------------
+    float3 ray_direction = camera.right * offset_x + camera.up * offset_y + camera.forward;
+    return normalize(ray_direction);
+}
+
+// Color seen along a unit direction: its Whitted path through up to MAX_RECURSION_DEPTH
+// mirror bounces, shaded at every hit
+// @param seed : random bits of the path, different for every pixel or sample
+float3 tracePath(const Scene* scene, float3 origin, float3 dir, uint seed) {
     // set up a stack of ray hit positions along a path
     RayHit ray_hits[MAX_RECURSION_DEPTH];
     int ray_hits_top = -1; 
@@ -304,40 +514,36 @@ __kernel void renderColor(__global unsigned char* output, int img_size, float ha
 
     // changes at each iteration of the loop
     Ray curr_ray = {
-        .origin = (float3){0.0, 0.0, 0.0}, 
-        .dir = ray_direction, 
+        .origin = origin, 
+        .dir = dir, 
+        .sphere = -1,
         .t = INFINITY 
     };
 
     for (int i = 0; i < MAX_RECURSION_DEPTH; ++i) {
-        intersectScene(spheres, num_spheres, &curr_ray);
+        intersectScene(scene, &curr_ray);
 
         // ray missed the scene so use the sky shader
         if (isinf(curr_ray.t)) {
             RayHit ray_hit = {
-                .phong = {0.5 * curr_ray.dir.x + 0.5, 0.5 * curr_ray.dir.y + 0.5, 0.7 * max(curr_ray.dir.z, -curr_ray.dir.z) + 0.3}, 
+                .phong = skyColor(curr_ray.dir), 
                 .specular = {0, 0, 0}
             };
             STACK_PUSH(ray_hit)
             break;
         }
 
+        finishHit(scene, &curr_ray);
+        const Material material = hitMaterial(scene, curr_ray);
         RayHit ray_hit = {
-            .phong = shadeRayHit(curr_ray, lights, num_lights, spheres, num_spheres), 
-            .specular = curr_ray.specular
+            .phong = shadeRayHit(curr_ray, material, scene, seed * MAX_RECURSION_DEPTH + i), 
+            .specular = material.specular
         };
 
         STACK_PUSH(ray_hit);
 
-        float3 reflection_direction = reflect(-normalize(curr_ray.dir), curr_ray.normal);
-
         // replace the ray for the next loop
-        curr_ray = (Ray){
-            .origin = (curr_ray.origin + (curr_ray.dir * curr_ray.t)) 
-                + (curr_ray.normal * 2.0f * 10e-5f),
-            .dir = reflection_direction,
-            .t = INFINITY 
-        };
+        curr_ray = reflectedRay(curr_ray);
     }
 
     // accumulate color backwards along the path
@@ -350,15 +556,61 @@ __kernel void renderColor(__global unsigned char* output, int img_size, float ha
         final_color *= curr_hit.specular; 
         final_color += curr_hit.phong;
     }
+    return final_color;
+}
+
+// Spread the even bits of a Morton code back into an integer
+uint compactBits(uint x) {
+    x &= 0x55555555;
+    x = (x | (x >> 1)) & 0x33333333;
+    x = (x | (x >> 2)) & 0x0f0f0f0f;
+    x = (x | (x >> 4)) & 0x00ff00ff;
+    x = (x | (x >> 8)) & 0x0000ffff;
+    return x;
+}
+
+//! KERNEL BEGINNING
+// The scene is loaded on the host: spheres in BVH leaf order, the flattened
+// tree over them, the material table and the lights
+// Launched over a 2D range of square tiles that may overhang the image.
+// output takes linear color, for toneMap in tonemap.cl to turn into bytes.
+__kernel void renderColor(__global float4* output, int width, int height, Camera camera,
+                          SCENE_SPACE const float4* spheres, SCENE_SPACE const int* sphere_materials,
+                          int num_spheres, SCENE_SPACE const BVHNode* nodes, int num_nodes,
+                          SCENE_SPACE const Material* materials,
+                          SCENE_SPACE const Light* lights, int num_lights) {
+#ifdef MORTON_ORDER
+    // Consecutive work-items walk the tile along a Z curve, so a SIMD group
+    // covers a compact block of pixels rather than a strip of one or two
+    // rows, and its reflection rays stay closer together
+    const uint local_id = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const int col = get_group_id(0) * get_local_size(0) + compactBits(local_id);
+    const int row = get_group_id(1) * get_local_size(1) + compactBits(local_id >> 1);
+#else
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+#endif
+    if (col >= width || row >= height) {
+        return;
+    }
+
+    const Scene scene = {
+        .spheres = spheres,
+        .sphere_materials = sphere_materials,
+        .num_spheres = num_spheres,
+        .nodes = nodes,
+        .num_nodes = num_nodes,
+        .materials = materials,
+        .lights = lights,
+        .num_lights = num_lights
+    };
+
+     //* ----------------- RAY GENERATION -----------------------------
+    float3 ray_direction = primaryDirection(camera, col, row, width, height);
 
-    // map final_color from [0, infinity] -> [0, 255]
-    final_color = final_color * 255.0f;
-    unsigned char r = fmin(final_color.x, 255.0f); 
-    unsigned char g = fmin(final_color.y, 255.0f); 
-    unsigned char b = fmin(final_color.z, 255.0f);
+    //* ----------------- RECURSIVE RAY TRACING -----------------------------
+    float3 final_color = tracePath(&scene, camera.position, ray_direction, row * width + col);
 
     // write to output
-    output[(row * img_size + col) * 3 + 0] = r;
-    output[(row * img_size + col) * 3 + 1] = g;
-    output[(row * img_size + col) * 3 + 2] = b;
+    output[row * width + col] = (float4)(final_color, 1.0f);
 }
\ No newline at end of file
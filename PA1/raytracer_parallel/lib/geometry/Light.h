@@ -10,6 +10,7 @@ typedef struct Light {
     cl_float3 color;
     cl_float3 atten;
     cl_int dir; // track if point light or not (1 if point, 0 if direc)
+    cl_float range; // distance at which a point light falls below LIGHT_CUTOFF
 
     //point lights atten (0,0,1)
     //no atten is (1,0,0)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Surface properties, shared by every sphere that refers to them by index;
+// kernel.cl declares the same layout
+typedef struct Material {
+    cl_float3 ambient;
+    cl_float3 diffuse;
+    cl_float3 specular;
+    cl_float shininess;
+} Material;
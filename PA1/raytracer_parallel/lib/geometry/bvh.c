@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "bvh.h"
+
+// Candidate split planes per axis are the boundaries between these bins
+#define SAH_BINS 16
+// Cost of visiting a node, relative to intersecting one sphere
+#define TRAVERSAL_COST 1.0f
+
+typedef struct Bounds {
+    float min[3];
+    float max[3];
+} Bounds;
+
+typedef struct Builder {
+    BVHNode* nodes;
+    int num_nodes;
+    SceneSphere* spheres;
+} Builder;
+
+static float centerAxis(const SceneSphere* sphere, int axis) {
+    return sphere->center[axis];
+}
+
+static void emptyBounds(Bounds* b) {
+    for (int a = 0; a < 3; ++a) {
+        b->min[a] = FLT_MAX;
+        b->max[a] = -FLT_MAX;
+    }
+}
+
+static void growSphere(Bounds* b, const SceneSphere* sphere) {
+    for (int a = 0; a < 3; ++a) {
+        const float c = centerAxis(sphere, a);
+        b->min[a] = fminf(b->min[a], c - sphere->radius);
+        b->max[a] = fmaxf(b->max[a], c + sphere->radius);
+    }
+}
+
+static void growBounds(Bounds* b, const Bounds* other) {
+    for (int a = 0; a < 3; ++a) {
+        b->min[a] = fminf(b->min[a], other->min[a]);
+        b->max[a] = fmaxf(b->max[a], other->max[a]);
+    }
+}
+
+// Half the surface area, which is all the SAH ratios need
+static float halfArea(const Bounds* b) {
+    if (b->min[0] > b->max[0]) {
+        return 0.0f;
+    }
+    const float dx = b->max[0] - b->min[0];
+    const float dy = b->max[1] - b->min[1];
+    const float dz = b->max[2] - b->min[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static int binOf(float center, float min, float scale) {
+    const int bin = (int)((center - min) * scale);
+    return bin < SAH_BINS - 1 ? bin : SAH_BINS - 1;
+}
+
+static void setNodeBounds(Builder* b, int index) {
+    BVHNode* node = &b->nodes[index];
+    Bounds bounds;
+    emptyBounds(&bounds);
+    for (int i = 0; i < node->count; ++i) {
+        growSphere(&bounds, &b->spheres[node->left_first + i]);
+    }
+    for (int a = 0; a < 3; ++a) {
+        node->bounds_min[a] = bounds.min[a];
+        node->bounds_max[a] = bounds.max[a];
+    }
+}
+
+// Split a leaf in two if the surface area heuristic says it pays off
+static void subdivide(Builder* b, int index, int depth) {
+    BVHNode* node = &b->nodes[index];
+    const int first = node->left_first;
+    const int count = node->count;
+    if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH) {
+        return;
+    }
+
+    Bounds node_bounds, centroids;
+    emptyBounds(&centroids);
+    for (int a = 0; a < 3; ++a) {
+        node_bounds.min[a] = node->bounds_min[a];
+        node_bounds.max[a] = node->bounds_max[a];
+    }
+    for (int i = first; i < first + count; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            const float c = centerAxis(&b->spheres[i], a);
+            centroids.min[a] = fminf(centroids.min[a], c);
+            centroids.max[a] = fmaxf(centroids.max[a], c);
+        }
+    }
+
+    // Expected cost of a split, in sphere tests, relative to a leaf's count
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+    for (int a = 0; a < 3; ++a) {
+        const float extent = centroids.max[a] - centroids.min[a];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        const float scale = SAH_BINS / extent;
+
+        Bounds bins[SAH_BINS];
+        int counts[SAH_BINS] = {0};
+        for (int k = 0; k < SAH_BINS; ++k) {
+            emptyBounds(&bins[k]);
+        }
+        for (int i = first; i < first + count; ++i) {
+            const int k = binOf(centerAxis(&b->spheres[i], a), centroids.min[a], scale);
+            counts[k]++;
+            growSphere(&bins[k], &b->spheres[i]);
+        }
+
+        // Sweep from the left, then from the right, over the SAH_BINS - 1 planes
+        float left_area[SAH_BINS - 1];
+        int left_count[SAH_BINS - 1];
+        Bounds left;
+        emptyBounds(&left);
+        int sum = 0;
+        for (int k = 0; k < SAH_BINS - 1; ++k) {
+            growBounds(&left, &bins[k]);
+            sum += counts[k];
+            left_area[k] = halfArea(&left);
+            left_count[k] = sum;
+        }
+        Bounds right;
+        emptyBounds(&right);
+        sum = 0;
+        for (int k = SAH_BINS - 1; k > 0; --k) {
+            growBounds(&right, &bins[k]);
+            sum += counts[k];
+            if (left_count[k - 1] == 0 || sum == 0) {
+                continue;
+            }
+            const float cost = left_count[k - 1] * left_area[k - 1] + sum * halfArea(&right);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = a;
+                best_split = k - 1;
+            }
+        }
+    }
+
+    const float parent_area = halfArea(&node_bounds);
+    if (best_axis < 0 || parent_area <= 0.0f
+        || TRAVERSAL_COST + best_cost / parent_area >= count) {
+        return;
+    }
+
+    // Partition the spheres around the chosen plane
+    const float scale = SAH_BINS / (centroids.max[best_axis] - centroids.min[best_axis]);
+    int i = first;
+    int j = first + count - 1;
+    while (i <= j) {
+        if (binOf(centerAxis(&b->spheres[i], best_axis), centroids.min[best_axis], scale) <= best_split) {
+            i++;
+        } else {
+            SceneSphere tmp = b->spheres[i];
+            b->spheres[i] = b->spheres[j];
+            b->spheres[j] = tmp;
+            j--;
+        }
+    }
+    const int left_count = i - first;
+
+    const int left_child = b->num_nodes;
+    b->num_nodes += 2;
+    b->nodes[left_child].left_first = first;
+    b->nodes[left_child].count = left_count;
+    b->nodes[left_child + 1].left_first = i;
+    b->nodes[left_child + 1].count = count - left_count;
+    node->left_first = left_child;
+    node->count = 0;
+
+    setNodeBounds(b, left_child);
+    setNodeBounds(b, left_child + 1);
+    subdivide(b, left_child, depth + 1);
+    subdivide(b, left_child + 1, depth + 1);
+}
+
+BVHNode* buildBVH(SceneSphere* spheres, int num_spheres, int* num_nodes) {
+    *num_nodes = 0;
+    if (num_spheres <= 0) {
+        return NULL;
+    }
+
+    // A binary tree over n leaves never needs more than 2n - 1 nodes
+    Builder b = {
+        .nodes = malloc((2 * num_spheres - 1) * sizeof(BVHNode)),
+        .num_nodes = 1,
+        .spheres = spheres
+    };
+    b.nodes[0].left_first = 0;
+    b.nodes[0].count = num_spheres;
+    setNodeBounds(&b, 0);
+    subdivide(&b, 0, 0);
+
+    *num_nodes = b.num_nodes;
+    return b.nodes;
+}
+
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <CL/cl.h>
+#include "../scene.h"
+
+// Deepest node buildBVH creates; kernel.cl sizes its traversal stack with it
+#define BVH_MAX_DEPTH 32
+
+// Bounding volume hierarchy node, 32 bytes, stored in one flat array that is
+// copied to the device as is; kernel.cl declares the same layout.
+// Interior nodes keep their children next to each other at left_first and
+// left_first + 1; leaves cover spheres[left_first, left_first + count).
+typedef struct BVHNode {
+    cl_float bounds_min[3];
+    cl_int left_first;
+    cl_float bounds_max[3];
+    cl_int count; // 0 for interior nodes
+} BVHNode;
+
+// Build a BVH over the spheres using binned SAH splits. The spheres are
+// reordered so that every leaf covers a contiguous range; render from them
+// in that order.
+// @param spheres : scene geometry, permuted in place
+// @param num_spheres : number of spheres
+// @param num_nodes : set to the number of nodes used
+// @return malloc'ed node array, root at index 0; NULL if there are no spheres
+BVHNode* buildBVH(SceneSphere* spheres, int num_spheres, int* num_nodes);
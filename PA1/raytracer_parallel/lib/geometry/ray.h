@@ -1,18 +1,25 @@
 #pragma once
 #include <CL/cl.h>
 
+// Rays are only held in registers by the tracing kernels; the wavefront
+// renderer, which keeps them in device memory between launches, stores them
+// as structure of arrays. Each queue is one buffer holding an array per
+// field, capacity entries long, in this order; the float4 arrays come first
+// so that all of them stay 16-byte aligned. wavefront.cl reads them through
+// PathQueue and ShadowQueue.
+//
+//   paths        origin, with the distance to the closest hit in w  float4
+//                dir                                                float4
+//                normal at the closest hit                          float4
+//                throughput                                         float4
+//                sphere of the closest hit                          int
+//                pixel                                              int
+//
+//   shadow rays  origin, with the distance to the light in w        float4
+//                dir                                                float4
+//                contribution to the pixel                          float4
+//                pixel                                              int
 
-
-typedef struct Ray {
-    cl_float3 origin;
-    cl_float3 dir;
-    cl_float3 normal;
-
-    // Material properties of closest intersection
-    cl_float3 diffuse;
-    cl_float3 specular;
-    cl_float3 ambient;
-    cl_float shininess;
-    
-    cl_float  t;
-} Ray;
\ No newline at end of file
+// Bytes each path and each shadow ray takes in its queue
+#define PATH_RAY_BYTES (4 * sizeof(cl_float4) + 2 * sizeof(cl_int))
+#define SHADOW_RAY_BYTES (3 * sizeof(cl_float4) + sizeof(cl_int))
@@ -0,0 +1,85 @@
+#pragma once
+
+// Scene description shared by raytracer_sequential and raytracer_parallel.
+//
+// Scene files are plain text, one entry per line; '#' starts a comment.
+//
+//   camera    <position x y z> <look at x y z> <vertical fov in degrees>
+//   material  <name> <ambient r g b> <diffuse r g b> <specular r g b> <shininess>
+//   sphere    <center x y z> <radius> <material name>
+//   light     point <position x y z> <color r g b> [<attenuation const lin quad>]
+//   light     directional <direction x y z> <color r g b>
+//
+// Materials must be declared before the spheres that use them. Without a
+// camera line the camera sits at the origin looking down -z with a 60
+// degree field of view.
+
+typedef struct SceneCamera {
+    float position[3];
+    float look_at[3];
+    float fov; // vertical, in degrees
+} SceneCamera;
+
+typedef struct SceneMaterial {
+    char name[32];
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+} SceneMaterial;
+
+typedef struct SceneSphere {
+    float center[3];
+    float radius;
+    int material; // index into SceneFile.materials
+} SceneSphere;
+
+typedef struct SceneLight {
+    float pos[3]; // direction the light travels in for directional lights
+    float color[3];
+    float atten[3];
+    int point; // 1 for point lights, 0 for directional ones
+} SceneLight;
+
+typedef struct SceneFile {
+    SceneCamera camera;
+    SceneMaterial* materials;
+    int num_materials;
+    SceneSphere* spheres;
+    int num_spheres;
+    SceneLight* lights;
+    int num_lights;
+} SceneFile;
+
+// Parse a scene file; errors are reported on stderr with their line number
+// @param path : scene file to read
+// @param scene : filled in on success, to be released with freeScene
+// @return 0 on success, -1 on error
+int loadScene(const char* path, SceneFile* scene);
+
+// An empty scene with the default camera
+void initScene(SceneFile* scene);
+
+// Append a material, sphere or light, growing the arrays as needed
+// @return index of the new entry
+int addMaterial(SceneFile* scene, SceneMaterial material);
+int addSphere(SceneFile* scene, SceneSphere sphere);
+int addLight(SceneFile* scene, SceneLight light);
+
+void freeScene(SceneFile* scene);
+
+// Benchmark scene: num_spheres - 1 random small spheres on the ground of the
+// default scene, under its lights, spread so that their density does not
+// depend on the count. The same count always gives the same scene.
+void randomScene(SceneFile* scene, int num_spheres);
+
+// Replace the scene's lights with num_lights random point lights over the
+// field of randomScene(num_spheres), with quadratic falloff so that each
+// only reaches part of it. The same counts always give the same lights.
+void randomLights(SceneFile* scene, int num_lights, int num_spheres);
+
+// Orthonormal camera frame, with +y as world up
+// @param camera : camera to frame
+// @param right, up, forward : unit vectors of the image plane and view direction
+// @return half the height of the image plane at distance 1
+float cameraBasis(const SceneCamera* camera, float right[3], float up[3], float forward[3]);
@@ -4,22 +4,673 @@
 #else 
 #include <CL/cl.h>
 #endif
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "render.h"
+#include "wavefront.h"
+#include "progressive.h"
+#include "animation.h"
+#include "tonemap.h"
+#include "device.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "lib/stb_image_write.h"
 
-const cl_int IMG_SIZE = 1024;
-const size_t GLOBAL_SIZE = IMG_SIZE * IMG_SIZE;
-const size_t LOCAL_SIZE = 32;
-const float FOV = 3.14159265359/3.0;
+// Testing every sphere is not worth timing past this many
+#define MAX_LINEAR_SPHERES 1000
+
+// Render random scenes of growing size with and without the BVH
+void benchmark(cl_context context, cl_device_id device, cl_command_queue queue,
+               const char* kernelSrc, cl_mem hdr_d) {
+    const int counts[] = {10, 1000, 100000};
+    // built on first use, indexed by whether the scene is in __constant memory
+    cl_program programs[2] = {NULL, NULL};
+    cl_kernel kernels[2] = {NULL, NULL};
+
+    printf("Scenes rendered at %dx%d\n", settings.width, settings.height);
+    printf("%10s %8s %9s %10s %12s %12s %9s\n", "spheres", "nodes", "memory", "build ms", "bvh ms", "linear ms", "speedup");
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        SceneFile file;
+        randomScene(&file, counts[i]);
+
+        clock_t start = clock();
+        Scene scene;
+        prepareScene(&file, &scene);
+        const double build_ms = ((double) (clock() - start)) / CLOCKS_PER_SEC * 1000;
+
+        const int constant_scene = fitsConstant(device, &scene);
+        if (!kernels[constant_scene]) {
+            cl_int err;
+            programs[constant_scene] = buildProgram(context, device, kernelSrc, constant_scene);
+            kernels[constant_scene] = clCreateKernel(programs[constant_scene], "renderColor", &err);
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "Error creating kernel\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        cl_kernel kernel = kernels[constant_scene];
+
+        // The first launch also pays for uploading the scene
+        renderScene(context, device, queue, kernel, &scene, 1, hdr_d);
+        const double bvh_ms = renderScene(context, device, queue, kernel, &scene, 1, hdr_d);
+        printf("%10d %8d %9s %10.2f %12.3f", scene.num_spheres, scene.num_nodes,
+               constant_scene ? "constant" : "global", build_ms, bvh_ms);
+        if (scene.num_spheres <= MAX_LINEAR_SPHERES) {
+            const double linear_ms = renderScene(context, device, queue, kernel, &scene, 0, hdr_d);
+            printf(" %12.3f %8.1fx\n", linear_ms, linear_ms / bvh_ms);
+        } else {
+            printf(" %12s %9s\n", "-", "-");
+        }
+
+        releaseScene(&scene);
+        freeScene(&file);
+    }
+
+    for (int c = 0; c < 2; ++c) {
+        if (kernels[c]) {
+            clReleaseKernel(kernels[c]);
+            clReleaseProgram(programs[c]);
+        }
+    }
+}
+
+// Spheres in the scenes of the shadow ray benchmark
+#define SHADOW_BENCH_SPHERES 1000
+
+// Render random scenes under more and more lights: shadow rays through the
+// wavefront renderer, which traces them in a launch of their own, and
+// whole frames with renderColor, with light culling and sampling and with
+// every light traced
+void benchmarkShadows(cl_context context, cl_device_id device, cl_command_queue queue,
+                      const char* kernelSrc, const ToneMap* tone_map, cl_mem hdr_d, cl_mem pixels_d) {
+    const int light_counts[] = {2, 16, 64, 256};
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    const int light_threshold = settings.light_threshold;
+
+    printf("\nShadow rays over %d spheres, sampling %d lights per hit above %d\n",
+           SHADOW_BENCH_SPHERES, settings.light_samples, settings.light_threshold);
+    printf("%8s %12s %11s %13s %10s %14s %9s\n", "lights", "shadow rays", "shadow ms", "Mrays/s",
+           "frame ms", "all lights ms", "speedup");
+    for (int i = 0; i < sizeof(light_counts) / sizeof(light_counts[0]); ++i) {
+        cl_int err;
+        SceneFile file;
+        randomScene(&file, SHADOW_BENCH_SPHERES);
+        if (light_counts[i] != file.num_lights) {
+            randomLights(&file, light_counts[i], SHADOW_BENCH_SPHERES);
+        }
+        Scene scene;
+        prepareScene(&file, &scene);
+        const int constant_scene = fitsConstant(device, &scene);
+
+        char* source = extendSource(kernelSrc, "wavefront.cl");
+        cl_program program = buildProgram(context, device, source, constant_scene);
+        free(source);
+
+        Wavefront wavefront;
+        DeviceScene device_scene;
+        WavefrontStats stats;
+        createWavefront(&wavefront, context, device, program, tone_map, num_pixels, scene.num_lights);
+        uploadScene(context, &scene, &device_scene);
+        renderWavefront(&wavefront, queue, &scene, &device_scene, scene.num_nodes, pixels_d, &stats);
+        renderWavefront(&wavefront, queue, &scene, &device_scene, scene.num_nodes, pixels_d, &stats);
+        size_t shadow_rays = 0;
+        for (int b = 0; b < stats.bounces; ++b) {
+            shadow_rays += stats.shadow_rays[b];
+        }
+        releaseDeviceScene(&device_scene);
+        releaseWavefront(&wavefront);
+
+        // Then the whole frame, as sampled and with every light in range
+        double frame_ms[2];
+        for (int all = 0; all < 2; ++all) {
+            settings.light_threshold = all ? scene.num_lights : light_threshold;
+            cl_program frame_program = all ? buildProgram(context, device, kernelSrc, constant_scene) : program;
+            cl_kernel kernel = clCreateKernel(frame_program, "renderColor", &err);
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "Error creating kernel\n");
+                exit(EXIT_FAILURE);
+            }
+            renderScene(context, device, queue, kernel, &scene, 1, hdr_d);
+            frame_ms[all] = renderScene(context, device, queue, kernel, &scene, 1, hdr_d);
+            clReleaseKernel(kernel);
+            if (all) {
+                clReleaseProgram(frame_program);
+            }
+        }
+        settings.light_threshold = light_threshold;
+        clReleaseProgram(program);
+
+        printf("%8d %12zu %11.3f %13.2f %10.3f %14.3f %8.2fx\n", scene.num_lights, shadow_rays,
+               stats.shadow_ms, shadow_rays / stats.shadow_ms / 1000, frame_ms[0], frame_ms[1],
+               frame_ms[1] / frame_ms[0]);
+
+        releaseScene(&scene);
+        freeScene(&file);
+    }
+}
+
+// Resolutions of the output stage benchmark
+static const int output_sizes[][2] = {{3840, 2160}, {7680, 4320}};
+
+// Tone map a flat HDR image at 4K and 8K with every filter and read the
+// bytes back: the output stage alone, whatever the scene
+void benchmarkOutput(cl_context context, cl_command_queue queue, const ToneMap* tone_map) {
+    const int runs = 10;
+    const int filter = settings.filter;
+    printf("\nOutput stage: float4 HDR in, RGBA bytes out\n");
+    printf("%11s %9s %12s %11s %12s %12s\n", "size", "filter", "tone map ms", "GB/s", "read ms", "read GB/s");
+    for (int i = 0; i < sizeof(output_sizes) / sizeof(output_sizes[0]); ++i) {
+        cl_int err, pixels_err;
+        const int width = output_sizes[i][0];
+        const int height = output_sizes[i][1];
+        const size_t num_pixels = (size_t)width * height;
+        cl_mem hdr_d = clCreateBuffer(context, CL_MEM_READ_WRITE, num_pixels * sizeof(cl_float4), NULL, &err);
+        cl_mem pixels_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_pixels * 4, NULL, &pixels_err);
+        unsigned char* pixels_h = malloc(num_pixels * 4);
+        if (err != CL_SUCCESS || pixels_err != CL_SUCCESS || !pixels_h) {
+            printf("%5dx%-5d %9s\n", width, height, "no memory");
+            if (err == CL_SUCCESS) {
+                clReleaseMemObject(hdr_d);
+            }
+            if (pixels_err == CL_SUCCESS) {
+                clReleaseMemObject(pixels_d);
+            }
+            free(pixels_h);
+            continue;
+        }
+        const cl_float4 grey = {{0.75f, 0.75f, 0.75f, 1.0f}};
+        clEnqueueFillBuffer(queue, hdr_d, &grey, sizeof(grey), 0, num_pixels * sizeof(cl_float4), 0, NULL, NULL);
+
+        for (int f = FILTER_CLAMP; f <= FILTER_ACES; ++f) {
+            settings.filter = f;
+            toneMap(tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f);
+            double map_ms = 0;
+            for (int r = 0; r < runs; ++r) {
+                map_ms += toneMap(tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f) / runs;
+            }
+            const double start = wallClockMs();
+            clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+            const double read_ms = wallClockMs() - start;
+
+            // 16 bytes in and 4 out per pixel
+            printf("%5dx%-5d %9s %12.3f %11.1f %12.3f %12.1f\n", width, height, toneFilterName(f), map_ms,
+                   num_pixels * 20 / map_ms / 1e6, read_ms, num_pixels * 4 / read_ms / 1e6);
+        }
+        settings.filter = filter;
+
+        clReleaseMemObject(hdr_d);
+        clReleaseMemObject(pixels_d);
+        free(pixels_h);
+    }
+}
+
+// Render the scene with renderColor and with the wavefront kernels, compare
+// their throughput and leave the wavefront image in pixels_h
+void compareWavefront(cl_context context, cl_device_id device, cl_command_queue queue,
+                      const char* kernelSrc, const ToneMap* tone_map, const Scene* scene,
+                      cl_mem hdr_d, cl_mem pixels_d, unsigned char* pixels_h) {
+    cl_int err;
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+
+    char* source = extendSource(kernelSrc, "wavefront.cl");
+    cl_program program = buildProgram(context, device, source, fitsConstant(device, scene));
+    free(source);
+
+    cl_kernel kernel = clCreateKernel(program, "renderColor", &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating kernel\n");
+        exit(EXIT_FAILURE);
+    }
+    renderScene(context, device, queue, kernel, scene, 1, hdr_d);
+    const double mega_ms = renderScene(context, device, queue, kernel, scene, 1, hdr_d)
+        + toneMap(tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f);
+    unsigned char* reference = malloc(num_pixels * 4);
+    clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, reference, 0, NULL, NULL);
+    clReleaseKernel(kernel);
+
+    Wavefront wavefront;
+    DeviceScene device_scene;
+    WavefrontStats stats;
+    createWavefront(&wavefront, context, device, program, tone_map, num_pixels, scene->num_lights);
+    uploadScene(context, scene, &device_scene);
+    renderWavefront(&wavefront, queue, scene, &device_scene, scene->num_nodes, pixels_d, &stats);
+    const double wave_ms = renderWavefront(&wavefront, queue, scene, &device_scene, scene->num_nodes,
+                                           pixels_d, &stats);
+    clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+
+    // One sample per pixel for both
+    printf("%-11s %10s %12s\n", "renderer", "ms", "Msamples/s");
+    printf("%-11s %10.3f %12.2f\n", "megakernel", mega_ms, num_pixels / mega_ms / 1000);
+    printf("%-11s %10.3f %12.2f %8.2fx\n", "wavefront", wave_ms, num_pixels / wave_ms / 1000, mega_ms / wave_ms);
+    printf("Stage ms: generate %.3f, extend %.3f, shade %.3f, shadow %.3f, resolve %.3f\n",
+           stats.generate_ms, stats.extend_ms, stats.shade_ms, stats.shadow_ms, stats.resolve_ms);
+    printf("%8s %12s %12s\n", "bounce", "paths", "shadow rays");
+    for (int b = 0; b < stats.bounces; ++b) {
+        printf("%8d %12u %12u\n", b, stats.paths[b], stats.shadow_rays[b]);
+    }
+
+    // Light is summed in a different order, so a channel may round the
+    // other way
+    const ImageDiff diff = diffImages(pixels_h, reference, num_pixels);
+    printf("Max channel difference from megakernel: %d (%zu channels differ)\n", diff.max_diff, diff.differing);
+
+    releaseDeviceScene(&device_scene);
+    releaseWavefront(&wavefront);
+    clReleaseProgram(program);
+    free(reference);
+}
+
+// Lowest PSNR against the reference render that validation accepts; fast
+// math moves shadow and reflection edges by a pixel here and there
+#define VALIDATE_MIN_PSNR 40.0
+
+// Render the scene with renderColor built as usual and with fast math,
+// leave the fast image in pixels_h and write the amplified difference to
+// output_diff.png
+// @return whether the fast image is within VALIDATE_MIN_PSNR of the reference
+int validateFastMath(cl_context context, cl_device_id device, cl_command_queue queue,
+                     const char* kernelSrc, const ToneMap* tone_map, const Scene* scene,
+                     cl_mem hdr_d, cl_mem pixels_d, unsigned char* pixels_h) {
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    const int constant_scene = fitsConstant(device, scene);
+    unsigned char* reference = malloc(num_pixels * 4);
+    double kernel_ms[2];
+
+    for (int fast = 0; fast < 2; ++fast) {
+        cl_int err;
+        settings.fast_math = fast;
+        cl_program program = buildProgram(context, device, kernelSrc, constant_scene);
+        cl_kernel kernel = clCreateKernel(program, "renderColor", &err);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error creating kernel\n");
+            exit(EXIT_FAILURE);
+        }
+        renderScene(context, device, queue, kernel, scene, 1, hdr_d);
+        kernel_ms[fast] = renderScene(context, device, queue, kernel, scene, 1, hdr_d);
+        toneMap(tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f);
+        clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, fast ? pixels_h : reference,
+                            0, NULL, NULL);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+    }
+
+    const ImageDiff diff = diffImages(pixels_h, reference, num_pixels);
+    printf("%-10s %10s\n", "build", "kernel ms");
+    printf("%-10s %10.3f\n", "reference", kernel_ms[0]);
+    printf("%-10s %10.3f %8.2fx\n", "fast math", kernel_ms[1], kernel_ms[0] / kernel_ms[1]);
+    printf("Max channel difference: %d (%zu of %zu channels differ), PSNR %.1f dB\n",
+           diff.max_diff, diff.differing, num_pixels * 3, diff.psnr);
+
+    // Differences are a few levels at most away from edges, so scale them up
+    for (size_t i = 0; i < num_pixels * 4; ++i) {
+        const int scaled = i % 4 == 3 ? 255 : abs(pixels_h[i] - reference[i]) * 16;
+        reference[i] = scaled > 255 ? 255 : scaled;
+    }
+    stbi_write_png("output_diff.png", settings.width, settings.height, 4, reference, settings.width * 4);
+    free(reference);
+
+    const int passed = diff.psnr >= VALIDATE_MIN_PSNR;
+    printf("Validation %s (PSNR at least %.0f dB required)\n", passed ? "passed" : "FAILED", VALIDATE_MIN_PSNR);
+    return passed;
+}
+
+// Add samples until the budget runs out, leaving the image in pixels_h.
+// The noise is checked after 1, 2, 4, ... launches, since every check
+// reads the accumulator back.
+void renderProgressive(cl_context context, cl_device_id device, cl_command_queue queue,
+                       const char* kernelSrc, const ToneMap* tone_map, const Scene* scene,
+                       cl_mem pixels_d, unsigned char* pixels_h, const ProgressiveBudget* budget) {
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    char* source = extendSource(kernelSrc, "progressive.cl");
+    cl_program program = buildProgram(context, device, source, fitsConstant(device, scene));
+    free(source);
+
+    Progressive progressive;
+    DeviceScene device_scene;
+    createProgressive(&progressive, context, device, program, tone_map, num_pixels, 1);
+    uploadScene(context, scene, &device_scene);
+    resetProgressive(&progressive, queue);
+
+    printf("%8s %10s %10s %14s %14s %10s\n", "spp", "wall ms", "kernel ms", "Msamples/s", "wall Msamp/s", "noise");
+    const char* stop_reason = "sample limit";
+    double kernel_ms = 0;
+    int launches = 0;
+    int next_check = 1;
+    const double start = wallClockMs();
+    while (progressive.samples < budget->max_samples) {
+        const int left = budget->max_samples - progressive.samples;
+        const int samples = left < budget->samples_per_launch ? left : budget->samples_per_launch;
+        kernel_ms += addSamples(&progressive, queue, scene, &device_scene, scene->num_nodes, samples);
+        launches++;
+
+        const double wall_ms = wallClockMs() - start;
+        const int out_of_time = wall_ms >= budget->time_ms;
+        if (launches == next_check || out_of_time || progressive.samples >= budget->max_samples) {
+            next_check *= 2;
+            const double noise = estimateNoise(&progressive, queue);
+            const double total_samples = (double)num_pixels * progressive.samples;
+            printf("%8d %10.1f %10.1f %14.2f %14.2f %10.5f\n", progressive.samples, wall_ms, kernel_ms,
+                   total_samples / kernel_ms / 1000, total_samples / wall_ms / 1000, noise);
+
+            // Intermediate frames come from the same accumulator
+            if (budget->snapshots) {
+                char name[64];
+                snprintf(name, sizeof(name), "output_progressive_%04d.png", progressive.samples);
+                resolveProgressive(&progressive, queue, pixels_d);
+                clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+                stbi_write_png(name, settings.width, settings.height, 4, pixels_h, settings.width * 4);
+            }
+            if (noise <= budget->noise) {
+                stop_reason = "noise budget";
+                break;
+            }
+        }
+        if (out_of_time) {
+            stop_reason = "time budget";
+            break;
+        }
+    }
+    const double wall_ms = wallClockMs() - start;
+
+    resolveProgressive(&progressive, queue, pixels_d);
+    clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+
+    const double total_samples = (double)num_pixels * progressive.samples;
+    printf("Stopped on the %s at %d samples per pixel\n", stop_reason, progressive.samples);
+    printf("Samples/s: %.2f M on the device, %.2f M overall\n",
+           total_samples / kernel_ms / 1000, total_samples / wall_ms / 1000);
+
+    releaseDeviceScene(&device_scene);
+    releaseProgressive(&progressive);
+    clReleaseProgram(program);
+}
+
+// Render the scene on every OpenCL device, or on every device of one
+// platform, and compare each one's throughput and image with the first's
+void compareDevices(const char* kernelSrc, const Scene* scene, int only_platform) {
+    OclPlatformProp* platforms = NULL;
+    cl_uint num_platforms;
+    if (OclFindPlatforms((const OclPlatformProp**)&platforms, &num_platforms) != CL_SUCCESS) {
+        fprintf(stderr, "Error getting OpenCL platforms\n");
+        exit(EXIT_FAILURE);
+    }
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    unsigned char* pixels_h = malloc(num_pixels * 4);
+    unsigned char* reference = NULL;
+    char reference_label[24] = "";
+
+    printf("Scene rendered at %dx%d on every device\n", settings.width, settings.height);
+    printf("%-6s %-32s %5s %5s %6s %10s %10s %12s %9s %8s\n", "device", "name", "type", "units", "tile",
+           "build ms", "kernel ms", "Msamples/s", "max diff", "PSNR");
+    for (int i = 0; i < num_platforms; ++i) {
+        if (only_platform >= 0 && i != only_platform) {
+            continue;
+        }
+        for (int j = 0; j < platforms[i].num_devices; ++j) {
+            const OclDeviceProp* prop = &platforms[i].devices[j];
+            cl_device_id device = prop->device_id;
+            char label[24];
+            snprintf(label, sizeof(label), "%d.%d", i, j);
+            printf("%-6s %-32.32s %5s %5u", label, prop->name, OclDeviceTypeString(*prop->type),
+                   *prop->max_compute_units);
+            fflush(stdout);
+
+            cl_int err, hdr_err, pixels_err;
+            cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+            if (err != CL_SUCCESS) {
+                printf(" %6s\n", "no context");
+                continue;
+            }
+            cl_command_queue queue = createQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+            cl_mem hdr_d = clCreateBuffer(context, CL_MEM_READ_WRITE, num_pixels * sizeof(cl_float4), NULL, &hdr_err);
+            cl_mem pixels_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_pixels * 4, NULL, &pixels_err);
+            if (err != CL_SUCCESS || hdr_err != CL_SUCCESS || pixels_err != CL_SUCCESS) {
+                printf(" %6s\n", err != CL_SUCCESS ? "no queue" : "no memory");
+                if (err == CL_SUCCESS) {
+                    clReleaseCommandQueue(queue);
+                }
+                if (hdr_err == CL_SUCCESS) {
+                    clReleaseMemObject(hdr_d);
+                }
+                if (pixels_err == CL_SUCCESS) {
+                    clReleaseMemObject(pixels_d);
+                }
+                clReleaseContext(context);
+                continue;
+            }
+
+            // CPU runtimes compile much more slowly, so the build is timed too
+            ToneMap tone_map;
+            createToneMap(&tone_map, context, device);
+            const double start = wallClockMs();
+            cl_program program = buildProgram(context, device, kernelSrc, fitsConstant(device, scene));
+            const double build_ms = wallClockMs() - start;
+            cl_kernel kernel = clCreateKernel(program, "renderColor", &err);
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "Error creating kernel\n");
+                exit(EXIT_FAILURE);
+            }
+            renderScene(context, device, queue, kernel, scene, 1, hdr_d);
+            const double kernel_ms = renderScene(context, device, queue, kernel, scene, 1, hdr_d);
+            toneMap(&tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f);
+            clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, num_pixels * 4, pixels_h, 0, NULL, NULL);
+
+            printf(" %3zux%-2zu %10.1f %10.3f %12.2f", chooseTile(kernel, device), chooseTile(kernel, device),
+                   build_ms, kernel_ms, num_pixels / kernel_ms / 1000);
+            if (reference) {
+                const ImageDiff diff = diffImages(pixels_h, reference, num_pixels);
+                printf(" %9d %8.1f\n", diff.max_diff, diff.psnr);
+            } else {
+                // The first device's image is what the others are compared with
+                printf(" %9s %8s\n", "-", "-");
+                reference = pixels_h;
+                pixels_h = malloc(num_pixels * 4);
+                strcpy(reference_label, label);
+            }
+
+            clReleaseKernel(kernel);
+            clReleaseProgram(program);
+            releaseToneMap(&tone_map);
+            clReleaseMemObject(hdr_d);
+            clReleaseMemObject(pixels_d);
+            clReleaseCommandQueue(queue);
+            clReleaseContext(context);
+        }
+    }
+    if (reference) {
+        printf("Image differences are against device %s\n", reference_label);
+    } else {
+        printf("No OpenCL device could render the scene\n");
+    }
+
+    for (cl_uint i = 0; i < num_platforms; ++i) {
+        OclFreePlatformProp(&platforms[i]);
+    }
+    free(platforms);
+    free(reference);
+    free(pixels_h);
+}
+
+// Morton order needs a power of two
+static int validTile(size_t tile) {
+    return tile >= 4 && tile <= 32 && (tile & (tile - 1)) == 0;
+}
+
+// Releases what main sets up for every mode; scene and file may be NULL if
+// they were never loaded or are already released
+static void cleanup(Scene* scene, SceneFile* file, ToneMap* tone_map, cl_mem hdr_d, cl_mem pixels_d,
+                    cl_command_queue queue, cl_context context, char* kernelSrc, unsigned char* pixels_h) {
+    if (scene) {
+        releaseScene(scene);
+    }
+    if (file) {
+        freeScene(file);
+    }
+    releaseToneMap(tone_map);
+    clReleaseMemObject(hdr_d);
+    clReleaseMemObject(pixels_d);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    free(kernelSrc);
+    free(pixels_h);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    // ./raytracer_parallel <gpu | cpu | all | platform> [scene file | bench]
+    //                      [wavefront | progressive | animate | validate]
+    //                      [--platform <index>] [--device <index>]
+    //                      [--size <width> <height>] [--tile <4|8|16|32>] [--morton] [--fast-math]
+    //                      [--light-threshold <lights>] [--light-samples <rays>]
+    //                      [--filter <clamp|reinhard|aces>] [--exposure <stops>] [--gamma <gamma>]
+    //                      [--spp <per launch>] [--max-spp <n>] [--time <ms>] [--noise <rms>] [--snapshots]
+    //                      [--frames <n>] [--arc <degrees>] [--encoders <threads>] [--serial]
+    int bench = 0;
+    int wavefront = 0;
+    int progressive = 0;
+    int animate = 0;
+    int validate = 0;
+    AnimationSettings animation = {
+        .frames = 36,
+        .arc = 360,
+        .encoders = 0,
+        .serial = 0
+    };
+    ProgressiveBudget budget = {
+        .samples_per_launch = 4,
+        .max_samples = 1024,
+        .time_ms = 5000,
+        .noise = 0.001,
+        .snapshots = 0
+    };
+    const char* scene_path = "../scenes/default.scene";
+    int usage_ok = argc >= 2;
+
+    // The device is looked for by type, or given as a platform index, which
+    // --platform and --device override. "all" renders on every device.
+    // PLATFORM_INDEX and DEVICE_INDEX stand in for indices not given here.
+    cl_device_type device_type = OCL_DEVICE_TYPE;
+    int platform_index = -1;
+    int device_index = -1;
+    int all_devices = 0;
+    if (usage_ok) {
+        if (strcmp(argv[1], "gpu") == 0) {
+            device_type = CL_DEVICE_TYPE_GPU;
+        } else if (strcmp(argv[1], "cpu") == 0) {
+            device_type = CL_DEVICE_TYPE_CPU;
+        } else if (strcmp(argv[1], "all") == 0) {
+            all_devices = 1;
+        } else {
+            char* str_end;
+            platform_index = strtol(argv[1], &str_end, 10);
+            usage_ok = *str_end == '\0' && platform_index >= 0;
+        }
+    }
+    // TILE_SIZE sets the work-group edge when --tile does not
+    const char* tile_env = getenv("TILE_SIZE");
+    if (tile_env) {
+        settings.tile = atoi(tile_env);
+        if (!validTile(settings.tile)) {
+            fprintf(stderr, "ERROR: TILE_SIZE must be 4, 8, 16 or 32. Received %s.\n", tile_env);
+            return 1;
+        }
+    }
+    for (int i = 2; i < argc && usage_ok; ++i) {
+        if (strcmp(argv[i], "--platform") == 0 && i + 1 < argc) {
+            platform_index = atoi(argv[++i]);
+            usage_ok = platform_index >= 0;
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            device_index = atoi(argv[++i]);
+            usage_ok = device_index >= 0;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            settings.width = atoi(argv[++i]);
+            settings.height = atoi(argv[++i]);
+            usage_ok = settings.width > 0 && settings.height > 0;
+        } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            settings.tile = atoi(argv[++i]);
+            usage_ok = validTile(settings.tile);
+        } else if (strcmp(argv[i], "--morton") == 0) {
+            settings.morton = 1;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            settings.fast_math = 1;
+        } else if (strcmp(argv[i], "--light-threshold") == 0 && i + 1 < argc) {
+            settings.light_threshold = atoi(argv[++i]);
+            usage_ok = settings.light_threshold >= 0;
+        } else if (strcmp(argv[i], "--light-samples") == 0 && i + 1 < argc) {
+            settings.light_samples = atoi(argv[++i]);
+            usage_ok = settings.light_samples > 0;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            ToneFilter filter;
+            usage_ok = parseToneFilter(argv[++i], &filter) == 0;
+            settings.filter = filter;
+        } else if (strcmp(argv[i], "--exposure") == 0 && i + 1 < argc) {
+            settings.exposure = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+            settings.gamma = atof(argv[++i]);
+            usage_ok = settings.gamma > 0;
+        } else if (strcmp(argv[i], "bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "wavefront") == 0) {
+            wavefront = 1;
+        } else if (strcmp(argv[i], "progressive") == 0) {
+            progressive = 1;
+        } else if (strcmp(argv[i], "animate") == 0) {
+            animate = 1;
+        } else if (strcmp(argv[i], "validate") == 0) {
+            validate = 1;
+        } else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc) {
+            budget.samples_per_launch = atoi(argv[++i]);
+            usage_ok = budget.samples_per_launch > 0;
+        } else if (strcmp(argv[i], "--max-spp") == 0 && i + 1 < argc) {
+            budget.max_samples = atoi(argv[++i]);
+            usage_ok = budget.max_samples > 0;
+        } else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+            budget.time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            budget.noise = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshots") == 0) {
+            budget.snapshots = 1;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            animation.frames = atoi(argv[++i]);
+            usage_ok = animation.frames > 0;
+        } else if (strcmp(argv[i], "--arc") == 0 && i + 1 < argc) {
+            animation.arc = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--encoders") == 0 && i + 1 < argc) {
+            animation.encoders = atoi(argv[++i]);
+            usage_ok = animation.encoders > 0;
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            animation.serial = 1;
+        } else if (argv[i][0] != '-') {
+            scene_path = argv[i];
+        } else {
+            usage_ok = 0;
+        }
+    }
+    // Comparing devices renders the scene and nothing else
+    if (all_devices && (bench || wavefront || progressive || animate || validate)) {
+        usage_ok = 0;
+    }
+    if (!usage_ok) {
         fprintf(stderr, "ERROR: Incorrect usage! Example usage: make gpu\n");
         return 1;
     }
+    SceneFile file;
+    if (!bench && loadScene(scene_path, &file) != 0) {
+        return 1;
+    }
+
+    if (all_devices) {
+        char* kernelSrc = readSource("kernel.cl");
+        Scene scene;
+        prepareScene(&file, &scene);
+        compareDevices(kernelSrc, &scene, platform_index);
+        releaseScene(&scene);
+        freeScene(&file);
+        free(kernelSrc);
+        return 0;
+    }
+
     // Time measurement variables
     clock_t start, end;
     double cpu_time_used;
@@ -28,31 +679,17 @@ int main(int argc, char *argv[]) {
     start = clock();
 
     // OpenCL Initialization
-    cl_platform_id platform[10];
     cl_device_id device;
     cl_context context;
     cl_command_queue queue;
     cl_program program;
     cl_kernel kernel;
 
-    // Get platform and GPU device on platform
-    cl_uint num_devices, num_platforms;
     cl_int err;
 
-    // Run kernel on CPU or GPU depending on command line arg
-    char* str_end;
-    int device_choice = strtol(argv[1], &str_end, 10);
-    if (*str_end != '\0') {
-        fprintf(stderr, "Invalid device id. Expected an integer. Received %s.\n", argv[1]);
-        return 1;
-    }
-    err = clGetPlatformIDs(2, platform, &num_platforms);
-    err |= clGetDeviceIDs(platform[device_choice], CL_DEVICE_TYPE_ALL, 1, &device, &num_devices);
-
+    // Run kernel on the device chosen on the command line
     printf("\n========================================================\n");
-    char device_name[256];
-    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL); // Name of device
-    printf("Device: %s\n", device_name);
+    err = OclSelectDevice(&device, &platform_index, &device_index, device_type);
     if (err != CL_SUCCESS) {
         fprintf(stderr, "Error getting platform and device\n");
         return 1;
@@ -65,80 +702,73 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Create command queue
-    queue = clCreateCommandQueue(context, device, 0, &err);
+    // Create command queue; profiling gives the kernel time on its own
+    queue = createQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
     if (err != CL_SUCCESS) {
         fprintf(stderr, "Error creating queue\n");
         return 1;
     }
 
-    // Create memory buffer for output
-    size_t pixel_size = IMG_SIZE * IMG_SIZE * 3 * sizeof(unsigned char);
-    unsigned char pixels_h[IMG_SIZE * IMG_SIZE * 3];
+    // Create memory buffers for output: linear color from the tracing
+    // kernels, and the RGBA bytes toneMap makes of it
+    const size_t num_pixels = (size_t)settings.width * settings.height;
+    size_t pixel_size = num_pixels * 4 * sizeof(unsigned char);
+    unsigned char* pixels_h = malloc(pixel_size);
 
+    cl_mem hdr_d = clCreateBuffer(context, CL_MEM_READ_WRITE, num_pixels * sizeof(cl_float4), NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating hdr_d\n");
+    }
     cl_mem pixels_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixel_size, NULL, &err);
     if (err != CL_SUCCESS) {
         fprintf(stderr, "Error creating pixels_d\n");
     }
+    ToneMap tone_map;
+    createToneMap(&tone_map, context, device);
 
     // Read kernel and instantiate it
-    FILE* fp;
-    char* kernelSrc;
-    size_t kernelSize;
-
-    fp = fopen("kernel.cl", "rb");
-
-    if (!fp) {
-        printf("Error reading kernel");
-        exit(-1);
+    char* kernelSrc = readSource("kernel.cl");
+
+    if (bench) {
+        benchmark(context, device, queue, kernelSrc, hdr_d);
+        benchmarkShadows(context, device, queue, kernelSrc, &tone_map, hdr_d, pixels_d);
+        benchmarkOutput(context, queue, &tone_map);
+        cleanup(NULL, NULL, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
+        return 0;
     }
 
-    fseek(fp, 0, SEEK_END);
-    kernelSize = ftell(fp);
-    rewind(fp);
-
-    // Allocate memory to read in source of kernel
-    kernelSrc = (char*)malloc(kernelSize + 1);
-    fread(kernelSrc, sizeof(char), kernelSize, fp);
-    kernelSrc[kernelSize] = '\0';
-    fclose(fp);
-
-    // Create program now that we have kernel source
-    program = clCreateProgramWithSource(context, 1, (const char**)&kernelSrc, NULL, &err);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "Error creating program\n");
+    // Small scenes go to __constant memory, which the kernel is built for
+    Scene scene;
+    prepareScene(&file, &scene);
+    if (progressive) {
+        renderProgressive(context, device, queue, kernelSrc, &tone_map, &scene, pixels_d, pixels_h, &budget);
+        stbi_write_png("output_progressive.png", settings.width, settings.height, 4, pixels_h, settings.width * 4);
+        printf("Image titled output_progressive.png has been created/modified and can now be viewed!\n");
+        cleanup(&scene, &file, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
+        return 0;
     }
-
-    // Build program
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-
-    if (err != CL_SUCCESS) {
-        char *buff_erro;
-        cl_int errcode;
-        size_t build_log_len;
-        errcode = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len);
-        if (errcode) {
-            printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
-            exit(-1);
-        }
-
-        buff_erro = malloc(build_log_len);
-        if (!buff_erro) {
-            printf("malloc failed at line %d\n", __LINE__);
-            exit(-2);
-        }
-
-        errcode = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, build_log_len, buff_erro, NULL);
-        if (errcode) {
-            printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
-            exit(-3);
-        }
-
-        fprintf(stderr,"Build log: \n%s\n", buff_erro); //Be careful with  the fprint
-        free(buff_erro);
-        fprintf(stderr,"clBuildProgram failed\n");
-        exit(EXIT_FAILURE);
+    if (validate) {
+        const int passed = validateFastMath(context, device, queue, kernelSrc, &tone_map, &scene,
+                                            hdr_d, pixels_d, pixels_h);
+        stbi_write_png("output_fast_math.png", settings.width, settings.height, 4, pixels_h, settings.width * 4);
+        printf("Images titled output_fast_math.png and output_diff.png have been created/modified and can now be viewed!\n");
+        cleanup(&scene, &file, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
+        return passed ? 0 : 1;
+    }
+    if (animate) {
+        renderAnimation(context, device, queue, &tone_map, kernelSrc, &scene, &file.camera, &animation);
+        printf("Frames titled output_frame_<n>.png have been created/modified and can now be viewed!\n");
+        cleanup(&scene, &file, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
+        return 0;
+    }
+    if (wavefront) {
+        compareWavefront(context, device, queue, kernelSrc, &tone_map, &scene, hdr_d, pixels_d, pixels_h);
+        stbi_write_png("output_wavefront.png", settings.width, settings.height, 4, pixels_h, settings.width * 4);
+        printf("Image titled output_wavefront.png has been created/modified and can now be viewed!\n");
+        cleanup(&scene, &file, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
+        return 0;
     }
+    program = buildProgram(context, device, kernelSrc, fitsConstant(device, &scene));
 
     // Build kernel
     kernel = clCreateKernel(program, "renderColor", &err);
@@ -146,46 +776,34 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Error creating kernel\n");
     }
 
-
-    cl_float half_height = tan(FOV * 0.5);
-
-    // Set kernel arguments
-    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &pixels_d);
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_int), &IMG_SIZE);
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_float), &half_height);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "Error setting kernel arguments\n");
-    }
-
-    // Execute kernel on data
-    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &GLOBAL_SIZE, &LOCAL_SIZE, 0, NULL, NULL);
-
-    // Wait for kernel to finish
-    clFinish(queue);
+    const double kernel_ms = renderScene(context, device, queue, kernel, &scene, 1, hdr_d);
+    const double tone_map_ms = toneMap(&tone_map, queue, hdr_d, pixels_d, num_pixels, 1.0f);
+    const size_t tile = chooseTile(kernel, device);
+    printf("Work-groups: %zux%zu, %s order\n", tile, tile, settings.morton ? "Morton" : "row");
+    printf("Kernel time: %.3f ms\n", kernel_ms);
+    printf("Tone map time: %.3f ms (%s, exposure %+.1f, gamma %.2f)\n", tone_map_ms,
+           toneFilterName(settings.filter), settings.exposure, settings.gamma);
+    releaseScene(&scene);
+    freeScene(&file);
 
     // Read pixels results from device
     clEnqueueReadBuffer(queue, pixels_d, CL_TRUE, 0, pixel_size, pixels_h, 0, NULL, NULL);
 
     // Save the result to a PNG file
+    cl_device_type type;
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
     char* out_img_name;
-    if (device_choice == 0) {
+    if (type & CL_DEVICE_TYPE_GPU) {
         out_img_name = "output_gpu.png";
     } else {
         out_img_name = "output_cpu.png";
     }
-    stbi_write_png(out_img_name, IMG_SIZE, IMG_SIZE, 3, pixels_h, IMG_SIZE * 3);
+    stbi_write_png(out_img_name, settings.width, settings.height, 4, pixels_h, settings.width * 4);
 
     // Release OpenCL resources
-    clReleaseMemObject(pixels_d);
-
     clReleaseKernel(kernel);
     clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-
-
-    // Free memory allocated to kernel source
-    free(kernelSrc);
+    cleanup(NULL, NULL, &tone_map, hdr_d, pixels_d, queue, context, kernelSrc, pixels_h);
 
     // Stop measuring host execution time
     end = clock();
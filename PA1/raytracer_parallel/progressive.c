@@ -0,0 +1,103 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "progressive.h"
+
+void createProgressive(Progressive* progressive, cl_context context, cl_device_id device, cl_program program,
+                       const ToneMap* tone_map, size_t num_pixels, cl_uint seed) {
+    cl_int err;
+    progressive->accumulate = clCreateKernel(program, "accumulateSamples", &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating progressive kernels\n");
+        exit(EXIT_FAILURE);
+    }
+    progressive->resolve = tone_map;
+    progressive->accum = clCreateBuffer(context, CL_MEM_READ_WRITE, num_pixels * 4 * sizeof(cl_float), NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating the accumulation buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    progressive->accum_h = malloc(num_pixels * 4 * sizeof(cl_float));
+    progressive->num_pixels = num_pixels;
+    progressive->tile = chooseTile(progressive->accumulate, device);
+    progressive->seed = seed;
+    progressive->samples = 0;
+}
+
+void releaseProgressive(Progressive* progressive) {
+    clReleaseKernel(progressive->accumulate);
+    clReleaseMemObject(progressive->accum);
+    free(progressive->accum_h);
+}
+
+void resetProgressive(Progressive* progressive, cl_command_queue queue) {
+    const cl_float zero = 0.0f;
+    clEnqueueFillBuffer(queue, progressive->accum, &zero, sizeof(zero), 0,
+                        progressive->num_pixels * 4 * sizeof(cl_float), 0, NULL, NULL);
+    progressive->samples = 0;
+}
+
+double addSamples(Progressive* progressive, cl_command_queue queue, const Scene* scene,
+                  const DeviceScene* device_scene, cl_int num_nodes, int samples) {
+    cl_int err;
+    cl_kernel kernel = progressive->accumulate;
+    const Camera camera = imageCamera(scene);
+
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &progressive->accum);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_int), &settings.width);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_int), &settings.height);
+    err |= clSetKernelArg(kernel, 3, sizeof(Camera), &camera);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_uint), &progressive->seed);
+    err |= clSetKernelArg(kernel, 5, sizeof(cl_int), &progressive->samples);
+    err |= clSetKernelArg(kernel, 6, sizeof(cl_int), &samples);
+    err |= setSceneArgs(kernel, 7, scene, device_scene, num_nodes);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting progressive kernel arguments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const size_t tile = progressive->tile;
+    const size_t local_size[2] = {tile, tile};
+    const size_t global_size[2] = {
+        (settings.width + tile - 1) / tile * tile,
+        (settings.height + tile - 1) / tile * tile
+    };
+    cl_event event;
+    err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, local_size, 0, NULL, &event);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error launching accumulateSamples\n");
+        exit(EXIT_FAILURE);
+    }
+    clWaitForEvents(1, &event);
+    const double kernel_ms = eventMs(event, event);
+    clReleaseEvent(event);
+
+    progressive->samples += samples;
+    return kernel_ms;
+}
+
+void resolveProgressive(Progressive* progressive, cl_command_queue queue, cl_mem pixels_d) {
+    const float inv_samples = progressive->samples > 0 ? 1.0f / progressive->samples : 0.0f;
+    clReleaseEvent(enqueueToneMap(progressive->resolve, queue, progressive->accum, pixels_d,
+                                  progressive->num_pixels, inv_samples, 0, NULL));
+}
+
+double estimateNoise(Progressive* progressive, cl_command_queue queue) {
+    const int n = progressive->samples;
+    if (n < 2) {
+        return INFINITY;
+    }
+    clEnqueueReadBuffer(queue, progressive->accum, CL_TRUE, 0, progressive->num_pixels * 4 * sizeof(cl_float),
+                        progressive->accum_h, 0, NULL, NULL);
+
+    // Unbiased variance of each pixel's luminance samples, over n for the
+    // variance of their mean
+    double sum_error = 0;
+    for (size_t p = 0; p < progressive->num_pixels; ++p) {
+        const cl_float* pixel = &progressive->accum_h[p * 4];
+        const double luminance = 0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2];
+        const double variance = (pixel[3] - luminance * luminance / n) / (n - 1);
+        sum_error += variance > 0 ? variance / n : 0;
+    }
+    return sqrt(sum_error / progressive->num_pixels);
+}
@@ -0,0 +1,70 @@
+// Progressive rendering: every launch adds samples to a float accumulator
+// per pixel that stays on the device between launches, so the image can be
+// resolved after any number of them. Each sample jitters the primary ray
+// inside the pixel, which is what averages out the aliased edges. Built
+// after kernel.cl, whose helpers it shares.
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"): a counter-based generator, so a sample's random numbers come from its
+// pixel and sample index alone, with no state stored between launches
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 philox4x32(uint4 counter, uint2 key) {
+    for (int round = 0; round < 10; ++round) {
+        const uint hi0 = mul_hi(PHILOX_M0, counter.x);
+        const uint lo0 = PHILOX_M0 * counter.x;
+        const uint hi1 = mul_hi(PHILOX_M1, counter.z);
+        const uint lo1 = PHILOX_M1 * counter.z;
+        counter = (uint4)(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+        key += (uint2)(PHILOX_W0, PHILOX_W1);
+    }
+    return counter;
+}
+
+// Uniform in [0, 1) from the top 24 bits
+float uniformFloat(uint bits) {
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// accum holds the summed color in xyz and the summed squared luminance in
+// w, for the noise estimate. Samples first_sample to first_sample + samples
+// - 1 of every pixel are added.
+__kernel void accumulateSamples(__global float4* accum, int width, int height, Camera camera,
+                                uint seed, int first_sample, int samples,
+                                SCENE_SPACE const float4* spheres, SCENE_SPACE const int* sphere_materials,
+                                int num_spheres, SCENE_SPACE const BVHNode* nodes, int num_nodes,
+                                SCENE_SPACE const Material* materials,
+                                SCENE_SPACE const Light* lights, int num_lights) {
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    if (col >= width || row >= height) {
+        return;
+    }
+
+    const Scene scene = {
+        .spheres = spheres,
+        .sphere_materials = sphere_materials,
+        .num_spheres = num_spheres,
+        .nodes = nodes,
+        .num_nodes = num_nodes,
+        .materials = materials,
+        .lights = lights,
+        .num_lights = num_lights
+    };
+
+    const int pixel = row * width + col;
+    float4 sum = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+    for (int s = first_sample; s < first_sample + samples; ++s) {
+        const uint4 random = philox4x32((uint4)(pixel, s, 0, 0), (uint2)(seed, 0));
+        const float x = col + uniformFloat(random.x);
+        const float y = row + uniformFloat(random.y);
+        const float3 color = tracePath(&scene, camera.position, imageDirection(camera, x, y, width, height),
+                                       random.z);
+        const float luminance = dot(color, (float3)(0.2126f, 0.7152f, 0.0722f));
+        sum += (float4)(color, luminance * luminance);
+    }
+    accum[pixel] += sum;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "render.h"
+#include "tonemap.h"
+
+// When renderProgressive stops adding samples
+typedef struct ProgressiveBudget {
+    int samples_per_launch; // per pixel; keep launches short on display GPUs
+    int max_samples; // per pixel
+    double time_ms; // wall time
+    double noise; // RMS standard error of the pixel luminance, 0 to ignore
+    int snapshots; // write the image after every noise check
+} ProgressiveBudget;
+
+// Samples of one image accumulated on the device between launches
+typedef struct Progressive {
+    cl_kernel accumulate;
+    const ToneMap* resolve;
+    cl_mem accum; // float4 per pixel: summed color, summed squared luminance
+    cl_float* accum_h; // host copy for the noise estimate
+    size_t num_pixels;
+    size_t tile;
+    cl_uint seed;
+    int samples; // per pixel so far
+} Progressive;
+
+// @param program : built from kernel.cl followed by progressive.cl
+// @param tone_map : resolves the average, must outlive the accumulator
+// @param seed : key of the random stream; the same seed gives the same image
+void createProgressive(Progressive* progressive, cl_context context, cl_device_id device, cl_program program,
+                       const ToneMap* tone_map, size_t num_pixels, cl_uint seed);
+void releaseProgressive(Progressive* progressive);
+
+// Drop every sample taken so far
+void resetProgressive(Progressive* progressive, cl_command_queue queue);
+
+// Add samples per pixel of the uploaded scene
+// @param num_nodes : BVH nodes to traverse, 0 to test every sphere
+// @return kernel time in ms
+double addSamples(Progressive* progressive, cl_command_queue queue, const Scene* scene,
+                  const DeviceScene* device_scene, cl_int num_nodes, int samples);
+
+// Average of the samples so far into pixels_d, tone mapped to 8-bit RGBA
+void resolveProgressive(Progressive* progressive, cl_command_queue queue, cl_mem pixels_d);
+
+// RMS over all pixels of the standard error of their mean luminance; reads
+// the accumulator back. INFINITY until there are two samples.
+double estimateNoise(Progressive* progressive, cl_command_queue queue);
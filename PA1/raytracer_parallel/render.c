@@ -0,0 +1,381 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "render.h"
+
+RenderSettings settings = {
+    .width = 1024,
+    .height = 1024,
+    .tile = 0,
+    .morton = 0,
+    .fast_math = 0,
+    .light_threshold = 8,
+    .light_samples = 4,
+    .filter = 0,
+    .exposure = 0,
+    .gamma = 1
+};
+
+static cl_float3 toFloat3(const float v[3]) {
+    return (cl_float3){{v[0], v[1], v[2]}};
+}
+
+int shadowRaysPerHit(int num_lights) {
+    if (num_lights <= settings.light_threshold) {
+        return num_lights;
+    }
+    return settings.light_threshold > settings.light_samples ? settings.light_threshold : settings.light_samples;
+}
+
+// Distance at which the light's brightest channel, divided by its
+// attenuation const + lin * d + quad * d^2, drops to LIGHT_CUTOFF
+static float lightRange(const SceneLight* light) {
+    const float brightest = fmaxf(light->color[0], fmaxf(light->color[1], light->color[2]));
+    const float c = light->atten[0] - brightest / LIGHT_CUTOFF;
+    const float lin = light->atten[1];
+    const float quad = light->atten[2];
+    if (c >= 0) {
+        return 0; // too dim anywhere
+    }
+    if (quad > 0) {
+        return (-lin + sqrtf(lin * lin - 4 * quad * c)) / (2 * quad);
+    }
+    if (lin > 0) {
+        return -c / lin;
+    }
+    return INFINITY;
+}
+
+void prepareScene(SceneFile* file, Scene* scene) {
+    scene->nodes = buildBVH(file->spheres, file->num_spheres, &scene->num_nodes);
+
+    scene->num_spheres = file->num_spheres;
+    scene->spheres = malloc(file->num_spheres * sizeof(cl_float4));
+    scene->sphere_materials = malloc(file->num_spheres * sizeof(cl_int));
+    for (int s = 0; s < file->num_spheres; ++s) {
+        const SceneSphere* sphere = &file->spheres[s];
+        scene->spheres[s] = (cl_float4){{sphere->center[0], sphere->center[1], sphere->center[2], sphere->radius}};
+        scene->sphere_materials[s] = sphere->material;
+    }
+
+    scene->num_materials = file->num_materials;
+    scene->materials = malloc(file->num_materials * sizeof(Material));
+    for (int m = 0; m < file->num_materials; ++m) {
+        const SceneMaterial* material = &file->materials[m];
+        scene->materials[m] = (Material){
+            .ambient = toFloat3(material->ambient),
+            .diffuse = toFloat3(material->diffuse),
+            .specular = toFloat3(material->specular),
+            .shininess = material->shininess
+        };
+    }
+
+    scene->num_lights = file->num_lights;
+    scene->lights = malloc(file->num_lights * sizeof(Light));
+    for (int l = 0; l < file->num_lights; ++l) {
+        const SceneLight* light = &file->lights[l];
+        scene->lights[l] = (Light){
+            .pos = toFloat3(light->pos),
+            .color = toFloat3(light->color),
+            .atten = toFloat3(light->atten),
+            .dir = light->point,
+            .range = lightRange(light)
+        };
+    }
+
+    setCamera(scene, &file->camera);
+}
+
+void setCamera(Scene* scene, const SceneCamera* camera) {
+    float right[3], up[3], forward[3];
+    scene->camera.half_height = cameraBasis(camera, right, up, forward);
+    scene->camera.position = toFloat3(camera->position);
+    scene->camera.right = toFloat3(right);
+    scene->camera.up = toFloat3(up);
+    scene->camera.forward = toFloat3(forward);
+}
+
+void releaseScene(Scene* scene) {
+    free(scene->spheres);
+    free(scene->sphere_materials);
+    free(scene->nodes);
+    free(scene->materials);
+    free(scene->lights);
+}
+
+int fitsConstant(cl_device_id device, const Scene* scene) {
+    cl_ulong max_bytes;
+    cl_uint max_args;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(max_bytes), &max_bytes, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CONSTANT_ARGS, sizeof(max_args), &max_args, NULL);
+
+    const size_t bytes = scene->num_spheres * (sizeof(cl_float4) + sizeof(cl_int))
+        + scene->num_nodes * sizeof(BVHNode)
+        + scene->num_materials * sizeof(Material)
+        + scene->num_lights * sizeof(Light);
+    return max_args >= SCENE_BUFFERS && bytes <= max_bytes;
+}
+
+cl_program buildProgram(cl_context context, cl_device_id device, const char* kernelSrc, int constant_scene) {
+    cl_int err;
+
+    // Create program now that we have kernel source
+    cl_program program = clCreateProgramWithSource(context, 1, &kernelSrc, NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating program\n");
+    }
+
+    // Build program
+    char options[256];
+    snprintf(options, sizeof(options),
+             "-DBVH_MAX_DEPTH=%d -DSCENE_SPACE=%s -DLIGHT_SAMPLE_THRESHOLD=%d -DLIGHT_SAMPLES=%d%s%s",
+             BVH_MAX_DEPTH, constant_scene ? "__constant" : "__global",
+             settings.light_threshold, settings.light_samples,
+             settings.morton ? " -DMORTON_ORDER" : "",
+             settings.fast_math ? " -cl-fast-relaxed-math" : "");
+    err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+
+    if (err != CL_SUCCESS) {
+        char *buff_erro;
+        cl_int errcode;
+        size_t build_log_len;
+        errcode = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len);
+        if (errcode) {
+            printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
+            exit(-1);
+        }
+
+        buff_erro = malloc(build_log_len);
+        if (!buff_erro) {
+            printf("malloc failed at line %d\n", __LINE__);
+            exit(-2);
+        }
+
+        errcode = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, build_log_len, buff_erro, NULL);
+        if (errcode) {
+            printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
+            exit(-3);
+        }
+
+        fprintf(stderr,"Build log: \n%s\n", buff_erro); //Be careful with  the fprint
+        free(buff_erro);
+        fprintf(stderr,"clBuildProgram failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return program;
+}
+
+char* readSource(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error reading %s\n", path);
+        exit(-1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    rewind(fp);
+
+    char* source = malloc(size + 1);
+    size = fread(source, sizeof(char), size, fp);
+    source[size] = '\0';
+    fclose(fp);
+    return source;
+}
+
+char* extendSource(const char* kernelSrc, const char* path) {
+    char* extension = readSource(path);
+    char* source = malloc(strlen(kernelSrc) + strlen(extension) + 2);
+    sprintf(source, "%s\n%s", kernelSrc, extension);
+    free(extension);
+    return source;
+}
+
+cl_command_queue createQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties,
+                             cl_int* err) {
+#ifdef __APPLE__
+    return clCreateCommandQueue(context, device, properties, err);
+#else
+    const cl_queue_properties list[] = {CL_QUEUE_PROPERTIES, properties, 0};
+    return clCreateCommandQueueWithProperties(context, device, list, err);
+#endif
+}
+
+// The largest power of two up to 16 whose area the device can run and, if
+// possible, is a multiple of the kernel's preferred work-group size multiple.
+// A tile forced by --tile or TILE_SIZE is halved, with a warning, until the
+// kernel can run it.
+size_t chooseTile(cl_kernel kernel, cl_device_id device) {
+    size_t max_size, multiple;
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, NULL);
+    if (settings.tile) {
+        size_t tile = settings.tile;
+        while (tile > 1 && tile * tile > max_size) {
+            tile /= 2;
+        }
+        static int warned = 0;
+        if (tile != settings.tile && !warned) {
+            fprintf(stderr, "WARNING: %zux%zu work-groups exceed this kernel's limit of %zu work-items; using %zux%zu\n",
+                    settings.tile, settings.tile, max_size, tile, tile);
+            warned = 1;
+        }
+        return tile;
+    }
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                             sizeof(multiple), &multiple, NULL);
+
+    size_t fallback = 1;
+    for (size_t tile = 16; tile >= 1; tile /= 2) {
+        if (tile * tile > max_size) {
+            continue;
+        }
+        if ((tile * tile) % multiple == 0) {
+            return tile;
+        }
+        if (fallback == 1) {
+            fallback = tile;
+        }
+    }
+    return fallback;
+}
+
+// Read-only copy of a scene array; empty arrays still get a small buffer
+static cl_mem sceneBuffer(cl_context context, size_t bytes, void* data) {
+    cl_int err;
+    cl_mem buffer;
+    if (bytes == 0) {
+        buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_float4), NULL, &err);
+    } else {
+        buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, data, &err);
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating scene buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+void uploadScene(cl_context context, const Scene* scene, DeviceScene* device_scene) {
+    device_scene->buffers[0] = sceneBuffer(context, scene->num_spheres * sizeof(cl_float4), scene->spheres);
+    device_scene->buffers[1] = sceneBuffer(context, scene->num_spheres * sizeof(cl_int), scene->sphere_materials);
+    device_scene->buffers[2] = sceneBuffer(context, scene->num_nodes * sizeof(BVHNode), scene->nodes);
+    device_scene->buffers[3] = sceneBuffer(context, scene->num_materials * sizeof(Material), scene->materials);
+    device_scene->buffers[4] = sceneBuffer(context, scene->num_lights * sizeof(Light), scene->lights);
+}
+
+void releaseDeviceScene(DeviceScene* device_scene) {
+    for (int b = 0; b < SCENE_BUFFERS; ++b) {
+        clReleaseMemObject(device_scene->buffers[b]);
+    }
+}
+
+cl_int setSceneArgs(cl_kernel kernel, cl_uint first, const Scene* scene,
+                    const DeviceScene* device_scene, cl_int num_nodes) {
+    cl_int err;
+    err = clSetKernelArg(kernel, first + 0, sizeof(cl_mem), &device_scene->buffers[0]);
+    err |= clSetKernelArg(kernel, first + 1, sizeof(cl_mem), &device_scene->buffers[1]);
+    err |= clSetKernelArg(kernel, first + 2, sizeof(cl_int), &scene->num_spheres);
+    err |= clSetKernelArg(kernel, first + 3, sizeof(cl_mem), &device_scene->buffers[2]);
+    err |= clSetKernelArg(kernel, first + 4, sizeof(cl_int), &num_nodes);
+    err |= clSetKernelArg(kernel, first + 5, sizeof(cl_mem), &device_scene->buffers[3]);
+    err |= clSetKernelArg(kernel, first + 6, sizeof(cl_mem), &device_scene->buffers[4]);
+    err |= clSetKernelArg(kernel, first + 7, sizeof(cl_int), &scene->num_lights);
+    return err;
+}
+
+Camera imageCamera(const Scene* scene) {
+    Camera camera = scene->camera;
+    camera.half_width = (double)camera.half_height * settings.width / settings.height;
+    return camera;
+}
+
+double wallClockMs(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000 / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec * 1e-6;
+#endif
+}
+
+ImageDiff diffImages(const unsigned char* image, const unsigned char* reference, size_t num_pixels) {
+    ImageDiff diff = {0, 0, INFINITY};
+    double squared = 0;
+    for (size_t i = 0; i < num_pixels * 4; ++i) {
+        if (i % 4 == 3) {
+            continue; // alpha is always opaque
+        }
+        const int channel_diff = abs(image[i] - reference[i]);
+        diff.max_diff = channel_diff > diff.max_diff ? channel_diff : diff.max_diff;
+        diff.differing += channel_diff != 0;
+        squared += channel_diff * channel_diff;
+    }
+    if (squared > 0) {
+        diff.psnr = 10 * log10(255.0 * 255.0 * num_pixels * 3 / squared);
+    }
+    return diff;
+}
+
+double eventMs(cl_event start, cl_event end) {
+    cl_ulong start_ns, end_ns;
+    clGetEventProfilingInfo(start, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_ns, NULL);
+    clGetEventProfilingInfo(end, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_ns, NULL);
+    return (end_ns - start_ns) * 1e-6;
+}
+
+cl_event enqueueRender(cl_command_queue queue, cl_kernel kernel, cl_device_id device,
+                       cl_uint num_wait, const cl_event* wait) {
+    // One work-item per pixel, in square tiles that overhang the image edges
+    const size_t tile = chooseTile(kernel, device);
+    const size_t local_size[2] = {tile, tile};
+    const size_t global_size[2] = {
+        (settings.width + tile - 1) / tile * tile,
+        (settings.height + tile - 1) / tile * tile
+    };
+
+    cl_event event;
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, local_size, num_wait, wait, &event);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error launching kernel\n");
+        exit(EXIT_FAILURE);
+    }
+    return event;
+}
+
+double renderScene(cl_context context, cl_device_id device, cl_command_queue queue, cl_kernel kernel,
+                   const Scene* scene, int use_bvh, cl_mem hdr_d) {
+    cl_int err;
+    DeviceScene device_scene;
+    uploadScene(context, scene, &device_scene);
+    Camera camera = imageCamera(scene);
+
+    // Set kernel arguments
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &hdr_d);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_int), &settings.width);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_int), &settings.height);
+    err |= clSetKernelArg(kernel, 3, sizeof(Camera), &camera);
+    err |= setSceneArgs(kernel, 4, scene, &device_scene, use_bvh ? scene->num_nodes : 0);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting kernel arguments\n");
+    }
+
+    // Execute kernel on data
+    cl_event event = enqueueRender(queue, kernel, device, 0, NULL);
+
+    // Wait for kernel to finish
+    clFinish(queue);
+    const double kernel_ms = eventMs(event, event);
+    clReleaseEvent(event);
+
+    releaseDeviceScene(&device_scene);
+    return kernel_ms;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "lib/geometry/Light.h"
+#include "lib/geometry/Material.h"
+#include "lib/geometry/bvh.h"
+#include "lib/scene.h"
+
+// How renderColor is launched; set from the command line
+typedef struct RenderSettings {
+    cl_int width;
+    cl_int height;
+    size_t tile; // edge of the square work-group, 0 to pick one per kernel
+    int morton; // walk each tile in Morton order instead of row by row
+    int fast_math; // build with -cl-fast-relaxed-math
+    int light_threshold; // lights in range above which a hit samples them
+    int light_samples; // shadow rays per hit once it does
+    int filter; // ToneFilter from HDR to 8-bit output
+    float exposure; // in stops
+    float gamma; // of the display, 1 for linear output
+} RenderSettings;
+
+extern RenderSettings settings;
+
+// Frame the primary rays are generated in; kernel.cl declares the same layout
+typedef struct Camera {
+    cl_float3 position;
+    cl_float3 right;
+    cl_float3 up;
+    cl_float3 forward;
+    cl_float half_height; // half the height of the image plane
+    cl_float half_width; // set for the image's aspect ratio before each launch
+} Camera;
+
+// Host copy of what renderColor reads, laid out as kernel.cl expects
+typedef struct Scene {
+    cl_float4* spheres; // center in xyz, radius in w, in BVH leaf order
+    cl_int* sphere_materials;
+    cl_int num_spheres;
+    BVHNode* nodes;
+    cl_int num_nodes;
+    Material* materials;
+    cl_int num_materials;
+    Light* lights;
+    cl_int num_lights;
+    Camera camera;
+} Scene;
+
+// Number of buffers the tracing kernels take the scene in
+#define SCENE_BUFFERS 5
+
+// The scene buffers on the device, in the order the kernels take them
+typedef struct DeviceScene {
+    cl_mem buffers[SCENE_BUFFERS];
+} DeviceScene;
+
+// Point lights are culled where they add less than this to any channel,
+// half of an 8-bit level
+#define LIGHT_CUTOFF (1.0f / 512)
+
+// Most shadow rays a hit sends, given the scene's light count
+int shadowRaysPerHit(int num_lights);
+
+// Lay a parsed scene out for the device: build the BVH, which reorders the
+// scene's spheres, then split them into geometry and material indices
+void prepareScene(SceneFile* file, Scene* scene);
+void releaseScene(Scene* scene);
+
+// Frame the scene's camera on a new viewpoint
+void setCamera(Scene* scene, const SceneCamera* camera);
+
+// Whether every scene buffer fits in the device's __constant memory at once
+int fitsConstant(cl_device_id device, const Scene* scene);
+
+// Build OpenCL source that includes kernel.cl for the device, with the scene
+// in __constant or __global memory and the pixel order, math mode and light
+// sampling from settings
+cl_program buildProgram(cl_context context, cl_device_id device, const char* kernelSrc, int constant_scene);
+
+// Read a kernel source file; exits if it cannot be read
+// @return malloc'ed, NUL-terminated source
+char* readSource(const char* path);
+
+// kernel.cl followed by another kernel file that builds on its helpers
+// @return malloc'ed, NUL-terminated source
+char* extendSource(const char* kernelSrc, const char* path);
+
+// Command queue with the given properties, e.g. CL_QUEUE_PROFILING_ENABLE
+cl_command_queue createQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties,
+                             cl_int* err);
+
+// Edge of the square work-group for a 2D image kernel on its device
+size_t chooseTile(cl_kernel kernel, cl_device_id device);
+
+void uploadScene(cl_context context, const Scene* scene, DeviceScene* device_scene);
+void releaseDeviceScene(DeviceScene* device_scene);
+
+// Set the eight scene arguments that every tracing kernel takes, starting at
+// first: spheres, sphere materials, sphere count, nodes, node count (0 to
+// test every sphere), materials, lights and light count
+cl_int setSceneArgs(cl_kernel kernel, cl_uint first, const Scene* scene,
+                    const DeviceScene* device_scene, cl_int num_nodes);
+
+// The camera with its horizontal extent set for the image's aspect ratio
+Camera imageCamera(const Scene* scene);
+
+// Wall-clock time in ms from an arbitrary start; clock() does not count the
+// time spent waiting on the device on every platform
+double wallClockMs(void);
+
+// How far the color of one 8-bit RGBA image is from a reference
+typedef struct ImageDiff {
+    int max_diff; // largest color channel difference
+    size_t differing; // color channels that differ at all
+    double psnr; // in dB, INFINITY for identical images
+} ImageDiff;
+
+ImageDiff diffImages(const unsigned char* image, const unsigned char* reference, size_t num_pixels);
+
+// Time between the start and end of a profiled command, in ms
+double eventMs(cl_event start, cl_event end);
+
+// Launch renderColor, with its arguments already set, over the image in
+// tiles once the wait events complete; exits if it cannot be launched
+// @return event of the launch, to be released by the caller
+cl_event enqueueRender(cl_command_queue queue, cl_kernel kernel, cl_device_id device,
+                       cl_uint num_wait, const cl_event* wait);
+
+// Upload the scene, render it into hdr_d, a float4 per pixel, with
+// renderColor and return the kernel time in ms. With use_bvh 0 the kernel
+// tests every sphere instead.
+double renderScene(cl_context context, cl_device_id device, cl_command_queue queue, cl_kernel kernel,
+                   const Scene* scene, int use_bvh, cl_mem hdr_d);
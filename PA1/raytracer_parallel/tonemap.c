@@ -0,0 +1,87 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tonemap.h"
+
+// Work-items per group, if the device allows it
+#define TONE_MAP_GROUP_SIZE 256
+
+static const char* filter_names[] = {"clamp", "reinhard", "aces"};
+
+void createToneMap(ToneMap* tone_map, cl_context context, cl_device_id device) {
+    cl_int err;
+    char* source = readSource("tonemap.cl");
+    tone_map->program = buildProgram(context, device, source, 0);
+    free(source);
+    tone_map->kernel = clCreateKernel(tone_map->program, "toneMap", &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating kernel toneMap\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t max_size;
+    clGetKernelWorkGroupInfo(tone_map->kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, NULL);
+    tone_map->group_size = TONE_MAP_GROUP_SIZE;
+    while (tone_map->group_size > max_size) {
+        tone_map->group_size /= 2;
+    }
+}
+
+void releaseToneMap(ToneMap* tone_map) {
+    clReleaseKernel(tone_map->kernel);
+    clReleaseProgram(tone_map->program);
+}
+
+int parseToneFilter(const char* name, ToneFilter* filter) {
+    for (int f = 0; f < sizeof(filter_names) / sizeof(filter_names[0]); ++f) {
+        if (strcmp(name, filter_names[f]) == 0) {
+            *filter = f;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* toneFilterName(ToneFilter filter) {
+    return filter_names[filter];
+}
+
+cl_event enqueueToneMap(const ToneMap* tone_map, cl_command_queue queue, cl_mem hdr, cl_mem pixels,
+                        size_t num_pixels, float scale, cl_uint num_wait, const cl_event* wait) {
+    cl_int err;
+    const cl_int count = num_pixels;
+    const cl_float exposed = scale * exp2f(settings.exposure);
+    const cl_int filter = settings.filter;
+    const cl_float inv_gamma = 1.0f / settings.gamma;
+    err = clSetKernelArg(tone_map->kernel, 0, sizeof(cl_mem), &hdr);
+    err |= clSetKernelArg(tone_map->kernel, 1, sizeof(cl_mem), &pixels);
+    err |= clSetKernelArg(tone_map->kernel, 2, sizeof(cl_int), &count);
+    err |= clSetKernelArg(tone_map->kernel, 3, sizeof(cl_float), &exposed);
+    err |= clSetKernelArg(tone_map->kernel, 4, sizeof(cl_int), &filter);
+    err |= clSetKernelArg(tone_map->kernel, 5, sizeof(cl_float), &inv_gamma);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting toneMap arguments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const size_t local_size = tone_map->group_size;
+    const size_t global_size = (num_pixels + local_size - 1) / local_size * local_size;
+    cl_event event;
+    err = clEnqueueNDRangeKernel(queue, tone_map->kernel, 1, NULL, &global_size, &local_size,
+                                 num_wait, wait, &event);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error launching toneMap\n");
+        exit(EXIT_FAILURE);
+    }
+    return event;
+}
+
+double toneMap(const ToneMap* tone_map, cl_command_queue queue, cl_mem hdr, cl_mem pixels,
+               size_t num_pixels, float scale) {
+    cl_event event = enqueueToneMap(tone_map, queue, hdr, pixels, num_pixels, scale, 0, NULL);
+    clWaitForEvents(1, &event);
+    const double kernel_ms = eventMs(event, event);
+    clReleaseEvent(event);
+    return kernel_ms;
+}
@@ -0,0 +1,37 @@
+// Output stage: the tracing kernels leave linear color in a float4 per
+// pixel, and toneMap turns it into 8-bit RGBA, one uchar4 store per pixel.
+// Rows come out packed at width * 4 bytes, which is the layout
+// stbi_write_png takes as is. Built on its own; it needs nothing from
+// kernel.cl.
+
+// Same values as ToneFilter in tonemap.h
+#define FILTER_CLAMP 0
+#define FILTER_REINHARD 1
+#define FILTER_ACES 2
+
+// @param scale : multiplies the color before the filter, e.g. exposure over
+//                the number of samples summed into hdr
+// @param filter : one of the FILTER_ curves
+// @param inv_gamma : 1 / display gamma, 1 to leave the curve linear
+__kernel void toneMap(__global const float4* hdr, __global uchar4* output, int num_pixels,
+                      float scale, int filter, float inv_gamma) {
+    const int pixel = get_global_id(0);
+    if (pixel >= num_pixels) {
+        return;
+    }
+
+    float3 color = fmax(hdr[pixel].xyz * scale, 0.0f);
+    if (filter == FILTER_REINHARD) {
+        color = color / (1.0f + color);
+    } else if (filter == FILTER_ACES) {
+        // Narkowicz's fit of the ACES filmic curve
+        color = (color * (2.51f * color + 0.03f)) / (color * (2.43f * color + 0.59f) + 0.14f);
+    }
+    if (inv_gamma != 1.0f) {
+        color = pow(color, inv_gamma);
+    }
+
+    // map the color from [0, infinity] -> [0, 255]; the conversion rounds
+    // toward zero, as the byte stores it replaces did
+    output[pixel] = convert_uchar4_sat((float4)(color * 255.0f, 255.0f));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "render.h"
+
+// Curves toneMap can bring HDR color into [0, 1] with
+typedef enum ToneFilter {
+    FILTER_CLAMP = 0, // clip at 1, as the 8-bit output always did
+    FILTER_REINHARD = 1,
+    FILTER_ACES = 2
+} ToneFilter;
+
+// The output stage, built once from tonemap.cl and shared by every renderer
+typedef struct ToneMap {
+    cl_program program;
+    cl_kernel kernel;
+    size_t group_size;
+} ToneMap;
+
+void createToneMap(ToneMap* tone_map, cl_context context, cl_device_id device);
+void releaseToneMap(ToneMap* tone_map);
+
+// Filter by name, for the command line
+// @return 0 on success, -1 for an unknown name
+int parseToneFilter(const char* name, ToneFilter* filter);
+const char* toneFilterName(ToneFilter filter);
+
+// Turn num_pixels float4 colors in hdr into RGBA bytes in pixels, with the
+// exposure, filter and gamma from settings once the wait events complete
+// @param scale : multiplies the color before the exposure
+// @return event of the launch, to be released by the caller
+cl_event enqueueToneMap(const ToneMap* tone_map, cl_command_queue queue, cl_mem hdr, cl_mem pixels,
+                        size_t num_pixels, float scale, cl_uint num_wait, const cl_event* wait);
+
+// enqueueToneMap, waited for
+// @return kernel time in ms
+double toneMap(const ToneMap* tone_map, cl_command_queue queue, cl_mem hdr, cl_mem pixels,
+               size_t num_pixels, float scale);
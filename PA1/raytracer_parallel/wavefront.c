@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "wavefront.h"
+
+// Work-items per group for the 1D queue kernels, if the device allows it
+#define WAVEFRONT_GROUP_SIZE 64
+
+static cl_kernel createKernel(cl_program program, const char* name) {
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating kernel %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return kernel;
+}
+
+static cl_mem createBuffer(cl_context context, size_t bytes) {
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error creating a %zu byte ray queue\n", bytes);
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+void createWavefront(Wavefront* wavefront, cl_context context, cl_device_id device, cl_program program,
+                     const ToneMap* tone_map, size_t num_pixels, int num_lights) {
+    wavefront->generate = createKernel(program, "generate");
+    wavefront->extend = createKernel(program, "extend");
+    wavefront->shade = createKernel(program, "shade");
+    wavefront->shadow = createKernel(program, "shadow");
+    wavefront->resolve = tone_map;
+
+    // Every pixel has at most one path in flight, and each of its hits at
+    // most shadowRaysPerHit shadow rays
+    const int per_hit = shadowRaysPerHit(num_lights);
+    wavefront->path_capacity = num_pixels;
+    wavefront->shadow_capacity = num_pixels * (per_hit > 0 ? per_hit : 1);
+    wavefront->paths[0] = createBuffer(context, wavefront->path_capacity * PATH_RAY_BYTES);
+    wavefront->paths[1] = createBuffer(context, wavefront->path_capacity * PATH_RAY_BYTES);
+    wavefront->shadow_rays = createBuffer(context, wavefront->shadow_capacity * SHADOW_RAY_BYTES);
+    wavefront->counters = createBuffer(context, 2 * sizeof(cl_uint));
+    wavefront->accum = createBuffer(context, num_pixels * 4 * sizeof(cl_float));
+
+    const cl_kernel kernels[] = {
+        wavefront->generate, wavefront->extend, wavefront->shade, wavefront->shadow
+    };
+    wavefront->group_size = WAVEFRONT_GROUP_SIZE;
+    for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        size_t max_size;
+        clGetKernelWorkGroupInfo(kernels[k], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, NULL);
+        while (wavefront->group_size > max_size) {
+            wavefront->group_size /= 2;
+        }
+    }
+}
+
+void releaseWavefront(Wavefront* wavefront) {
+    clReleaseKernel(wavefront->generate);
+    clReleaseKernel(wavefront->extend);
+    clReleaseKernel(wavefront->shade);
+    clReleaseKernel(wavefront->shadow);
+    clReleaseMemObject(wavefront->paths[0]);
+    clReleaseMemObject(wavefront->paths[1]);
+    clReleaseMemObject(wavefront->shadow_rays);
+    clReleaseMemObject(wavefront->counters);
+    clReleaseMemObject(wavefront->accum);
+}
+
+// Run kernel over count items, in groups that may overhang the queue
+static cl_event launch(const Wavefront* wavefront, cl_command_queue queue, cl_kernel kernel, size_t count) {
+    const size_t local_size = wavefront->group_size;
+    const size_t global_size = (count + local_size - 1) / local_size * local_size;
+    cl_event event;
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, &event);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error launching wavefront kernel\n");
+        exit(EXIT_FAILURE);
+    }
+    return event;
+}
+
+// Add a launch's device time to its stage once it has run
+static void addStageTime(cl_event event, double* stage_ms) {
+    clWaitForEvents(1, &event);
+    *stage_ms += eventMs(event, event);
+    clReleaseEvent(event);
+}
+
+double renderWavefront(Wavefront* wavefront, cl_command_queue queue, const Scene* scene,
+                       const DeviceScene* device_scene, cl_int num_nodes, cl_mem pixels_d,
+                       WavefrontStats* stats) {
+    static const cl_uint zeros[2] = {0, 0};
+    cl_int err;
+    const cl_int num_pixels = settings.width * settings.height;
+    const Camera camera = imageCamera(scene);
+    *stats = (WavefrontStats){0};
+
+    err = clSetKernelArg(wavefront->generate, 0, sizeof(cl_mem), &wavefront->paths[0]);
+    err |= clSetKernelArg(wavefront->generate, 1, sizeof(cl_int), &wavefront->path_capacity);
+    err |= clSetKernelArg(wavefront->generate, 2, sizeof(cl_mem), &wavefront->accum);
+    err |= clSetKernelArg(wavefront->generate, 3, sizeof(cl_int), &settings.width);
+    err |= clSetKernelArg(wavefront->generate, 4, sizeof(cl_int), &settings.height);
+    err |= clSetKernelArg(wavefront->generate, 5, sizeof(Camera), &camera);
+
+    err |= clSetKernelArg(wavefront->extend, 1, sizeof(cl_int), &wavefront->path_capacity);
+    err |= setSceneArgs(wavefront->extend, 3, scene, device_scene, num_nodes);
+
+    err |= clSetKernelArg(wavefront->shade, 1, sizeof(cl_int), &wavefront->path_capacity);
+    err |= clSetKernelArg(wavefront->shade, 3, sizeof(cl_mem), &wavefront->accum);
+    err |= clSetKernelArg(wavefront->shade, 5, sizeof(cl_mem), &wavefront->shadow_rays);
+    err |= clSetKernelArg(wavefront->shade, 6, sizeof(cl_int), &wavefront->shadow_capacity);
+    err |= clSetKernelArg(wavefront->shade, 7, sizeof(cl_mem), &wavefront->counters);
+    err |= clSetKernelArg(wavefront->shade, 9, sizeof(cl_mem), &device_scene->buffers[1]);
+    err |= clSetKernelArg(wavefront->shade, 10, sizeof(cl_mem), &device_scene->buffers[3]);
+    err |= clSetKernelArg(wavefront->shade, 11, sizeof(cl_mem), &device_scene->buffers[4]);
+    err |= clSetKernelArg(wavefront->shade, 12, sizeof(cl_int), &scene->num_lights);
+
+    err |= clSetKernelArg(wavefront->shadow, 0, sizeof(cl_mem), &wavefront->shadow_rays);
+    err |= clSetKernelArg(wavefront->shadow, 1, sizeof(cl_int), &wavefront->shadow_capacity);
+    err |= clSetKernelArg(wavefront->shadow, 3, sizeof(cl_mem), &wavefront->accum);
+    err |= setSceneArgs(wavefront->shadow, 4, scene, device_scene, num_nodes);
+
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error setting wavefront kernel arguments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cl_event first = launch(wavefront, queue, wavefront->generate, num_pixels);
+
+    // Each bounce ends with a blocking read of the counters, so its shadow
+    // launch is only timed after the next read instead of waited on
+    cl_event shadow_event = NULL;
+    cl_int num_paths = num_pixels;
+    while (stats->bounces < WAVEFRONT_MAX_BOUNCES && num_paths > 0) {
+        const int bounce = stats->bounces;
+        cl_mem paths = wavefront->paths[bounce % 2];
+        cl_mem next_paths = wavefront->paths[(bounce + 1) % 2];
+
+        clEnqueueWriteBuffer(queue, wavefront->counters, CL_FALSE, 0, sizeof(zeros), zeros, 0, NULL, NULL);
+
+        err = clSetKernelArg(wavefront->extend, 0, sizeof(cl_mem), &paths);
+        err |= clSetKernelArg(wavefront->extend, 2, sizeof(cl_int), &num_paths);
+        err |= clSetKernelArg(wavefront->shade, 0, sizeof(cl_mem), &paths);
+        err |= clSetKernelArg(wavefront->shade, 2, sizeof(cl_int), &num_paths);
+        err |= clSetKernelArg(wavefront->shade, 4, sizeof(cl_mem), &next_paths);
+        err |= clSetKernelArg(wavefront->shade, 8, sizeof(cl_int), &bounce);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "Error setting wavefront kernel arguments\n");
+            exit(EXIT_FAILURE);
+        }
+        cl_event extend_event = launch(wavefront, queue, wavefront->extend, num_paths);
+        cl_event shade_event = launch(wavefront, queue, wavefront->shade, num_paths);
+
+        // Size the next launches by how many rays shade queued
+        cl_uint counts[2];
+        clEnqueueReadBuffer(queue, wavefront->counters, CL_TRUE, 0, sizeof(counts), counts, 0, NULL, NULL);
+        addStageTime(extend_event, &stats->extend_ms);
+        addStageTime(shade_event, &stats->shade_ms);
+        if (shadow_event) {
+            addStageTime(shadow_event, &stats->shadow_ms);
+            shadow_event = NULL;
+        }
+        stats->paths[bounce] = num_paths;
+        stats->shadow_rays[bounce] = counts[1];
+
+        if (counts[1] > 0) {
+            const cl_int num_shadow_rays = counts[1];
+            clSetKernelArg(wavefront->shadow, 2, sizeof(cl_int), &num_shadow_rays);
+            shadow_event = launch(wavefront, queue, wavefront->shadow, num_shadow_rays);
+        }
+        num_paths = counts[0];
+        stats->bounces++;
+    }
+
+    cl_event last = enqueueToneMap(wavefront->resolve, queue, wavefront->accum, pixels_d, num_pixels, 1.0f,
+                                   0, NULL);
+    clWaitForEvents(1, &last);
+    if (shadow_event) {
+        addStageTime(shadow_event, &stats->shadow_ms);
+    }
+    stats->generate_ms = eventMs(first, first);
+    stats->resolve_ms = eventMs(last, last);
+    stats->total_ms = eventMs(first, last);
+    clReleaseEvent(first);
+    clReleaseEvent(last);
+    return stats->total_ms;
+}
@@ -0,0 +1,243 @@
+// Wavefront path tracing: the same image as renderColor, split into one
+// kernel per stage so every launch runs a dense batch of rays doing the same
+// thing. Built after kernel.cl, whose helpers it shares.
+//
+//   generate  one path per pixel
+//   extend    closest hit of every active path
+//   shade     sky or ambient light into the pixel, then queue a shadow ray
+//             per light startLights picks and the reflected path for the
+//             next bounce
+//   shadow    light from every shadow ray that gets through into the pixel
+//   resolve   accumulated light to 8-bit RGBA, with toneMap from tonemap.cl
+//
+// The host reads the queue counters back after each shade, so the next
+// launches cover exactly the rays that are still alive.
+//
+// The queues are structure of arrays, laid out as lib/geometry/ray.h
+// describes: a work-item's origin and direction are each one float4 load
+// next to its neighbours', and fields a stage does not use are not read.
+
+// Paths still being traced, capacity entries per array
+typedef struct PathQueue {
+    __global float4* origin; // distance to the closest hit in w, once extended
+    __global float4* dir; // unit
+    __global float4* normal; // at the closest hit
+    __global float4* throughput; // product of the specular colors it bounced off
+    __global int* sphere; // closest hit, -1 for none
+    __global int* pixel;
+} PathQueue;
+
+PathQueue pathQueue(__global float4* paths, int capacity) {
+    __global int* ints = (__global int*)(paths + 4 * capacity);
+    PathQueue queue = {
+        .origin = paths,
+        .dir = paths + capacity,
+        .normal = paths + 2 * capacity,
+        .throughput = paths + 3 * capacity,
+        .sphere = ints,
+        .pixel = ints + capacity
+    };
+    return queue;
+}
+
+void pushPath(PathQueue queue, uint slot, Ray ray, float3 throughput, int pixel) {
+    queue.origin[slot] = (float4)(ray.origin, ray.t);
+    queue.dir[slot] = (float4)(ray.dir, 0.0f);
+    queue.throughput[slot] = (float4)(throughput, 0.0f);
+    queue.pixel[slot] = pixel;
+}
+
+// Shadow rays waiting to be traced, capacity entries per array
+typedef struct ShadowQueue {
+    __global float4* origin; // distance to a point light in w, INFINITY for directional ones
+    __global float4* dir; // unit, to the light
+    __global float4* contribution; // added to the pixel if the light is reached
+    __global int* pixel;
+} ShadowQueue;
+
+ShadowQueue shadowQueue(__global float4* shadow_rays, int capacity) {
+    ShadowQueue queue = {
+        .origin = shadow_rays,
+        .dir = shadow_rays + capacity,
+        .contribution = shadow_rays + 2 * capacity,
+        .pixel = (__global int*)(shadow_rays + 3 * capacity)
+    };
+    return queue;
+}
+
+// Slots of the counters buffer
+#define NEXT_PATHS 0
+#define SHADOW_RAYS 1
+
+// Several shadow rays of one pixel can finish in the same launch
+void atomicAddFloat(volatile __global float* address, float value) {
+    union { uint u; float f; } old_value, new_value;
+    do {
+        old_value.f = *address;
+        new_value.f = old_value.f + value;
+    } while (atomic_cmpxchg((volatile __global uint*)address, old_value.u, new_value.u) != old_value.u);
+}
+
+// accum holds 4 floats per pixel, rgb and padding
+__kernel void generate(__global float4* paths, int capacity, __global float* accum,
+                       int width, int height, Camera camera) {
+    const int pixel = get_global_id(0);
+    if (pixel >= width * height) {
+        return;
+    }
+    const int col = pixel % width;
+    const int row = pixel / width;
+
+    const Ray ray = {
+        .origin = camera.position,
+        .dir = primaryDirection(camera, col, row, width, height),
+        .sphere = -1,
+        .t = INFINITY
+    };
+    pushPath(pathQueue(paths, capacity), pixel, ray, (float3)(1.0f, 1.0f, 1.0f), pixel);
+    vstore4((float4)(0.0f, 0.0f, 0.0f, 0.0f), pixel, accum);
+}
+
+// Reads each path's origin and direction, and writes its hit back
+__kernel void extend(__global float4* paths, int capacity, int num_paths,
+                     SCENE_SPACE const float4* spheres, SCENE_SPACE const int* sphere_materials,
+                     int num_spheres, SCENE_SPACE const BVHNode* nodes, int num_nodes,
+                     SCENE_SPACE const Material* materials,
+                     SCENE_SPACE const Light* lights, int num_lights) {
+    const int id = get_global_id(0);
+    if (id >= num_paths) {
+        return;
+    }
+    const Scene scene = {
+        .spheres = spheres,
+        .sphere_materials = sphere_materials,
+        .num_spheres = num_spheres,
+        .nodes = nodes,
+        .num_nodes = num_nodes,
+        .materials = materials,
+        .lights = lights,
+        .num_lights = num_lights
+    };
+
+    const PathQueue queue = pathQueue(paths, capacity);
+    const float4 origin = queue.origin[id];
+    Ray ray = {
+        .origin = origin.xyz,
+        .dir = queue.dir[id].xyz,
+        .sphere = -1,
+        .t = origin.w
+    };
+    intersectScene(&scene, &ray);
+    if (!isinf(ray.t)) {
+        finishHit(&scene, &ray);
+        queue.normal[id] = (float4)(ray.normal, 0.0f);
+    }
+    queue.origin[id] = (float4)(ray.origin, ray.t);
+    queue.sphere[id] = ray.sphere;
+}
+
+// Each path is the only one of its pixel in flight, so its own terms go into
+// accum without atomics. The last bounce drops the reflected paths, as
+// renderColor stops after MAX_RECURSION_DEPTH hits, and picks lights with
+// the same random bits renderColor would.
+__kernel void shade(__global float4* paths, int capacity, int num_paths, __global float* accum,
+                    __global float4* next_paths, __global float4* shadow_rays, int shadow_capacity,
+                    volatile __global uint* counters, int bounce,
+                    SCENE_SPACE const int* sphere_materials, SCENE_SPACE const Material* materials,
+                    SCENE_SPACE const Light* lights, int num_lights) {
+    const int id = get_global_id(0);
+    if (id >= num_paths) {
+        return;
+    }
+    const PathQueue queue = pathQueue(paths, capacity);
+    const int pixel = queue.pixel[id];
+    const float3 throughput = queue.throughput[id].xyz;
+    const float4 origin = queue.origin[id];
+    Ray ray = {
+        .origin = origin.xyz,
+        .dir = queue.dir[id].xyz,
+        .sphere = -1,
+        .t = origin.w
+    };
+    float4 color = vload4(pixel, accum);
+
+    // ray missed the scene so use the sky shader
+    if (isinf(ray.t)) {
+        color.xyz += throughput * skyColor(ray.dir);
+        vstore4(color, pixel, accum);
+        return;
+    }
+    // extend already found the normal; the material is only needed here
+    ray.normal = queue.normal[id].xyz;
+    ray.sphere = queue.sphere[id];
+    const Material material = materials[sphere_materials[ray.sphere]];
+    color.xyz += throughput * material.ambient;
+    vstore4(color, pixel, accum);
+
+    const Scene scene = {
+        .lights = lights,
+        .num_lights = num_lights
+    };
+    const float3 hit_point = ray.origin + ray.dir * ray.t;
+    const ShadowQueue shadows = shadowQueue(shadow_rays, shadow_capacity);
+    LightSampler sampler = startLights(&scene, hit_point, pixel * MAX_RECURSION_DEPTH + bounce);
+    float weight;
+    for (int l = nextLight(&sampler, &scene, &weight); l >= 0; l = nextLight(&sampler, &scene, &weight)) {
+        Light curr_light = lights[l];
+        const Ray to_light = shadowRay(hit_point, ray.normal, curr_light);
+
+        // the shadow kernel decides whether this reaches the pixel
+        const float3 light_color = calcLight(hit_point, curr_light);
+        const float3 contribution = throughput * weight * phongLight(ray, material, to_light.dir, light_color);
+        const uint slot = atomic_inc(&counters[SHADOW_RAYS]);
+        shadows.origin[slot] = (float4)(to_light.origin, to_light.t);
+        shadows.dir[slot] = (float4)(to_light.dir, 0.0f);
+        shadows.contribution[slot] = (float4)(contribution, 0.0f);
+        shadows.pixel[slot] = pixel;
+    }
+
+    if (bounce + 1 < MAX_RECURSION_DEPTH) {
+        pushPath(pathQueue(next_paths, capacity), atomic_inc(&counters[NEXT_PATHS]), reflectedRay(ray),
+                 throughput * material.specular, pixel);
+    }
+}
+
+// Reads the contribution and pixel only of the rays that reach their light
+__kernel void shadow(__global float4* shadow_rays, int shadow_capacity, int num_shadow_rays,
+                     __global float* accum,
+                     SCENE_SPACE const float4* spheres, SCENE_SPACE const int* sphere_materials,
+                     int num_spheres, SCENE_SPACE const BVHNode* nodes, int num_nodes,
+                     SCENE_SPACE const Material* materials,
+                     SCENE_SPACE const Light* lights, int num_lights) {
+    const int id = get_global_id(0);
+    if (id >= num_shadow_rays) {
+        return;
+    }
+    const Scene scene = {
+        .spheres = spheres,
+        .sphere_materials = sphere_materials,
+        .num_spheres = num_spheres,
+        .nodes = nodes,
+        .num_nodes = num_nodes,
+        .materials = materials,
+        .lights = lights,
+        .num_lights = num_lights
+    };
+
+    const ShadowQueue queue = shadowQueue(shadow_rays, shadow_capacity);
+    const float4 origin = queue.origin[id];
+    Ray ray = {
+        .origin = origin.xyz,
+        .dir = queue.dir[id].xyz,
+        .sphere = -1,
+        .t = origin.w
+    };
+    if (occluded(&scene, ray)) {
+        return;
+    }
+    const float4 contribution = queue.contribution[id];
+    const int pixel = queue.pixel[id];
+    atomicAddFloat(&accum[pixel * 4 + 0], contribution.x);
+    atomicAddFloat(&accum[pixel * 4 + 1], contribution.y);
+    atomicAddFloat(&accum[pixel * 4 + 2], contribution.z);
+}
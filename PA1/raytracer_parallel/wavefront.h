@@ -0,0 +1,53 @@
+#pragma once
+
+#include "render.h"
+#include "tonemap.h"
+#include "lib/geometry/ray.h"
+
+// Bounces a path can take; the same as MAX_RECURSION_DEPTH in kernel.cl
+#define WAVEFRONT_MAX_BOUNCES 6
+
+// Kernels and ray queues of the wavefront renderer, sized for one image and
+// light count
+typedef struct Wavefront {
+    cl_kernel generate;
+    cl_kernel extend;
+    cl_kernel shade;
+    cl_kernel shadow;
+    const ToneMap* resolve;
+    cl_mem paths[2]; // the paths of this bounce and of the next
+    cl_mem shadow_rays;
+    cl_int path_capacity; // entries per array of each queue
+    cl_int shadow_capacity;
+    cl_mem counters;
+    cl_mem accum;
+    size_t group_size;
+} Wavefront;
+
+// What one renderWavefront did, summed over bounces
+typedef struct WavefrontStats {
+    double total_ms; // start of generate to end of resolve
+    double generate_ms;
+    double extend_ms;
+    double shade_ms;
+    double shadow_ms;
+    double resolve_ms;
+    int bounces;
+    cl_uint paths[WAVEFRONT_MAX_BOUNCES]; // paths extended per bounce
+    cl_uint shadow_rays[WAVEFRONT_MAX_BOUNCES]; // shadow rays traced per bounce
+} WavefrontStats;
+
+// @param program : built from kernel.cl followed by wavefront.cl
+// @param tone_map : resolves the accumulated light, must outlive the renderer
+// @param num_pixels : pixels of the images it will render
+// @param num_lights : lights of the scenes it will render
+void createWavefront(Wavefront* wavefront, cl_context context, cl_device_id device, cl_program program,
+                     const ToneMap* tone_map, size_t num_pixels, int num_lights);
+void releaseWavefront(Wavefront* wavefront);
+
+// Render the uploaded scene into pixels_d, one path per pixel
+// @param num_nodes : BVH nodes to traverse, 0 to test every sphere
+// @return device time in ms, from the start of the first kernel to the end of the last
+double renderWavefront(Wavefront* wavefront, cl_command_queue queue, const Scene* scene,
+                       const DeviceScene* device_scene, cl_int num_nodes, cl_mem pixels_d,
+                       WavefrontStats* stats);
@@ -0,0 +1,10 @@
+#pragma once
+
+// Four floats on a 16-byte boundary, like OpenCL's float4, so that a
+// single aligned load fetches all of them
+typedef struct float4 {
+    float x;
+    float y;
+    float z;
+    float w;
+} __attribute__((aligned(16))) float4;
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "../float3.h"
+
+// Frame the primary rays are generated in
+typedef struct Camera {
+    float3 position;
+    float3 right;
+    float3 up;
+    float3 forward;
+    float half_height; // half the height (and also width) of the image plane
+} Camera;
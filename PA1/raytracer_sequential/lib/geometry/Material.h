@@ -0,0 +1,12 @@
+#pragma once
+
+#include "../float3.h"
+
+// Surface properties, shared by every sphere that refers to them by index;
+// only read once a ray's closest hit is known
+typedef struct Material {
+    float3 ambient;
+    float3 diffuse;
+    float3 specular;
+    float shininess;
+} Material;
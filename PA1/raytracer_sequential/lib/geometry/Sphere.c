@@ -1,58 +1,68 @@
 #include "Sphere.h"
 
-void intersectSphere(Ray* r_ray, Sphere* sphere) {
-    float3 p0 = r_ray->origin;
-    float3 p1 = r_ray->dir;
-    float3 dir_to_center = add(p0, neg(sphere->center));
+// Distance along the ray from p0 in direction p1 to where it hits the
+// sphere, if it does
+static inline int closestRoot(float3 p0, float3 p1, float3 center, float radius, float* final_t) {
+    float3 dir_to_center = add(p0, neg(center));
 
     // set up quadratic coefficients
     const float a = dot(p1, p1);
     const float b = 2 * dot(p1, dir_to_center);
-    const float c = dot(dir_to_center, dir_to_center) - (sphere->radius * sphere->radius);
+    const float c = dot(dir_to_center, dir_to_center) - (radius * radius);
 
     const float disc = (b * b) - 4 * a * c;
 
-    // solve ray-sphere system
-    const float t1 = (-b + sqrt(disc)) / (2 * a);
-    const float t2 = (-b - sqrt(disc)) / (2 * a);
-
     // Do nothing if no intersection
     if (disc < 0) {
-        return;
+        return 0;
     }
 
-    float final_t = 0.0f;
+    // solve ray-sphere system
+    const float t1 = (-b + sqrt(disc)) / (2 * a);
+    const float t2 = (-b - sqrt(disc)) / (2 * a);
 
     // 1 root
     if (disc == 0) {
-        final_t = t1; 
+        *final_t = t1;
     }
     // lesser root is positive, so use it
     else if (t2 > 0) {
-       final_t = t2 ;
+        *final_t = t2;
     }
-    // lesser root is negative and larger root is positive 
+    // lesser root is negative and larger root is positive
     // use the positive root
     else if (t1 > 0) {
-        final_t = t1;
+        *final_t = t1;
     }
     // both roots are negative
     else {
-        return;
+        return 0;
     }
+    return 1;
+}
 
-    float3 intersectPoint = add(p0, scale(p1, final_t));
+void intersectSphere(Ray* r_ray, const float4* sphere, int index) {
+    const float3 center = {sphere->x, sphere->y, sphere->z};
+    float final_t;
 
-    // If a closer intersection is found 
-    if (final_t < r_ray-> t) {
+    // If a closer intersection is found
+    if (closestRoot(r_ray->origin, r_ray->dir, center, sphere->w, &final_t) && final_t < r_ray->t) {
         r_ray->t = final_t;
-        r_ray->normal = normalize(add(intersectPoint, neg(sphere->center)));
+        r_ray->sphere = index;
+    }
+}
 
-        // keep track of material properties of the new intersection
-        r_ray->ambient = sphere->ambient;
-        r_ray->diffuse = sphere->diffuse;
-        r_ray->specular = sphere->specular;
-        r_ray->shininess = sphere->shininess;
+void intersectSphereAoS(Ray* r_ray, const Sphere* sphere, int index) {
+    float final_t;
+    if (closestRoot(r_ray->origin, r_ray->dir, sphere->center, sphere->radius, &final_t) && final_t < r_ray->t) {
+        r_ray->t = final_t;
+        r_ray->sphere = index;
     }
+}
 
-}
\ No newline at end of file
+void finishHit(Ray* r_ray, const float4* spheres) {
+    const float4 sphere = spheres[r_ray->sphere];
+    const float3 center = {sphere.x, sphere.y, sphere.z};
+    float3 intersectPoint = add(r_ray->origin, scale(r_ray->dir, r_ray->t));
+    r_ray->normal = normalize(add(intersectPoint, neg(center)));
+}
@@ -3,9 +3,29 @@
 #include <math.h>
 
 #include "ray.h"
+#include "Material.h"
 #include "../vec_ops.h"
 #include "../float3.h"
+#include "../float4.h"
 
+// Spheres are stored as structure of arrays: the geometry that every
+// intersection test reads is one float4 per sphere, center in xyz and
+// radius in w, and each sphere's material is an index into a separate
+// Material table.
+
+// Closest-hit test against one sphere
+// @param r_ray : ray to intersect; its t and sphere are updated if this hit is closer
+// @param sphere : center in xyz, radius in w
+// @param index : recorded as the ray's sphere on a hit
+void intersectSphere(Ray* r_ray, const float4* sphere, int index);
+
+// Set the normal of the ray's closest hit, once every sphere has been tested
+// @param r_ray : ray with a hit
+// @param spheres : the spheres it was intersected with
+void finishHit(Ray* r_ray, const float4* spheres);
+
+// One struct per sphere with its material inline, the layout the renderer
+// used before; the layout benchmark measures against it
 typedef struct Sphere {
     float radius;
     float3 ambient;
@@ -17,5 +37,5 @@ typedef struct Sphere {
     float shininess;
 } Sphere;
 
-
-void intersectSphere(Ray* r_ray, Sphere* sphere);
\ No newline at end of file
+// intersectSphere for the Sphere layout
+void intersectSphereAoS(Ray* r_ray, const Sphere* sphere, int index);
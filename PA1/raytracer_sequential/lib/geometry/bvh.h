@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ray.h"
+#include "Sphere.h"
+#include "../scene.h"
+
+// Deepest node buildBVH creates; also bounds the traversal stack
+#define BVH_MAX_DEPTH 32
+
+// Bounding volume hierarchy node, 32 bytes, stored in one flat array.
+// Interior nodes keep their children next to each other at left_first and
+// left_first + 1; leaves cover spheres[left_first, left_first + count).
+typedef struct BVHNode {
+    float bounds_min[3];
+    int left_first;
+    float bounds_max[3];
+    int count; // 0 for interior nodes
+} BVHNode;
+
+// Build a BVH over the spheres using binned SAH splits. The spheres are
+// reordered so that every leaf covers a contiguous range; render from them
+// in that order.
+// @param spheres : scene geometry, permuted in place
+// @param num_spheres : number of spheres
+// @param num_nodes : set to the number of nodes used
+// @return malloc'ed node array, root at index 0; NULL if there are no spheres
+BVHNode* buildBVH(SceneSphere* spheres, int num_spheres, int* num_nodes);
+
+// Closest-hit traversal; updates the ray like intersectSphere does
+// @param nodes : array returned by buildBVH
+// @param spheres : spheres in the order buildBVH left them
+// @param r_ray : ray to intersect
+void intersectBVH(const BVHNode* nodes, const float4* spheres, Ray* r_ray);
@@ -0,0 +1,43 @@
+#include <math.h>
+#include <stdlib.h>
+#include "ray.h"
+
+void createRayStream(RayStream* rays, int count) {
+    const int padded = (count + RAY_STREAM_PADDING - 1) / RAY_STREAM_PADDING * RAY_STREAM_PADDING;
+    for (int a = 0; a < 3; ++a) {
+        rays->origin[a] = calloc(padded, sizeof(float));
+        rays->dir[a] = calloc(padded, sizeof(float));
+    }
+    rays->t = malloc(padded * sizeof(float));
+    rays->sphere = malloc(padded * sizeof(int));
+    rays->count = count;
+
+    // padding rays point somewhere, so that tests on them stay finite, and
+    // have a hit closer than any sphere can be
+    for (int i = 0; i < padded; ++i) {
+        rays->dir[2][i] = 1.0f;
+        rays->t[i] = -INFINITY;
+        rays->sphere[i] = -1;
+    }
+}
+
+void releaseRayStream(RayStream* rays) {
+    for (int a = 0; a < 3; ++a) {
+        free(rays->origin[a]);
+        free(rays->dir[a]);
+    }
+    free(rays->t);
+    free(rays->sphere);
+    rays->count = 0;
+}
+
+void setStreamRay(RayStream* rays, int i, float3 origin, float3 dir) {
+    rays->origin[0][i] = origin.x;
+    rays->origin[1][i] = origin.y;
+    rays->origin[2][i] = origin.z;
+    rays->dir[0][i] = dir.x;
+    rays->dir[1][i] = dir.y;
+    rays->dir[2][i] = dir.z;
+    rays->t[i] = INFINITY;
+    rays->sphere[i] = -1;
+}
@@ -2,16 +2,33 @@
 
 #include "../float3.h"
 
+// The closest hit is kept as a sphere index; its normal is filled in by
+// finishHit and its material looked up only when it is shaded
 typedef struct Ray {
     float3 origin;
     float3 dir;
     float3 normal;
-
-    // Material properties of closest intersection
-    float3 diffuse;
-    float3 specular;
-    float3 ambient;
-    float shininess;
-    
+    int sphere; // closest hit so far, -1 for none
     float  t;
-} Ray;
\ No newline at end of file
+} Ray;
+
+// Stream arrays are padded to a multiple of this many rays, the widest
+// packet, so that packet code can read whole packets past the last ray
+#define RAY_STREAM_PADDING 16
+
+// Rays in structure-of-arrays layout, for testing a whole batch of rays
+// against one sphere at a time
+typedef struct RayStream {
+    float* origin[3];
+    float* dir[3];
+    float* t; // closest hit so far
+    int* sphere; // closest sphere hit, -1 for none
+    int count; // rays in use; the padding never records a hit
+} RayStream;
+
+// Allocate a stream of count rays; they are set with setStreamRay
+void createRayStream(RayStream* rays, int count);
+void releaseRayStream(RayStream* rays);
+
+// Set ray i of the stream, with no hit yet
+void setStreamRay(RayStream* rays, int i, float3 origin, float3 dir);
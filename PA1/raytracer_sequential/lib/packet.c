@@ -0,0 +1,449 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "packet.h"
+
+// One float or int per ray of a packet, in the widest registers the
+// compiler was allowed to use; wider packets are split across registers
+typedef float vfloat __attribute__((vector_size(PACKET_WIDTH * sizeof(float))));
+typedef int vint __attribute__((vector_size(PACKET_WIDTH * sizeof(int))));
+typedef double vdouble __attribute__((vector_size(PACKET_WIDTH * sizeof(double))));
+
+// Pixels covered by a packet of primary rays, as compact as the width allows
+#define PACKET_COLS (PACKET_WIDTH == 4 ? 2 : 4)
+#define PACKET_ROWS (PACKET_WIDTH / PACKET_COLS)
+
+// Rays in structure-of-arrays layout, one lane each
+typedef struct RayPacket {
+    vfloat origin[3];
+    vfloat dir[3];
+    vfloat t; // closest hit so far; -INFINITY in lanes without a ray
+    vint sphere; // index of the closest sphere hit, -1 if none
+} RayPacket;
+
+typedef struct RayHit {
+    float3 phong;
+    float3 specular;
+} RayHit;
+
+static inline vfloat splat(float x) {
+    return (vfloat){0} + x;
+}
+
+// a where mask is set, b elsewhere
+static inline vfloat selectFloat(vint mask, vfloat a, vfloat b) {
+    return (vfloat)((mask & (vint)a) | (~mask & (vint)b));
+}
+
+static inline vint selectInt(vint mask, vint a, vint b) {
+    return (mask & a) | (~mask & b);
+}
+
+// Like fminf and fmaxf, these ignore a NaN in b
+static inline vfloat minLanes(vfloat a, vfloat b) {
+    return selectFloat(b < a, b, a);
+}
+
+static inline vfloat maxLanes(vfloat a, vfloat b) {
+    return selectFloat(b > a, b, a);
+}
+
+static inline float horizontalMin(vfloat a) {
+    float m = a[0];
+    for (int i = 1; i < PACKET_WIDTH; ++i) {
+        m = fminf(m, a[i]);
+    }
+    return m;
+}
+
+static inline float horizontalMax(vfloat a) {
+    float m = a[0];
+    for (int i = 1; i < PACKET_WIDTH; ++i) {
+        m = fmaxf(m, a[i]);
+    }
+    return m;
+}
+
+// True if any lane of mask is set
+static inline int anyLane(vint mask) {
+    int any = 0;
+    for (int i = 0; i < PACKET_WIDTH; ++i) {
+        any |= mask[i];
+    }
+    return any;
+}
+
+// The roots are solved in double precision, as intersectSphere does by
+// calling sqrt; in float, -b + sqrt(disc) loses the small roots of rays
+// leaving big spheres and lets shadow rays hit the surface they start on
+static inline vdouble sqrtLanes(vdouble x) {
+#if defined(__AVX512F__) && PACKET_WIDTH >= 8
+    union { vdouble v; __m512d r[PACKET_WIDTH / 8]; } u = {x};
+    for (int i = 0; i < PACKET_WIDTH / 8; ++i) {
+        u.r[i] = _mm512_sqrt_pd(u.r[i]);
+    }
+#elif defined(__AVX__)
+    union { vdouble v; __m256d r[PACKET_WIDTH / 4]; } u = {x};
+    for (int i = 0; i < PACKET_WIDTH / 4; ++i) {
+        u.r[i] = _mm256_sqrt_pd(u.r[i]);
+    }
+#else
+    union { vdouble v; __m128d r[PACKET_WIDTH / 2]; } u = {x};
+    for (int i = 0; i < PACKET_WIDTH / 2; ++i) {
+        u.r[i] = _mm_sqrt_pd(u.r[i]);
+    }
+#endif
+    return u.v;
+}
+
+// intersectSphere for every lane at once. two_a is 2 * dot(dir, dir), which
+// is the same for every sphere.
+static inline void intersectSpherePacket(RayPacket* packet, vfloat two_a, float4 sphere, int index) {
+    const vfloat to_x = packet->origin[0] - sphere.x;
+    const vfloat to_y = packet->origin[1] - sphere.y;
+    const vfloat to_z = packet->origin[2] - sphere.z;
+
+    // set up quadratic coefficients
+    const vfloat b = 2 * ((packet->dir[0] * to_x) + (packet->dir[1] * to_y) + (packet->dir[2] * to_z));
+    const vfloat c = ((to_x * to_x) + (to_y * to_y) + (to_z * to_z)) - (sphere.w * sphere.w);
+    const vfloat disc = (b * b) - 2 * two_a * c;
+    const vint real = disc >= 0.0f;
+    // Most spheres miss every lane; skip the roots then, as intersectSphere
+    // returns before its sqrt
+    if (!anyLane(real)) {
+        return;
+    }
+
+    // solve ray-sphere system; lanes with no real roots take the square
+    // root of 0 and are dropped below
+    const vdouble root = sqrtLanes(__builtin_convertvector(maxLanes(disc, splat(0.0f)), vdouble));
+    const vdouble minus_b = __builtin_convertvector(-b, vdouble);
+    const vdouble denom = __builtin_convertvector(two_a, vdouble);
+    const vfloat t1 = __builtin_convertvector((minus_b + root) / denom, vfloat);
+    const vfloat t2 = __builtin_convertvector((minus_b - root) / denom, vfloat);
+
+    // the lesser root if it is positive, else the larger one, which
+    // intersectSphere keeps when there is one root even if it is negative
+    const vint t2_positive = t2 > 0.0f;
+    const vfloat final_t = selectFloat(t2_positive, t2, t1);
+    const vint closer = real & ((disc == 0.0f) | t2_positive | (t1 > 0.0f)) & (final_t < packet->t);
+
+    packet->t = selectFloat(closer, final_t, packet->t);
+    packet->sphere = selectInt(closer, (vint){0} + index, packet->sphere);
+}
+
+// The stream's arrays need not be aligned for vfloat, so whole packets are
+// copied in and out; each packet stays in registers across every sphere
+void intersectStream(RayStream* rays, const float4* spheres, int num_spheres) {
+    for (int i = 0; i < rays->count; i += PACKET_WIDTH) {
+        RayPacket packet;
+        for (int a = 0; a < 3; ++a) {
+            memcpy(&packet.origin[a], &rays->origin[a][i], sizeof(vfloat));
+            memcpy(&packet.dir[a], &rays->dir[a][i], sizeof(vfloat));
+        }
+        memcpy(&packet.t, &rays->t[i], sizeof(vfloat));
+        memcpy(&packet.sphere, &rays->sphere[i], sizeof(vint));
+
+        const vfloat two_a = 2 * ((packet.dir[0] * packet.dir[0]) + (packet.dir[1] * packet.dir[1])
+            + (packet.dir[2] * packet.dir[2]));
+        for (int s = 0; s < num_spheres; ++s) {
+            intersectSpherePacket(&packet, two_a, spheres[s], s);
+        }
+        memcpy(&rays->t[i], &packet.t, sizeof(vfloat));
+        memcpy(&rays->sphere[i], &packet.sphere, sizeof(vint));
+    }
+}
+
+// Distance at which the first lane enters the node's box, or INFINITY if
+// every lane misses it before its closest hit
+static inline float hitBoundsPacket(const BVHNode* node, const RayPacket* packet, const vfloat inv_dir[3]) {
+    vfloat t_enter = splat(0.0f);
+    vfloat t_exit = packet->t;
+    for (int a = 0; a < 3; ++a) {
+        const vfloat t0 = (node->bounds_min[a] - packet->origin[a]) * inv_dir[a];
+        const vfloat t1 = (node->bounds_max[a] - packet->origin[a]) * inv_dir[a];
+        t_enter = maxLanes(t_enter, minLanes(t0, t1));
+        t_exit = minLanes(t_exit, maxLanes(t0, t1));
+    }
+    return horizontalMin(selectFloat(t_enter <= t_exit, t_enter, splat(INFINITY)));
+}
+
+// Closest hit of every lane. The packet walks the BVH together: a node is
+// visited if any lane still can hit something in it.
+static void intersectPacket(const TraceScene* scene, RayPacket* packet) {
+    const vfloat two_a = 2 * ((packet->dir[0] * packet->dir[0]) + (packet->dir[1] * packet->dir[1])
+        + (packet->dir[2] * packet->dir[2]));
+    const BVHNode* nodes = scene->nodes;
+    if (!nodes) {
+        for (int s = 0; s < scene->num_spheres; ++s) {
+            intersectSpherePacket(packet, two_a, scene->spheres[s], s);
+        }
+        return;
+    }
+
+    const vfloat inv_dir[3] = {1.0f / packet->dir[0], 1.0f / packet->dir[1], 1.0f / packet->dir[2]};
+    int stack_node[BVH_MAX_DEPTH];
+    float stack_t[BVH_MAX_DEPTH];
+    int top = 0;
+
+    int index = 0;
+    if (isinf(hitBoundsPacket(&nodes[0], packet, inv_dir))) {
+        return;
+    }
+    while (1) {
+        const BVHNode* node = &nodes[index];
+        if (node->count == 0) {
+            // the child the packet enters first goes first
+            int near_child = node->left_first;
+            int far_child = near_child + 1;
+            float t_near = hitBoundsPacket(&nodes[near_child], packet, inv_dir);
+            float t_far = hitBoundsPacket(&nodes[far_child], packet, inv_dir);
+            if (t_far < t_near) {
+                int tmp_child = near_child;
+                near_child = far_child;
+                far_child = tmp_child;
+                float tmp_t = t_near;
+                t_near = t_far;
+                t_far = tmp_t;
+            }
+            if (!isinf(t_near)) {
+                if (!isinf(t_far)) {
+                    stack_node[top] = far_child;
+                    stack_t[top] = t_far;
+                    top++;
+                }
+                index = near_child;
+                continue;
+            }
+        } else {
+            for (int i = 0; i < node->count; ++i) {
+                intersectSpherePacket(packet, two_a, scene->spheres[node->left_first + i], node->left_first + i);
+            }
+        }
+
+        // pop the next subtree that can still hold a closer hit for some lane
+        index = -1;
+        const float t_max = horizontalMax(packet->t);
+        while (top > 0) {
+            top--;
+            if (stack_t[top] < t_max) {
+                index = stack_node[top];
+                break;
+            }
+        }
+        if (index < 0) {
+            return;
+        }
+    }
+}
+
+static inline void setLane(RayPacket* packet, int lane, float3 origin, float3 dir, float t) {
+    packet->origin[0][lane] = origin.x;
+    packet->origin[1][lane] = origin.y;
+    packet->origin[2][lane] = origin.z;
+    packet->dir[0][lane] = dir.x;
+    packet->dir[1][lane] = dir.y;
+    packet->dir[2][lane] = dir.z;
+    packet->t[lane] = t;
+}
+
+static inline float3 laneOrigin(const RayPacket* packet, int lane) {
+    return (float3){packet->origin[0][lane], packet->origin[1][lane], packet->origin[2][lane]};
+}
+
+static inline float3 laneDir(const RayPacket* packet, int lane) {
+    return (float3){packet->dir[0][lane], packet->dir[1][lane], packet->dir[2][lane]};
+}
+
+// Lanes without a ray still get a valid direction so that they do not turn
+// into NaNs in the box tests
+static const float3 IDLE_DIR = {0, 0, 1};
+
+// Trace the pixels of one packet footprint, with the same shading steps as
+// render and shadeRayHit in main.c; lanes past the image edge stay idle
+static void tracePacket(const TraceScene* scene, unsigned char* pixels, unsigned int img_size,
+                        int first_col, int first_row) {
+    const Camera* camera = &scene->camera;
+    const float half_height = camera->half_height;
+
+    RayHit ray_hits[MAX_RECURSION_DEPTH][PACKET_WIDTH];
+    int ray_hits_top[PACKET_WIDTH];
+    int active[PACKET_WIDTH];
+    int num_active = 0;
+
+    //* ----------------- RAY GENERATION  -----------------------------
+    RayPacket packet;
+    for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+        const int col = first_col + lane % PACKET_COLS;
+        const int row = first_row + lane / PACKET_COLS;
+        ray_hits_top[lane] = -1;
+        active[lane] = col < img_size && row < img_size;
+        if (!active[lane]) {
+            setLane(&packet, lane, camera->position, IDLE_DIR, -INFINITY);
+            continue;
+        }
+        num_active++;
+
+        float offset_x = half_height * ((col + 0.5 - img_size/2.0)/(img_size/2.0));
+        float offset_y = half_height * ((img_size/2.0 - row - 0.5)/(img_size/2.0));
+        float3 ray_direction = add(add(scale(camera->right, offset_x), scale(camera->up, offset_y)), camera->forward);
+        setLane(&packet, lane, camera->position, normalize(ray_direction), INFINITY);
+    }
+
+    //* ----------------- RECURSIVE RAY TRACING -----------------------------
+    for (int i = 0; i < MAX_RECURSION_DEPTH && num_active > 0; ++i) {
+        packet.sphere = (vint){0} - 1;
+        intersectPacket(scene, &packet);
+
+        float3 hit_point[PACKET_WIDTH];
+        float3 hit_normal[PACKET_WIDTH];
+        float3 color[PACKET_WIDTH];
+        for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+            if (!active[lane]) {
+                continue;
+            }
+            const float3 dir = laneDir(&packet, lane);
+
+            // ray missed the scene so use the sky shader
+            if (isinf(packet.t[lane])) {
+                RayHit ray_hit = {
+                    .phong = {0.5 * dir.x + 0.5, 0.5 * dir.y + 0.5, 0.7 * fabsf(dir.z) + 0.3},
+                    .specular = {0, 0, 0}
+                };
+                ray_hits[++ray_hits_top[lane]][lane] = ray_hit;
+                active[lane] = 0;
+                num_active--;
+                continue;
+            }
+            const float4 sphere = scene->spheres[packet.sphere[lane]];
+            const float3 center = {sphere.x, sphere.y, sphere.z};
+            hit_point[lane] = add(laneOrigin(&packet, lane), scale(dir, packet.t[lane]));
+            hit_normal[lane] = normalize(add(hit_point[lane], neg(center)));
+            color[lane] = (float3){0, 0, 0};
+        }
+
+        // one packet of shadow rays per light, from every lane that hit
+        for (int l = 0; l < scene->num_lights; ++l) {
+            const Light curr_light = scene->lights[l];
+            float3 hit_to_light[PACKET_WIDTH];
+            RayPacket shadow_packet;
+            for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+                if (!active[lane]) {
+                    setLane(&shadow_packet, lane, camera->position, IDLE_DIR, -INFINITY);
+                    continue;
+                }
+                if (curr_light.dir) {
+                    hit_to_light[lane] = add(curr_light.pos, neg(hit_point[lane])); // point light
+                } else {
+                    hit_to_light[lane] = neg(curr_light.pos); // directional light
+                }
+                setLane(&shadow_packet, lane, add(hit_point[lane], scale(hit_normal[lane], 5 * 10e-5)),
+                        hit_to_light[lane], INFINITY);
+            }
+            intersectPacket(scene, &shadow_packet);
+
+            for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+                if (!active[lane]) {
+                    continue;
+                }
+                const float shadow_t = shadow_packet.t[lane];
+                const int light_reached = curr_light.dir ? shadow_t > 1 : isinf(shadow_t);
+                if (!light_reached) {
+                    continue;
+                }
+
+                // the light is reachable so we evaluate the shading model
+                const Material* material = &scene->materials[scene->sphere_materials[packet.sphere[lane]]];
+                const float3 normal = hit_normal[lane];
+                const float3 light_direction = normalize(hit_to_light[lane]);
+                float3 reflection_direction = add(
+                    scale(normal, dot(light_direction, normal) * 2.0f),
+                    neg(light_direction)
+                );
+                float NdotL = fmax(0, dot(normal, light_direction));
+                float3 color_diffuse = scale(material->diffuse, NdotL);
+                float3 color_specular = scale(
+                    material->specular,
+                    pow(fmax(0, dot(reflection_direction, neg(normalize(laneDir(&packet, lane))))),
+                        material->shininess)
+                );
+                color[lane] = add(color[lane], multiply(add(color_diffuse, color_specular), curr_light.color));
+            }
+        }
+
+        // record the hits and reflect the rays for the next loop
+        for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+            if (!active[lane]) {
+                continue;
+            }
+            const Material* material = &scene->materials[scene->sphere_materials[packet.sphere[lane]]];
+            const float3 normal = hit_normal[lane];
+            const float3 dir = laneDir(&packet, lane);
+            RayHit ray_hit = {
+                .phong = add(color[lane], material->ambient),
+                .specular = material->specular
+            };
+            ray_hits[++ray_hits_top[lane]][lane] = ray_hit;
+
+            float3 reflection_direction = add(
+                scale(normal, dot(neg(normalize(dir)), normal) * 2.0f),
+                neg(neg(normalize(dir)))
+            );
+            const float3 origin = add(add(laneOrigin(&packet, lane), scale(dir, packet.t[lane])),
+                                      scale(normal, 2 * 10e-5));
+            setLane(&packet, lane, origin, reflection_direction, INFINITY);
+        }
+    }
+
+    //* ------------------------------- WRITE TO IMAGE --------------------------------------------
+    for (int lane = 0; lane < PACKET_WIDTH; ++lane) {
+        const int col = first_col + lane % PACKET_COLS;
+        const int row = first_row + lane / PACKET_COLS;
+        if (col >= img_size || row >= img_size) {
+            continue;
+        }
+
+        // accumulate color backwards along the path
+        float3 final_color = {0.0f, 0.0f, 0.0f};
+        for (int h = ray_hits_top[lane]; h >= 0; --h) {
+            final_color = multiply(final_color, ray_hits[h][lane].specular);
+            final_color = add(final_color, ray_hits[h][lane].phong);
+        }
+
+        // map final color from [0, infinity) to [0, 255]
+        final_color = scale(final_color, 255.0f);
+        pixels[(row * img_size + col) * 3 + 0] = fmin(final_color.x, 255.0f);
+        pixels[(row * img_size + col) * 3 + 1] = fmin(final_color.y, 255.0f);
+        pixels[(row * img_size + col) * 3 + 2] = fmin(final_color.z, 255.0f);
+    }
+}
+
+typedef struct TileJob {
+    unsigned char* pixels;
+    unsigned int img_size;
+    int tiles_per_row;
+    const TraceScene* scene;
+} TileJob;
+
+static void renderTile(void* context, int task) {
+    const TileJob* job = context;
+    const int first_col = (task % job->tiles_per_row) * PACKET_TILE;
+    const int first_row = (task / job->tiles_per_row) * PACKET_TILE;
+    for (int row = first_row; row < first_row + PACKET_TILE && row < job->img_size; row += PACKET_ROWS) {
+        for (int col = first_col; col < first_col + PACKET_TILE && col < job->img_size; col += PACKET_COLS) {
+            tracePacket(job->scene, job->pixels, job->img_size, col, row);
+        }
+    }
+}
+
+void renderPackets(unsigned char* pixels, unsigned int img_size, const TraceScene* scene, ThreadPool* pool) {
+    const int tiles_per_row = (img_size + PACKET_TILE - 1) / PACKET_TILE;
+    TileJob job = {
+        .pixels = pixels,
+        .img_size = img_size,
+        .tiles_per_row = tiles_per_row,
+        .scene = scene
+    };
+    runTasks(pool, tiles_per_row * tiles_per_row, renderTile, &job);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "geometry/Camera.h"
+#include "geometry/Light.h"
+#include "geometry/Sphere.h"
+#include "geometry/bvh.h"
+#include "threadpool.h"
+
+// Rays traced together, one per SIMD lane: 4 fills an SSE register, 8 an
+// AVX one and 16 an AVX-512 one (or two AVX ones). Defaults to what the
+// target has registers for, since wider packets are emulated and slower than
+// the scalar renderer; override with make PACKET_WIDTH=<4|8|16>.
+#ifndef PACKET_WIDTH
+#ifdef __AVX__
+#define PACKET_WIDTH 8
+#else
+#define PACKET_WIDTH 4
+#endif
+#endif
+
+#if PACKET_WIDTH != 4 && PACKET_WIDTH != 8 && PACKET_WIDTH != 16
+#error "PACKET_WIDTH must be 4, 8 or 16"
+#endif
+
+// Bounces traced per pixel, by both renderers
+#define MAX_RECURSION_DEPTH 5
+
+// Edge of the square tiles handed to the worker threads
+#define PACKET_TILE 16
+
+// What the packet renderer reads; the same arrays the scalar renderer uses
+typedef struct TraceScene {
+    const float4* spheres; // center in xyz, radius in w
+    const int* sphere_materials;
+    int num_spheres;
+    const Material* materials;
+    const BVHNode* nodes; // NULL to test every sphere
+    const Light* lights;
+    int num_lights;
+    Camera camera;
+} TraceScene;
+
+// intersectSphere for every ray of the stream against every sphere,
+// PACKET_WIDTH rays at a time
+// @param rays : rays to intersect; their t and sphere are updated where a sphere is closer
+// @param spheres : center in xyz, radius in w
+// @param num_spheres : spheres to test; the index of the closest is recorded
+void intersectStream(RayStream* rays, const float4* spheres, int num_spheres);
+
+// Trace every pixel of an img_size x img_size image into pixels (RGB) the
+// way render in main.c does, PACKET_WIDTH rays at a time, one tile per task
+// @param pixels : img_size * img_size * 3 bytes
+// @param img_size : edge of the image
+// @param scene : scene to render
+// @param pool : threads to spread the tiles over
+void renderPackets(unsigned char* pixels, unsigned int img_size, const TraceScene* scene, ThreadPool* pool);
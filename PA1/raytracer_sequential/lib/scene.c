@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "scene.h"
+
+#define MAX_LINE 1024
+
+void initScene(SceneFile* scene) {
+    memset(scene, 0, sizeof(*scene));
+    scene->camera = (SceneCamera){
+        .position = {0, 0, 0},
+        .look_at = {0, 0, -1},
+        .fov = 60
+    };
+}
+
+void freeScene(SceneFile* scene) {
+    free(scene->materials);
+    free(scene->spheres);
+    free(scene->lights);
+    initScene(scene);
+}
+
+// Room for one more element in an array that grows by doubling
+static void* reserve(void* array, int count, size_t size) {
+    if (count & (count - 1)) {
+        return array;
+    }
+    return realloc(array, (count ? 2 * count : 1) * size);
+}
+
+int addMaterial(SceneFile* scene, SceneMaterial material) {
+    scene->materials = reserve(scene->materials, scene->num_materials, sizeof(material));
+    scene->materials[scene->num_materials] = material;
+    return scene->num_materials++;
+}
+
+int addSphere(SceneFile* scene, SceneSphere sphere) {
+    scene->spheres = reserve(scene->spheres, scene->num_spheres, sizeof(sphere));
+    scene->spheres[scene->num_spheres] = sphere;
+    return scene->num_spheres++;
+}
+
+int addLight(SceneFile* scene, SceneLight light) {
+    scene->lights = reserve(scene->lights, scene->num_lights, sizeof(light));
+    scene->lights[scene->num_lights] = light;
+    return scene->num_lights++;
+}
+
+// Read count numbers from *s, advancing it past them
+static int readFloats(const char** s, float* out, int count) {
+    for (int i = 0; i < count; ++i) {
+        char* end;
+        out[i] = strtof(*s, &end);
+        if (end == *s) {
+            return 0;
+        }
+        *s = end;
+    }
+    return 1;
+}
+
+// Read one whitespace-delimited word from *s, advancing it past the word
+static int readWord(const char** s, char* out, size_t size) {
+    while (isspace((unsigned char)**s)) {
+        (*s)++;
+    }
+    size_t n = 0;
+    while ((*s)[n] && !isspace((unsigned char)(*s)[n])) {
+        n++;
+    }
+    if (n == 0 || n >= size) {
+        return 0;
+    }
+    memcpy(out, *s, n);
+    out[n] = '\0';
+    *s += n;
+    return 1;
+}
+
+static int atEnd(const char* s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    return *s == '\0';
+}
+
+static int findMaterial(const SceneFile* scene, const char* name) {
+    for (int m = 0; m < scene->num_materials; ++m) {
+        if (strcmp(scene->materials[m].name, name) == 0) {
+            return m;
+        }
+    }
+    return -1;
+}
+
+// Parse one line with its comment stripped; returns an error message or NULL
+static const char* parseLine(SceneFile* scene, const char* s) {
+    char keyword[32];
+    if (!readWord(&s, keyword, sizeof(keyword))) {
+        return atEnd(s) ? NULL : "keyword too long";
+    }
+
+    if (strcmp(keyword, "camera") == 0) {
+        SceneCamera camera;
+        if (!readFloats(&s, camera.position, 3) || !readFloats(&s, camera.look_at, 3)
+            || !readFloats(&s, &camera.fov, 1)) {
+            return "expected: camera <position x y z> <look at x y z> <fov>";
+        }
+        if (!(camera.fov > 0 && camera.fov < 180)) {
+            return "camera fov must be between 0 and 180 degrees";
+        }
+        scene->camera = camera;
+    } else if (strcmp(keyword, "material") == 0) {
+        SceneMaterial material;
+        if (!readWord(&s, material.name, sizeof(material.name))
+            || !readFloats(&s, material.ambient, 3) || !readFloats(&s, material.diffuse, 3)
+            || !readFloats(&s, material.specular, 3) || !readFloats(&s, &material.shininess, 1)) {
+            return "expected: material <name> <ambient r g b> <diffuse r g b> <specular r g b> <shininess>";
+        }
+        if (findMaterial(scene, material.name) >= 0) {
+            return "material already declared";
+        }
+        addMaterial(scene, material);
+    } else if (strcmp(keyword, "sphere") == 0) {
+        SceneSphere sphere;
+        char name[32];
+        if (!readFloats(&s, sphere.center, 3) || !readFloats(&s, &sphere.radius, 1)
+            || !readWord(&s, name, sizeof(name))) {
+            return "expected: sphere <center x y z> <radius> <material>";
+        }
+        if (!(sphere.radius > 0)) {
+            return "sphere radius must be positive";
+        }
+        sphere.material = findMaterial(scene, name);
+        if (sphere.material < 0) {
+            return "unknown material";
+        }
+        addSphere(scene, sphere);
+    } else if (strcmp(keyword, "light") == 0) {
+        SceneLight light = {.atten = {1, 0, 0}};
+        char kind[16];
+        if (!readWord(&s, kind, sizeof(kind))
+            || !readFloats(&s, light.pos, 3) || !readFloats(&s, light.color, 3)) {
+            return "expected: light point|directional <x y z> <color r g b>";
+        }
+        if (strcmp(kind, "point") == 0) {
+            light.point = 1;
+            if (!atEnd(s) && !readFloats(&s, light.atten, 3)) {
+                return "expected: light point <position x y z> <color r g b> <attenuation const lin quad>";
+            }
+        } else if (strcmp(kind, "directional") == 0) {
+            light.point = 0;
+        } else {
+            return "light must be point or directional";
+        }
+        addLight(scene, light);
+    } else {
+        return "unknown keyword";
+    }
+
+    return atEnd(s) ? NULL : "unexpected text at end of line";
+}
+
+int loadScene(const char* path, SceneFile* scene) {
+    initScene(scene);
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error opening scene file %s\n", path);
+        return -1;
+    }
+
+    char line[MAX_LINE];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_no++;
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        const char* error = parseLine(scene, line);
+        if (error) {
+            fprintf(stderr, "%s:%d: %s\n", path, line_no, error);
+            fclose(fp);
+            freeScene(scene);
+            return -1;
+        }
+    }
+    fclose(fp);
+
+    if (scene->num_spheres == 0) {
+        fprintf(stderr, "%s: scene has no spheres\n", path);
+        freeScene(scene);
+        return -1;
+    }
+    return 0;
+}
+
+// Distinct materials the random spheres pick from
+#define RANDOM_MATERIALS 64
+
+// Uniform random float in [0, 1)
+static float randomUnit() {
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+void randomScene(SceneFile* scene, int num_spheres) {
+    initScene(scene);
+    srand(num_spheres);
+
+    const int ground = addMaterial(scene, (SceneMaterial){
+        .name = "ground",
+        .ambient = {0.1, 0.05, 0.1},
+        .diffuse = {0.5, 0.5, 0.5},
+        .specular = {0.4, 0.4, 0.4},
+        .shininess = 20
+    });
+    for (int m = 0; m < RANDOM_MATERIALS; ++m) {
+        SceneMaterial material = {.specular = {0.2, 0.2, 0.2}, .shininess = 50};
+        snprintf(material.name, sizeof(material.name), "random%d", m);
+        for (int a = 0; a < 3; ++a) {
+            const float c = randomUnit();
+            material.ambient[a] = 0.2f * c;
+            material.diffuse[a] = 0.7f * c;
+        }
+        addMaterial(scene, material);
+    }
+
+    addSphere(scene, (SceneSphere){.center = {0, -2501.5, -100}, .radius = 2500, .material = ground});
+    const float half_width = 0.75f * sqrtf(num_spheres);
+    for (int s = 1; s < num_spheres; ++s) {
+        SceneSphere sphere;
+        sphere.radius = 0.1f + 0.4f * randomUnit();
+        sphere.center[0] = half_width * (2 * randomUnit() - 1);
+        sphere.center[1] = -1.5f + sphere.radius;
+        sphere.center[2] = -3 - 2 * half_width * randomUnit();
+        sphere.material = ground + 1 + rand() % RANDOM_MATERIALS;
+        addSphere(scene, sphere);
+    }
+
+    addLight(scene, (SceneLight){.pos = {8, 4, 7}, .color = {0.5, 0.5, 0.5}, .atten = {1, 0, 0}, .point = 1});
+    addLight(scene, (SceneLight){.pos = {-5, 5, 0}, .color = {0.1, 0.1, 0.1}, .atten = {1, 0, 0}, .point = 1});
+}
+
+void randomLights(SceneFile* scene, int num_lights, int num_spheres) {
+    srand(num_lights);
+    scene->num_lights = 0;
+
+    // Spread and dimmed so that the field is about as bright for any count
+    const float half_width = 0.75f * sqrtf(num_spheres);
+    for (int l = 0; l < num_lights; ++l) {
+        SceneLight light = {.atten = {1, 0, 0.05f}, .point = 1};
+        light.pos[0] = half_width * (2 * randomUnit() - 1);
+        light.pos[1] = 1 + 3 * randomUnit();
+        light.pos[2] = -3 - 2 * half_width * randomUnit();
+        for (int a = 0; a < 3; ++a) {
+            light.color[a] = (0.5f + randomUnit()) * 8 / num_lights;
+        }
+        addLight(scene, light);
+    }
+}
+
+static void cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float normalize3(float v[3]) {
+    const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int a = 0; a < 3; ++a) {
+        v[a] /= length;
+    }
+    return length;
+}
+
+float cameraBasis(const SceneCamera* camera, float right[3], float up[3], float forward[3]) {
+    for (int a = 0; a < 3; ++a) {
+        forward[a] = camera->look_at[a] - camera->position[a];
+    }
+    normalize3(forward);
+
+    // Looking straight up or down, any horizontal right vector will do
+    const float world_up[3] = {0, 1, 0};
+    cross(forward, world_up, right);
+    if (normalize3(right) < 1e-6f) {
+        right[0] = 1;
+        right[1] = 0;
+        right[2] = 0;
+    }
+    cross(right, forward, up);
+
+    const float fov = camera->fov * 3.14159265359 / 180.0;
+    return tan(fov * 0.5);
+}
@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "threadpool.h"
+
+// Take tasks of the current batch until there are none left; called with
+// the lock held and returns with it held
+static void takeTasks(ThreadPool* pool) {
+    while (pool->next_task < pool->num_tasks) {
+        const int task = pool->next_task++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->function(pool->context, task);
+        pthread_mutex_lock(&pool->lock);
+    }
+}
+
+static void* worker(void* arg) {
+    ThreadPool* pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stop && pool->batch == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->batch;
+        pool->busy++;
+        takeTasks(pool);
+        pool->busy--;
+        if (pool->busy == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void createThreadPool(ThreadPool* pool, int num_threads) {
+    pool->num_threads = num_threads > 1 ? num_threads - 1 : 0;
+    pool->threads = malloc(pool->num_threads * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->function = NULL;
+    pool->context = NULL;
+    pool->num_tasks = 0;
+    pool->next_task = 0;
+    pool->busy = 0;
+    pool->batch = 0;
+    pool->stop = 0;
+
+    for (int i = 0; i < pool->num_threads; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+            fprintf(stderr, "Error starting worker thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void runTasks(ThreadPool* pool, int num_tasks, TaskFunction function, void* context) {
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->num_tasks = num_tasks;
+    pool->next_task = 0;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    takeTasks(pool);
+
+    // the last tasks may still be running on workers
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void destroyThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+}
+
+int cpuCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
+
+double wallClockMs(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000 / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec * 1e-6;
+#endif
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <pthread.h>
+
+// Work run for each task index of a batch
+typedef void (*TaskFunction)(void* context, int task);
+
+// Worker threads that stay alive between batches of tasks. Tasks are handed
+// out one index at a time, so uneven tasks still balance across threads.
+typedef struct ThreadPool {
+    pthread_t* threads;
+    int num_threads; // workers, not counting the thread that runs batches
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    // current batch, guarded by lock
+    TaskFunction function;
+    void* context;
+    int num_tasks;
+    int next_task;
+    int busy; // workers inside the batch
+    unsigned long batch; // bumped for every batch so sleeping workers notice
+    int stop;
+} ThreadPool;
+
+// Start a pool
+// @param pool : pool to initialize
+// @param num_threads : threads to run tasks on, including the caller of runTasks
+void createThreadPool(ThreadPool* pool, int num_threads);
+
+// Run function(context, task) for every task in [0, num_tasks) and return once
+// all of them have finished. The calling thread takes tasks too.
+void runTasks(ThreadPool* pool, int num_tasks, TaskFunction function, void* context);
+
+void destroyThreadPool(ThreadPool* pool);
+
+// Number of logical processors
+int cpuCount(void);
+
+// Wall-clock time in ms from an arbitrary start; clock() adds up the time of
+// every thread on some platforms
+double wallClockMs(void);
@@ -6,7 +6,6 @@
 
 //TODO: Dot product, vector scalar multiplication, vector addition, vector negate, normalize
 
-
 // Helper functions for random generation
 float random_float() {
     return rand() / (RAND_MAX + 1.0f);
@@ -16,60 +15,6 @@ float random_float_param(float min, float max) {
     return min + (max - min) * random_float();
 }
 
-// Vector addition
-// @param a : first vector operand
-// @param b : second vector operand
-float3 add(float3 a, float3 b) {
-    float3 sum = {a.x + b.x, a.y + b.y, a.z + b.z};
-    return sum;
-}
-
-// Vector negation
-// @param a : vector to negate
-float3 neg(float3 a) {
-    float3 negated = {-a.x, -a.y, -a.z};
-    return negated;
-}
-
-// Scalar multiplication
-// @param a : vector to scale
-// @param scale : scalar
-float3 scale(float3 a, float scale) {
-    float3 scaled = {scale * a.x, scale * a.y, scale * a.z};
-    return scaled;
-}
-
-// Dot product
-// @param a : first vector operand
-// @param b : second vector operand
-float dot(float3 a, float3 b) {
-    float dot_prod = (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
-    return dot_prod;
-}
-
-// Normalize vector
-// @param a : vector to normalize
-float3 normalize(float3 a) {
-    float magnitude = sqrt(dot(a, a));
-    float3 normalized_vec = {a.x / magnitude, a.y / magnitude, a.z / magnitude};
-    return normalized_vec;
-}
-
-// Get distance between two vectors
-// @param a : first vector operand
-// @param b: second vector operand
-float distance(float3 a, float3 b) {
-    return sqrt(powf(a.x - b.x, 2) + powf(a.y - b.y, 2) + powf(a.z - b.z, 2));
-}
-
-// Component wise multiplication of two vectors
-// @param a : first vector operand
-// @param b: second vector operand
-float3 multiply(float3 a, float3 b) {
-    float3 multiplied = {a.x * b.x, a.y * b.y, a.z * b.z};
-    return multiplied;
-}
-
 float lengthsquare(float3 a) {
     return pow(a.x, 2) + pow(a.y, 2) + pow(a.z, 2);
 }
@@ -3,38 +3,62 @@
 #include <math.h>
 #include "float3.h"
 
+// The basic operations are defined here so that they inline into the
+// tracing loops instead of being called across translation units
+
 // Vector addition
 // @param a : first vector operand
 // @param b : second vector operand
-float3 add(float3 a, float3 b);
+static inline float3 add(float3 a, float3 b) {
+    float3 sum = {a.x + b.x, a.y + b.y, a.z + b.z};
+    return sum;
+}
 
 // Vector negation
 // @param a : vector to negate
-float3 neg(float3 a);
+static inline float3 neg(float3 a) {
+    float3 negated = {-a.x, -a.y, -a.z};
+    return negated;
+}
 
 // Scalar multiplication
 // @param a : vector to scale
 // @param scale : scalar
-float3 scale(float3 a, float scale);
+static inline float3 scale(float3 a, float scale) {
+    float3 scaled = {scale * a.x, scale * a.y, scale * a.z};
+    return scaled;
+}
 
 // Dot product
 // @param a : first vector operand
 // @param b : second vector operand
-float dot(float3 a, float3 b);
+static inline float dot(float3 a, float3 b) {
+    float dot_prod = (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+    return dot_prod;
+}
 
 // Normalize vector
 // @param a : vector to normalize
-float3 normalize(float3 a);
+static inline float3 normalize(float3 a) {
+    float magnitude = sqrt(dot(a, a));
+    float3 normalized_vec = {a.x / magnitude, a.y / magnitude, a.z / magnitude};
+    return normalized_vec;
+}
 
 // Get distance between two vectors
 // @param a : first vector operand
 // @param b: second vector operand
-float distance(float3 a, float3 b);
+static inline float distance(float3 a, float3 b) {
+    return sqrt(powf(a.x - b.x, 2) + powf(a.y - b.y, 2) + powf(a.z - b.z, 2));
+}
 
 // Component wise multiplication of two vectors
 // @param a : first vector operand
 // @param b: second vector operand
-float3 multiply(float3 a, float3 b);
+static inline float3 multiply(float3 a, float3 b) {
+    float3 multiplied = {a.x * b.x, a.y * b.y, a.z * b.z};
+    return multiplied;
+}
 
 float3 random_param(float min, float max);
 
@@ -1,32 +1,46 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include "lib/geometry/ray.h"
 #include "lib/geometry/Sphere.h"
 #include "lib/geometry/Light.h"
+#include "lib/geometry/bvh.h"
+#include "lib/geometry/Camera.h"
+#include "lib/scene.h"
+#include "lib/packet.h"
+#include "lib/threadpool.h"
 #include "lib/vec_ops.h"
 #include "lib/float3.h"
 
-#define MAX_SPHERES 10 
-#define MAX_LIGHTS 5
-#define MAX_RECURSION_DEPTH 5
-
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "lib/stb_image_write.h"
 
 const float PI = 3.14159265359;
 const unsigned int IMG_SIZE = 1024;
-const float FOV = 3.14159265359/3.0;
 
-Sphere spheres[MAX_SPHERES];
-Light lights[MAX_LIGHTS];
+// Spheres as structure of arrays: center and radius, then the index of
+// each one's material
+float4* spheres;
+int* sphere_materials;
+Material* materials;
+Light* lights;
+Camera camera;
+
+// Acceleration structure over spheres; NULL to test every sphere
+BVHNode* bvh_nodes = NULL;
 
 typedef unsigned char bool;
 enum {false, true};
 
 void intersectScene(size_t num_spheres, Ray* r_ray) {
+    if (bvh_nodes) {
+        intersectBVH(bvh_nodes, spheres, r_ray);
+        return;
+    }
     for (int s = 0; s < num_spheres; ++s) {
-        intersectSphere(r_ray, &spheres[s]);
+        intersectSphere(r_ray, &spheres[s], s);
     }
 }
 
@@ -38,6 +52,7 @@ typedef struct RayHit {
 // Assumes the ray has already been intersected with relevant geometry. 
 // The ray is passed by value because we'll need to use all its members anyway.
 float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
+    const Material material = materials[sphere_materials[ray.sphere]];
     const float3 hit_point = add(ray.origin, scale(ray.dir, ray.t));
     const float3 hit_normal = ray.normal;
 
@@ -60,6 +75,7 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
         Ray shadow_ray = {
             .origin = add(hit_point, scale(hit_normal, 5 * 10e-5)), 
             .dir = hit_to_light, 
+            .sphere = -1,
             .t = INFINITY
         };
 
@@ -89,12 +105,12 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
 
         // phong shading model
         float NdotL =  fmax(0, dot(hit_normal, light_direction));
-        float3 color_diffuse = scale(ray.diffuse, NdotL);
+        float3 color_diffuse = scale(material.diffuse, NdotL);
         float3 color_specular = scale(
-            ray.specular, 
+            material.specular, 
             pow(
                 fmax(0, dot(reflection_direction, neg(normalize(ray.dir)))), 
-                ray.shininess)
+                material.shininess)
         );
 
         color = add(
@@ -104,134 +120,82 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
                 curr_light.color)
         );
     }
-    return add(color, ray.ambient);
+    return add(color, material.ambient);
 }
 
-;int main (int argc, char *argv[]) {
-    printf("Starting Sequential Ray Tracing...");
-
-    // Time measurement variables
-    clock_t start, end;
-    double cpu_time_used;
+float3 toFloat3(const float v[3]) {
+    return (float3){v[0], v[1], v[2]};
+}
 
-    // Start measuring host execution time
-    start = clock();
-
-       // hardcode the scene for now
-    spheres[0] = (Sphere){
-        .radius = 1.3f, 
-        .center = (float3){3.4, -1.8, -9},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){.7, 0.0, 0.0}, 
-        
-        .specular = (float3){0.3, 0.1, 0.1}, 
-        .shininess = 100 
-    };
+// Lay a parsed scene out for rendering: build the BVH, which reorders the
+// scene's spheres, and copy spheres, materials, lights and camera into the
+// globals. Returns the number of BVH nodes.
+int useScene(SceneFile* scene) {
+    int num_nodes;
+    bvh_nodes = buildBVH(scene->spheres, scene->num_spheres, &num_nodes);
+
+    spheres = malloc(scene->num_spheres * sizeof(float4));
+    sphere_materials = malloc(scene->num_spheres * sizeof(int));
+    for (int s = 0; s < scene->num_spheres; ++s) {
+        const SceneSphere* sphere = &scene->spheres[s];
+        spheres[s] = (float4){sphere->center[0], sphere->center[1], sphere->center[2], sphere->radius};
+        sphere_materials[s] = sphere->material;
+    }
 
-    spheres[1] = (Sphere){
-        .radius = 3.0f, 
-        .center = (float3){2, 0, -18},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.7, 0.6, 0.9}, 
-        .specular = (float3){0.6, 0.6, 0.6}, 
-        .shininess =  100 
-    };
+    materials = malloc(scene->num_materials * sizeof(Material));
+    for (int m = 0; m < scene->num_materials; ++m) {
+        const SceneMaterial* material = &scene->materials[m];
+        materials[m] = (Material){
+            .ambient = toFloat3(material->ambient),
+            .diffuse = toFloat3(material->diffuse),
+            .specular = toFloat3(material->specular),
+            .shininess = material->shininess
+        };
+    }
 
-    // Ground sphere
-    spheres[2] = (Sphere){
-        .radius = 2500.0f, 
-        .center = (float3){0, -2501.5, -100},
-        .ambient = (float3){0.1, 0.05, 0.1},
-        .diffuse = (float3){0.5, 0.5, 0.5},     
-        .specular = (float3){0.4, 0.4, 0.4},    
-        .shininess = 20
-    };
+    lights = malloc(scene->num_lights * sizeof(Light));
+    for (int l = 0; l < scene->num_lights; ++l) {
+        const SceneLight* light = &scene->lights[l];
+        lights[l] = (Light){
+            .pos = toFloat3(light->pos),
+            .color = toFloat3(light->color),
+            .atten = toFloat3(light->atten),
+            .dir = light->point
+        };
+    }
 
-    spheres[3] = (Sphere){
-        .radius = 1.3f, 
-        .center = (float3){-3, -2, -7},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.0, 0.7, 0.7}, 
-        .specular = (float3){0.1, 0.5, 0.1}, 
-        .shininess = 10 
-    };
-    spheres[4] = (Sphere){
-        .radius = 0.5f, 
-        .center = (float3){-1.8, -2.5, -10},
-        .ambient = (float3){0.1, 0.2, 0.2},
-        .diffuse = (float3){0.0, 0.6, 0.5},
-        .specular = (float3){0.1, 0.1, 0.1}, 
-        .shininess = 100 
-    };
-    spheres[5] = (Sphere){
-        .radius = 0.6667f, 
-        .center = (float3){-1.6, -2.7, -6},
-        .ambient = (float3){0, 0, 0.5},
-        .diffuse = (float3){0.0, 0.7, 0.7},
-        .specular = (float3){0.1, 0.1, 0.2}, 
-        .shininess = 0 
-    };
-    spheres[6] = (Sphere){
-        .radius = 0.4f, 
-        .center = (float3){1.5, -2.8, -7.2},
-        .ambient = (float3){0.4, 0, 0.0},
-        .diffuse = (float3){0.7, 0.7, 0.0},
-        .specular = (float3){0.1, 0.1, 0.2}, 
-        .shininess = 0 
-    };
-    spheres[7] = (Sphere){
-        .radius = 0.5f, 
-        .center = (float3){2.4, -2.7, -6.5},
-        .ambient = (float3){0.2, 0.0, 0.2},
-        .diffuse = (float3){0.7, 0.0, 0.4},
-        .specular = (float3){0.1, 0.1, 0.1}, 
-        .shininess = 50 
-    };
-    spheres[8] = (Sphere){
-        .radius = 5.0f, 
-        .center = (float3){-6, 2, -15},
-        .ambient = (float3){0.2, 0.1, 0.2},
-        .diffuse = (float3){0.7, 0.7, 0.7},
-        .specular = (float3){0.4, 0.4, 0.4}, 
-        .shininess = 100 
-    };
-    
-    // don't forget to update this
-    unsigned int num_spheres = 9;
-
-    // Lights
-    lights[0] = (Light){
-        .pos = (float3){8, 4, 7},
-        .color = (float3){0.5, 0.5, 0.5},
-        .atten = (float3){1, 0, 0},  
-        .dir = 1
-    };
+    float right[3], up[3], forward[3];
+    camera.half_height = cameraBasis(&scene->camera, right, up, forward);
+    camera.position = toFloat3(scene->camera.position);
+    camera.right = toFloat3(right);
+    camera.up = toFloat3(up);
+    camera.forward = toFloat3(forward);
+    return num_nodes;
+}
 
-    lights[1] = (Light){
-        .pos = (float3){-5, 5, 0},
-        .color = (float3){0.1, 0.1, 0.1},
-        .atten = (float3){1, 0, 0},
-        .dir = 1
-    };
-    // Set the number of spheres/lights
-    unsigned int num_lights = 2; 
-    
-    // Pixels to write to the image
-    unsigned char pixels[IMG_SIZE * IMG_SIZE * 3];
+void releaseScene() {
+    free(bvh_nodes);
+    free(spheres);
+    free(sphere_materials);
+    free(materials);
+    free(lights);
+    bvh_nodes = NULL;
+}
 
-    // half the height (and also width) of the image plane
-    float half_height = tan(FOV * 0.5);
+// Trace every pixel of an img_size x img_size image into pixels (RGB)
+void render(unsigned char* pixels, unsigned int img_size, unsigned int num_spheres, unsigned int num_lights) {
+    const float half_height = camera.half_height;
 
     // Iterate through every pixel on the screen; for every row, iterate through
     // every column.  All pixels are drawn on one thread. 
-    for (int row = 0; row < IMG_SIZE; row++) {
-        for (int col = 0; col < IMG_SIZE; col++) {
+    for (int row = 0; row < img_size; row++) {
+        for (int col = 0; col < img_size; col++) {
 
             //* ----------------- RAY GENERATION  -----------------------------
-            float offset_x = half_height * ((col + 0.5 - IMG_SIZE/2.0)/(IMG_SIZE/2.0));
-            float offset_y = half_height * ((IMG_SIZE/2.0 - row - 0.5)/(IMG_SIZE/2.0));
+            float offset_x = half_height * ((col + 0.5 - img_size/2.0)/(img_size/2.0));
+            float offset_y = half_height * ((img_size/2.0 - row - 0.5)/(img_size/2.0));
 
-            float3 ray_direction = {.x = offset_x, .y = offset_y, .z = -1}; 
+            float3 ray_direction = add(add(scale(camera.right, offset_x), scale(camera.up, offset_y)), camera.forward);
             ray_direction = normalize(ray_direction);
 
             //* ----------------- RECURSIVE RAY TRACING -----------------------------
@@ -241,8 +205,9 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
 
             // changes at each iteration of the loop
             Ray curr_ray = {
-                .origin = (float3){0.0, 0.0, 0.0}, 
+                .origin = camera.position, 
                 .dir = ray_direction, 
+                .sphere = -1,
                 .t = INFINITY 
             };
 
@@ -260,9 +225,10 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
                 }
 
                 // Intersection for shading
+                finishHit(&curr_ray, spheres);
                 RayHit ray_hit = {
                     .phong = shadeRayHit(curr_ray, num_lights, num_spheres), 
-                    .specular = curr_ray.specular
+                    .specular = materials[sphere_materials[curr_ray.sphere]].specular
                 };
 
                 STACK_PUSH(ray_hit);
@@ -279,6 +245,7 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
                 curr_ray = (Ray){
                     .origin = add(add(curr_ray.origin, scale(curr_ray.dir, curr_ray.t)), scale(curr_ray.normal, 2 * 10e-5)),
                     .dir = reflection_direction,
+                    .sphere = -1,
                    .t = INFINITY 
                 };
             }
@@ -296,27 +263,334 @@ float3 shadeRayHit(Ray ray, size_t num_lights, size_t num_spheres) {
 
             //* ------------------------------- WRITE TO IMAGE --------------------------------------------
             // map final color from [0, infinity) to [0, 255]
-            // final_color = (float3){(float)row/IMG_SIZE, (float)col/IMG_SIZE, 0};
+            // final_color = (float3){(float)row/img_size, (float)col/img_size, 0};
             final_color = scale(final_color, 255.0f);
             unsigned char r = fmin(final_color.x, 255.0f); 
             unsigned char g = fmin(final_color.y, 255.0f); 
             unsigned char b = fmin(final_color.z, 255.0f);
 
             // write the pixels 
-            pixels[(row * IMG_SIZE + col) * 3 + 0] = r;
-            pixels[(row * IMG_SIZE + col) * 3 + 1] = g;
-            pixels[(row * IMG_SIZE + col) * 3 + 2] = b;
+            pixels[(row * img_size + col) * 3 + 0] = r;
+            pixels[(row * img_size + col) * 3 + 1] = g;
+            pixels[(row * img_size + col) * 3 + 2] = b;
+
+        }
+    }
+}
+
+double elapsedMs(clock_t start) {
+    return ((double) (clock() - start)) / CLOCKS_PER_SEC * 1000;
+}
+
+// Testing every sphere is not worth timing past this many
+#define MAX_LINEAR_SPHERES 1000
+
+// Render random scenes of growing size with and without the BVH
+void benchmark(unsigned int img_size) {
+    const unsigned int counts[] = {10, 1000, 100000};
+    unsigned char* pixels = malloc(img_size * img_size * 3);
+
+    printf("Scenes rendered at %ux%u\n", img_size, img_size);
+    printf("%10s %8s %10s %12s %12s %9s\n", "spheres", "nodes", "build ms", "bvh ms", "linear ms", "speedup");
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        SceneFile scene;
+        randomScene(&scene, counts[i]);
+        const unsigned int num_spheres = scene.num_spheres;
+        const unsigned int num_lights = scene.num_lights;
+
+        clock_t start = clock();
+        const int num_nodes = useScene(&scene);
+        const double build_ms = elapsedMs(start);
+
+        start = clock();
+        render(pixels, img_size, num_spheres, num_lights);
+        const double bvh_ms = elapsedMs(start);
+
+        BVHNode* nodes = bvh_nodes;
+        bvh_nodes = NULL;
+        printf("%10u %8d %10.2f %12.2f", num_spheres, num_nodes, build_ms, bvh_ms);
+        if (num_spheres <= MAX_LINEAR_SPHERES) {
+            start = clock();
+            render(pixels, img_size, num_spheres, num_lights);
+            const double linear_ms = elapsedMs(start);
+            printf(" %12.2f %8.1fx\n", linear_ms, linear_ms / bvh_ms);
+        } else {
+            printf(" %12s %9s\n", "-", "-");
+        }
+
+        bvh_nodes = nodes;
+        releaseScene();
+        freeScene(&scene);
+    }
+    free(pixels);
+}
+
+// The scene in the globals, for the packet renderer
+TraceScene traceScene(unsigned int num_spheres, unsigned int num_lights) {
+    TraceScene scene = {
+        .spheres = spheres,
+        .sphere_materials = sphere_materials,
+        .num_spheres = num_spheres,
+        .materials = materials,
+        .nodes = bvh_nodes,
+        .lights = lights,
+        .num_lights = num_lights,
+        .camera = camera
+    };
+    return scene;
+}
 
+// Largest difference in any channel between two images of num_bytes bytes
+int maxDifference(const unsigned char* a, const unsigned char* b, size_t num_bytes) {
+    int max_diff = 0;
+    for (size_t i = 0; i < num_bytes; ++i) {
+        const int diff = abs(a[i] - b[i]);
+        max_diff = diff > max_diff ? diff : max_diff;
+    }
+    return max_diff;
+}
+
+// Render random scenes through the BVH with the scalar renderer on one
+// thread and the packet renderer on one thread and on the whole pool
+void benchmarkPackets(unsigned int img_size, ThreadPool* pool) {
+    const unsigned int counts[] = {10, 1000, 100000};
+    const size_t num_bytes = (size_t)img_size * img_size * 3;
+    unsigned char* reference = malloc(num_bytes);
+    unsigned char* pixels = malloc(num_bytes);
+    const double num_rays = (double)img_size * img_size;
+    ThreadPool single;
+    createThreadPool(&single, 1);
+
+    printf("\n%d-ray packets, %d threads\n", PACKET_WIDTH, pool->num_threads + 1);
+    printf("%10s %12s %12s %12s %9s %12s %6s\n", "spheres", "scalar ms", "packet ms", "threads ms",
+           "speedup", "Mpixels/s", "diff");
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        SceneFile file;
+        randomScene(&file, counts[i]);
+        useScene(&file);
+        const TraceScene scene = traceScene(file.num_spheres, file.num_lights);
+
+        double start = wallClockMs();
+        render(reference, img_size, file.num_spheres, file.num_lights);
+        const double scalar_ms = wallClockMs() - start;
+
+        start = wallClockMs();
+        renderPackets(pixels, img_size, &scene, &single);
+        const double packet_ms = wallClockMs() - start;
+
+        start = wallClockMs();
+        renderPackets(pixels, img_size, &scene, pool);
+        const double threads_ms = wallClockMs() - start;
+
+        printf("%10d %12.2f %12.2f %12.2f %8.1fx %12.2f %6d\n", file.num_spheres, scalar_ms, packet_ms,
+               threads_ms, scalar_ms / threads_ms, num_rays / threads_ms / 1000,
+               maxDifference(reference, pixels, num_bytes));
+
+        releaseScene();
+        freeScene(&file);
+    }
+    destroyThreadPool(&single);
+    free(reference);
+    free(pixels);
+}
+
+// Primary rays of a LAYOUT_RAYS_EDGE square image make the layout benchmark's batch
+#define LAYOUT_RAYS_EDGE 64
+// Timed runs of each layout; the fastest is reported
+#define LAYOUT_RUNS 3
+
+// Sphere layouts the layout benchmark compares
+enum { LAYOUT_STRUCT, LAYOUT_FLOAT4, LAYOUT_STREAM, NUM_LAYOUTS };
+
+// Test a batch of primary rays against every sphere of random scenes, with
+// each sphere a Sphere struct, with the float4 array, and with the float4
+// array against a RayStream, and check that all three find the same spheres
+void benchmarkLayouts() {
+    const unsigned int counts[] = {1000, 10000, 100000};
+    const char* names[NUM_LAYOUTS] = {"struct", "float4", "float4+stream"};
+    const int strides[NUM_LAYOUTS] = {sizeof(Sphere), sizeof(float4), sizeof(float4)};
+    const int edge = LAYOUT_RAYS_EDGE;
+    const int num_rays = edge * edge;
+    float3* dirs = malloc(num_rays * sizeof(float3));
+    Ray* rays = malloc(num_rays * sizeof(Ray));
+    int* reference = malloc(num_rays * sizeof(int));
+    RayStream stream;
+    createRayStream(&stream, num_rays);
+
+    printf("\nIntersection tests of %d rays against every sphere\n", num_rays);
+    printf("%10s %14s %13s %10s %10s %9s %11s\n", "spheres", "layout", "bytes/sphere", "ms", "Mtests/s",
+           "speedup", "mismatches");
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        SceneFile file;
+        randomScene(&file, counts[i]);
+        useScene(&file);
+        const int num_spheres = file.num_spheres;
+
+        // The same spheres, one struct each with the material inline
+        Sphere* records = malloc(num_spheres * sizeof(Sphere));
+        for (int s = 0; s < num_spheres; ++s) {
+            const Material* material = &materials[sphere_materials[s]];
+            records[s] = (Sphere){
+                .radius = spheres[s].w,
+                .center = {spheres[s].x, spheres[s].y, spheres[s].z},
+                .ambient = material->ambient,
+                .diffuse = material->diffuse,
+                .specular = material->specular,
+                .shininess = material->shininess
+            };
+        }
+        for (int row = 0; row < edge; ++row) {
+            for (int col = 0; col < edge; ++col) {
+                float offset_x = camera.half_height * ((col + 0.5 - edge/2.0)/(edge/2.0));
+                float offset_y = camera.half_height * ((edge/2.0 - row - 0.5)/(edge/2.0));
+                dirs[row * edge + col] = normalize(add(add(scale(camera.right, offset_x), scale(camera.up, offset_y)),
+                                                       camera.forward));
+            }
+        }
+
+        // Each layout runs LAYOUT_RUNS times, taking turns with the others, and
+        // keeps its fastest run, so that noise and clock changes hit all alike
+        double layout_ms[NUM_LAYOUTS];
+        int mismatches[NUM_LAYOUTS];
+        for (int run = 0; run < LAYOUT_RUNS; ++run) {
+            for (int layout = 0; layout < NUM_LAYOUTS; ++layout) {
+                for (int r = 0; r < num_rays; ++r) {
+                    rays[r] = (Ray){.origin = camera.position, .dir = dirs[r], .sphere = -1, .t = INFINITY};
+                    setStreamRay(&stream, r, camera.position, dirs[r]);
+                }
+
+                const double start = wallClockMs();
+                if (layout == LAYOUT_STRUCT) {
+                    for (int r = 0; r < num_rays; ++r) {
+                        for (int s = 0; s < num_spheres; ++s) {
+                            intersectSphereAoS(&rays[r], &records[s], s);
+                        }
+                    }
+                } else if (layout == LAYOUT_FLOAT4) {
+                    for (int r = 0; r < num_rays; ++r) {
+                        for (int s = 0; s < num_spheres; ++s) {
+                            intersectSphere(&rays[r], &spheres[s], s);
+                        }
+                    }
+                } else {
+                    intersectStream(&stream, spheres, num_spheres);
+                }
+                const double ms = wallClockMs() - start;
+                if (run == 0 || ms < layout_ms[layout]) {
+                    layout_ms[layout] = ms;
+                }
+
+                // Every layout should find the same closest sphere for every ray
+                mismatches[layout] = 0;
+                for (int r = 0; r < num_rays; ++r) {
+                    const int hit = layout == LAYOUT_STREAM ? stream.sphere[r] : rays[r].sphere;
+                    if (layout == LAYOUT_STRUCT) {
+                        reference[r] = hit;
+                    }
+                    mismatches[layout] += hit != reference[r];
+                }
+            }
+        }
+        for (int layout = 0; layout < NUM_LAYOUTS; ++layout) {
+            printf("%10d %14s %13d %10.2f %10.1f %8.2fx %11d\n", num_spheres, names[layout], strides[layout],
+                   layout_ms[layout], (double)num_rays * num_spheres / layout_ms[layout] / 1000,
+                   layout_ms[LAYOUT_STRUCT] / layout_ms[layout], mismatches[layout]);
         }
+
+        free(records);
+        releaseScene();
+        freeScene(&file);
+    }
+    releaseRayStream(&stream);
+    free(dirs);
+    free(rays);
+    free(reference);
+}
+
+;int main (int argc, char *argv[]) {
+    // ./raytracer_sequential bench [image size] [--threads <n>]
+    // ./raytracer_sequential [scene file] [--packets] [--threads <n>]
+    int bench = 0;
+    unsigned int bench_size = 256;
+    int packets = 0;
+    int num_threads = cpuCount();
+    const char* scene_path = "../scenes/default.scene";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "bench") == 0) {
+            bench = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                bench_size = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--packets") == 0) {
+            packets = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            scene_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (num_threads < 1) {
+        fprintf(stderr, "--threads needs at least 1 thread\n");
+        return 1;
+    }
+
+    if (bench) {
+        benchmark(bench_size);
+        ThreadPool pool;
+        createThreadPool(&pool, num_threads);
+        benchmarkPackets(bench_size, &pool);
+        destroyThreadPool(&pool);
+        benchmarkLayouts();
+        return 0;
+    }
+
+    SceneFile scene;
+    if (loadScene(scene_path, &scene) != 0) {
+        return 1;
+    }
+
+    printf("Starting %s Ray Tracing...", packets ? "Packet" : "Sequential");
+
+    // Time measurement variables; wall clock, since the packet renderer
+    // runs on several threads
+    double start, end;
+    double cpu_time_used;
+
+    // Start measuring host execution time
+    start = wallClockMs();
+
+    useScene(&scene);
+
+    // Pixels to write to the image
+    unsigned char* pixels = malloc(IMG_SIZE * IMG_SIZE * 3);
+    if (packets) {
+        ThreadPool pool;
+        createThreadPool(&pool, num_threads);
+        const TraceScene trace_scene = traceScene(scene.num_spheres, scene.num_lights);
+        renderPackets(pixels, IMG_SIZE, &trace_scene, &pool);
+        destroyThreadPool(&pool);
+    } else {
+        render(pixels, IMG_SIZE, scene.num_spheres, scene.num_lights);
     }
     stbi_write_png("output.png", IMG_SIZE, IMG_SIZE, 3, pixels, IMG_SIZE * 3);
+    free(pixels);
+
+    releaseScene();
+    freeScene(&scene);
 
     // Stop measuring host execution time
-    end = clock();
-    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC * 1000; // Convert to milliseconds
+    end = wallClockMs();
+    cpu_time_used = end - start;
 
     printf("\n========================================================\n");
-    printf("Single-Threaded Implementation on CPU\n");
+    if (packets) {
+        printf("%d-Ray Packets on %d CPU Threads\n", PACKET_WIDTH, num_threads);
+    } else {
+        printf("Single-Threaded Implementation on CPU\n");
+    }
     printf("Total execution time (host + kernel): %.3f ms\n", cpu_time_used);
      printf("========================================================\n\n");
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include <cstring>
+#include <iostream>
+
+#include "src/network.h"
+#include "src/weight_file.h"
+
+// Convert a legacy weights .bin file into a mapped WeightFile container:
+//   ./convert_weights build/weights-86.bin build/weights-86.wgt [fp16]
+int main(int argc, char* argv[]) {
+
+  if (argc < 3) {
+    std::cerr<<"Usage: "<<argv[0]<<" <legacy.bin> <out.wgt> [fp16]"<<std::endl;
+    return 1;
+  }
+
+  WeightFile::DType dtype = WeightFile::FLOAT32;
+  if (argc >= 4 && strcmp(argv[3], "fp16") == 0) {
+    dtype = WeightFile::FLOAT16;
+  }
+
+  std::vector<std::vector<float> > param = Network::read_parameters(argv[1]);
+  WeightFile::write(argv[2], param, dtype);
+
+  WeightFile file(argv[2]);
+  std::cout<<"Wrote "<<file.n_layer()<<" layers to "<<argv[2]
+           <<(file.verify() ? " (checksum ok)" : " (checksum MISMATCH)")<<std::endl;
+  for (int i = 0; i < file.n_layer(); i++) {
+    std::cout<<"Layer "<<i<<" size: "<<file.count(i)<<std::endl;
+  }
+
+  return file.verify() ? 0 : 1;
+}
@@ -10,22 +10,69 @@
 
  #include "ece408net.h"
 
+ // Host-only network with fresh random parameters, used for training
+ void buildNetwork_CPU(Network& dnn)
+ {
+   dnn.add_layer(new Conv(1, 86, 86, 4, 7, 7));
+   dnn.add_layer(new ReLU);
+   dnn.add_layer(new MaxPooling(4, 80, 80, 2, 2, 2));
+   dnn.add_layer(new Conv(4, 40, 40, 16, 7, 7));
+   dnn.add_layer(new ReLU);
+   Layer* pool2 = new MaxPooling(16, 34, 34, 4, 4, 4);
+   dnn.add_layer(pool2);
+   dnn.add_layer(new FullyConnected(pool2->output_dim(), 32));
+   dnn.add_layer(new ReLU);
+   dnn.add_layer(new FullyConnected(32, 10));
+   dnn.add_layer(new Softmax);
+   // loss
+   dnn.add_loss(new CrossEntropy);
+ }
+
+ // There is no separate custom CPU convolution in this tree, so
+ // customCPUConv has no effect
+ Network createNetwork_CPU(bool customCPUConv)
+ {
+   Network dnn;
+   buildNetwork_CPU(dnn);
+   std::ifstream mapped("./build/weights-86.wgt");
+   dnn.load_parameters(mapped.good() ? "./build/weights-86.wgt"
+                                     : "./build/weights-86.bin");
+   return dnn;
+ }
+
  Network createNetwork_OpenCL(OpenCL* opencl)
  {
    Network dnn;
- 
+   buildNetwork_OpenCL(dnn, opencl);
+   return dnn;
+ }
+
+ // Fills an existing Network, for owners that cannot take one by value
+ void buildNetwork_OpenCL(Network& dnn, OpenCL* opencl)
+ {
+   buildNetwork_OpenCL(dnn, opencl, false);
+ }
+
+ // conv_bias adds the convolution bias in forward, as training expects
+ void buildNetwork_OpenCL(Network& dnn, OpenCL* opencl, bool conv_bias)
+ {
    Layer* conv1 = new Conv_Custom(1, 86, 86, 4, 7, 7);
    ((Conv_Custom*)conv1)->opencl = opencl;
+   ((Conv_Custom*)conv1)->use_bias = conv_bias;
    Layer* pool1 = new MaxPooling(4, 80, 80, 2, 2, 2);
    Layer* conv2 = new Conv_Custom(4, 40, 40, 16, 7, 7);
    ((Conv_Custom*)conv2)->opencl = opencl;
+   ((Conv_Custom*)conv2)->use_bias = conv_bias;
    Layer* pool2 = new MaxPooling(16, 34, 34, 4, 4, 4);
-   Layer* fc3 = new FullyConnected(pool2->output_dim(), 32);
-   Layer* fc4 = new FullyConnected(32, 10);
+   // relu3 and softmax run in the epilogues of the fc3/fc4 kernels
+   Layer* fc3 = new FullyConnected_Custom(pool2->output_dim(), 32,
+                                          FullyConnected_Custom::RELU);
+   ((FullyConnected_Custom*)fc3)->opencl = opencl;
+   Layer* fc4 = new FullyConnected_Custom(32, 10,
+                                          FullyConnected_Custom::SOFTMAX);
+   ((FullyConnected_Custom*)fc4)->opencl = opencl;
    Layer* relu1 = new ReLU;
    Layer* relu2 = new ReLU;
-   Layer* relu3 = new ReLU;
-   Layer* softmax = new Softmax;
    dnn.add_layer(conv1);
    dnn.add_layer(relu1);
    dnn.add_layer(pool1);
@@ -33,16 +80,14 @@
    dnn.add_layer(relu2);
    dnn.add_layer(pool2);
    dnn.add_layer(fc3);
-   dnn.add_layer(relu3);
    dnn.add_layer(fc4);
-   dnn.add_layer(softmax);
    // loss
    Loss* loss = new CrossEntropy;
    dnn.add_loss(loss);
  
-   //load weights
-   dnn.load_parameters("./build/weights-86.bin");
- 
-   return dnn;
+   //load weights, preferring the mapped container (make weights)
+   std::ifstream mapped("./build/weights-86.wgt");
+   dnn.load_parameters(mapped.good() ? "./build/weights-86.wgt"
+                                     : "./build/weights-86.bin");
  }
  
\ No newline at end of file
@@ -17,6 +17,7 @@
  #include "src/layer/conv.h"
  #include "src/layer/conv_cust.h"
  #include "src/layer/fully_connected.h"
+ #include "src/layer/fc_cust.h"
  #include "src/layer/ave_pooling.h"
  #include "src/layer/max_pooling.h"
  #include "src/layer/relu.h"
@@ -32,5 +33,8 @@
  #include "src/layer/custom/opencl.h"
  
  Network createNetwork_CPU(bool customCPUConv = false);
+ void buildNetwork_CPU(Network& dnn);
  Network createNetwork_OpenCL(OpenCL* opencl);
+ void buildNetwork_OpenCL(Network& dnn, OpenCL* opencl);
+ void buildNetwork_OpenCL(Network& dnn, OpenCL* opencl, bool conv_bias);
  
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "ece408net.h"
+
+#include <chrono>
+#include <thread>
+
+#include "src/grad_check.h"
+
+int main(int argc, char* argv[]) {
+
+  // ./gradcheck <points> <threads> [batch] [opencl]
+  int n_points = 200;
+  int n_thread = std::max(1u, std::thread::hardware_concurrency());
+  int batch_size = 16;
+  bool use_opencl = false;
+  if(argc >= 2){
+    n_points = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    n_thread = atoi(argv[2]);
+  }
+  if(argc >= 4){
+    batch_size = atoi(argv[3]);
+  }
+  if(argc >= 5 && std::string(argv[4]) == "opencl"){
+    use_opencl = true;
+  }
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(batch_size);
+  std::cout<<"Done"<<std::endl;
+  // Pixels are 0..255; scale them so the loss is not saturated
+  Matrix input = dataset.test_data / 255.0f;
+  Matrix target = one_hot_encode(dataset.test_labels, 10);
+
+  // One clone per thread. OpenCL clones get their own context and kernels,
+  // since kernel arguments cannot be shared between threads.
+  std::vector<OpenCL*> contexts;
+  std::vector<Network*> clones;
+  for (int t = 0; t < n_thread; t++) {
+    clones.push_back(new Network());
+    if (use_opencl) {
+      contexts.push_back(new OpenCL());
+      contexts.back()->setup(CL_DEVICE_TYPE_GPU);
+      buildNetwork_OpenCL(*clones.back(), contexts.back(), true);
+    } else {
+      buildNetwork_CPU(*clones.back());
+    }
+  }
+
+  std::cout<<"Checking "<<n_points<<" points on "<<n_thread<<" threads ("
+           <<(use_opencl ? "OpenCL" : "CPU")<<" layers)"<<std::endl;
+  auto start_time = std::chrono::high_resolution_clock::now();
+  GradientChecker checker(clones);
+  std::vector<GradientChecker::Point> points =
+      checker.run(input, target, n_points);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  GradientChecker::report(points);
+  std::chrono::duration<float, std::milli> duration = (end_time-start_time);
+  std::cout<<"Check Time: " << duration.count() << " ms"<<std::endl;
+
+  for (int t = 0; t < n_thread; t++)
+    delete clones[t];
+  for (size_t t = 0; t < contexts.size(); t++) {
+    contexts[t]->teardown();
+    delete contexts[t];
+  }
+  return 0;
+}
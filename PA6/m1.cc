@@ -15,7 +15,9 @@ void inference_only(int batch_size) {
   std::cout<<"Done"<<std::endl;
 
   dnn.forward(dataset.test_data);
-  float acc = compute_accuracy(dnn.output(), dataset.test_labels);
+  // Only the predicted classes and the hit count come back to the host
+  std::vector<int> pred;
+  float acc = float(dnn.classify(dataset.test_labels, pred)) / pred.size();
   std::cout<<std::endl;
   std::cout<<"Test Accuracy: "<<acc<< std::endl;
   std::cout<<std::endl;
@@ -1,12 +1,15 @@
 #include "ece408net.h"
+#include "src/plan.h"
+
+#include <chrono>
 
 #include "device.h"
 #include "src/layer/custom/opencl.h"
 
-void inference_only(int batch_size) {
+void inference_only(int batch_size, bool half_storage, bool use_plan) {
 
   OpenCL opencl;
-  opencl.setup(CL_DEVICE_TYPE_GPU);
+  opencl.setup(CL_DEVICE_TYPE_GPU, half_storage);
 
   std::cout<<"Loading fashion-mnist data...";
   MNIST dataset("./data/");
@@ -17,8 +20,26 @@ void inference_only(int batch_size) {
   Network dnn = createNetwork_OpenCL(&opencl);
   std::cout<<"Done"<<std::endl;
 
+  if (use_plan) {
+    // Tuned once per batch size and storage format, then reused; the
+    // plan records the device and is re-tuned on any other
+    std::string plan_file = "./build/plan-" + std::to_string(batch_size)
+                            + (half_storage ? "-half" : "") + ".txt";
+    ExecutionPlan plan;
+    bool reused = plan.prepare(plan_file, dnn, dataset.test_data,
+                               opencl.device->name);
+    std::cout<<(reused ? "Reused " : "Tuned and saved ")<<plan_file<<std::endl;
+    plan.print();
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
   dnn.forward(dataset.test_data);
-  float acc = compute_accuracy(dnn.output(), dataset.test_labels);
+  // Only the predicted classes and the hit count come back to the host
+  std::vector<int> pred;
+  float acc = float(dnn.classify(dataset.test_labels, pred)) / pred.size();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<float, std::milli> duration = (end-start);
+  std::cout<<"Forward + classify: "<<duration.count()<<" ms"<<std::endl;
   std::cout<<std::endl;
   std::cout<<"Test Accuracy: "<<acc<< std::endl;
   std::cout<<std::endl;
@@ -26,16 +47,58 @@ void inference_only(int batch_size) {
   opencl.teardown();
 }
 
+// Compare the device backward pass against finite differences
+void check_gradient(int batch_size) {
+
+  OpenCL opencl;
+  opencl.setup(CL_DEVICE_TYPE_GPU);
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(batch_size);
+  std::cout<<"Done"<<std::endl;
+
+  std::cout<<"Loading model...";
+  Network dnn;
+  buildNetwork_OpenCL(dnn, &opencl, true);
+  std::cout<<"Done"<<std::endl;
+
+  // Pixels are 0..255; scale them so the loss is not saturated
+  Matrix input = dataset.test_data / 255.0f;
+  dnn.check_gradient(input, one_hot_encode(dataset.test_labels, 10), 20, 1);
+
+  opencl.teardown();
+}
+
 int main(int argc, char* argv[]) {
 
   int batch_size = 10000;
-  
-  if(argc == 2){
+  bool half_storage = false;
+  bool use_plan = false;
+
+  if(argc >= 2){
     batch_size = atoi(argv[1]);
   }
+  for(int i = 2; i < argc; i++){
+    std::string option(argv[i]);
+    // ./m2 <batch> half: keep device tensors and weights in fp16
+    if(option == "half"){
+      half_storage = true;
+    }
+    // ./m2 <batch> plan: run with a tuned execution plan (src/plan.h)
+    if(option == "plan"){
+      use_plan = true;
+    }
+    // ./m2 <batch> check: gradient check of the device backward pass
+    if(option == "check"){
+      check_gradient(batch_size);
+      return 0;
+    }
+  }
 
   std::cout<<"Test batch size: "<<batch_size<<std::endl;
-  inference_only(batch_size);
+  std::cout<<"Device storage: "<<(half_storage ? "fp16" : "fp32")<<std::endl;
+  inference_only(batch_size, half_storage, use_plan);
 
   return 0;
 }
@@ -0,0 +1,52 @@
+#include "ece408net.h"
+
+#include <chrono>
+
+#include "src/data_parallel.h"
+
+void inference_all_devices(int batch_size, int micro_batch, bool half_storage) {
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(batch_size);
+  std::cout<<"Done"<<std::endl;
+
+  std::cout<<"Loading model on every OpenCL device..."<<std::endl;
+  DataParallel dp(buildNetwork_OpenCL, half_storage);
+  std::cout<<"Done ("<<dp.n_device()<<" devices)"<<std::endl;
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int correct = dp.classify(dataset.test_data, dataset.test_labels, micro_batch);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  dp.print_report();
+  std::chrono::duration<float, std::milli> duration = (end_time-start_time);
+  std::cout<<"Wall Time: " << duration.count() << " ms"<<std::endl;
+  std::cout<<std::endl;
+  std::cout<<"Test Accuracy: "<<float(correct) / dataset.test_data.cols()<< std::endl;
+  std::cout<<std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+  int batch_size = 10000;
+  int micro_batch = 1000;
+  bool half_storage = false;
+
+  // ./multi <batch> <micro batch per device> [half]
+  if(argc >= 2){
+    batch_size = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    micro_batch = atoi(argv[2]);
+  }
+  if(argc >= 4 && std::string(argv[3]) == "half"){
+    half_storage = true;
+  }
+
+  std::cout<<"Test batch size: "<<batch_size<<std::endl;
+  std::cout<<"Micro-batch per device: "<<micro_batch<<std::endl;
+  inference_all_devices(batch_size, micro_batch, half_storage);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "ece408net.h"
+
+#include <chrono>
+#include <iomanip>
+
+#include "device.h"
+#include "src/layer/custom/opencl.h"
+#include "src/layer/custom/command-graph.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static float elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+// Host overhead per request: eager Network::forward against a recorded
+// CommandGraph, for batches of 1, 2, 4, ... max_batch images
+void compare(int max_batch, int iterations) {
+
+  OpenCL opencl;
+  opencl.setup(CL_DEVICE_TYPE_GPU);
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(max_batch);
+  std::cout<<"Done"<<std::endl;
+
+  std::cout<<"Loading model...";
+  Network dnn;
+  buildNetwork_OpenCL(dnn, &opencl);
+  std::cout<<"Done"<<std::endl;
+
+  std::cout<<std::endl;
+  std::cout<<std::setw(6)<<"batch"<<std::setw(12)<<"eager ms"
+           <<std::setw(12)<<"replay ms"<<std::setw(10)<<"speedup"
+           <<std::setw(13)<<"enqueue us"<<std::setw(7)<<"nodes"
+           <<std::setw(12)<<"max diff"<<std::endl;
+
+  for (int batch = 1; batch <= max_batch; batch *= 2) {
+    const Matrix x = dataset.test_data.leftCols(batch);
+
+    // Eager: every forward sets every argument and blocks between layers.
+    // The layers' per-call logging is part of that cost but not of the
+    // table, so it is muted.
+    std::streambuf* saved = std::cout.rdbuf(NULL);
+    dnn.forward(x);
+    dnn.output();
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+      dnn.forward(x);
+      dnn.output();
+    }
+    const float eager_ms = elapsed_ms(start) / iterations;
+    std::cout.rdbuf(saved);
+    std::cout.clear();
+    const Matrix expect = dnn.output();
+
+    CommandGraph graph(&opencl);
+    if (!graph.record(dnn, x.rows(), batch)) {
+      std::cerr<<"Network has layers without a device implementation"<<std::endl;
+      exit(EXIT_FAILURE);
+    }
+    Matrix y(expect.rows(), batch);
+    graph.run(x.data(), y.data());
+    start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+      graph.run(x.data(), y.data());
+    }
+    const float replay_ms = elapsed_ms(start) / iterations;
+
+    // Enqueue cost alone, with caller-owned buffers swapped in
+    cl_int err;
+    cl_mem x_d = clCreateBuffer(opencl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                x.size() * sizeof(float), (void*)x.data(), &err);
+    cl_mem y_d = clCreateBuffer(opencl.context, CL_MEM_WRITE_ONLY,
+                                y.size() * sizeof(float), NULL, &err);
+    float enqueue_ms = 0;
+    for (int i = 0; i < iterations; i++) {
+      start = Clock::now();
+      cl_event finished = graph.replay(x_d, y_d);
+      enqueue_ms += elapsed_ms(start);
+      clWaitForEvents(1, &finished);
+    }
+    clReleaseMemObject(x_d);
+    clReleaseMemObject(y_d);
+
+    std::cout<<std::setw(6)<<batch<<std::fixed<<std::setprecision(3)
+             <<std::setw(12)<<eager_ms<<std::setw(12)<<replay_ms
+             <<std::setprecision(2)<<std::setw(9)<<eager_ms / replay_ms<<"x"
+             <<std::setprecision(1)<<std::setw(13)<<1000 * enqueue_ms / iterations
+             <<std::setw(7)<<graph.n_nodes()<<std::defaultfloat
+             <<std::setw(12)<<(y - expect).cwiseAbs().maxCoeff()<<std::endl;
+  }
+
+  CommandGraph probe(&opencl);
+  std::cout<<std::endl<<"Graph queue: "
+           <<(probe.out_of_order ? "out-of-order" : "in-order (device has no out-of-order queues)")
+           <<std::endl;
+
+  opencl.teardown();
+}
+
+int main(int argc, char* argv[]) {
+
+  int max_batch = 32;
+  int iterations = 200;
+
+  // ./replay [max batch] [iterations]
+  if(argc >= 2){
+    max_batch = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    iterations = atoi(argv[2]);
+  }
+
+  compare(max_batch, iterations);
+
+  return 0;
+}
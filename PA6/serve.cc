@@ -0,0 +1,139 @@
+#include "ece408net.h"
+
+#include <stdio.h>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "device.h"
+#include "src/layer/custom/opencl.h"
+#include "src/server.h"
+
+// Framing on stdin/stdout, native byte order:
+//   request   uint32 id, then IMAGE_DIM uint8 pixels
+//   response  uint32 id, int32 label, float32 confidence
+static const int IMAGE_DIM = 86 * 86;
+
+struct WireResponse {
+  uint32_t id;
+  int32_t label;
+  float confidence;
+};
+
+// Serve framed requests from stdin until EOF
+void serve_stdin(int max_batch, float deadline_ms) {
+
+  // Responses own stdout; everything else that prints (device selection,
+  // layers) goes to stderr
+  FILE* responses = fdopen(dup(fileno(stdout)), "wb");
+  dup2(fileno(stderr), fileno(stdout));
+  std::cout.rdbuf(std::cerr.rdbuf());
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(responses), _O_BINARY);
+#endif
+
+  OpenCL opencl;
+  opencl.setup(CL_DEVICE_TYPE_CPU);
+  Network dnn;
+  buildNetwork_OpenCL(dnn, &opencl);
+  InferenceServer server(dnn, &opencl, IMAGE_DIM, max_batch, deadline_ms);
+  std::cerr<<"Ready: max batch "<<max_batch<<", deadline "<<deadline_ms
+           <<" ms"<<std::endl;
+
+  std::thread reader([&server] {
+    uint32_t id;
+    std::vector<unsigned char> pixels(IMAGE_DIM);
+    std::vector<float> input(IMAGE_DIM);
+    while (fread(&id, sizeof(id), 1, stdin) == 1
+           && fread(pixels.data(), 1, IMAGE_DIM, stdin) == IMAGE_DIM) {
+      std::copy(pixels.begin(), pixels.end(), input.begin());
+      server.submit(id, input.data());
+    }
+    server.close();
+  });
+
+  server.run([responses](const InferenceServer::Response& r) {
+               WireResponse wire = {r.id, r.label, r.confidence};
+               fwrite(&wire, sizeof(wire), 1, responses);
+             },
+             [responses] { fflush(responses); });
+  reader.join();
+  fclose(responses);
+
+  server.print_report(std::cerr);
+  opencl.teardown();
+}
+
+// Replay the test set as Poisson arrivals at rate requests/s, in process
+void serve_bench(int n_request, float rate, int max_batch, float deadline_ms) {
+
+  OpenCL opencl;
+  opencl.setup(CL_DEVICE_TYPE_CPU);
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_test_data(n_request);
+  std::cout<<"Done"<<std::endl;
+
+  Network dnn;
+  buildNetwork_OpenCL(dnn, &opencl);
+  InferenceServer server(dnn, &opencl, IMAGE_DIM, max_batch, deadline_ms);
+
+  const int n_image = dataset.test_data.cols();
+  std::thread client([&] {
+    std::mt19937 rng(1);
+    std::exponential_distribution<double> gap(rate);
+    InferenceServer::Clock::time_point next = InferenceServer::Clock::now();
+    for (int i = 0; i < n_request; i++) {
+      std::this_thread::sleep_until(next);
+      server.submit(i, dataset.test_data.col(i % n_image).data());
+      next += std::chrono::microseconds(static_cast<int64_t>(1e6 * gap(rng)));
+    }
+    server.close();
+  });
+
+  int correct = 0;
+  server.run([&](const InferenceServer::Response& r) {
+    if (r.label == int(dataset.test_labels(r.id % n_image)))
+      correct++;
+  });
+  client.join();
+
+  std::cout<<std::endl;
+  std::cout<<"Offered load: "<<rate<<" requests/s, max batch "<<max_batch
+           <<", deadline "<<deadline_ms<<" ms"<<std::endl;
+  server.print_report(std::cout);
+  std::cout<<"Test Accuracy: "<<float(correct) / n_request<<std::endl;
+
+  opencl.teardown();
+}
+
+int main(int argc, char* argv[]) {
+
+  // ./serve bench <requests> <rate/s> [max batch] [deadline ms]
+  if(argc >= 2 && std::string(argv[1]) == "bench"){
+    int n_request = argc >= 3 ? atoi(argv[2]) : 2000;
+    float rate = argc >= 4 ? atof(argv[3]) : 500;
+    int max_batch = argc >= 5 ? atoi(argv[4]) : 32;
+    float deadline_ms = argc >= 6 ? atof(argv[5]) : 10;
+    serve_bench(n_request, rate, max_batch, deadline_ms);
+    return 0;
+  }
+
+  // ./serve [max batch] [deadline ms]: framed requests on stdin
+  int max_batch = argc >= 2 ? atoi(argv[1]) : 32;
+  float deadline_ms = argc >= 3 ? atof(argv[2]) : 10;
+  serve_stdin(max_batch, deadline_ms);
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "./data_parallel.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+const float DataParallel::SMOOTHING = 0.5;
+
+DataParallel::DataParallel(Builder build, bool half_storage) {
+  OclPlatformProp* platforms = NULL;
+  cl_uint num_platforms;
+  if (OclFindPlatforms((const OclPlatformProp**)&platforms, &num_platforms)
+      != CL_SUCCESS)
+    throw std::runtime_error("OclFindPlatforms failed");
+
+  for (cl_uint i = 0; i < num_platforms; i++) {
+    for (cl_uint j = 0; j < platforms[i].num_devices; j++) {
+      Replica* replica = new Replica();
+      replica->opencl.setup_device(i, j, half_storage);
+      // Devices run concurrently; buffer their reports until the join
+      replica->opencl.report = &replica->report;
+      replica->dnn = new Network();
+      build(*replica->dnn, &replica->opencl);
+      replicas.push_back(replica);
+    }
+  }
+  if (replicas.empty())
+    throw std::runtime_error("No OpenCL devices found");
+}
+
+DataParallel::~DataParallel() {
+  for (int i = 0; i < n_device(); i++) {
+    // Layers release their device buffers before the context goes away
+    delete replicas[i]->dnn;
+    replicas[i]->opencl.teardown();
+    delete replicas[i];
+  }
+}
+
+void DataParallel::run(Replica* replica, const Matrix& data,
+                       const Matrix& labels, int offset, int count) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  Matrix x = data.middleCols(offset, count);
+  Matrix y = labels.middleCols(offset, count);
+  std::vector<int> pred;
+  replica->dnn->forward(x);
+  const int correct = replica->dnn->classify(y, pred);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  const double seconds =
+      std::chrono::duration<double>(end_time - start_time).count();
+  const float throughput = count / seconds;
+  replica->throughput = replica->samples == 0 ? throughput
+      : SMOOTHING * throughput + (1 - SMOOTHING) * replica->throughput;
+  replica->samples += count;
+  replica->correct += correct;
+  replica->seconds += seconds;
+}
+
+int DataParallel::classify(const Matrix& data, const Matrix& labels,
+                           int micro_batch) {
+  if (micro_batch < 1)
+    throw std::invalid_argument("Micro-batch size must be positive");
+  const int n_sample = data.cols();
+  const int n_dev = n_device();
+  std::vector<int> count(n_dev), offset(n_dev);
+  int correct_before = 0;
+  for (int i = 0; i < n_dev; i++)
+    correct_before += replicas[i]->correct;
+
+  for (int start = 0; start < n_sample; ) {
+    const int round = std::min(n_sample - start, micro_batch * n_dev);
+    // Even split until every device has been timed once
+    bool timed = true;
+    float total = 0;
+    for (int i = 0; i < n_dev; i++) {
+      timed = timed && replicas[i]->samples > 0;
+      total += replicas[i]->throughput;
+    }
+    int assigned = 0;
+    for (int i = 0; i < n_dev; i++) {
+      const float share = timed ? replicas[i]->throughput / total
+                                : 1.0f / n_dev;
+      count[i] = i == n_dev - 1 ? round - assigned
+          : std::min(round - assigned, int(round * share + 0.5f));
+      offset[i] = start + assigned;
+      assigned += count[i];
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < n_dev; i++) {
+      if (count[i] > 0)
+        workers.push_back(std::thread(run, replicas[i], std::cref(data),
+                                      std::cref(labels), offset[i], count[i]));
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+      workers[i].join();
+    for (int i = 0; i < n_dev; i++) {
+      if (count[i] == 0)
+        continue;
+      std::cout << "Device " << i << ":" << std::endl
+                << replicas[i]->report.str();
+      replicas[i]->report.str("");
+    }
+    start += round;
+  }
+
+  int correct = -correct_before;
+  for (int i = 0; i < n_dev; i++)
+    correct += replicas[i]->correct;
+  return correct;
+}
+
+void DataParallel::print_report() const {
+  int samples = 0;
+  int correct = 0;
+  std::cout << std::endl;
+  for (int i = 0; i < n_device(); i++) {
+    const Replica* r = replicas[i];
+    std::cout << "Device " << i << ": " << r->opencl.device->name
+              << std::endl << "    samples " << r->samples
+              << ", busy " << std::fixed << std::setprecision(2)
+              << r->seconds * 1000 << " ms, "
+              << r->throughput << " samples/s, accuracy "
+              << std::setprecision(4)
+              << (r->samples ? float(r->correct) / r->samples : 0.0f)
+              << std::defaultfloat << std::endl;
+    samples += r->samples;
+    correct += r->correct;
+  }
+  std::cout << "Aggregate: " << samples << " samples, accuracy "
+            << (samples ? float(correct) / samples : 0.0f) << std::endl;
+}
@@ -0,0 +1,48 @@
+#ifndef SRC_DATA_PARALLEL_H_
+#define SRC_DATA_PARALLEL_H_
+
+#include <sstream>
+#include <vector>
+#include "./network.h"
+#include "./layer/custom/opencl.h"
+
+// Data-parallel inference over every OpenCL device in the system. Each
+// device has its own context, queue and copy of the network. A batch is
+// processed in rounds: the first round splits evenly, later rounds split in
+// proportion to the throughput each device has shown so far.
+class DataParallel {
+ public:
+  typedef void (*Builder)(Network& dnn, OpenCL* opencl);
+
+  explicit DataParallel(Builder build, bool half_storage = false);
+  ~DataParallel();
+
+  int n_device() const { return replicas.size(); }
+  /// Classify the columns of data in rounds of micro_batch samples per
+  /// device; returns the number of correct predictions
+  int classify(const Matrix& data, const Matrix& labels, int micro_batch);
+  /// Per-device samples, time, throughput and accuracy
+  void print_report() const;
+
+ private:
+  struct Replica {
+    OpenCL opencl;
+    Network* dnn;
+    float throughput;  // samples/s, exponential moving average
+    int samples;
+    int correct;
+    double seconds;
+    std::ostringstream report;  // layer timings of the current round
+  };
+  std::vector<Replica*> replicas;
+
+  static const float SMOOTHING;  // weight of the newest throughput sample
+
+  static void run(Replica* replica, const Matrix& data, const Matrix& labels,
+                  int offset, int count);
+
+  DataParallel(const DataParallel&);
+  DataParallel& operator=(const DataParallel&);
+};
+
+#endif  // SRC_DATA_PARALLEL_H_
@@ -0,0 +1,100 @@
+#include "./grad_check.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+GradientChecker::GradientChecker(const std::vector<Network*>& clones,
+                                 float eps) : clones(clones), eps(eps) {
+  if (clones.empty())
+    throw std::invalid_argument("Need at least one network");
+}
+
+void GradientChecker::worker(int thread, const Matrix& input,
+                             const Matrix& target, std::vector<Point>* points,
+                             std::atomic<int>* next) {
+  Network& dnn = *clones[thread];
+  for (int i = (*next)++; i < static_cast<int>(points->size());
+       i = (*next)++) {
+    Point& pt = (*points)[i];
+    // A fresh view for every write lets device layers drop stale copies
+    const float old = *dnn.parameter_view(pt.layer, pt.index);
+    *dnn.parameter_view(pt.layer, pt.index) = old - eps;
+    const float loss_pre = dnn.evaluate_loss(input, target);
+    *dnn.parameter_view(pt.layer, pt.index) = old + eps;
+    const float loss_post = dnn.evaluate_loss(input, target);
+    *dnn.parameter_view(pt.layer, pt.index) = old;
+
+    pt.numeric = (loss_post - loss_pre) / (2 * eps);
+    const float denom = std::fabs(pt.analytic) + std::fabs(pt.numeric);
+    pt.rel_error = denom > 0 ? std::fabs(pt.analytic - pt.numeric) / denom : 0;
+  }
+}
+
+std::vector<GradientChecker::Point> GradientChecker::run(
+    const Matrix& input, const Matrix& target, int n_points, int seed) {
+  // Analytic gradient, and the same parameters in every clone
+  clones[0]->forward(input);
+  clones[0]->backward(input, target);
+  const std::vector< std::vector<float> > deriv = clones[0]->get_derivatives();
+  const std::vector< std::vector<float> > param = clones[0]->get_parameters();
+  for (size_t t = 1; t < clones.size(); t++)
+    clones[t]->set_parameters(param);
+
+  std::vector<int> trainable;
+  for (size_t i = 0; i < deriv.size(); i++) {
+    if (!deriv[i].empty())
+      trainable.push_back(i);
+  }
+  if (trainable.empty())
+    throw std::invalid_argument("Network has no parameters");
+
+  std::mt19937 rng(seed);
+  std::vector<Point> points(n_points);
+  for (int i = 0; i < n_points; i++) {
+    Point& pt = points[i];
+    pt.layer = trainable[rng() % trainable.size()];
+    pt.index = rng() % deriv[pt.layer].size();
+    pt.analytic = deriv[pt.layer][pt.index];
+  }
+
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < clones.size(); t++)
+    workers.push_back(std::thread(&GradientChecker::worker, this, t,
+                                  std::cref(input), std::cref(target), &points,
+                                  &next));
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+  return points;
+}
+
+void GradientChecker::report(const std::vector<Point>& points) {
+  std::map<int, std::vector<float> > by_layer;
+  for (size_t i = 0; i < points.size(); i++)
+    by_layer[points[i].layer].push_back(points[i].rel_error);
+
+  // Histogram buckets by decade of relative error
+  const float edges[] = {1e-6, 1e-4, 1e-2, 1};
+  const int n_edge = sizeof(edges) / sizeof(edges[0]);
+
+  printf("layer  points    median       p90       max  |  <1e-6 <1e-4 <1e-2   <1   >=1\n");
+  for (std::map<int, std::vector<float> >::iterator it = by_layer.begin();
+       it != by_layer.end(); ++it) {
+    std::vector<float>& err = it->second;
+    std::sort(err.begin(), err.end());
+    const int n = err.size();
+    int bucket[n_edge + 1] = {0};
+    for (int i = 0; i < n; i++)
+      bucket[std::upper_bound(edges, edges + n_edge, err[i]) - edges]++;
+    printf("%5d  %6d  %8.2e  %8.2e  %8.2e  | ", it->first, n,
+           err[n / 2], err[std::min(n - 1, n * 9 / 10)], err[n - 1]);
+    for (int b = 0; b <= n_edge; b++)
+      printf(" %5d", bucket[b]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef SRC_GRAD_CHECK_H_
+#define SRC_GRAD_CHECK_H_
+
+#include <atomic>
+#include <vector>
+#include "./network.h"
+
+// Central-difference gradient checking, one scalar parameter at a time, with
+// the points shared out across worker threads. The caller supplies
+// identically built networks ("clones"), one per worker thread.
+// clones[0] provides the analytic gradient with a single backward pass.
+// After that, every point only perturbs one parameter in place through a
+// Layer::parameter_view and runs two forward passes on one of the clones;
+// there is no backward pass and no parameter vectors are copied.
+class GradientChecker {
+ public:
+  struct Point {
+    int layer;
+    int index;
+    float analytic;
+    float numeric;
+    float rel_error;  // |a - n| / (|a| + |n|), 0 when both are 0
+  };
+
+  explicit GradientChecker(const std::vector<Network*>& clones,
+                           float eps = 1e-3);
+
+  /// Check n_points random parameters (a random layer with parameters,
+  /// then a random parameter in it, like Network::check_gradient)
+  std::vector<Point> run(const Matrix& input, const Matrix& target,
+                         int n_points, int seed = 1);
+  /// Per-layer relative error distribution: quantiles and a histogram
+  static void report(const std::vector<Point>& points);
+
+ private:
+  std::vector<Network*> clones;
+  float eps;
+
+  void worker(int thread, const Matrix& input, const Matrix& target,
+              std::vector<Point>* points, std::atomic<int>* next);
+};
+
+#endif  // SRC_GRAD_CHECK_H_
@@ -2,29 +2,84 @@
 #define SRC_LAYER_H_
 
 #include "Eigen/Core"
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include "./utils.h"
 #include "./optimizer.h"
 
+class CommandGraph;
+
 class Layer {
  protected:
   Matrix top;  // layer output
   Matrix grad_bottom;  // gradient w.r.t input
 
+  /// infer_output_dim for layers with a fixed input size
+  static int check_input_dim(int input_dim, int dim_in, int dim_out) {
+    if (input_dim != dim_in)
+      throw std::invalid_argument("Input size does not match");
+    return dim_out;
+  }
+
  public:
   virtual ~Layer() {}
 
   virtual void forward(const Matrix& bottom) = 0;
   virtual void backward(const Matrix& bottom, const Matrix& grad_top) = 0;
+  /// Forward from the previous layer; device layers override this to
+  /// consume prev's device-resident output without a host round trip
+  virtual void forward_from(Layer* prev) { forward(prev->output()); }
   virtual void update(Optimizer& opt) {}
   virtual const Matrix& output() { return top; }
   virtual const Matrix& back_gradient() { return grad_bottom; }
   virtual int output_dim() { return -1; }
+  /// Short type name, used to identify the layer in execution plans
+  virtual const char* name() const { return "layer"; }
+  /// Output size for an input of input_dim rows; throws if the layer cannot
+  /// take it. Element-wise layers keep the size.
+  virtual int infer_output_dim(int input_dim) {
+    return output_dim() < 0 ? input_dim : output_dim();
+  }
+  /// Allocate the output (and any device buffers) for batches of n_sample
+  /// ahead of the first forward
+  virtual void reserve(int top_dim, int n_sample) {
+    top.resize(top_dim, n_sample);
+  }
+  /// Interchangeable implementations of forward; index 0 is the default
+  virtual std::vector<std::string> algorithms() {
+    return std::vector<std::string>(1, "cpu");
+  }
+  virtual void set_algorithm(int index) {}
+  /// Append this layer's device kernels to graph, reading slot bottom and
+  /// writing slot top of top_dim x n_sample floats (see CommandGraph);
+  /// false if it has none
+  virtual bool record(CommandGraph& graph, int bottom, int top, int top_dim,
+                      int n_sample) {
+    return false;
+  }
+  /// Predicted class of each output column and the number matching labels;
+  /// apply_softmax replaces the outputs with probabilities in place
+  virtual int classify(const Matrix& labels, std::vector<int>& pred,
+                       bool apply_softmax) {
+    output();
+    pred.resize(top.cols());
+    return classify_columns(top.data(), top.rows(), top.cols(), labels.data(),
+                            pred.data(), apply_softmax);
+  }
   virtual std::vector<float> get_parameters() const
           { return std::vector<float>(); }
   virtual std::vector<float> get_derivatives() const
           { return std::vector<float>(); }
   virtual void set_parameters(const std::vector<float>& param) {}
+  /// Pointer to parameter `index` (in get_parameters order) for editing in
+  /// place. Device copies are invalidated by the call, so take a new view
+  /// for each write. NULL if there are no parameters.
+  virtual float* parameter_view(int index) { return NULL; }
+  /// Use externally owned memory (e.g. a mapped weight file) as the
+  /// parameter storage where possible; falls back to a copy
+  virtual void bind_parameters(float* param, int size)
+          { set_parameters(std::vector<float>(param, param + size)); }
 };
 
 #endif  // SRC_LAYER_H_
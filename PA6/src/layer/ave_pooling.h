@@ -32,6 +32,10 @@ class AvePooling : public Layer {
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
   int output_dim() { return dim_out; }
+  const char* name() const { return "avepool"; }
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
 };
 
 #endif  // SRC_LAYER_AVE_POOLING_H_
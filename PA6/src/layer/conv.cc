@@ -1,4 +1,5 @@
 #include "conv.h"
+#include <new>
 #include <math.h>
 #include <iostream>
 
@@ -7,7 +8,9 @@ void Conv::init() {
   width_out =   (1 + (width_in - width_kernel + 2 * pad_w) / stride);
   dim_out = height_out * width_out * channel_out;
 
-  weight.resize(channel_in * height_kernel * width_kernel, channel_out);
+  weight_storage.resize(channel_in * height_kernel * width_kernel, channel_out);
+  new (&weight) Eigen::Map<Matrix>(weight_storage.data(),
+                                   weight_storage.rows(), weight_storage.cols());
   bias.resize(channel_out);
   grad_weight.resize(channel_in * height_kernel * width_kernel, channel_out);
   grad_bias.resize(channel_out);
@@ -139,13 +142,6 @@ std::vector<float> Conv::get_parameters() const {
   return res;
 }
 
-void Conv::set_parameters(const std::vector<float>& param) {
-  if(static_cast<int>(param.size()) != weight.size() + bias.size())
-      throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
-}
-
 std::vector<float> Conv::get_derivatives() const {
   std::vector<float> res(grad_weight.size() + grad_bias.size());
   // Copy the data of weights and bias to a long vector
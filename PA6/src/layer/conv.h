@@ -2,9 +2,9 @@
 #define SRC_LAYER_CONV_H_
 
 #include <vector>
-#include "../layer.h"
+#include "./weight_bias.h"
 
-class Conv: public Layer {
+class Conv: public WeightBiasLayer {
  private:
   const int dim_in;
   int dim_out;
@@ -22,8 +22,6 @@ class Conv: public Layer {
   int height_out;
   int width_out;
 
-  Matrix weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
-  Vector bias;  // bias param, size = channel_out
   Matrix grad_weight;  // gradient w.r.t weight
   Vector grad_bias;  // gradient w.r.t bias
 
@@ -47,9 +45,12 @@ class Conv: public Layer {
   void im2col(const Vector& image, Matrix& data_col);
   void col2im(const Matrix& data_col, Vector& image);
   int output_dim() { return dim_out; }
+  const char* name() const { return "conv"; }
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
-  void set_parameters(const std::vector<float>& param);
 };
 
 #endif  // SRC_LAYER_CONV_H_
@@ -1,13 +1,22 @@
 #include "conv_cust.h"
+#include <new>
 #include <math.h>
 #include <iostream>
+#include <stdexcept>
+#include "../optimizer/sgd.h"
+#include "./custom/command-graph.h"
+
+#define TILE_WIDTH 16
+#define KERNEL_SZ 7  // largest kernel conv_forward_kernel_tiled can stage
 
 void Conv_Custom::init() {
   height_out = (1 + (height_in - height_kernel + 2 * pad_h) / stride);
   width_out =   (1 + (width_in - width_kernel + 2 * pad_w) / stride);
   dim_out = height_out * width_out * channel_out;
 
-  weight.resize(channel_in * height_kernel * width_kernel, channel_out);
+  weight_storage.resize(channel_in * height_kernel * width_kernel, channel_out);
+  new (&weight) Eigen::Map<Matrix>(weight_storage.data(),
+                                   weight_storage.rows(), weight_storage.cols());
   bias.resize(channel_out);
   grad_weight.resize(channel_in * height_kernel * width_kernel, channel_out);
   grad_bias.resize(channel_out);
@@ -23,53 +32,263 @@ void Conv_Custom::forward(const Matrix& bottom) {
   top.resize(height_out * width_out * channel_out, n_sample);
   float *x = (float*)bottom.data();
   float *y = (float*)top.data();
-  float *k = (float*)weight.data();
-  float *b = (float*)bias.data();
 
   const int B = n_sample;
   const int M = channel_out;
   const int C = channel_in;
   const int K = height_kernel; // Assuming width_kernel is also K
 
-  cl_mem x_d;
-  cl_mem y_d;
-  cl_mem k_d;
-
-  std::cout<<"Conv-OpenCL=="<<std::endl;
+  *opencl->report<<"Conv-OpenCL=="<<std::endl;
 
   openclInterface.opencl = opencl;
   
   // Start layer timer
   auto start_time_layer = std::chrono::high_resolution_clock::now();
+  // Weights stay resident on the device after the first forward
+  const bool weights_uploaded = (weight_d == NULL);
+  if (weights_uploaded)
+    upload_weights();
+  if (io_cols != B)
+    resize_io_buffers(B);
   // Data transfer CPU to GPU
-  openclInterface.conv_forward_opencl_prolog(y, x, k, &y_d, &x_d, &k_d, B, M, C, height_in, width_in, K);
+  openclInterface.conv_forward_opencl_prolog(y, x, &y_d, &x_d, B, M, C, height_in, width_in, K);
+  x_d_current = true;
   
   // Start kernel timer
   auto start_time_kernel = std::chrono::high_resolution_clock::now();
   // Hand off to GPU for computation
-  openclInterface.conv_forward_opencl(y_d, x_d, k_d, B, M, C, height_in, width_in, K);
+  openclInterface.conv_forward_opencl(y_d, x_d, weight_d, B, M, C, height_in, width_in, K, tiled);
+  if (use_bias)
+    openclInterface.conv_bias_opencl(y_d, bias_d, B, M, height_out * width_out);
   // Stop kernel timer
   auto end_time_kernel = std::chrono::high_resolution_clock::now();
   
   // Data transfer GPU to CPU
-  openclInterface.conv_forward_opencl_epilog(y, y_d, x_d, k_d, B, M, C, height_in, width_in, K);
+  openclInterface.conv_forward_opencl_epilog(y, y_d, x_d, B, M, C, height_in, width_in, K);
 
   // Stop layer timer
   auto end_time_layer = std::chrono::high_resolution_clock::now();
 
   std::chrono::duration<float, std::milli> duration_layer = (end_time_layer-start_time_layer);
-  std::cout<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
+  *opencl->report<<"Layer Time: " << duration_layer.count() << " ms"<<std::endl;
   
   std::chrono::duration<float, std::milli> duration_kernel = (end_time_kernel-start_time_kernel);
-  std::cout<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
+  *opencl->report<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
+
+  // Host<->device traffic in the device storage format (fp32 or fp16)
+  const float transfer_mb = float(bottom.size() + top.size()
+                                  + (weights_uploaded ? weight.size() : 0))
+                            * opencl->element_size() / (1024 * 1024);
+  const float transfer_ms = duration_layer.count() - duration_kernel.count();
+  *opencl->report<<"Transfer: " << transfer_mb << " MB ("
+                 << (opencl->half_storage ? "fp16" : "fp32") << "), "
+                 << transfer_mb / 1024 / (transfer_ms / 1000) << " GB/s"<<std::endl;
+}
+
+Conv_Custom::~Conv_Custom() {
+  release_device_weights();
+  cl_mem buffers[6] = {grad_weight_d, grad_bias_d, velocity_weight_d,
+                       velocity_bias_d, x_d, y_d};
+  for (int i = 0; i < 6; i++) {
+    if (buffers[i])
+      clReleaseMemObject(buffers[i]);
+  }
+}
+
+// (Re)allocate x_d/y_d for batches of n_sample
+void Conv_Custom::resize_io_buffers(int n_sample) {
+  if (x_d) {
+    clReleaseMemObject(x_d);
+    clReleaseMemObject(y_d);
+    x_d = NULL;
+    y_d = NULL;
+  }
+  x_d_current = false;
+  openclInterface.opencl = opencl;
+  openclInterface.conv_forward_opencl_prolog(NULL, NULL, &y_d, &x_d, n_sample,
+                                             channel_out, channel_in,
+                                             height_in, width_in,
+                                             height_kernel);
+  io_cols = n_sample;
+}
+
+void Conv_Custom::reserve(int top_dim, int n_sample) {
+  Layer::reserve(top_dim, n_sample);
+  if (io_cols != n_sample)
+    resize_io_buffers(n_sample);
+}
+
+std::vector<std::string> Conv_Custom::algorithms() {
+  std::vector<std::string> res(1, "opencl-direct");
+  // The tiled kernel has no fp16 variant and a fixed-size local tile
+  if (!(opencl && opencl->half_storage) && height_kernel <= KERNEL_SZ)
+    res.push_back("opencl-tiled");
+  return res;
+}
+
+void Conv_Custom::set_algorithm(int index) {
+  if (index < 0 || index >= static_cast<int>(algorithms().size()))
+    throw std::out_of_range("Algorithm index out of range");
+  tiled = (index == 1);
+}
+
+void Conv_Custom::upload_weights() {
+  if (use_bias && opencl->half_storage)
+    throw std::runtime_error("Conv_Custom bias needs fp32 device storage");
+  openclInterface.conv_weights_opencl(weight.data(), &weight_d, channel_out,
+                                      channel_in, height_kernel);
+  if (use_bias)
+    bias_d = openclInterface.create_buffer_opencl(bias.data(), channel_out);
+}
+
+// Drop the device copy so the next forward uploads the current weights
+void Conv_Custom::release_device_weights() {
+  if (weight_d) {
+    clReleaseMemObject(weight_d);
+    weight_d = NULL;
+  }
+  if (bias_d) {
+    clReleaseMemObject(bias_d);
+    bias_d = NULL;
+  }
+}
+
+// Same launches as conv_forward_opencl and conv_bias_opencl
+bool Conv_Custom::record(CommandGraph& graph, int bottom, int top, int top_dim,
+                         int n_sample) {
+  // The graph's other kernels work on fp32
+  if (opencl->half_storage)
+    return false;
+  // Replays read the graph's slots, so x_d stops tracking the input
+  x_d_current = false;
+  openclInterface.opencl = opencl;
+  if (weight_d == NULL)
+    upload_weights();
+
+  const int B = n_sample;
+  const int M = channel_out;
+  const int C = channel_in;
+  const int K = height_kernel;
+  const size_t local_size[3] = {TILE_WIDTH, TILE_WIDTH, 1};
+  const size_t global_size[3] = {
+      (size_t)((width_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+      (size_t)((height_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+      (size_t)B * M};
+  int node = graph.add_kernel(tiled ? "conv_forward_kernel_tiled"
+                                    : "conv_forward_kernel",
+                              3, global_size, local_size);
+  graph.arg_slot(node, 0, top, true);
+  graph.arg_slot(node, 1, bottom, false);
+  graph.arg_mem(node, 2, weight_d);
+  graph.arg_value(node, 3, sizeof(int), &B);
+  graph.arg_value(node, 4, sizeof(int), &M);
+  graph.arg_value(node, 5, sizeof(int), &C);
+  graph.arg_value(node, 6, sizeof(int), &height_in);
+  graph.arg_value(node, 7, sizeof(int), &width_in);
+  graph.arg_value(node, 8, sizeof(int), &K);
+
+  if (use_bias) {
+    const int HW = height_out * width_out;
+    const size_t bias_local[1] = {TILE_WIDTH * TILE_WIDTH};
+    const size_t bias_global[1] = {
+        ((size_t)B * M * HW + bias_local[0] - 1) / bias_local[0]
+        * bias_local[0]};
+    node = graph.add_kernel("conv_bias_kernel", 1, bias_global, bias_local);
+    graph.arg_slot(node, 0, top, true);
+    graph.arg_mem(node, 1, bias_d);
+    graph.arg_value(node, 2, sizeof(int), &B);
+    graph.arg_value(node, 3, sizeof(int), &M);
+    graph.arg_value(node, 4, sizeof(int), &HW);
+  }
+  return true;
 }
 
 void Conv_Custom::backward(const Matrix& bottom, const Matrix& grad_top) {
+  if (opencl->half_storage)
+    throw std::runtime_error("Conv_Custom backward needs fp32 device storage");
+  const int B = bottom.cols();
+  const int M = channel_out;
+  const int C = channel_in;
+  const int K = height_kernel;
+
+  openclInterface.opencl = opencl;
+  if (weight_d == NULL)
+    upload_weights();
+  if (grad_weight_d == NULL) {
+    grad_weight_d = openclInterface.create_buffer_opencl(NULL, weight.size());
+    grad_bias_d = openclInterface.create_buffer_opencl(NULL, bias.size());
+  }
+  // backward gets the bottom of the last forward, which forward left in
+  // x_d; upload it again only if x_d no longer holds it
+  cl_mem bottom_d = x_d;
+  if (!x_d_current || io_cols != B)
+    bottom_d = openclInterface.create_buffer_opencl(bottom.data(),
+                                                    bottom.size());
+  cl_mem dy_d = openclInterface.create_buffer_opencl(grad_top.data(),
+                                                     grad_top.size());
+  cl_mem dx_d = openclInterface.create_buffer_opencl(NULL, bottom.size());
+
+  openclInterface.conv_backward_opencl(dx_d, grad_weight_d, grad_bias_d, dy_d,
+                                       bottom_d, weight_d, B, M, C, height_in,
+                                       width_in, K);
 
+  // The rest of the network (and get_derivatives) works on the host
+  grad_bottom.resize(dim_in, B);
+  openclInterface.read_buffer_opencl(grad_bottom.data(), dx_d,
+                                     grad_bottom.size());
+  openclInterface.read_buffer_opencl(grad_weight.data(), grad_weight_d,
+                                     grad_weight.size());
+  if (use_bias)
+    openclInterface.read_buffer_opencl(grad_bias.data(), grad_bias_d,
+                                       grad_bias.size());
+  else
+    grad_bias.setZero();  // the bias does not take part in forward
+
+  if (bottom_d != x_d)
+    clReleaseMemObject(bottom_d);
+  clReleaseMemObject(dy_d);
+  clReleaseMemObject(dx_d);
 }
 
 void Conv_Custom::update(Optimizer& opt) {
+  SGD* sgd = dynamic_cast<SGD*>(&opt);
+  if (sgd == NULL || weight_d == NULL || grad_weight_d == NULL) {
+    // Other optimizers run on the host, like Conv::update
+    Vector::AlignedMapType weight_vec(weight.data(), weight.size());
+    Vector::AlignedMapType bias_vec(bias.data(), bias.size());
+    Vector::ConstAlignedMapType grad_weight_vec(grad_weight.data(),
+                                                grad_weight.size());
+    Vector::ConstAlignedMapType grad_bias_vec(grad_bias.data(),
+                                              grad_bias.size());
+    opt.update(weight_vec, grad_weight_vec);
+    opt.update(bias_vec, grad_bias_vec);
+    release_device_weights();
+    return;
+  }
 
+  // SGD runs on the device-resident weights and gradients; the momentum
+  // lives next to them rather than in the optimizer
+  openclInterface.opencl = opencl;
+  if (velocity_weight_d == NULL) {
+    std::vector<float> zeros(std::max(weight.size(), bias.size()), 0.0f);
+    velocity_weight_d = openclInterface.create_buffer_opencl(zeros.data(),
+                                                             weight.size());
+    velocity_bias_d = openclInterface.create_buffer_opencl(zeros.data(),
+                                                           bias.size());
+  }
+  openclInterface.sgd_update_opencl(weight_d, grad_weight_d, velocity_weight_d,
+                                    weight.size(), sgd->learning_rate(),
+                                    sgd->weight_decay(), sgd->get_momentum(),
+                                    sgd->is_nesterov());
+  if (use_bias)
+    openclInterface.sgd_update_opencl(bias_d, grad_bias_d, velocity_bias_d,
+                                      bias.size(), sgd->learning_rate(),
+                                      sgd->weight_decay(), sgd->get_momentum(),
+                                      sgd->is_nesterov());
+  // Keep the host copy in step for get_parameters and saving
+  openclInterface.read_buffer_opencl(weight.data(), weight_d, weight.size());
+  if (use_bias)
+    openclInterface.read_buffer_opencl(bias.data(), bias_d, bias.size());
 }
 
 std::vector<float> Conv_Custom::get_parameters() const {
@@ -80,13 +299,6 @@ std::vector<float> Conv_Custom::get_parameters() const {
   return res;
 }
 
-void Conv_Custom::set_parameters(const std::vector<float>& param) {
-  if(static_cast<int>(param.size()) != weight.size() + bias.size())
-      throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
-}
-
 std::vector<float> Conv_Custom::get_derivatives() const {
   std::vector<float> res(grad_weight.size() + grad_bias.size());
   // Copy the data of weights and bias to a long vector
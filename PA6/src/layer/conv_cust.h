@@ -3,11 +3,11 @@
 
 #include <vector>
 #include <chrono>
-#include "../layer.h"
+#include "./weight_bias.h"
 #include "./custom/opencl-new-forward.h"
 #include "./custom/opencl.h"
 
-class Conv_Custom: public Layer {
+class Conv_Custom: public WeightBiasLayer {
  private:
   const int dim_in;
   int dim_out;
@@ -25,19 +25,35 @@ class Conv_Custom: public Layer {
   int height_out;
   int width_out;
 
-  Matrix weight;  // weight param, size=channel_in*h_kernel*w_kernel*channel_out
-  Vector bias;  // bias param, size = channel_out
   Matrix grad_weight;  // gradient w.r.t weight
   Vector grad_bias;  // gradient w.r.t bias
 
   std::vector<Matrix> data_cols;
 
   OpenCLInterface openclInterface;
+  cl_mem weight_d;  // device copy of weight, uploaded on first forward
+  cl_mem bias_d;  // device copy of bias (use_bias only)
+  cl_mem grad_weight_d;  // gradients of the last backward, kept for update
+  cl_mem grad_bias_d;
+  cl_mem velocity_weight_d;  // SGD momentum for the device update
+  cl_mem velocity_bias_d;
+  cl_mem x_d;  // per-batch input/output buffers, reused while the
+  cl_mem y_d;  // batch size stays at io_cols
+  int io_cols;
+  bool x_d_current;  // x_d holds the bottom of the last forward
+  bool tiled;  // forward with conv_forward_kernel_tiled
 
   void init();
+  void upload_weights();
+  void release_device_weights();
+  void parameters_changed() { release_device_weights(); }
+  void resize_io_buffers(int n_sample);
 
  public:
   OpenCL* opencl;
+  // Add the bias in forward. Off by default: the inference kernel (and the
+  // reference accuracy) leaves it out. Training enables it.
+  bool use_bias;
 
   Conv_Custom(int channel_in, int height_in, int width_in, int channel_out,
        int height_kernel, int width_kernel, int stride = 1, int pad_w = 0,
@@ -45,16 +61,30 @@ class Conv_Custom: public Layer {
        dim_in(channel_in * height_in * width_in),
        channel_in(channel_in), height_in(height_in), width_in(width_in),
        channel_out(channel_out), height_kernel(height_kernel),
-       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h), opencl(0)
+       width_kernel(width_kernel), stride(stride), pad_w(pad_w), pad_h(pad_h),
+       weight_d(NULL), bias_d(NULL),
+       grad_weight_d(NULL), grad_bias_d(NULL), velocity_weight_d(NULL),
+       velocity_bias_d(NULL), x_d(NULL), y_d(NULL), io_cols(0),
+       x_d_current(false), tiled(false),
+       opencl(0), use_bias(false)
   { init(); }
+  ~Conv_Custom();
 
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
   void update(Optimizer& opt);
+  void reserve(int top_dim, int n_sample);
+  std::vector<std::string> algorithms();
+  void set_algorithm(int index);
+  bool record(CommandGraph& graph, int bottom, int top, int top_dim,
+              int n_sample);
   int output_dim() { return dim_out; }
+  const char* name() const { return "conv_opencl"; }
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
-  void set_parameters(const std::vector<float>& param);
 };
 
 #endif  // SRC_LAYER_CONV_CUST_H_
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "command-graph.h"
+#include "../../network.h"
+
+#define CHECK_ERR(err, msg)                           \
+    if (err != CL_SUCCESS)                            \
+    {                                                 \
+        fprintf(stderr, "%s failed: %d\n", msg, err); \
+        exit(EXIT_FAILURE);                           \
+    }
+
+CommandGraph::CommandGraph(OpenCL *opencl)
+    : opencl(opencl), done(nullptr), bound_input(nullptr), bound_output(nullptr),
+      input_d(nullptr), output_d(nullptr), batch(0), n_input(0), n_output(0)
+{
+    cl_int err;
+    cl_device_id device_id = opencl->device->device_id;
+
+    // Out-of-order execution is optional for host queues
+    cl_command_queue_properties supported = 0;
+    err = clGetDeviceInfo(device_id, CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, nullptr);
+    CHECK_ERR(err, "clGetDeviceInfo(CL_DEVICE_QUEUE_PROPERTIES)");
+    out_of_order = (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+
+#ifdef __APPLE__
+    queue = clCreateCommandQueue(opencl->context, device_id, out_of_order ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0, &err);
+#else
+    cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, 0};
+    queue = clCreateCommandQueueWithProperties(opencl->context, device_id, out_of_order ? properties : nullptr, &err);
+#endif
+    CHECK_ERR(err, "clCreateCommandQueueWithProperties");
+}
+
+CommandGraph::~CommandGraph()
+{
+    clFinish(queue);
+    release_events();
+    if (done)
+    {
+        clReleaseEvent(done);
+    }
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        clReleaseKernel(nodes[i].kernel);
+    }
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        clReleaseMemObject(buffers[i]);
+    }
+    for (size_t i = 0; i < retained.size(); i++)
+    {
+        clReleaseMemObject(retained[i]);
+    }
+    if (input_d)
+    {
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(output_d);
+    }
+    clReleaseCommandQueue(queue);
+}
+
+bool CommandGraph::record(Network &dnn, int input_dim, int batch_size)
+{
+    if (!nodes.empty())
+    {
+        fprintf(stderr, "CommandGraph::record: graph already recorded\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int bottom = INPUT;
+    int dim = input_dim;
+    for (int i = 0; i < dnn.n_layers(); i++)
+    {
+        Layer *layer = dnn.layer(i);
+        const int top_dim = layer->infer_output_dim(dim);
+        const bool last = (i + 1 == dnn.n_layers());
+        const int top = last ? OUTPUT : add_buffer((size_t)top_dim * batch_size * sizeof(float));
+        if (!layer->record(*this, bottom, top, top_dim, batch_size))
+        {
+            return false;
+        }
+        bottom = top;
+        dim = top_dim;
+    }
+
+    batch = batch_size;
+    n_input = (size_t)input_dim * batch_size;
+    n_output = (size_t)dim * batch_size;
+
+    cl_int err;
+    input_d = clCreateBuffer(opencl->context, CL_MEM_READ_ONLY, n_input * sizeof(float), nullptr, &err);
+    CHECK_ERR(err, "clCreateBuffer(graph input)");
+    output_d = clCreateBuffer(opencl->context, CL_MEM_WRITE_ONLY, n_output * sizeof(float), nullptr, &err);
+    CHECK_ERR(err, "clCreateBuffer(graph output)");
+    return true;
+}
+
+int CommandGraph::add_buffer(size_t bytes)
+{
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(opencl->context, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+    CHECK_ERR(err, "clCreateBuffer(graph)");
+    buffers.push_back(buffer);
+    return (int)buffers.size() - 1;
+}
+
+int CommandGraph::add_kernel(const char *name, cl_uint work_dim, const size_t *global_size, const size_t *local_size)
+{
+    cl_int err;
+    Node node;
+
+    // A kernel object per node keeps its arguments across replays
+    node.kernel = clCreateKernel(opencl->program, name, &err);
+    CHECK_ERR(err, name);
+    node.work_dim = work_dim;
+    node.has_local = (local_size != nullptr);
+    for (cl_uint d = 0; d < work_dim; d++)
+    {
+        node.global_size[d] = global_size[d];
+        node.local_size[d] = node.has_local ? local_size[d] : 0;
+    }
+    nodes.push_back(node);
+    is_sink.push_back(true);
+    return (int)nodes.size() - 1;
+}
+
+void CommandGraph::add_dep(int node, int dep)
+{
+    if (dep == node)
+    {
+        return;
+    }
+    std::vector<int> &deps = nodes[node].deps;
+    if (std::find(deps.begin(), deps.end(), dep) == deps.end())
+    {
+        deps.push_back(dep);
+        is_sink[dep] = false;
+    }
+}
+
+void CommandGraph::arg_slot(int node, cl_uint index, int slot, bool written)
+{
+    std::map<int, int>::iterator prev = producer.find(slot);
+    if (prev != producer.end())
+    {
+        add_dep(node, prev->second);
+    }
+    if (written)
+    {
+        // Do not overwrite what earlier nodes still have to read
+        std::vector<int> &pending = readers[slot];
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            add_dep(node, pending[i]);
+        }
+        pending.clear();
+        producer[slot] = node;
+    }
+    else
+    {
+        readers[slot].push_back(node);
+    }
+
+    if (slot == INPUT || slot == OUTPUT)
+    {
+        nodes[node].io_args.push_back(std::make_pair(index, slot));
+        return;
+    }
+    cl_int err = clSetKernelArg(nodes[node].kernel, index, sizeof(cl_mem), &buffers[slot]);
+    CHECK_ERR(err, "clSetKernelArg(slot)");
+}
+
+void CommandGraph::arg_mem(int node, cl_uint index, cl_mem buffer)
+{
+    // Hold on to it even if the layer releases its copy
+    clRetainMemObject(buffer);
+    retained.push_back(buffer);
+    cl_int err = clSetKernelArg(nodes[node].kernel, index, sizeof(cl_mem), &buffer);
+    CHECK_ERR(err, "clSetKernelArg(mem)");
+}
+
+void CommandGraph::arg_value(int node, cl_uint index, size_t size, const void *value)
+{
+    cl_int err = clSetKernelArg(nodes[node].kernel, index, size, value);
+    CHECK_ERR(err, "clSetKernelArg(value)");
+}
+
+void CommandGraph::release_events()
+{
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        clReleaseEvent(events[i]);
+    }
+    events.clear();
+}
+
+cl_event CommandGraph::replay(cl_mem input, cl_mem output, cl_uint num_wait, const cl_event *wait_list)
+{
+    cl_int err;
+
+    // The only per-replay clSetKernelArg calls, and only if the buffers moved
+    if (input != bound_input || output != bound_output)
+    {
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            for (size_t j = 0; j < nodes[i].io_args.size(); j++)
+            {
+                cl_mem buffer = nodes[i].io_args[j].second == INPUT ? input : output;
+                err = clSetKernelArg(nodes[i].kernel, nodes[i].io_args[j].first, sizeof(cl_mem), &buffer);
+                CHECK_ERR(err, "clSetKernelArg(io)");
+            }
+        }
+        bound_input = input;
+        bound_output = output;
+    }
+
+    // Roots wait for the previous replay, which shares the intermediate
+    // buffers, and for whatever the caller asked for
+    std::vector<cl_event> roots(wait_list, wait_list + num_wait);
+    if (done)
+    {
+        roots.push_back(done);
+    }
+
+    std::vector<cl_event> current(nodes.size());
+    std::vector<cl_event> wait;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const Node &node = nodes[i];
+        if (node.deps.empty())
+        {
+            wait = roots;
+        }
+        else
+        {
+            wait.clear();
+            for (size_t d = 0; d < node.deps.size(); d++)
+            {
+                wait.push_back(current[node.deps[d]]);
+            }
+        }
+        err = clEnqueueNDRangeKernel(queue, node.kernel, node.work_dim, nullptr, node.global_size,
+                                     node.has_local ? node.local_size : nullptr, (cl_uint)wait.size(),
+                                     wait.empty() ? nullptr : wait.data(), &current[i]);
+        CHECK_ERR(err, "clEnqueueNDRangeKernel(graph)");
+    }
+
+    std::vector<cl_event> sinks;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (is_sink[i])
+        {
+            sinks.push_back(current[i]);
+        }
+    }
+    cl_event finished;
+    if (sinks.size() == 1)
+    {
+        finished = sinks[0];
+        clRetainEvent(finished);
+    }
+    else
+    {
+        err = clEnqueueMarkerWithWaitList(queue, (cl_uint)sinks.size(), sinks.empty() ? nullptr : sinks.data(), &finished);
+        CHECK_ERR(err, "clEnqueueMarkerWithWaitList");
+    }
+
+    release_events();
+    events.swap(current);
+    if (done)
+    {
+        clReleaseEvent(done);
+    }
+    done = finished;
+    return done;
+}
+
+void CommandGraph::run(const float *host_x, float *host_y)
+{
+    cl_int err;
+    cl_event written;
+
+    // The previous replay may still be reading input_d
+    err = clEnqueueWriteBuffer(queue, input_d, CL_FALSE, 0, n_input * sizeof(float), host_x,
+                               done ? 1 : 0, done ? &done : nullptr, &written);
+    CHECK_ERR(err, "clEnqueueWriteBuffer(graph input)");
+
+    cl_event finished = replay(input_d, output_d, 1, &written);
+    clReleaseEvent(written);
+
+    err = clEnqueueReadBuffer(queue, output_d, CL_TRUE, 0, n_output * sizeof(float), host_y, 1, &finished, nullptr);
+    CHECK_ERR(err, "clEnqueueReadBuffer(graph output)");
+}
@@ -0,0 +1,94 @@
+#ifndef SRC_LAYER_COMMAND_GRAPH_H
+#define SRC_LAYER_COMMAND_GRAPH_H
+
+#include <map>
+#include <vector>
+
+#include "device.h"
+#include "opencl.h"
+
+class Network;
+
+// A forward pass recorded once for a fixed batch size and replayed many times.
+//
+// Every node owns its own cl_kernel, so all arguments are set while recording
+// and a replay is nothing but enqueues. Only the arguments bound to the INPUT
+// and OUTPUT slots are re-set, and only when the caller passes different
+// buffers than last time. Intermediate activations live in graph-owned
+// buffers. Nodes wait on the events of the nodes whose buffers they touch,
+// so the graph runs on an out-of-order queue when the device has one.
+// Weights are captured when recording: record again after changing them.
+class CommandGraph
+{
+    public:
+        // Slots for the buffers that may change on every replay
+        static const int INPUT = -1;
+        static const int OUTPUT = -2;
+
+        explicit CommandGraph(OpenCL *opencl);
+        ~CommandGraph();
+
+        // Record every layer of dnn (see Layer::record); false if a layer has
+        // no device implementation
+        bool record(Network &dnn, int input_dim, int batch_size);
+
+        // Recording primitives, used by Layer::record
+        int add_buffer(size_t bytes);
+        int add_kernel(const char *name, cl_uint work_dim, const size_t *global_size, const size_t *local_size);
+        void arg_slot(int node, cl_uint index, int slot, bool written);
+        void arg_mem(int node, cl_uint index, cl_mem buffer);
+        void arg_value(int node, cl_uint index, size_t size, const void *value);
+
+        // Enqueue the whole graph on input/output after wait_list; the returned
+        // event completes with the graph and is valid until the next replay
+        cl_event replay(cl_mem input, cl_mem output, cl_uint num_wait = 0, const cl_event *wait_list = nullptr);
+        // Copy host_x in, replay, copy host_y out (blocking)
+        void run(const float *host_x, float *host_y);
+
+        int batch_size() const { return batch; }
+        size_t input_count() const { return n_input; }
+        size_t output_count() const { return n_output; }
+        size_t n_nodes() const { return nodes.size(); }
+
+        OpenCL *opencl;
+        cl_command_queue queue;  // the graph's own queue
+        bool out_of_order;       // queue created with out-of-order execution
+
+    private:
+        struct Node
+        {
+            cl_kernel kernel;
+            cl_uint work_dim;
+            size_t global_size[3];
+            size_t local_size[3];
+            bool has_local;
+            std::vector<int> deps;  // nodes that must finish first
+            std::vector<std::pair<cl_uint, int> > io_args;  // (arg, INPUT/OUTPUT)
+        };
+
+        std::vector<Node> nodes;
+        std::vector<cl_mem> buffers;    // intermediate slots 0..n-1
+        std::vector<cl_mem> retained;   // resident buffers (weights) in use
+        std::map<int, int> producer;    // slot -> last node writing it
+        std::map<int, std::vector<int> > readers;  // slot -> reads since the last write
+        std::vector<bool> is_sink;      // no node depends on it
+
+        std::vector<cl_event> events;  // per node, last replay
+        cl_event done;                 // completion of the last replay
+        cl_mem bound_input;
+        cl_mem bound_output;
+        cl_mem input_d;   // owned I/O pair used by run()
+        cl_mem output_d;
+
+        int batch;
+        size_t n_input;
+        size_t n_output;
+
+        void add_dep(int node, int dep);
+        void release_events();
+
+        CommandGraph(const CommandGraph &);
+        CommandGraph &operator=(const CommandGraph &);
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <iostream>
+
+#include "kernel.h"
+#include "device.h"
+
+#include "opencl-new-forward.h"
+
+#define TILE_WIDTH 16
+
+#define CHECK_ERR(err, msg)                           \
+    if (err != CL_SUCCESS)                            \
+    {                                                 \
+        fprintf(stderr, "%s failed: %d.\n", msg, err); \
+        exit(EXIT_FAILURE);                           \
+    }
+
+// Read-write fp32 buffer of n floats, initialized from host when given
+cl_mem OpenCLInterface::create_buffer_opencl(const float *host, const size_t n)
+{
+    cl_int err;
+    cl_mem_flags flags = CL_MEM_READ_WRITE | (host ? CL_MEM_COPY_HOST_PTR : 0);
+    cl_mem device = clCreateBuffer(this->opencl->context, flags, n * sizeof(float), (void *)host, &err);
+    CHECK_ERR(err, "clCreateBuffer");
+    return device;
+}
+
+void OpenCLInterface::read_buffer_opencl(float *host, const cl_mem device, const size_t n)
+{
+    cl_int err = clEnqueueReadBuffer(this->opencl->queue, device, CL_TRUE, 0, n * sizeof(float), host, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueReadBuffer");
+}
+
+void OpenCLInterface::conv_bias_opencl(cl_mem device_y, const cl_mem device_b, const int B, const int M, const int HW)
+{
+    cl_int err;
+    cl_kernel kernel = this->opencl->conv_bias_kernel;
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_b);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &HW);
+    CHECK_ERR(err, "clSetKernelArg");
+
+    size_t local_size[1] = {TILE_WIDTH * TILE_WIDTH};
+    size_t global_size[1] = {((size_t)B * M * HW + local_size[0] - 1) / local_size[0] * local_size[0]};
+
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 1, nullptr, global_size, local_size, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel");
+}
+
+void OpenCLInterface::conv_backward_opencl(cl_mem device_dx, cl_mem device_dk, cl_mem device_db, const cl_mem device_dy, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    cl_int err;
+    cl_kernel kernel;
+
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    const int HW_out = H_out * W_out;
+
+    // dW: one work-group per weight
+    kernel = this->opencl->conv_dw_kernel;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_dk);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_dy);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &C);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 8, sizeof(int), &K);
+    CHECK_ERR(err, "clSetKernelArg(dw)");
+
+    size_t reduce_local[1] = {TILE_WIDTH * TILE_WIDTH};
+    size_t dw_global[1] = {(size_t)M * C * K * K * reduce_local[0]};
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 1, nullptr, dw_global, reduce_local, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel(dw)");
+
+    // db: one work-group per feature map
+    kernel = this->opencl->conv_db_kernel;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_db);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_dy);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &HW_out);
+    CHECK_ERR(err, "clSetKernelArg(db)");
+
+    size_t db_global[1] = {(size_t)M * reduce_local[0]};
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 1, nullptr, db_global, reduce_local, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel(db)");
+
+    // dX: one work-item per input element, laid out like the forward pass
+    kernel = this->opencl->conv_dx_kernel;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_dx);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_dy);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_k);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &C);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 8, sizeof(int), &K);
+    CHECK_ERR(err, "clSetKernelArg(dx)");
+
+    size_t dx_local[3] = {TILE_WIDTH, TILE_WIDTH, 1};
+    size_t dx_global[3] = {
+        (size_t)((W + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+        (size_t)((H + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+        (size_t)B * C};
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 3, nullptr, dx_global, dx_local, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel(dx)");
+
+    err = clFinish(this->opencl->queue);
+    CHECK_ERR(err, "clFinish");
+}
+
+void OpenCLInterface::sgd_update_opencl(cl_mem device_w, const cl_mem device_dw, cl_mem device_v, const int n, const float lr, const float decay, const float momentum, const bool nesterov)
+{
+    cl_int err;
+    cl_kernel kernel = this->opencl->sgd_kernel;
+    const int nesterov_flag = nesterov;
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_w);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_dw);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_v);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &n);
+    err |= clSetKernelArg(kernel, 4, sizeof(float), &lr);
+    err |= clSetKernelArg(kernel, 5, sizeof(float), &decay);
+    err |= clSetKernelArg(kernel, 6, sizeof(float), &momentum);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &nesterov_flag);
+    CHECK_ERR(err, "clSetKernelArg");
+
+    size_t local_size[1] = {TILE_WIDTH * TILE_WIDTH};
+    size_t global_size[1] = {((size_t)n + local_size[0] - 1) / local_size[0] * local_size[0]};
+
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 1, nullptr, global_size, local_size, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel");
+}
@@ -15,13 +15,380 @@ __kernel void prefn_marker_kernel() {
 
 __kernel void conv_forward_kernel(__global float *y, __global float *x, __constant float *k, const int B, const int M, const int C, const int H, const int W, const int K)
 {
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+
 #define y4d(i3, i2, i1, i0) y[(i3) * (M * H_out * W_out) + (i2) * (H_out * W_out) + (i1) * (W_out) + i0]
 #define x4d(i3, i2, i1, i0) x[(i3) * (C * H * W) + (i2) * (H * W) + (i1) * (W) + i0]
 #define k4d(i3, i2, i1, i0) k[(i3) * (C * K * K) + (i2) * (K * K) + (i1) * (K) + i0]
 
-	//@@ Insert code to implement convolution here
+    const int w = get_global_id(0);
+    const int h = get_global_id(1);
+    const int b = get_global_id(2) / M;
+    const int m = get_global_id(2) % M;
+
+    if (h < H_out && w < W_out) {
+        float acc = 0.0f;
+        for (int c = 0; c < C; c++) {
+            for (int p = 0; p < K; p++) {
+                for (int q = 0; q < K; q++) {
+                    acc += x4d(b, c, h + p, w + q) * k4d(m, c, p, q);
+                }
+            }
+        }
+        y4d(b, m, h, w) = acc;
+    }
 
 #undef y4d
 #undef x4d
 #undef k4d
 }
+
+// Same computation as conv_forward_kernel, with each work-group staging the
+// (TILE_WIDTH + K - 1)^2 input patch of one channel in local memory so that
+// neighbouring outputs share their loads. Requires K <= KERNEL_SZ.
+__kernel void conv_forward_kernel_tiled(__global float *y, __global const float *x, __constant float *k, const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    __local float x_tile[TILE_WIDTH + KERNEL_SZ - 1][TILE_WIDTH + KERNEL_SZ - 1];
+
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    const int tile = TILE_WIDTH + K - 1;
+
+#define y4d(i3, i2, i1, i0) y[(i3) * (M * H_out * W_out) + (i2) * (H_out * W_out) + (i1) * (W_out) + i0]
+#define x4d(i3, i2, i1, i0) x[(i3) * (C * H * W) + (i2) * (H * W) + (i1) * (W) + i0]
+#define k4d(i3, i2, i1, i0) k[(i3) * (C * K * K) + (i2) * (K * K) + (i1) * (K) + i0]
+
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int w0 = get_group_id(0) * TILE_WIDTH;
+    const int h0 = get_group_id(1) * TILE_WIDTH;
+    const int w = w0 + tx;
+    const int h = h0 + ty;
+    const int b = get_global_id(2) / M;
+    const int m = get_global_id(2) % M;
+
+    float acc = 0.0f;
+    for (int c = 0; c < C; c++) {
+        for (int i = ty; i < tile; i += TILE_WIDTH) {
+            for (int j = tx; j < tile; j += TILE_WIDTH) {
+                x_tile[i][j] = (h0 + i < H && w0 + j < W) ? x4d(b, c, h0 + i, w0 + j) : 0.0f;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int p = 0; p < K; p++) {
+            for (int q = 0; q < K; q++) {
+                acc += x_tile[ty + p][tx + q] * k4d(m, c, p, q);
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (h < H_out && w < W_out) {
+        y4d(b, m, h, w) = acc;
+    }
+
+#undef y4d
+#undef x4d
+#undef k4d
+}
+
+// Same computation as conv_forward_kernel, but x, y and k are stored as
+// 16-bit halves. vload_half/vstore_half are core OpenCL, so this does not
+// need cl_khr_fp16: every value is widened to float before it is used and
+// all arithmetic stays in fp32.
+__kernel void conv_forward_kernel_half(__global half *y, __global const half *x, __constant half *k, const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+
+#define y4d_idx(i3, i2, i1, i0) ((i3) * (M * H_out * W_out) + (i2) * (H_out * W_out) + (i1) * (W_out) + i0)
+#define x4d(i3, i2, i1, i0) vload_half((i3) * (C * H * W) + (i2) * (H * W) + (i1) * (W) + i0, x)
+#define k4d(i3, i2, i1, i0) vload_half((i3) * (C * K * K) + (i2) * (K * K) + (i1) * (K) + i0, k)
+
+    const int w = get_global_id(0);
+    const int h = get_global_id(1);
+    const int b = get_global_id(2) / M;
+    const int m = get_global_id(2) % M;
+
+    if (h < H_out && w < W_out) {
+        float acc = 0.0f;
+        for (int c = 0; c < C; c++) {
+            for (int p = 0; p < K; p++) {
+                for (int q = 0; q < K; q++) {
+                    acc += x4d(b, c, h + p, w + q) * k4d(m, c, p, q);
+                }
+            }
+        }
+        vstore_half(acc, y4d_idx(b, m, h, w), y);
+    }
+
+#undef y4d_idx
+#undef x4d
+#undef k4d
+}
+
+// ---------------------------------------------------------------------------
+// Element-wise and pooling layers, so that a whole forward pass can be
+// recorded into a CommandGraph without returning to the host
+// ---------------------------------------------------------------------------
+
+__kernel void relu_kernel(__global float *y, __global const float *x, const int n)
+{
+    const int i = get_global_id(0);
+    if (i < n) {
+        y[i] = fmax(x[i], 0.0f);
+    }
+}
+
+// Same as MaxPooling::forward: windows that run past the edge are clipped.
+// x is (B * C, H, W) and y is (B * C, H_out, W_out).
+__kernel void maxpool_kernel(__global float *y, __global const float *x, const int H, const int W, const int pool_h, const int pool_w, const int stride, const int H_out, const int W_out)
+{
+    const int w = get_global_id(0);
+    const int h = get_global_id(1);
+    const int bc = get_global_id(2);
+
+    if (h < H_out && w < W_out) {
+        __global const float *plane = x + bc * H * W;
+        float max_val = -FLT_MAX;
+        for (int p = 0; p < pool_h && h * stride + p < H; p++) {
+            for (int q = 0; q < pool_w && w * stride + q < W; q++) {
+                max_val = fmax(max_val, plane[(h * stride + p) * W + w * stride + q]);
+            }
+        }
+        y[(bc * H_out + h) * W_out + w] = max_val;
+    }
+}
+
+#define FC_ACT_NONE 0
+#define FC_ACT_RELU 1
+#define FC_ACT_SOFTMAX 2
+
+// y = act(w' * x + b) over a whole batch. x is D_in x N and y is D_out x N,
+// both column-major like the host Matrix. w is the host's D_in x D_out
+// column-major matrix, i.e. already stored transposed: row o of w' is
+// contiguous. Softmax needs a full output column inside one work-group, so
+// it requires D_out <= TILE_WIDTH.
+__kernel void fc_forward_kernel(__global float *y, __global const float *x, __global const float *w, __global const float *b, const int N, const int D_in, const int D_out, const int activation)
+{
+    __local float w_tile[TILE_WIDTH][TILE_WIDTH + 1];
+    __local float x_tile[TILE_WIDTH][TILE_WIDTH + 1];
+
+    const int to = get_local_id(0);
+    const int tn = get_local_id(1);
+    const int o0 = get_group_id(0) * TILE_WIDTH;
+    const int n0 = get_group_id(1) * TILE_WIDTH;
+    const int o = o0 + to;
+    const int n = n0 + tn;
+
+    float acc = 0.0f;
+    for (int i0 = 0; i0 < D_in; i0 += TILE_WIDTH) {
+        // Neighbouring work-items read neighbouring elements of a row
+        const int i = i0 + to;
+        w_tile[tn][to] = (o0 + tn < D_out && i < D_in) ? w[(o0 + tn) * D_in + i] : 0.0f;
+        x_tile[tn][to] = (n < N && i < D_in) ? x[n * D_in + i] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int c = 0; c < TILE_WIDTH; c++) {
+            acc += w_tile[to][c] * x_tile[tn][c];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Epilogue: bias and activation
+    if (o < D_out) {
+        acc += b[o];
+    }
+    if (activation == FC_ACT_RELU) {
+        acc = fmax(acc, 0.0f);
+    } else if (activation == FC_ACT_SOFTMAX) {
+        // Reuse w_tile as a per-column scratch row: w_tile[tn][*] is column n
+        w_tile[tn][to] = (o < D_out) ? acc : -INFINITY;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        float max_val = -INFINITY;
+        for (int r = 0; r < TILE_WIDTH; r++) {
+            max_val = fmax(max_val, w_tile[tn][r]);
+        }
+        const float e = (o < D_out) ? exp(acc - max_val) : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        w_tile[tn][to] = e;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        float sum = 0.0f;
+        for (int r = 0; r < TILE_WIDTH; r++) {
+            sum += w_tile[tn][r];
+        }
+        acc = e / sum;
+    }
+
+    if (o < D_out && n < N) {
+        y[n * D_out + o] = acc;
+    }
+}
+
+// One work-item per column of the D x N score matrix z: argmax, optional
+// stable softmax written back in place, and the number of columns whose
+// argmax equals the label. Hits are counted per work-group in local memory
+// so there is only one global atomic per group.
+__kernel void classify_kernel(__global float *z, __global const float *labels, __global int *pred, __global int *correct, const int N, const int D, const int apply_softmax)
+{
+    __local int group_correct;
+
+    const int n = get_global_id(0);
+    if (get_local_id(0) == 0) {
+        group_correct = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (n < N) {
+        __global float *col = z + n * D;
+        float max_val = col[0];
+        int max_idx = 0;
+        for (int d = 1; d < D; d++) {
+            if (col[d] > max_val) {
+                max_val = col[d];
+                max_idx = d;
+            }
+        }
+        if (apply_softmax) {
+            float sum = 0.0f;
+            for (int d = 0; d < D; d++) {
+                sum += exp(col[d] - max_val);
+            }
+            for (int d = 0; d < D; d++) {
+                col[d] = exp(col[d] - max_val) / sum;
+            }
+        }
+        pred[n] = max_idx;
+        if (max_idx == (int)labels[n]) {
+            atomic_inc(&group_correct);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (get_local_id(0) == 0 && group_correct > 0) {
+        atomic_add(correct, group_correct);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Conv_Custom backward. Layouts match the forward pass: x is (B, C, H, W),
+// dy is (B, M, H_out, W_out) and k/dk are (M, C, K, K). Every gradient is
+// computed as a gather, so no kernel needs atomics.
+// ---------------------------------------------------------------------------
+
+// y[b, m, :, :] += bias[m]
+__kernel void conv_bias_kernel(__global float *y, __global const float *bias, const int B, const int M, const int HW)
+{
+    const int i = get_global_id(0);
+    if (i < B * M * HW) {
+        y[i] += bias[(i / HW) % M];
+    }
+}
+
+// dk[m, c, p, q] = sum over b, h, w of dy[b, m, h, w] * x[b, c, h + p, w + q]
+// One work-group per weight; its work-items stride over (b, h, w) and the
+// partial sums are reduced in local memory.
+__kernel void conv_dw_kernel(__global float *dk, __global const float *dy, __global const float *x, const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    __local float partial[TILE_WIDTH * TILE_WIDTH];
+
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    const int HW_out = H_out * W_out;
+
+    const int weight = get_group_id(0);
+    const int q = weight % K;
+    const int p = (weight / K) % K;
+    const int c = (weight / (K * K)) % C;
+    const int m = weight / (K * K * C);
+
+    const int tid = get_local_id(0);
+    const int n_local = get_local_size(0);
+
+    float acc = 0.0f;
+    for (int i = tid; i < B * HW_out; i += n_local) {
+        const int b = i / HW_out;
+        const int h = (i % HW_out) / W_out;
+        const int w = i % W_out;
+        acc += dy[(b * M + m) * HW_out + h * W_out + w] * x[((b * C + c) * H + h + p) * W + w + q];
+    }
+    partial[tid] = acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = n_local / 2; stride > 0; stride /= 2) {
+        if (tid < stride) {
+            partial[tid] += partial[tid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (tid == 0) {
+        dk[weight] = partial[0];
+    }
+}
+
+// db[m] = sum over b, h, w of dy[b, m, h, w], one work-group per feature map
+__kernel void conv_db_kernel(__global float *db, __global const float *dy, const int B, const int M, const int HW_out)
+{
+    __local float partial[TILE_WIDTH * TILE_WIDTH];
+
+    const int m = get_group_id(0);
+    const int tid = get_local_id(0);
+    const int n_local = get_local_size(0);
+
+    float acc = 0.0f;
+    for (int i = tid; i < B * HW_out; i += n_local) {
+        acc += dy[((i / HW_out) * M + m) * HW_out + i % HW_out];
+    }
+    partial[tid] = acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = n_local / 2; stride > 0; stride /= 2) {
+        if (tid < stride) {
+            partial[tid] += partial[tid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (tid == 0) {
+        db[m] = partial[0];
+    }
+}
+
+// dx[b, c, h, w] = sum over m, p, q of dy[b, m, h - p, w - q] * k[m, c, p, q]
+// A transposed convolution written as a gather: each work-item owns one
+// input element, so there is no col2im scatter and no atomics.
+__kernel void conv_dx_kernel(__global float *dx, __global const float *dy, __global const float *k, const int B, const int M, const int C, const int H, const int W, const int K)
+{
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+
+    const int w = get_global_id(0);
+    const int h = get_global_id(1);
+    const int b = get_global_id(2) / C;
+    const int c = get_global_id(2) % C;
+
+    if (h < H && w < W) {
+        float acc = 0.0f;
+        for (int m = 0; m < M; m++) {
+            for (int p = max(0, h - H_out + 1); p <= min(K - 1, h); p++) {
+                for (int q = max(0, w - W_out + 1); q <= min(K - 1, w); q++) {
+                    acc += dy[((b * M + m) * H_out + h - p) * W_out + w - q] * k[((m * C + c) * K + p) * K + q];
+                }
+            }
+        }
+        dx[((b * C + c) * H + h) * W + w] = acc;
+    }
+}
+
+// SGD with momentum, weight decay and optional Nesterov, same as SGD::update
+__kernel void sgd_update_kernel(__global float *w, __global const float *dw, __global float *v, const int n, const float lr, const float decay, const float momentum, const int nesterov)
+{
+    const int i = get_global_id(0);
+    if (i < n) {
+        const float g = dw[i] + decay * w[i];
+        const float v_new = momentum * v[i] + g;
+        v[i] = v_new;
+        w[i] -= lr * (nesterov ? momentum * v_new + g : v_new);
+    }
+}
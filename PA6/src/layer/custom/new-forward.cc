@@ -1,9 +1,12 @@
 #include <cmath>
 #include <iostream>
+#include <vector>
 
 #include "kernel.h"
 #include "device.h"
 
+#include <CL/cl_half.h>
+
 #include "opencl-new-forward.h"
 
 #define TILE_WIDTH 16
@@ -14,53 +17,258 @@
         fprintf(stderr, "%s failed: %d.\n", msg, err); \
         exit(EXIT_FAILURE);                           \
     }
-	
-void OpenCLInterface::conv_forward_opencl_prolog(const float *host_y, const float *host_x, const float *host_k, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k, const int B, const int M, const int C, const int H, const int W, const int K)
+
+// Creates a device buffer holding n host floats in the device storage format
+// (fp32, or fp16 when opencl->half_storage is set).
+static cl_mem create_device_tensor(OpenCL *opencl, cl_mem_flags flags, const float *host, size_t n, const char *msg)
+{
+    cl_int err;
+    cl_mem device;
+
+    if (!opencl->half_storage)
+    {
+        device = clCreateBuffer(opencl->context, flags | CL_MEM_COPY_HOST_PTR, n * sizeof(float), (void *)host, &err);
+        CHECK_ERR(err, msg);
+        return device;
+    }
+
+    std::vector<cl_half> staged(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        staged[i] = cl_half_from_float(host[i], CL_HALF_RTE);
+    }
+    device = clCreateBuffer(opencl->context, flags | CL_MEM_COPY_HOST_PTR, n * sizeof(cl_half), staged.data(), &err);
+    CHECK_ERR(err, msg);
+    return device;
+}
+
+void OpenCLInterface::conv_weights_opencl(const float *host_k, cl_mem *device_k, const int M, const int C, const int K)
+{
+    const size_t k_size = (size_t)M * C * K * K;
+    // Writable so the device SGD update can train the weights in place
+    *device_k = create_device_tensor(this->opencl, CL_MEM_READ_WRITE, host_k, k_size, "clCreateBuffer(k)");
+}
+
+// Copies n host floats into an existing device buffer, converting to the
+// device storage format on the way.
+static void write_device_tensor(OpenCL *opencl, cl_mem device, const float *host, size_t n, const char *msg)
+{
+    cl_int err;
+
+    if (!opencl->half_storage)
+    {
+        err = clEnqueueWriteBuffer(opencl->queue, device, CL_TRUE, 0, n * sizeof(float), host, 0, nullptr, nullptr);
+        CHECK_ERR(err, msg);
+        return;
+    }
+
+    std::vector<cl_half> staged(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        staged[i] = cl_half_from_float(host[i], CL_HALF_RTE);
+    }
+    err = clEnqueueWriteBuffer(opencl->queue, device, CL_TRUE, 0, n * sizeof(cl_half), staged.data(), 0, nullptr, nullptr);
+    CHECK_ERR(err, msg);
+}
+
+// The x/y buffers belong to the caller and are reused across batches of the
+// same size: they are only allocated while *device_x / *device_y are NULL.
+// host_x may be NULL to allocate without copying anything.
+void OpenCLInterface::conv_forward_opencl_prolog(const float *host_y, const float *host_x, cl_mem *device_y, cl_mem *device_x, const int B, const int M, const int C, const int H, const int W, const int K)
 {
+    cl_int err;
 
-    //@@ Allocate OpenCL memory here
-    // Create memory buffers for input and output vectors
-    // 
-    // Do not create your own device/context/queue. 
-    // Use this->opencl->[program, kernel, queue, context]
-    // OpenCL (common for entire NN)
-    //      class is defined here: https://github.com/KastnerRG/cse160-WI25/blob/main/PA6/src/layer/custom/opencl.h
-    //      methods defined here: https://github.com/KastnerRG/cse160-WI25/blob/main/PA6%2Fsrc%2Flayer%2Fcustom%opencl.cc
-    //      created and passed into the network here: https://github.com/KastnerRG/cse160-WI25/blob/main/PA6/m2.cc
-    //      it's pointer is kept in OpenCLInterface (THIS) class here: https://github.com/KastnerRG/cse160-WI25/blob/main/PA6/src/layer/custom/opencl-new-forward.h
-
-    //@@ Copy memory to the OpenCL here
-    // Copy input vectors to memory buffers
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+
+    const size_t x_size = (size_t)B * C * H * W;
+    const size_t y_size = (size_t)B * M * H_out * W_out;
+
+    if (*device_x == nullptr)
+    {
+        *device_x = clCreateBuffer(this->opencl->context, CL_MEM_READ_ONLY, x_size * this->opencl->element_size(), nullptr, &err);
+        CHECK_ERR(err, "clCreateBuffer(x)");
+    }
+    if (*device_y == nullptr)
+    {
+        *device_y = clCreateBuffer(this->opencl->context, CL_MEM_WRITE_ONLY, y_size * this->opencl->element_size(), nullptr, &err);
+        CHECK_ERR(err, "clCreateBuffer(y)");
+    }
+
+    // Copy the input over
+    if (host_x != nullptr)
+    {
+        write_device_tensor(this->opencl, *device_x, host_x, x_size, "clEnqueueWriteBuffer(x)");
+    }
 }
 
 
-void OpenCLInterface::conv_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K)
+void OpenCLInterface::conv_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K, const bool tiled)
 {
+    cl_int err;
+    // Both kernels take the same arguments and launch geometry
+    cl_kernel kernel = tiled ? this->opencl->tiled_kernel : this->opencl->kernel;
+
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
 
-    //__global float *y, __constant float *x, __constant float *k,
-    // const int B, const int M, const int C, const int H, const int W, const int K)
     // Set the arguments to our compute kernel
-    //
-    // Do not create your own device/context/queue.
-    // Use this->opencl->[program, kernel, queue, context]
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_k);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &B);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &C);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 8, sizeof(int), &K);
+    CHECK_ERR(err, "clSetKernelArg");
+
+    // One work-item per output element; dimension 2 walks (image, feature map)
+    size_t local_size[3] = {TILE_WIDTH, TILE_WIDTH, 1};
+    size_t global_size[3] = {
+        (size_t)((W_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+        (size_t)((H_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+        (size_t)B * M};
 
-    //@@ Set the kernel dimensions and call the kernel
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 3, nullptr, global_size, local_size, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel");
 
-    //@@ Launch the OpenCL Kernel here
-    // Execute the OpenCL kernel on the array
+    err = clFinish(this->opencl->queue);
+    CHECK_ERR(err, "clFinish");
 }
 
 
-void OpenCLInterface::conv_forward_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K)
+void OpenCLInterface::conv_forward_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, const int B, const int M, const int C, const int H, const int W, const int K)
 {
+    cl_int err;
+
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    const size_t y_size = (size_t)B * M * H_out * W_out;
+
+    // Copy the output back to host
+    if (!this->opencl->half_storage)
+    {
+        err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, y_size * sizeof(float), host_y, 0, nullptr, nullptr);
+        CHECK_ERR(err, "clEnqueueReadBuffer(y)");
+    }
+    else
+    {
+        std::vector<cl_half> staged(y_size);
+        err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, y_size * sizeof(cl_half), staged.data(), 0, nullptr, nullptr);
+        CHECK_ERR(err, "clEnqueueReadBuffer(y)");
+        for (size_t i = 0; i < y_size; i++)
+        {
+            host_y[i] = cl_half_to_float(staged[i]);
+        }
+    }
+}
+
+
+// Fully connected layers always keep fp32 on the device: their tensors are
+// small and the softmax epilogue feeds the accuracy check directly.
+void OpenCLInterface::fc_weights_opencl(const float *host_w, const float *host_b, cl_mem *device_w, cl_mem *device_b, const int D_in, const int D_out)
+{
+    cl_int err;
+
+    *device_w = clCreateBuffer(this->opencl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (size_t)D_in * D_out * sizeof(float), (void *)host_w, &err);
+    CHECK_ERR(err, "clCreateBuffer(w)");
+    *device_b = clCreateBuffer(this->opencl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (size_t)D_out * sizeof(float), (void *)host_b, &err);
+    CHECK_ERR(err, "clCreateBuffer(b)");
+}
+
+// Like the conv prolog, *device_x is only allocated while it is NULL and
+// host_x may be NULL to allocate without copying
+void OpenCLInterface::fc_forward_opencl_prolog(const float *host_x, cl_mem *device_x, const int N, const int D_in)
+{
+    cl_int err;
+
+    if (*device_x == nullptr)
+    {
+        *device_x = clCreateBuffer(this->opencl->context, CL_MEM_READ_ONLY, (size_t)N * D_in * sizeof(float), nullptr, &err);
+        CHECK_ERR(err, "clCreateBuffer(x)");
+    }
+    if (host_x != nullptr)
+    {
+        err = clEnqueueWriteBuffer(this->opencl->queue, *device_x, CL_TRUE, 0, (size_t)N * D_in * sizeof(float), host_x, 0, nullptr, nullptr);
+        CHECK_ERR(err, "clEnqueueWriteBuffer(x)");
+    }
+}
+
+void OpenCLInterface::fc_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_w, const cl_mem device_b, const int N, const int D_in, const int D_out, const int activation)
+{
+    cl_int err;
+    cl_kernel kernel = this->opencl->fc_kernel;
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_y);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_x);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_w);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_b);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &D_in);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &D_out);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &activation);
+    CHECK_ERR(err, "clSetKernelArg");
+
+    // Dimension 0 walks output features, dimension 1 the batch
+    size_t local_size[2] = {TILE_WIDTH, TILE_WIDTH};
+    size_t global_size[2] = {
+        (size_t)((D_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+        (size_t)((N + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH};
+
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 2, nullptr, global_size, local_size, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel");
+
+    err = clFinish(this->opencl->queue);
+    CHECK_ERR(err, "clFinish");
+}
+
+void OpenCLInterface::fc_forward_opencl_epilog(float *host_y, cl_mem device_y, const int N, const int D_out)
+{
+    cl_int err;
+
+    err = clEnqueueReadBuffer(this->opencl->queue, device_y, CL_TRUE, 0, (size_t)N * D_out * sizeof(float), host_y, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueReadBuffer(y)");
+}
+
+// Returns the number of correct predictions; only the N class indices and
+// the counter cross back to the host.
+int OpenCLInterface::classify_opencl(cl_mem device_z, const float *host_labels, int *host_pred, const int N, const int D, const int apply_softmax)
+{
+    cl_int err;
+    cl_kernel kernel = this->opencl->classify_kernel;
+    int correct = 0;
+
+    cl_mem device_labels = clCreateBuffer(this->opencl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (size_t)N * sizeof(float), (void *)host_labels, &err);
+    CHECK_ERR(err, "clCreateBuffer(labels)");
+    cl_mem device_pred = clCreateBuffer(this->opencl->context, CL_MEM_WRITE_ONLY, (size_t)N * sizeof(int), nullptr, &err);
+    CHECK_ERR(err, "clCreateBuffer(pred)");
+    cl_mem device_correct = clCreateBuffer(this->opencl->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(int), &correct, &err);
+    CHECK_ERR(err, "clCreateBuffer(correct)");
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device_z);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &device_labels);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &device_pred);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &device_correct);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &D);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &apply_softmax);
+    CHECK_ERR(err, "clSetKernelArg");
+
+    size_t local_size[1] = {TILE_WIDTH * TILE_WIDTH};
+    size_t global_size[1] = {(size_t)((N + local_size[0] - 1) / local_size[0]) * local_size[0]};
 
-    //@@ Copy the output back to host
+    err = clEnqueueNDRangeKernel(this->opencl->queue, kernel, 1, nullptr, global_size, local_size, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueNDRangeKernel");
 
-    // Read the memory buffer output_mem_obj to the local variable result
-    //
-    // Do not create your own device/context/queue.
-    // Use this->opencl->[program, kernel, queue, context]
+    err = clEnqueueReadBuffer(this->opencl->queue, device_pred, CL_FALSE, 0, (size_t)N * sizeof(int), host_pred, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueReadBuffer(pred)");
+    err = clEnqueueReadBuffer(this->opencl->queue, device_correct, CL_TRUE, 0, sizeof(int), &correct, 0, nullptr, nullptr);
+    CHECK_ERR(err, "clEnqueueReadBuffer(correct)");
 
-    //@@ Free the OpenCL memory here
-    // Release OpenCL resources
+    clReleaseMemObject(device_labels);
+    clReleaseMemObject(device_pred);
+    clReleaseMemObject(device_correct);
+    return correct;
 }
@@ -9,9 +9,24 @@ class OpenCLInterface
     public:
     OpenCL* opencl;
 
-    void conv_forward_opencl_prolog(const float *host_y, const float *host_x, const float *host_k, cl_mem *device_y, cl_mem *device_x, cl_mem *device_k, const int B, const int M, const int C, const int H, const int W, const int K);
-    void conv_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
-    void conv_forward_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
+    void conv_weights_opencl(const float *host_k, cl_mem *device_k, const int M, const int C, const int K);
+    void conv_forward_opencl_prolog(const float *host_y, const float *host_x, cl_mem *device_y, cl_mem *device_x, const int B, const int M, const int C, const int H, const int W, const int K);
+    void conv_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K, const bool tiled = false);
+    void conv_forward_opencl_epilog(float *host_y, cl_mem device_y, cl_mem device_x, const int B, const int M, const int C, const int H, const int W, const int K);
+
+    void fc_weights_opencl(const float *host_w, const float *host_b, cl_mem *device_w, cl_mem *device_b, const int D_in, const int D_out);
+    void fc_forward_opencl_prolog(const float *host_x, cl_mem *device_x, const int N, const int D_in);
+    void fc_forward_opencl(cl_mem device_y, const cl_mem device_x, const cl_mem device_w, const cl_mem device_b, const int N, const int D_in, const int D_out, const int activation);
+    void fc_forward_opencl_epilog(float *host_y, cl_mem device_y, const int N, const int D_out);
+
+    // Training (new-backward.cc); fp32 device storage only
+    cl_mem create_buffer_opencl(const float *host, const size_t n);
+    void read_buffer_opencl(float *host, const cl_mem device, const size_t n);
+    void conv_bias_opencl(cl_mem device_y, const cl_mem device_b, const int B, const int M, const int HW);
+    void conv_backward_opencl(cl_mem device_dx, cl_mem device_dk, cl_mem device_db, const cl_mem device_dy, const cl_mem device_x, const cl_mem device_k, const int B, const int M, const int C, const int H, const int W, const int K);
+    void sgd_update_opencl(cl_mem device_w, const cl_mem device_dw, cl_mem device_v, const int n, const float lr, const float decay, const float momentum, const bool nesterov);
+
+    int classify_opencl(cl_mem device_z, const float *host_labels, int *host_pred, const int N, const int D, const int apply_softmax);
 };
 
 #endif
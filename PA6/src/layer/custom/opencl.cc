@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
 
 #include "opencl.h"
@@ -13,15 +14,28 @@
         exit(EXIT_FAILURE);                           \
     }
 
-void OpenCL::setup(cl_device_type device_type)
+void OpenCL::setup(cl_device_type device_type, bool half_storage)
 {
+    cl_int err;
+    cl_device_id device_id;
+    int platform_index, device_index;
+
+    // Get the device subject to the device_type.
+    err = OclGetDeviceInfoWithFallback(&device_id, &platform_index, &device_index, device_type);
+    CHECK_ERR(err, "OclGetDeviceWithFallback");
+
+    setup_device(platform_index, device_index, half_storage);
+}
+
+void OpenCL::setup_device(int platform_index, int device_index, bool half_storage)
+{
+    this->half_storage = half_storage;
+
     // Load external OpenCL kernel code
     char *kernel_source = OclLoadKernel(KERNEL_PATH); // Load kernel source
 
     cl_int err;
 
-    cl_device_id device_id; // device ID
-
     // Find platforms and devices
     OclPlatformProp *platforms = nullptr;
     cl_uint num_platforms;
@@ -29,15 +43,10 @@ void OpenCL::setup(cl_device_type device_type)
     err = OclFindPlatforms((const OclPlatformProp **)&platforms, &num_platforms);
     CHECK_ERR(err, "OclFindPlatforms");
 
-    int platform_index, device_index;
-
-    // Get the device subject to the device_type.
-    err = OclGetDeviceInfoWithFallback(&device_id, &platform_index, &device_index, device_type);
-    CHECK_ERR(err, "OclGetDeviceWithFallback");
-
     // Get the platform and device properties.
     platform = &platforms[platform_index];
     device = &platform->devices[device_index];
+    cl_device_id device_id = device->device_id; // device ID
 
     // Create a context
     context = clCreateContext(0, 1, &device_id, nullptr, nullptr, &err);
@@ -57,17 +66,54 @@ void OpenCL::setup(cl_device_type device_type)
 
     // Build the program executable
     err = clBuildProgram(program, 0, nullptr, nullptr, nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+        size_t log_size;
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+        char *log = (char *)malloc(log_size);
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, nullptr);
+        fprintf(stderr, "Build log:\n%s\n", log);
+        free(log);
+    }
     CHECK_ERR(err, "clBuildProgram");
 
     // Create the compute kernel in the program we wish to run
-    kernel = clCreateKernel(program, "conv_forward_kernel", &err);
+    kernel = clCreateKernel(program, half_storage ? "conv_forward_kernel_half" : "conv_forward_kernel", &err);
     CHECK_ERR(err, "clCreateKernel");
+
+    tiled_kernel = clCreateKernel(program, "conv_forward_kernel_tiled", &err);
+    CHECK_ERR(err, "clCreateKernel(tiled)");
+
+    fc_kernel = clCreateKernel(program, "fc_forward_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(fc)");
+
+    classify_kernel = clCreateKernel(program, "classify_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(classify)");
+
+    conv_bias_kernel = clCreateKernel(program, "conv_bias_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(conv_bias)");
+    conv_dw_kernel = clCreateKernel(program, "conv_dw_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(conv_dw)");
+    conv_db_kernel = clCreateKernel(program, "conv_db_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(conv_db)");
+    conv_dx_kernel = clCreateKernel(program, "conv_dx_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(conv_dx)");
+    sgd_kernel = clCreateKernel(program, "sgd_update_kernel", &err);
+    CHECK_ERR(err, "clCreateKernel(sgd)");
 }
 
 void OpenCL::teardown()
 {
     clReleaseProgram(this->program);
     clReleaseKernel(this->kernel);
+    clReleaseKernel(this->tiled_kernel);
+    clReleaseKernel(this->fc_kernel);
+    clReleaseKernel(this->classify_kernel);
+    clReleaseKernel(this->conv_bias_kernel);
+    clReleaseKernel(this->conv_dw_kernel);
+    clReleaseKernel(this->conv_db_kernel);
+    clReleaseKernel(this->conv_dx_kernel);
+    clReleaseKernel(this->sgd_kernel);
     clReleaseCommandQueue(this->queue);
     clReleaseContext(this->context);
 }
\ No newline at end of file
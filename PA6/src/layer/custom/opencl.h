@@ -3,6 +3,8 @@
 
 #define KERNEL_PATH "src/layer/custom/new-forward-kernel.cl"
 
+#include <iostream>
+
 #include "kernel.h"
 #include "device.h"
 
@@ -11,13 +13,32 @@ class OpenCL
     public:
         cl_program program;        // program
         cl_kernel kernel;          // kernel
+        cl_kernel tiled_kernel;    // conv with a local-memory input tile (fp32 only)
+        cl_kernel fc_kernel;       // fully connected GEMM + epilogue
+        cl_kernel classify_kernel; // softmax + argmax + accuracy
+        cl_kernel conv_bias_kernel; // training: conv bias add
+        cl_kernel conv_dw_kernel;  // training: conv weight gradient
+        cl_kernel conv_db_kernel;  // training: conv bias gradient
+        cl_kernel conv_dx_kernel;  // training: conv input gradient
+        cl_kernel sgd_kernel;      // training: SGD update
         cl_command_queue queue;    // command queue
         cl_context context;        // context
 
         OclPlatformProp *platform;
         OclDeviceProp *device;
 
-        void setup(cl_device_type device_type);
+        // Store device activations and weights as fp16 (compute stays fp32)
+        bool half_storage = false;
+
+        // Where layers write their per-forward timing reports
+        std::ostream* report = &std::cout;
+
+        // Bytes per element of device-side tensors
+        size_t element_size() const { return half_storage ? sizeof(cl_half) : sizeof(cl_float); }
+
+        void setup(cl_device_type device_type, bool half_storage = false);
+        // Bind to a specific device, as numbered by OclFindPlatforms
+        void setup_device(int platform_index, int device_index, bool half_storage = false);
         void teardown();
 };
 
@@ -0,0 +1,254 @@
+#include "fc_cust.h"
+#include "./custom/command-graph.h"
+#include <new>
+#include <stdexcept>
+#include <iostream>
+
+#define TILE_WIDTH 16
+
+void FullyConnected_Custom::init() {
+  // The softmax epilogue reduces a whole output column inside one work-group
+  if (activation == SOFTMAX && dim_out > TILE_WIDTH)
+    throw std::invalid_argument("Fused softmax needs dim_out <= TILE_WIDTH");
+  weight_storage.resize(dim_in, dim_out);
+  new (&weight) Eigen::Map<Matrix>(weight_storage.data(), dim_in, dim_out);
+  bias.resize(dim_out);
+  grad_weight.resize(dim_in, dim_out);
+  grad_bias.resize(dim_out);
+  set_normal_random(weight.data(), weight.size(), 0, 0.01);
+  set_normal_random(bias.data(), bias.size(), 0, 0.01);
+}
+
+FullyConnected_Custom::~FullyConnected_Custom() {
+  release_device_weights();
+  if (top_d)
+    clReleaseMemObject(top_d);
+  if (x_d)
+    clReleaseMemObject(x_d);
+}
+
+// Drop the device copies so the next forward uploads the current parameters
+void FullyConnected_Custom::release_device_weights() {
+  if (weight_d) {
+    clReleaseMemObject(weight_d);
+    clReleaseMemObject(bias_d);
+    weight_d = NULL;
+    bias_d = NULL;
+  }
+}
+
+void FullyConnected_Custom::run(cl_mem x_d, int n_sample) {
+  cl_int err;
+
+  *opencl->report<<"FC-OpenCL=="<<std::endl;
+
+  if (weight_d == NULL)
+    openclInterface.fc_weights_opencl(weight.data(), bias.data(), &weight_d,
+                                      &bias_d, dim_in, dim_out);
+  if (top_d_cols != n_sample) {
+    if (top_d)
+      clReleaseMemObject(top_d);
+    top_d = clCreateBuffer(opencl->context, CL_MEM_READ_WRITE,
+                           (size_t)dim_out * n_sample * sizeof(float), NULL,
+                           &err);
+    if (err != CL_SUCCESS)
+      throw std::runtime_error("clCreateBuffer(fc top) failed");
+    top_d_cols = n_sample;
+  }
+
+  auto start_time_kernel = std::chrono::high_resolution_clock::now();
+  openclInterface.fc_forward_opencl(top_d, x_d, weight_d, bias_d, n_sample,
+                                    dim_in, dim_out, activation);
+  auto end_time_kernel = std::chrono::high_resolution_clock::now();
+
+  std::chrono::duration<float, std::milli> duration_kernel = (end_time_kernel-start_time_kernel);
+  *opencl->report<<"Op Time: " << duration_kernel.count() << " ms"<<std::endl;
+
+  // Read back lazily, only if someone on the host asks for it
+  top.resize(dim_out, n_sample);
+  top_on_host = false;
+  device_output = true;
+}
+
+// Same as FullyConnected::forward plus the fused activation
+void FullyConnected_Custom::run_host(const Matrix& bottom) {
+  top = weight.transpose() * bottom;
+  top.colwise() += bias;
+  if (activation == RELU) {
+    top = top.cwiseMax(0.0);
+  } else if (activation == SOFTMAX) {
+    top.array() = (top.rowwise() - top.colwise().maxCoeff()).array().exp();
+    RowVector z_exp_sum = top.colwise().sum();
+    top.array().rowwise() /= z_exp_sum.array();
+  }
+  top_on_host = true;
+  device_output = false;
+}
+
+void FullyConnected_Custom::forward(const Matrix& bottom) {
+  // z = act(w' * x + b)
+  if (on_host) {
+    run_host(bottom);
+    return;
+  }
+  openclInterface.opencl = opencl;
+  if (x_d_cols != bottom.cols()) {
+    if (x_d)
+      clReleaseMemObject(x_d);
+    x_d = NULL;
+    x_d_cols = bottom.cols();
+  }
+  openclInterface.fc_forward_opencl_prolog(bottom.data(), &x_d, bottom.cols(),
+                                           dim_in);
+  run(x_d, bottom.cols());
+}
+
+void FullyConnected_Custom::forward_from(Layer* prev) {
+  FullyConnected_Custom* fc = dynamic_cast<FullyConnected_Custom*>(prev);
+  if (on_host || fc == NULL || fc->opencl != opencl || !fc->device_output) {
+    forward(prev->output());
+    return;
+  }
+  // Consume the previous layer's output where it already is
+  openclInterface.opencl = opencl;
+  run(fc->top_d, fc->top_d_cols);
+}
+
+void FullyConnected_Custom::reserve(int top_dim, int n_sample) {
+  Layer::reserve(top_dim, n_sample);
+  if (on_host || opencl == NULL)
+    return;
+  cl_int err;
+  if (top_d_cols != n_sample) {
+    if (top_d)
+      clReleaseMemObject(top_d);
+    top_d = clCreateBuffer(opencl->context, CL_MEM_READ_WRITE,
+                           (size_t)dim_out * n_sample * sizeof(float), NULL,
+                           &err);
+    if (err != CL_SUCCESS)
+      throw std::runtime_error("clCreateBuffer(fc top) failed");
+    top_d_cols = n_sample;
+  }
+  if (x_d_cols != n_sample) {
+    if (x_d)
+      clReleaseMemObject(x_d);
+    x_d = NULL;
+    openclInterface.opencl = opencl;
+    openclInterface.fc_forward_opencl_prolog(NULL, &x_d, n_sample, dim_in);
+    x_d_cols = n_sample;
+  }
+}
+
+std::vector<std::string> FullyConnected_Custom::algorithms() {
+  std::vector<std::string> res;
+  res.push_back("opencl-gemm");
+  res.push_back("cpu-eigen");
+  return res;
+}
+
+void FullyConnected_Custom::set_algorithm(int index) {
+  if (index < 0 || index > 1)
+    throw std::out_of_range("Algorithm index out of range");
+  on_host = (index == 1);
+}
+
+// Same launch as fc_forward_opencl. Always the device kernel: the graph
+// stays on the device whatever set_algorithm chose for eager forwards.
+bool FullyConnected_Custom::record(CommandGraph& graph, int bottom, int top,
+                                   int top_dim, int n_sample) {
+  if (weight_d == NULL) {
+    openclInterface.opencl = opencl;
+    openclInterface.fc_weights_opencl(weight.data(), bias.data(), &weight_d,
+                                      &bias_d, dim_in, dim_out);
+  }
+  const int act = activation;
+  const size_t local_size[2] = {TILE_WIDTH, TILE_WIDTH};
+  const size_t global_size[2] = {
+      (size_t)((dim_out + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH,
+      (size_t)((n_sample + TILE_WIDTH - 1) / TILE_WIDTH) * TILE_WIDTH};
+  const int node = graph.add_kernel("fc_forward_kernel", 2, global_size,
+                                    local_size);
+  graph.arg_slot(node, 0, top, true);
+  graph.arg_slot(node, 1, bottom, false);
+  graph.arg_mem(node, 2, weight_d);
+  graph.arg_mem(node, 3, bias_d);
+  graph.arg_value(node, 4, sizeof(int), &n_sample);
+  graph.arg_value(node, 5, sizeof(int), &dim_in);
+  graph.arg_value(node, 6, sizeof(int), &dim_out);
+  graph.arg_value(node, 7, sizeof(int), &act);
+  return true;
+}
+
+const Matrix& FullyConnected_Custom::output() {
+  if (!top_on_host) {
+    openclInterface.fc_forward_opencl_epilog(top.data(), top_d, top.cols(),
+                                             dim_out);
+    top_on_host = true;
+  }
+  return top;
+}
+
+// Classify straight from top_d; the scores themselves never leave the device
+int FullyConnected_Custom::classify(const Matrix& labels,
+                                    std::vector<int>& pred,
+                                    bool apply_softmax) {
+  if (top_on_host || top_d == NULL)
+    return Layer::classify(labels, pred, apply_softmax);
+  pred.resize(top.cols());
+  openclInterface.opencl = opencl;
+  return openclInterface.classify_opencl(top_d, labels.data(), pred.data(),
+                                         top.cols(), dim_out, apply_softmax);
+}
+
+void FullyConnected_Custom::backward(const Matrix& bottom,
+                                     const Matrix& grad_top) {
+  const int n_sample = bottom.cols();
+  const Matrix& a = output();
+  // Undo the fused activation first: d(L)/d(z) from d(L)/d(a)
+  Matrix grad_z;
+  if (activation == RELU) {
+    grad_z = grad_top.cwiseProduct((a.array() > 0.0).cast<float>().matrix());
+  } else if (activation == SOFTMAX) {
+    RowVector temp_sum = a.cwiseProduct(grad_top).colwise().sum();
+    grad_z = (a.array().cwiseProduct(grad_top.array().rowwise() - temp_sum))
+             .matrix();
+  } else {
+    grad_z = grad_top;
+  }
+  // Same as FullyConnected::backward from here on
+  grad_weight = bottom * grad_z.transpose();
+  grad_bias = grad_z.rowwise().sum();
+  grad_bottom.resize(dim_in, n_sample);
+  grad_bottom = weight * grad_z;
+}
+
+void FullyConnected_Custom::update(Optimizer& opt) {
+  Vector::AlignedMapType weight_vec(weight.data(), weight.size());
+  Vector::AlignedMapType bias_vec(bias.data(), bias.size());
+  Vector::ConstAlignedMapType grad_weight_vec(grad_weight.data(),
+                                              grad_weight.size());
+  Vector::ConstAlignedMapType grad_bias_vec(grad_bias.data(), grad_bias.size());
+
+  opt.update(weight_vec, grad_weight_vec);
+  opt.update(bias_vec, grad_bias_vec);
+  release_device_weights();
+}
+
+std::vector<float> FullyConnected_Custom::get_parameters() const {
+  std::vector<float> res(weight.size() + bias.size());
+  // Copy the data of weights and bias to a long vector
+  std::copy(weight.data(), weight.data() + weight.size(), res.begin());
+  std::copy(bias.data(), bias.data() + bias.size(),
+            res.begin() + weight.size());
+  return res;
+}
+
+std::vector<float> FullyConnected_Custom::get_derivatives() const {
+  std::vector<float> res(grad_weight.size() + grad_bias.size());
+  // Copy the data of weights and bias to a long vector
+  std::copy(grad_weight.data(), grad_weight.data() + grad_weight.size(),
+            res.begin());
+  std::copy(grad_bias.data(), grad_bias.data() + grad_bias.size(),
+            res.begin() + grad_weight.size());
+  return res;
+}
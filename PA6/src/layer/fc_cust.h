@@ -0,0 +1,79 @@
+#ifndef SRC_LAYER_FC_CUST_H_
+#define SRC_LAYER_FC_CUST_H_
+
+#include <vector>
+#include <chrono>
+#include "./weight_bias.h"
+#include "./custom/opencl-new-forward.h"
+#include "./custom/opencl.h"
+
+// FullyConnected on the device, with bias and an optional activation fused
+// into the GEMM epilogue. The output stays on the device and is only read
+// back when output() is called, so consecutive FullyConnected_Custom layers
+// chain without leaving the device. For small batches the launch overhead
+// can outweigh the GEMM, so the layer can also run on the host ("cpu-eigen").
+class FullyConnected_Custom : public WeightBiasLayer {
+ public:
+  // Must match FC_ACT_* in new-forward-kernel.cl
+  enum Activation { NONE = 0, RELU = 1, SOFTMAX = 2 };
+
+ private:
+  const int dim_in;
+  const int dim_out;
+  const Activation activation;
+
+  Matrix grad_weight;  // gradient w.r.t weight
+  Vector grad_bias;  // gradient w.r.t bias
+
+  OpenCLInterface openclInterface;
+  cl_mem weight_d;  // device copy of weight, uploaded on first forward
+  cl_mem bias_d;  // device copy of bias
+  cl_mem top_d;  // device output of the last forward
+  int top_d_cols;  // batch size top_d was allocated for
+  cl_mem x_d;  // host input staged for the device, reused across batches
+  int x_d_cols;
+  bool top_on_host;  // top holds the contents of top_d
+  bool device_output;  // the last forward ran on the device
+  bool on_host;  // forward with Eigen instead of the OpenCL kernel
+
+  void init();
+  void run(cl_mem x_d, int n_sample);
+  void run_host(const Matrix& bottom);
+  void release_device_weights();
+  void parameters_changed() { release_device_weights(); }
+
+ public:
+  OpenCL* opencl;
+
+  FullyConnected_Custom(const int dim_in, const int dim_out,
+                        Activation activation = NONE) :
+                 dim_in(dim_in), dim_out(dim_out), activation(activation),
+                 weight_d(NULL), bias_d(NULL),
+                 top_d(NULL), top_d_cols(0), x_d(NULL), x_d_cols(0),
+                 top_on_host(true), device_output(false), on_host(false),
+                 opencl(0)
+  { init(); }
+  ~FullyConnected_Custom();
+
+  void forward(const Matrix& bottom);
+  void forward_from(Layer* prev);
+  void backward(const Matrix& bottom, const Matrix& grad_top);
+  void update(Optimizer& opt);
+  void reserve(int top_dim, int n_sample);
+  std::vector<std::string> algorithms();
+  void set_algorithm(int index);
+  bool record(CommandGraph& graph, int bottom, int top, int top_dim,
+              int n_sample);
+  const Matrix& output();
+  int classify(const Matrix& labels, std::vector<int>& pred,
+               bool apply_softmax);
+  int output_dim() { return dim_out; }
+  const char* name() const { return "fc_opencl"; }
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
+  std::vector<float> get_parameters() const;
+  std::vector<float> get_derivatives() const;
+};
+
+#endif  // SRC_LAYER_FC_CUST_H_
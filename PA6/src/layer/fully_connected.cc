@@ -1,7 +1,9 @@
 #include "./fully_connected.h"
+#include <new>
 
 void FullyConnected::init() {
-  weight.resize(dim_in, dim_out);
+  weight_storage.resize(dim_in, dim_out);
+  new (&weight) Eigen::Map<Matrix>(weight_storage.data(), dim_in, dim_out);
   bias.resize(dim_out);
   grad_weight.resize(dim_in, dim_out);
   grad_bias.resize(dim_out);
@@ -48,13 +50,6 @@ std::vector<float> FullyConnected::get_parameters() const {
   return res;
 }
 
-void FullyConnected::set_parameters(const std::vector<float>& param) {
-  if (static_cast<int>(param.size()) != weight.size() + bias.size())
-      throw std::invalid_argument("Parameter size does not match");
-  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
-  std::copy(param.begin() + weight.size(), param.end(), bias.data());
-}
-
 std::vector<float> FullyConnected::get_derivatives() const {
   std::vector<float> res(grad_weight.size() + grad_bias.size());
   // Copy the data of weights and bias to a long vector
@@ -2,15 +2,13 @@
 #define SRC_LAYER_FULLY_CONNECTED_H_
 
 #include <vector>
-#include "../layer.h"
+#include "./weight_bias.h"
 
-class FullyConnected : public Layer {
+class FullyConnected : public WeightBiasLayer {
  private:
   const int dim_in;
   const int dim_out;
 
-  Matrix weight;  // weight parameter
-  Vector bias;  // bias paramter
   Matrix grad_weight;  // gradient w.r.t weight
   Vector grad_bias;  // gradient w.r.t bias
 
@@ -25,9 +23,12 @@ class FullyConnected : public Layer {
   void backward(const Matrix& bottom, const Matrix& grad_top);
   void update(Optimizer& opt);
   int output_dim() { return dim_out; }
+  const char* name() const { return "fc"; }
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
   std::vector<float> get_parameters() const;
   std::vector<float> get_derivatives() const;
-  void set_parameters(const std::vector<float>& param);
 };
 
 #endif  // SRC_LAYER_FULLY_CONNECTED_H_
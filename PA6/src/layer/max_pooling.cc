@@ -1,4 +1,5 @@
 #include "./max_pooling.h"
+#include "./custom/command-graph.h"
 #include <math.h>
 #include <limits>
 #include <iostream>
@@ -52,3 +53,20 @@ void MaxPooling::backward(const Matrix& bottom, const Matrix& grad_top) {
     }
   }
 }
+
+bool MaxPooling::record(CommandGraph& graph, int bottom, int top, int top_dim,
+                        int n_sample) {
+  const size_t global_size[3] = {(size_t)width_out, (size_t)height_out,
+                                 (size_t)n_sample * channel_in};
+  const int node = graph.add_kernel("maxpool_kernel", 3, global_size, NULL);
+  graph.arg_slot(node, 0, top, true);
+  graph.arg_slot(node, 1, bottom, false);
+  graph.arg_value(node, 2, sizeof(int), &height_in);
+  graph.arg_value(node, 3, sizeof(int), &width_in);
+  graph.arg_value(node, 4, sizeof(int), &height_pool);
+  graph.arg_value(node, 5, sizeof(int), &width_pool);
+  graph.arg_value(node, 6, sizeof(int), &stride);
+  graph.arg_value(node, 7, sizeof(int), &height_out);
+  graph.arg_value(node, 8, sizeof(int), &width_out);
+  return true;
+}
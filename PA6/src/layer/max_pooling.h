@@ -35,6 +35,12 @@ class MaxPooling : public Layer {
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
   int output_dim() { return dim_out; }
+  const char* name() const { return "maxpool"; }
+  bool record(CommandGraph& graph, int bottom, int top, int top_dim,
+              int n_sample);
+  int infer_output_dim(int input_dim) {
+    return check_input_dim(input_dim, dim_in, dim_out);
+  }
 };
 
 #endif  // SRC_LAYER_MAX_POOLING_H_
@@ -1,4 +1,5 @@
 #include "./relu.h"
+#include "./custom/command-graph.h"
 
 void ReLU::forward(const Matrix& bottom) {
   // a = z*(z>0)
@@ -11,3 +12,14 @@ void ReLU::backward(const Matrix& bottom, const Matrix& grad_top) {
   Matrix positive = (bottom.array() > 0.0).cast<float>();
   grad_bottom = grad_top.cwiseProduct(positive);
 }
+
+bool ReLU::record(CommandGraph& graph, int bottom, int top, int top_dim,
+                  int n_sample) {
+  const int n = top_dim * n_sample;
+  const size_t global_size[1] = {(size_t)n};
+  const int node = graph.add_kernel("relu_kernel", 1, global_size, NULL);
+  graph.arg_slot(node, 0, top, true);
+  graph.arg_slot(node, 1, bottom, false);
+  graph.arg_value(node, 2, sizeof(int), &n);
+  return true;
+}
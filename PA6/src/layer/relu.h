@@ -7,6 +7,9 @@ class ReLU : public Layer {
  public:
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
+  const char* name() const { return "relu"; }
+  bool record(CommandGraph& graph, int bottom, int top, int top_dim,
+              int n_sample);
 };
 
 #endif  // SRC_LAYER_RELU_H_
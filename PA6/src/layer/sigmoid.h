@@ -7,6 +7,7 @@ class Sigmoid : public Layer {
  public:
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
+  const char* name() const { return "sigmoid"; }
 };
 
 #endif  // SRC_LAYER_SIGMOID_H_
@@ -7,6 +7,7 @@ class Softmax: public Layer {
  public:
   void forward(const Matrix& bottom);
   void backward(const Matrix& bottom, const Matrix& grad_top);
+  const char* name() const { return "softmax"; }
 };
 
 #endif  // SRC_LAYER_SOFTMAX_H_
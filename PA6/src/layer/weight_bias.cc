@@ -0,0 +1,38 @@
+#include "./weight_bias.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+void WeightBiasLayer::set_parameters(const std::vector<float>& param) {
+  if (static_cast<int>(param.size()) != weight.size() + bias.size())
+      throw std::invalid_argument("Parameter size does not match");
+  // Copies always land in owned storage, even if the weights were bound
+  if (weight.data() != weight_storage.data()) {
+    weight_storage.resize(weight.rows(), weight.cols());
+    new (&weight) Eigen::Map<Matrix>(weight_storage.data(),
+                                     weight.rows(), weight.cols());
+  }
+  std::copy(param.begin(), param.begin() + weight.size(), weight.data());
+  std::copy(param.begin() + weight.size(), param.end(), bias.data());
+  parameters_changed();
+}
+
+void WeightBiasLayer::bind_parameters(float* param, int size) {
+  if (size != weight.size() + bias.size())
+      throw std::invalid_argument("Parameter size does not match");
+  // Weights are used in place. The bias starts right after them, so it is
+  // only float-aligned, and update() views it as a Vector::AlignedMapType;
+  // an owned copy keeps that view valid.
+  new (&weight) Eigen::Map<Matrix>(param, weight.rows(), weight.cols());
+  weight_storage.resize(0, 0);
+  std::copy(param + weight.size(), param + size, bias.data());
+  parameters_changed();
+}
+
+float* WeightBiasLayer::parameter_view(int index) {
+  if (index < 0 || index >= weight.size() + bias.size())
+    throw std::out_of_range("Parameter index out of range");
+  parameters_changed();
+  return index < weight.size() ? weight.data() + index
+                              : bias.data() + (index - weight.size());
+}
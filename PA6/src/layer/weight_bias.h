@@ -0,0 +1,28 @@
+#ifndef SRC_LAYER_WEIGHT_BIAS_H_
+#define SRC_LAYER_WEIGHT_BIAS_H_
+
+#include <vector>
+#include "../layer.h"
+
+// Base of the layers whose parameters are a weight matrix followed by a bias
+// vector, in one block. The weights can be bound to external memory (see
+// Layer::bind_parameters); the bias is always owned.
+class WeightBiasLayer : public Layer {
+ protected:
+  Matrix weight_storage;  // owned weights, released once weights are bound
+  Eigen::Map<Matrix> weight;  // weight parameter, owned or bound
+  Vector bias;  // bias parameter
+
+  WeightBiasLayer() : weight(NULL, 0, 0) {}
+
+  /// Called whenever the parameters may have changed outside the layer;
+  /// device layers drop their device copies here
+  virtual void parameters_changed() {}
+
+ public:
+  void set_parameters(const std::vector<float>& param);
+  void bind_parameters(float* param, int size);
+  float* parameter_view(int index);
+};
+
+#endif  // SRC_LAYER_WEIGHT_BIAS_H_
@@ -81,3 +81,8 @@ void MNIST::read_test_data(int batch_size) {
   read_mnist_data(data_dir + "t10k-86-images-idx3-ubyte", test_data, batch_size);
   read_mnist_label(data_dir + "t10k-86-labels-idx1-ubyte", test_labels, batch_size);
 }
+
+void MNIST::read_train_data(int batch_size) {
+  read_mnist_data(data_dir + "train-86-images-idx3-ubyte", train_data, batch_size);
+  read_mnist_label(data_dir + "train-86-labels-idx1-ubyte", train_labels, batch_size);
+}
@@ -22,6 +22,7 @@ class MNIST {
   explicit MNIST(std::string data_dir) : data_dir(data_dir) {}
   void read();
   void read_test_data(int batch_size); 
+  void read_train_data(int batch_size);
 };
 
 #endif  // SRC_MNIST_H_
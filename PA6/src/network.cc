@@ -5,7 +5,7 @@ void Network::forward(const Matrix& input) {
     return;
   layers[0]->forward(input);
   for (int i = 1; i < layers.size(); i++) {
-    layers[i]->forward(layers[i-1]->output());
+    layers[i]->forward_from(layers[i-1]);
   }
 }
 
@@ -45,12 +45,44 @@ std::vector<std::vector<float> > Network::get_parameters() const {
   return res;
 }
 
-void Network::set_parameters(const std::vector< std::vector<float> >& param) {
+std::vector<int> Network::match_parameters(
+    const std::vector<int>& sizes) const {
   const int n_layer = layers.size();
-  if (static_cast<int>(param.size()) != n_layer)
+  const int n_block = sizes.size();
+  std::vector<int> slot(n_layer, -1);
+  if (n_block == n_layer) {
+    for (int i = 0; i < n_layer; i++)
+      slot[i] = i;
+    return slot;
+  }
+  // Layer counts differ (e.g. ReLU/Softmax fused into FullyConnected_Custom):
+  // pair up the non-empty blocks with the layers that have parameters
+  int j = 0;
+  for (int i = 0; i < n_layer; i++) {
+    if (layers[i]->get_parameters().empty())
+      continue;
+    while (j < n_block && sizes[j] == 0)
+      j++;
+    if (j == n_block)
       throw std::invalid_argument("Parameter size does not match");
+    slot[i] = j++;
+  }
+  while (j < n_block && sizes[j] == 0)
+    j++;
+  if (j != n_block)
+    throw std::invalid_argument("Parameter size does not match");
+  return slot;
+}
+
+void Network::set_parameters(const std::vector< std::vector<float> >& param) {
+  const int n_layer = layers.size();
+  std::vector<int> sizes(param.size());
+  for (int j = 0; j < static_cast<int>(param.size()); j++)
+    sizes[j] = param[j].size();
+  const std::vector<int> slot = match_parameters(sizes);
   for (int i = 0; i < n_layer; i++) {
-    layers[i]->set_parameters(param[i]);
+    if (slot[i] >= 0)
+      layers[i]->set_parameters(param[slot[i]]);
   }
 }
 
@@ -64,6 +96,12 @@ std::vector<std::vector<float> > Network::get_derivatives() const {
   return res;
 }
 
+float Network::evaluate_loss(const Matrix& input, const Matrix& target) {
+  this->forward(input);
+  loss->evaluate(this->output(), target);
+  return loss->output();
+}
+
 void Network::check_gradient(const Matrix& input, const Matrix& target,
                              int n_points, int seed) {
   if (seed > 0)
@@ -71,7 +109,6 @@ void Network::check_gradient(const Matrix& input, const Matrix& target,
 
   this->forward(input);
   this->backward(input, target);
-  std::vector< std::vector<float> > param = this->get_parameters();
   std::vector< std::vector<float> > deriv = this->get_derivatives();
 
   const float eps = 1e-4;
@@ -83,20 +120,15 @@ void Network::check_gradient(const Matrix& input, const Matrix& target,
     const int n_param = deriv[layer_id].size();
     if (n_param < 1)  continue;
     const int param_id = int(std::rand() / double(RAND_MAX) * n_param);
-    // Turbulate the parameter a little bit
-    const float old = param[layer_id][param_id];
+    // Turbulate the parameter a little bit, in place. Each write goes
+    // through a fresh view so device layers drop their stale copy.
+    const float old = *this->parameter_view(layer_id, param_id);
 
-    param[layer_id][param_id] -= eps;
-    this->set_parameters(param);
-    this->forward(input);
-    this->backward(input, target);
-    const float loss_pre = loss->output();
+    *this->parameter_view(layer_id, param_id) = old - eps;
+    const float loss_pre = this->evaluate_loss(input, target);
 
-    param[layer_id][param_id] += eps * 2;
-    this->set_parameters(param);
-    this->forward(input);
-    this->backward(input, target);
-    const float loss_post = loss->output();
+    *this->parameter_view(layer_id, param_id) = old + eps;
+    const float loss_post = this->evaluate_loss(input, target);
 
     const float deriv_est = (loss_post - loss_pre) / eps / 2;
 
@@ -104,11 +136,8 @@ void Network::check_gradient(const Matrix& input, const Matrix& target,
     "] deriv = " << deriv[layer_id][param_id] << ", est = " << deriv_est <<
     ", diff = " << deriv_est - deriv[layer_id][param_id] << std::endl;
 
-    param[layer_id][param_id] = old;
+    *this->parameter_view(layer_id, param_id) = old;
   }
-
-  // Restore original parameters
-  this->set_parameters(param);
 }
 
 void Network::save_parameters(std::string filename) {
@@ -133,9 +162,11 @@ void Network::save_parameters(std::string filename) {
   }
 }
 
-void Network::load_parameters(std::string filename) {
+std::vector<std::vector<float> > Network::read_parameters(std::string filename) {
   std::ifstream in;
   in.open(filename, std::ios::in | std::ios::binary);
+  if (!in.is_open())
+      throw std::runtime_error("Failed to open " + filename);
   std::vector< std::vector<float> > res;
   
   int n_layer;
@@ -148,17 +179,59 @@ void Network::load_parameters(std::string filename) {
   for (int i=0; i<n_layer; i++){
     in.read(reinterpret_cast<char*>(&layer_size), sizeof(int));
     // std::cout<<"Layer "<<i<<" size: "<<layer_size<<std::endl;
-    std::vector<float> layer_params;
-    layer_params.reserve(layer_size);
-    for (int j=0; j<layer_size; j++)
-    {
-      float param = 0;
-      in.read(reinterpret_cast<char*>(&param), sizeof(float));
-      layer_params.push_back(param);
-    }
+    // Read the whole layer block at once
+    std::vector<float> layer_params(layer_size);
+    in.read(reinterpret_cast<char*>(layer_params.data()),
+            layer_size * sizeof(float));
     res.push_back(layer_params);
   }
-  
-  set_parameters(res);
+  return res;
+}
+
+void Network::bind_parameters(const std::vector<float*>& param,
+                              const std::vector<int>& sizes) {
+  const std::vector<int> slot = match_parameters(sizes);
+  for (int i = 0; i < static_cast<int>(layers.size()); i++) {
+    const int j = slot[i];
+    if (j >= 0 && sizes[j] > 0)
+      layers[i]->bind_parameters(param[j], sizes[j]);
+  }
+}
+
+void Network::load_parameters(std::string filename, bool verify) {
+  if (WeightFile::is_weight_file(filename)) {
+    map_parameters(filename, verify);
+    return;
+  }
+  set_parameters(read_parameters(filename));
 }
 
+void Network::map_parameters(std::string filename, bool verify) {
+  WeightFile* file = new WeightFile(filename);
+  const int n_layer = layers.size();
+  std::vector<int> sizes(file->n_layer());
+  for (int j = 0; j < file->n_layer(); j++)
+    sizes[j] = file->count(j);
+  std::vector<int> slot;
+  try {
+    slot = match_parameters(sizes);
+  } catch (const std::invalid_argument&) {
+    slot.clear();
+  }
+  if (slot.empty() || (verify && !file->verify())) {
+    delete file;
+    throw std::invalid_argument("Weight file does not match network");
+  }
+  for (int i = 0; i < n_layer; i++) {
+    const int j = slot[i];
+    if (j < 0 || file->count(j) == 0)
+      continue;
+    if (file->dtype(j) == WeightFile::FLOAT32)
+      layers[i]->bind_parameters(file->data(j), file->count(j));
+    else
+      layers[i]->set_parameters(file->to_float(j));
+  }
+  // Every layer now points into the new mapping (or owns a copy)
+  delete weights;
+  weights = file;
+}
@@ -9,15 +9,20 @@
 #include "./loss.h"
 #include "./optimizer.h"
 #include "./utils.h"
+#include "./weight_file.h"
 
 class Network {
  private:
   std::vector<Layer*> layers;  // layer pointers
   Loss* loss;  // loss pointer
+  WeightFile* weights;  // mapped parameters bound into the layers
   float BIN_FILE_DELIM = 0xFFFFFFFF;
 
+  /// Layer -> block index in a saved parameter list (-1: no parameters)
+  std::vector<int> match_parameters(const std::vector<int>& sizes) const;
+
  public:
-  Network() : loss(NULL) {}
+  Network() : loss(NULL), weights(NULL) {}
   ~Network() {
     for (int i = 0; i < layers.size(); i ++) {
       delete layers[i];
@@ -25,10 +30,14 @@ class Network {
     if (loss) {
       delete loss;
     }
+    // Layers may still point into the mapping, so unmap last
+    delete weights;
   }
 
   void add_layer(Layer* layer) { layers.push_back(layer); }
   void add_loss(Loss* loss_in) { loss = loss_in; }
+  int n_layers() const { return layers.size(); }
+  Layer* layer(int i) { return layers[i]; }
 
   void forward(const Matrix& input);
   void backward(const Matrix& input, const Matrix& target);
@@ -36,17 +45,40 @@ class Network {
 
   const Matrix& output() { return layers.back()->output(); }
   float get_loss() { return loss->output(); }
+  /// Argmax of the output per sample; returns the number of correct ones
+  int classify(const Matrix& labels, std::vector<int>& pred,
+               bool apply_softmax = false) {
+    return layers.back()->classify(labels, pred, apply_softmax);
+  }
   /// Get the serialized layer parameters
   std::vector<std::vector<float> > get_parameters() const;
-  /// Set the layer parameters
+  /// Set the layer parameters; the list may come from a network whose
+  /// parameter-free layers were fused away (or not)
   void set_parameters(const std::vector< std::vector<float> >& param);
+  /// Use caller-owned per-layer blocks as the parameter storage (see
+  /// Layer::bind_parameters); the blocks must outlive the binding
+  void bind_parameters(const std::vector<float*>& param,
+                       const std::vector<int>& sizes);
   /// Get the serialized derivatives of layer parameters
   std::vector<std::vector<float> > get_derivatives() const;
+  /// Forward pass and loss only, no backward
+  float evaluate_loss(const Matrix& input, const Matrix& target);
+  /// In-place view of one parameter (see Layer::parameter_view)
+  float* parameter_view(int layer, int index) {
+    return layers[layer]->parameter_view(index);
+  }
   /// Debugging tool to check parameter gradients
   void check_gradient(const Matrix& input, const Matrix& target, int n_points,
                       int seed = -1);
   void save_parameters(std::string filename);
-  void load_parameters(std::string filename);
+  /// Load either a legacy .bin file or a WeightFile container (see
+  /// map_parameters for verify)
+  void load_parameters(std::string filename, bool verify = false);
+  /// Map a WeightFile container and bind its blocks into the layers. With
+  /// verify the checksum is checked too, which reads every page of the file.
+  void map_parameters(std::string filename, bool verify = false);
+  /// Read the per-layer parameters of a legacy .bin file
+  static std::vector<std::vector<float> > read_parameters(std::string filename);
 };
 
 #endif  // SRC_NETWORK_H_
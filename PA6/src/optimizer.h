@@ -13,6 +13,11 @@ class Optimizer {
                      lr(lr), decay(decay) {}
   virtual ~Optimizer() {}
 
+  float learning_rate() const { return lr; }
+  float weight_decay() const { return decay; }
+
+  /// State such as momentum is kept per parameter block, keyed by the
+  /// block's address, so blocks may be updated in any order or skipped
   virtual void update(Vector::AlignedMapType& w,
                       Vector::ConstAlignedMapType& dw) = 0;
 };
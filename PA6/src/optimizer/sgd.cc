@@ -1,15 +1,20 @@
 #include "./sgd.h"
+#include <stdexcept>
 
 void SGD::update(Vector::AlignedMapType& w,
                  Vector::ConstAlignedMapType& dw) {
   // refer to SGD in PyTorch:
   // https://github.com/pytorch/pytorch/blob/master/torch/optim/sgd.py
-  // If v is zero, initialize it
-  Vector& v = v_map[dw.data()];
+  // Velocity belongs to the parameter block, not to the order of the
+  // update() calls, which may change when a layer switches between its
+  // host and device paths. If v is zero, initialize it
+  Vector& v = v_map[w.data()];
   if (v.size() == 0) {
     v.resize(dw.size());
     v.setZero();
   }
+  if (v.size() != dw.size())
+    throw std::invalid_argument("Optimizer state does not match parameters");
   // update v
   v = momentum * v + (dw + decay * w);
   // update w
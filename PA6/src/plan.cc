@@ -0,0 +1,179 @@
+#include "./plan.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+static const char* PLAN_MAGIC = "ece408-plan";
+static const int PLAN_VERSION = 2;
+
+int ExecutionPlan::find_algorithm(Layer* layer, const std::string& algorithm) {
+  std::vector<std::string> algs = layer->algorithms();
+  for (size_t i = 0; i < algs.size(); i++) {
+    if (algs[i] == algorithm)
+      return i;
+  }
+  return -1;
+}
+
+void ExecutionPlan::compile(Network& dnn, int input_dim, int batch_size) {
+  this->input_dim = input_dim;
+  this->batch_size = batch_size;
+  steps.clear();
+  int dim = input_dim;
+  for (int i = 0; i < dnn.n_layers(); i++) {
+    Layer* layer = dnn.layer(i);
+    Step step;
+    step.layer = layer->name();
+    step.input_dim = dim;
+    try {
+      step.output_dim = layer->infer_output_dim(dim);
+    } catch (const std::invalid_argument&) {
+      throw std::invalid_argument("Layer " + std::to_string(i) + " ("
+                                  + step.layer + ") cannot take "
+                                  + std::to_string(dim) + " inputs");
+    }
+    step.algorithm = layer->algorithms()[0];
+    step.ms = -1;
+    steps.push_back(step);
+    dim = step.output_dim;
+  }
+}
+
+void ExecutionPlan::autotune(Network& dnn, const Matrix& sample, int repeat) {
+  if (sample.rows() != input_dim || sample.cols() != batch_size)
+    throw std::invalid_argument("Sample does not match the plan");
+  Matrix input = sample;
+  for (size_t i = 0; i < steps.size(); i++) {
+    Layer* layer = dnn.layer(i);
+    std::vector<std::string> algs = layer->algorithms();
+    int best = 0;
+    float best_ms = 0;
+    for (size_t a = 0; a < algs.size(); a++) {
+      layer->set_algorithm(a);
+      layer->reserve(steps[i].output_dim, batch_size);
+      // The first run uploads weights and warms up caches
+      layer->forward(input);
+      layer->output();
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int r = 0; r < repeat; r++) {
+        layer->forward(input);
+        layer->output();  // device layers: include the readback
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      const float ms = std::chrono::duration<float, std::milli>(end - start)
+                       .count() / repeat;
+      if (a == 0 || ms < best_ms) {
+        best = a;
+        best_ms = ms;
+      }
+    }
+    layer->set_algorithm(best);
+    steps[i].algorithm = algs[best];
+    steps[i].ms = best_ms;
+    // The next layer is tuned on what the chosen algorithm produces
+    layer->forward(input);
+    input = layer->output();
+  }
+}
+
+void ExecutionPlan::apply(Network& dnn) const {
+  if (dnn.n_layers() != static_cast<int>(steps.size()))
+    throw std::invalid_argument("Plan does not match the network");
+  for (size_t i = 0; i < steps.size(); i++) {
+    Layer* layer = dnn.layer(i);
+    const int index = find_algorithm(layer, steps[i].algorithm);
+    if (index < 0)
+      throw std::invalid_argument("Unknown algorithm " + steps[i].algorithm);
+    layer->set_algorithm(index);
+    layer->reserve(steps[i].output_dim, batch_size);
+  }
+}
+
+void ExecutionPlan::save(const std::string& filename) const {
+  std::ofstream ofs(filename.c_str());
+  if (!ofs)
+    throw std::runtime_error("Cannot write plan " + filename);
+  ofs << PLAN_MAGIC << " " << PLAN_VERSION << "\n"
+      << "device " << device << "\n"
+      << "input " << input_dim << "\n"
+      << "batch " << batch_size << "\n"
+      << "steps " << steps.size() << "\n";
+  for (size_t i = 0; i < steps.size(); i++) {
+    const Step& s = steps[i];
+    ofs << s.layer << " " << s.input_dim << " " << s.output_dim << " "
+        << s.algorithm << " " << s.ms << "\n";
+  }
+}
+
+bool ExecutionPlan::load(const std::string& filename, Network& dnn,
+                         int input_dim, int batch_size,
+                         const std::string& device) {
+  std::ifstream ifs(filename.c_str());
+  if (!ifs)
+    return false;
+  std::string magic, key, file_device;
+  int version, n_step;
+  int file_input, file_batch;
+  ifs >> magic >> version;
+  if (!ifs || magic != PLAN_MAGIC || version != PLAN_VERSION)
+    return false;
+  // Timings from one device say nothing about another
+  ifs >> key >> std::ws;
+  std::getline(ifs, file_device);
+  if (!ifs || file_device != device)
+    return false;
+  ifs >> key >> file_input >> key >> file_batch >> key >> n_step;
+  if (!ifs || file_input != input_dim || file_batch != batch_size)
+    return false;
+
+  // The saved steps must describe exactly the network we would compile now
+  ExecutionPlan fresh;
+  fresh.compile(dnn, input_dim, batch_size);
+  fresh.device = device;
+  if (n_step != static_cast<int>(fresh.steps.size()))
+    return false;
+  for (int i = 0; i < n_step; i++) {
+    Step s;
+    ifs >> s.layer >> s.input_dim >> s.output_dim >> s.algorithm >> s.ms;
+    const Step& expect = fresh.steps[i];
+    if (!ifs || s.layer != expect.layer || s.input_dim != expect.input_dim
+        || s.output_dim != expect.output_dim
+        || find_algorithm(dnn.layer(i), s.algorithm) < 0)
+      return false;
+    fresh.steps[i] = s;
+  }
+  *this = fresh;
+  return true;
+}
+
+bool ExecutionPlan::prepare(const std::string& filename, Network& dnn,
+                            const Matrix& sample, const std::string& device) {
+  const bool reused = load(filename, dnn, sample.rows(), sample.cols(), device);
+  if (!reused) {
+    compile(dnn, sample.rows(), sample.cols());
+    this->device = device;
+    autotune(dnn, sample);
+    save(filename);
+  }
+  apply(dnn);
+  return reused;
+}
+
+void ExecutionPlan::print() const {
+  std::cout << "Execution plan for " << device << " (input " << input_dim
+            << ", batch " << batch_size << ")" << std::endl;
+  for (size_t i = 0; i < steps.size(); i++) {
+    const Step& s = steps[i];
+    std::cout << "  " << std::setw(2) << i << "  " << std::left
+              << std::setw(12) << s.layer << std::right << std::setw(8)
+              << s.input_dim << " -> " << std::setw(6) << s.output_dim << "  "
+              << std::left << std::setw(14) << s.algorithm << std::right;
+    if (s.ms >= 0)
+      std::cout << std::fixed << std::setprecision(3) << s.ms << " ms"
+                << std::defaultfloat;
+    std::cout << std::endl;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef SRC_PLAN_H_
+#define SRC_PLAN_H_
+
+#include <string>
+#include <vector>
+#include "./network.h"
+
+// Compiled schedule for running a Network at a fixed batch size.
+//
+// compile() walks the layers once before any data moves: it infers every
+// layer's output size from the input size (so a mis-wired network fails
+// here rather than inside a kernel) and gives each layer its default
+// implementation. autotune() times each layer's alternatives (see
+// Layer::algorithms) on a sample batch and keeps the fastest. apply()
+// selects the planned implementations and preallocates every layer's
+// output and device buffers, so the first batch runs like any other.
+//
+// Plans are saved as a small text file and only reused for the same device,
+// layer sequence, shapes and batch size, so tuning is paid once per device,
+// network and batch size.
+class ExecutionPlan {
+ public:
+  struct Step {
+    std::string layer;  // Layer::name()
+    int input_dim;
+    int output_dim;
+    std::string algorithm;  // one of Layer::algorithms()
+    float ms;  // measured forward time, -1 if not tuned
+  };
+
+  ExecutionPlan() : input_dim(0), batch_size(0) {}
+
+  /// Shape inference and default algorithms; throws if shapes do not chain
+  void compile(Network& dnn, int input_dim, int batch_size);
+  /// Time every algorithm of every layer on sample and keep the fastest
+  void autotune(Network& dnn, const Matrix& sample, int repeat = 2);
+  /// Select the planned algorithms and preallocate buffers
+  void apply(Network& dnn) const;
+
+  /// Load a saved plan; false if missing or made for another device,
+  /// network, input size or batch size
+  bool load(const std::string& filename, Network& dnn, int input_dim,
+            int batch_size, const std::string& device);
+  void save(const std::string& filename) const;
+  /// Load filename, or compile, tune on sample and save it; then apply.
+  /// device names what the plan is tuned on, as OclDeviceProp::name.
+  /// Returns true if the saved plan was reused.
+  bool prepare(const std::string& filename, Network& dnn,
+               const Matrix& sample, const std::string& device);
+
+  const std::vector<Step>& get_steps() const { return steps; }
+  void print() const;
+
+ private:
+  std::string device;
+  int input_dim;
+  int batch_size;
+  std::vector<Step> steps;
+
+  static int find_algorithm(Layer* layer, const std::string& algorithm);
+};
+
+#endif  // SRC_PLAN_H_
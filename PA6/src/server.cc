@@ -0,0 +1,170 @@
+#include "./server.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+// Weight of the newest batch in the run time estimate
+static const float SMOOTHING = 0.2;
+
+InferenceServer::InferenceServer(Network& dnn, OpenCL* opencl, int input_dim,
+                                 int max_batch, float deadline_ms) :
+    dnn(dnn), opencl(opencl), input_dim(input_dim), max_batch(max_batch),
+    deadline_ms(deadline_ms), closed(false) {
+  if (max_batch < 1)
+    throw std::invalid_argument("max_batch must be at least 1");
+  // Record every batch size up front and time one run of each, so neither
+  // recording nor the first estimate lands on a request
+  std::vector<float> zeros((size_t)input_dim * max_batch, 0.0f);
+  for (int n = 1; ; n = std::min(2 * n, max_batch)) {
+    CommandGraph* g = graph(n);
+    std::vector<float> out(g->output_count());
+    g->run(zeros.data(), out.data());  // first run pays for the warm-up
+    Clock::time_point start = Clock::now();
+    g->run(zeros.data(), out.data());
+    run_ms[n] = std::chrono::duration<float, std::milli>(Clock::now() - start)
+                .count();
+    if (n == max_batch)
+      break;
+  }
+}
+
+InferenceServer::~InferenceServer() {
+  for (std::map<int, CommandGraph*>::iterator it = graphs.begin();
+       it != graphs.end(); ++it)
+    delete it->second;
+}
+
+int InferenceServer::padded(int n) const {
+  int p = 1;
+  while (p < n)
+    p *= 2;
+  return std::min(p, max_batch);
+}
+
+CommandGraph* InferenceServer::graph(int padded_batch) {
+  std::map<int, CommandGraph*>::iterator it = graphs.find(padded_batch);
+  if (it != graphs.end())
+    return it->second;
+  CommandGraph* g = new CommandGraph(opencl);
+  if (!g->record(dnn, input_dim, padded_batch)) {
+    delete g;
+    throw std::runtime_error("Network has layers without a device kernel");
+  }
+  graphs[padded_batch] = g;
+  return g;
+}
+
+float InferenceServer::estimate_ms(int n) {
+  return run_ms[padded(n)];
+}
+
+void InferenceServer::submit(uint32_t id, const float* input) {
+  Request request;
+  request.id = id;
+  request.input.assign(input, input + input_dim);
+  request.arrival = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (first_arrival == Clock::time_point())
+    first_arrival = request.arrival;
+  queue.push_back(request);
+  arrived.notify_one();
+}
+
+void InferenceServer::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  closed = true;
+  arrived.notify_one();
+}
+
+void InferenceServer::run(Reply reply, std::function<void()> flush) {
+  std::vector<Request> batch;
+  Matrix x, y;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      arrived.wait(lock, [this] { return !queue.empty() || closed; });
+      if (queue.empty())
+        break;  // closed and drained
+      // Hold the batch open while more requests can still be absorbed
+      // without the oldest one missing its deadline
+      while (static_cast<int>(queue.size()) < max_batch && !closed) {
+        const float slack = deadline_ms - estimate_ms(queue.size() + 1);
+        const Clock::time_point due = queue.front().arrival
+            + std::chrono::microseconds(static_cast<int64_t>(1000 * slack));
+        if (Clock::now() >= due)
+          break;
+        arrived.wait_until(lock, due);
+      }
+      const int n = std::min(static_cast<int>(queue.size()), max_batch);
+      batch.assign(queue.begin(), queue.begin() + n);
+      queue.erase(queue.begin(), queue.begin() + n);
+    }
+
+    const int n = batch.size();
+    const int p = padded(n);
+    CommandGraph* g = graph(p);
+    x.setZero(input_dim, p);
+    for (int i = 0; i < n; i++)
+      std::copy(batch[i].input.begin(), batch[i].input.end(), x.col(i).data());
+    y.resize(g->output_count() / p, p);
+
+    Clock::time_point start = Clock::now();
+    g->run(x.data(), y.data());
+    Clock::time_point end = Clock::now();
+    run_ms[p] = (1 - SMOOTHING) * run_ms[p] + SMOOTHING
+                * std::chrono::duration<float, std::milli>(end - start).count();
+
+    for (int i = 0; i < n; i++) {
+      Response response;
+      response.id = batch[i].id;
+      response.label = 0;
+      for (int c = 1; c < y.rows(); c++) {
+        if (y(c, i) > y(response.label, i))
+          response.label = c;
+      }
+      response.confidence = y(response.label, i);
+      reply(response);
+    }
+    if (flush)
+      flush();
+
+    Clock::time_point replied = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < n; i++)
+      latencies_ms.push_back(std::chrono::duration<float, std::milli>(
+                             replied - batch[i].arrival).count());
+    batch_sizes[n]++;
+    last_reply = replied;
+  }
+}
+
+void InferenceServer::print_report(std::ostream& os) const {
+  std::vector<float> sorted(latencies_ms);
+  if (sorted.empty()) {
+    os << "No requests served" << std::endl;
+    return;
+  }
+  std::sort(sorted.begin(), sorted.end());
+  const int n = sorted.size();
+  float sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += sorted[i];
+  const float seconds = std::chrono::duration<float>(last_reply - first_arrival)
+                        .count();
+
+  os << std::fixed << std::setprecision(3);
+  os << "Requests:   " << n << std::endl;
+  os << "Latency ms: p50 " << sorted[(n - 1) / 2]
+     << "  p99 " << sorted[std::max(0, int(std::ceil(0.99 * n)) - 1)]
+     << "  mean " << sum / n << "  max " << sorted[n - 1] << std::endl;
+  os << std::setprecision(1);
+  os << "Throughput: " << (seconds > 0 ? n / seconds : 0) << " requests/s"
+     << std::endl;
+  os << "Batches:   ";
+  for (std::map<int, int>::const_iterator it = batch_sizes.begin();
+       it != batch_sizes.end(); ++it)
+    os << " " << it->first << "x" << it->second;
+  os << std::endl << std::defaultfloat;
+}
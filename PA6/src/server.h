@@ -0,0 +1,86 @@
+#ifndef SRC_SERVER_H_
+#define SRC_SERVER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "./network.h"
+#include "./layer/custom/opencl.h"
+#include "./layer/custom/command-graph.h"
+
+// Long-lived classifier with dynamic micro-batching.
+//
+// Requests are queued by submit() from any thread. run() takes them off the
+// queue in batches: it dispatches as soon as max_batch requests are waiting,
+// or when the oldest one would otherwise miss its deadline, given the
+// measured run time of a batch of that size. Batches are padded to a power
+// of two and run through a CommandGraph recorded once per padded size, so
+// the weights, kernels and activation buffers stay resident between
+// requests.
+class InferenceServer {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Response {
+    uint32_t id;
+    int label;  // argmax class
+    float confidence;  // its softmax probability
+  };
+  typedef std::function<void(const Response&)> Reply;
+
+  InferenceServer(Network& dnn, OpenCL* opencl, int input_dim, int max_batch,
+                  float deadline_ms);
+  ~InferenceServer();
+
+  /// Queue one input of input_dim floats; thread-safe
+  void submit(uint32_t id, const float* input);
+  /// No more requests: run() returns once the queue is drained
+  void close();
+  /// Batching loop; reply is called on this thread, once per request, and
+  /// flush once per batch
+  void run(Reply reply, std::function<void()> flush = NULL);
+
+  /// Latency percentiles, throughput and batch sizes so far
+  void print_report(std::ostream& os) const;
+
+ private:
+  struct Request {
+    uint32_t id;
+    std::vector<float> input;
+    Clock::time_point arrival;
+  };
+
+  Network& dnn;
+  OpenCL* opencl;
+  const int input_dim;
+  const int max_batch;
+  const float deadline_ms;
+
+  std::mutex mutex;
+  std::condition_variable arrived;
+  std::deque<Request> queue;
+  bool closed;
+
+  std::map<int, CommandGraph*> graphs;  // by padded batch size
+  std::map<int, float> run_ms;  // padded batch size -> smoothed run time
+
+  std::vector<float> latencies_ms;
+  std::map<int, int> batch_sizes;  // requests per batch -> count
+  Clock::time_point first_arrival;
+  Clock::time_point last_reply;
+
+  int padded(int n) const;
+  CommandGraph* graph(int padded_batch);
+  float estimate_ms(int n);
+
+  InferenceServer(const InferenceServer&);
+  InferenceServer& operator=(const InferenceServer&);
+};
+
+#endif  // SRC_SERVER_H_
@@ -0,0 +1,127 @@
+#include "./trainer.h"
+
+#include <stdexcept>
+#include <thread>
+
+ParallelTrainer::ParallelTrainer(Builder build, int n_thread) {
+  if (n_thread < 1)
+    throw std::invalid_argument("Need at least one thread");
+  for (int t = 0; t < n_thread; t++) {
+    replicas.push_back(new Network());
+    build(*replicas.back());
+  }
+  // The first replica's initialization becomes the master copy
+  std::vector<std::vector<float> > init = replicas[0]->get_parameters();
+  params.resize(init.size());
+  sizes.resize(init.size());
+  for (size_t i = 0; i < init.size(); i++) {
+    sizes[i] = init[i].size();
+    params[i] = Vector::Map(init[i].data(), sizes[i]);
+  }
+  grads.resize(n_thread);
+  for (int t = 0; t < n_thread; t++) {
+    grads[t].resize(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++)
+      grads[t][i] = Vector::Zero(sizes[i]);
+  }
+  losses.resize(n_thread);
+  bind();
+}
+
+ParallelTrainer::~ParallelTrainer() {
+  for (int t = 0; t < n_thread(); t++)
+    delete replicas[t];
+}
+
+// Weights are used in place; biases are copied, so this runs again after
+// every update. The master blocks come from replicas[0]->get_parameters(),
+// one per layer of the same architecture, so block i always belongs to
+// layer i and no matching is needed; rebinding only copies the biases.
+void ParallelTrainer::bind() {
+  for (int t = 0; t < n_thread(); t++) {
+    for (size_t i = 0; i < params.size(); i++) {
+      if (sizes[i] > 0)
+        replicas[t]->layer(i)->bind_parameters(params[i].data(), sizes[i]);
+    }
+  }
+}
+
+void ParallelTrainer::step(int thread, const Matrix& data,
+                           const Matrix& target, int offset, int count,
+                           float scale) {
+  Network& dnn = *replicas[thread];
+  Matrix x = data.middleCols(offset, count);
+  Matrix y = target.middleCols(offset, count);
+  dnn.forward(x);
+  dnn.backward(x, y);
+  // The loss is a mean over the slice; weight it by the slice's share of
+  // the mini-batch so the reduced gradient is the mini-batch mean
+  losses[thread] = dnn.get_loss() * scale;
+  std::vector<std::vector<float> > deriv = dnn.get_derivatives();
+  for (size_t i = 0; i < deriv.size(); i++) {
+    if (sizes[i] > 0)
+      grads[thread][i] += scale * Vector::Map(deriv[i].data(), sizes[i]);
+  }
+}
+
+float ParallelTrainer::train_epoch(Matrix& data, Matrix& labels,
+                                   int batch_size, Optimizer& opt) {
+  shuffle_data(data, labels);
+  const Matrix target = one_hot_encode(labels, 10);
+  const int n_sample = data.cols();
+  const int n_thr = n_thread();
+
+  float loss = 0;
+  int n_batch = 0;
+  for (int start = 0; start < n_sample; start += batch_size) {
+    const int batch = std::min(batch_size, n_sample - start);
+    const int slice = (batch + n_thr - 1) / n_thr;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < n_thr; t++) {
+      const int offset = start + t * slice;
+      const int count = std::min(slice, start + batch - offset);
+      losses[t] = 0;
+      if (count <= 0)
+        continue;
+      workers.push_back(std::thread(&ParallelTrainer::step, this, t,
+                                    std::cref(data), std::cref(target),
+                                    offset, count, float(count) / batch));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+      workers[t].join();
+
+    // Reduce into thread 0's accumulators, then apply
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (sizes[i] == 0)
+        continue;
+      for (int t = 1; t < n_thr; t++) {
+        grads[0][i] += grads[t][i];
+        grads[t][i].setZero();
+      }
+      Vector::AlignedMapType w(params[i].data(), sizes[i]);
+      Vector::ConstAlignedMapType dw(grads[0][i].data(), sizes[i]);
+      opt.update(w, dw);
+      grads[0][i].setZero();
+    }
+    bind();
+
+    for (int t = 0; t < n_thr; t++)
+      loss += losses[t];
+    n_batch++;
+  }
+  return n_batch ? loss / n_batch : 0;
+}
+
+float ParallelTrainer::evaluate(const Matrix& data, const Matrix& labels) {
+  std::vector<int> pred;
+  replicas[0]->forward(data);
+  return float(replicas[0]->classify(labels, pred)) / data.cols();
+}
+
+std::vector<std::vector<float> > ParallelTrainer::get_parameters() const {
+  std::vector<std::vector<float> > res(params.size());
+  for (size_t i = 0; i < params.size(); i++)
+    res[i].assign(params[i].data(), params[i].data() + sizes[i]);
+  return res;
+}
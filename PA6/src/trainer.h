@@ -0,0 +1,43 @@
+#ifndef SRC_TRAINER_H_
+#define SRC_TRAINER_H_
+
+#include <vector>
+#include "./network.h"
+#include "./optimizer.h"
+
+// Data-parallel mini-batch training on the host. Every thread owns a replica
+// of the network whose parameters are bound to one shared master copy. Each
+// mini-batch is split across the threads. Every thread accumulates the
+// gradient of its slice into its own buffers, and the buffers are reduced
+// and applied once at the end of the mini-batch.
+class ParallelTrainer {
+ public:
+  typedef void (*Builder)(Network& dnn);
+
+  ParallelTrainer(Builder build, int n_thread);
+  ~ParallelTrainer();
+
+  int n_thread() const { return replicas.size(); }
+  /// Shuffle, then one pass over data; returns the mean training loss
+  float train_epoch(Matrix& data, Matrix& labels, int batch_size,
+                    Optimizer& opt);
+  /// Fraction of columns classified correctly by the current parameters
+  float evaluate(const Matrix& data, const Matrix& labels);
+  std::vector<std::vector<float> > get_parameters() const;
+
+ private:
+  std::vector<Network*> replicas;
+  std::vector<Vector> params;  // master parameters, one block per layer
+  std::vector<int> sizes;  // block sizes (0 for layers without parameters)
+  std::vector< std::vector<Vector> > grads;  // per-thread accumulators
+  std::vector<float> losses;  // per-thread weighted loss of the batch
+
+  void bind();
+  void step(int thread, const Matrix& data, const Matrix& target,
+            int offset, int count, float scale);
+
+  ParallelTrainer(const ParallelTrainer&);
+  ParallelTrainer& operator=(const ParallelTrainer&);
+};
+
+#endif  // SRC_TRAINER_H_
@@ -6,6 +6,10 @@
 #include <iostream>
 #include <random>
 #include <chrono>       // std::chrono::system_clock
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> Matrix;
 typedef Eigen::Matrix<float, Eigen::Dynamic, 1> Vector;
@@ -55,4 +59,66 @@ inline float compute_accuracy(const Matrix& preditions, const Matrix& labels) {
   return acc / n;
 }
 
+// Fused classification over the columns of a n_class x n_sample score
+// matrix: argmax (first maximum, like maxCoeff), an optional numerically
+// stable softmax written back in place, and the number of correct
+// predictions, all in a single pass over each column.
+inline int classify_columns(float* z, int n_class, int n_sample,
+                            const float* labels, int* pred,
+                            bool apply_softmax) {
+  int correct = 0;
+  for (int n = 0; n < n_sample; n++) {
+    float* col = z + (size_t)n * n_class;
+    float max_val = col[0];
+    int max_idx = 0;
+#ifdef __SSE2__
+    int d = 0;
+    __m128 vmax = _mm_set1_ps(-INFINITY);
+    for (; d + 4 <= n_class; d += 4)
+      vmax = _mm_max_ps(vmax, _mm_loadu_ps(col + d));
+    vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    max_val = std::max(max_val, _mm_cvtss_f32(vmax));
+    for (; d < n_class; d++)
+      max_val = std::max(max_val, col[d]);
+    // Locate the first lane equal to the maximum
+    const __m128 vbest = _mm_set1_ps(max_val);
+    max_idx = -1;
+    for (d = 0; d + 4 <= n_class; d += 4) {
+      int mask = _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(col + d), vbest));
+      if (mask) {
+        max_idx = d + __builtin_ctz(mask);
+        break;
+      }
+    }
+    for (; max_idx < 0 && d < n_class; d++) {
+      if (col[d] == max_val)
+        max_idx = d;
+    }
+    if (max_idx < 0)  // NaN scores
+      max_idx = 0;
+#else
+    for (int d = 1; d < n_class; d++) {
+      if (col[d] > max_val) {
+        max_val = col[d];
+        max_idx = d;
+      }
+    }
+#endif
+    if (apply_softmax) {
+      float sum = 0;
+      for (int d = 0; d < n_class; d++) {
+        col[d] = std::exp(col[d] - max_val);
+        sum += col[d];
+      }
+      const float inv_sum = 1.0f / sum;
+      for (int d = 0; d < n_class; d++)
+        col[d] *= inv_sum;
+    }
+    pred[n] = max_idx;
+    correct += max_idx == int(labels[n]);
+  }
+  return correct;
+}
+
 #endif  // SRC_UTILS_H_
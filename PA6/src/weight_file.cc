@@ -0,0 +1,185 @@
+#include "./weight_file.h"
+
+#include <string.h>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <CL/cl_half.h>
+
+static const char WEIGHT_MAGIC[8] = {'E', '4', '0', '8', 'W', 'G', 'T', '\0'};
+
+uint64_t WeightFile::checksum(const char* begin, const char* end) {
+  uint64_t hash = 1469598103934665603ULL;  // FNV-1a offset basis
+  for (const char* p = begin; p != end; p++) {
+    hash ^= (unsigned char)*p;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+size_t WeightFile::dtype_size(uint32_t dtype) {
+  switch (dtype) {
+    case FLOAT32: return sizeof(float);
+    case FLOAT16: return sizeof(cl_half);
+    default: throw std::runtime_error("Unknown weight dtype");
+  }
+}
+
+bool WeightFile::is_weight_file(const std::string& filename) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  char magic[sizeof(WEIGHT_MAGIC)] = {0};
+  in.read(magic, sizeof(magic));
+  return in && memcmp(magic, WEIGHT_MAGIC, sizeof(magic)) == 0;
+}
+
+void WeightFile::write(const std::string& filename,
+                       const std::vector< std::vector<float> >& param,
+                       DType dtype) {
+  const size_t n_layer = param.size();
+  const size_t elem_size = dtype_size(dtype);
+
+  // Lay out the blocks
+  std::vector<Entry> entries(n_layer);
+  size_t offset = sizeof(Header) + n_layer * sizeof(Entry);
+  for (size_t i = 0; i < n_layer; i++) {
+    offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    entries[i].offset = offset;
+    entries[i].count = param[i].size();
+    entries[i].dtype = dtype;
+    offset += param[i].size() * elem_size;
+  }
+
+  std::vector<char> image(offset, 0);
+  memcpy(image.data() + sizeof(Header), entries.data(),
+         n_layer * sizeof(Entry));
+  for (size_t i = 0; i < n_layer; i++) {
+    char* block = image.data() + entries[i].offset;
+    if (dtype == FLOAT32) {
+      memcpy(block, param[i].data(), param[i].size() * sizeof(float));
+    } else {
+      cl_half* halves = reinterpret_cast<cl_half*>(block);
+      for (size_t j = 0; j < param[i].size(); j++)
+        halves[j] = cl_half_from_float(param[i][j], CL_HALF_RTE);
+    }
+  }
+
+  Header header;
+  memcpy(header.magic, WEIGHT_MAGIC, sizeof(WEIGHT_MAGIC));
+  header.version = VERSION;
+  header.n_layer = n_layer;
+  header.alignment = ALIGNMENT;
+  header.reserved = 0;
+  header.checksum = checksum(image.data() + sizeof(Header),
+                             image.data() + image.size());
+  memcpy(image.data(), &header, sizeof(Header));
+
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  out.write(image.data(), image.size());
+  if (!out)
+    throw std::runtime_error("Failed to write " + filename);
+}
+
+WeightFile::WeightFile(const std::string& filename)
+    : base(NULL), length(0), header(NULL), table(NULL) {
+#ifdef _WIN32
+  file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_handle == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Failed to open " + filename);
+  LARGE_INTEGER size;
+  GetFileSizeEx(file_handle, &size);
+  length = size.QuadPart;
+  mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_WRITECOPY, 0, 0,
+                                      NULL);
+  if (mapping_handle)
+    base = (char*)MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0);
+  if (!base) {
+    if (mapping_handle) CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    throw std::runtime_error("Failed to map " + filename);
+  }
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open " + filename);
+  struct stat st;
+  fstat(fd, &st);
+  length = st.st_size;
+  // Private mapping: parameter updates copy the touched pages only
+  void* addr = length ? mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                             fd, 0) : MAP_FAILED;
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw std::runtime_error("Failed to map " + filename);
+  base = (char*)addr;
+#endif
+
+  header = reinterpret_cast<const Header*>(base);
+  table = reinterpret_cast<const Entry*>(base + sizeof(Header));
+  if (length < sizeof(Header) ||
+      memcmp(header->magic, WEIGHT_MAGIC, sizeof(WEIGHT_MAGIC)) != 0 ||
+      header->version != VERSION || header->alignment != ALIGNMENT ||
+      header->n_layer > (length - sizeof(Header)) / sizeof(Entry)) {
+    unmap();
+    throw std::runtime_error("Invalid weight file " + filename);
+  }
+  for (uint32_t i = 0; i < header->n_layer; i++) {
+    // Divide instead of multiply so a forged offset or count cannot wrap
+    if (table[i].offset % ALIGNMENT != 0 || table[i].dtype > FLOAT16 ||
+        table[i].offset > length ||
+        table[i].count > (length - table[i].offset)
+                             / dtype_size(table[i].dtype)) {
+      unmap();
+      throw std::runtime_error("Corrupt layer table in " + filename);
+    }
+  }
+}
+
+WeightFile::~WeightFile() {
+  unmap();
+}
+
+void WeightFile::unmap() {
+  if (!base)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(base);
+  CloseHandle(mapping_handle);
+  CloseHandle(file_handle);
+#else
+  munmap(base, length);
+#endif
+  base = NULL;
+}
+
+float* WeightFile::data(int layer) {
+  if (dtype(layer) != FLOAT32)
+    throw std::invalid_argument("Layer block is not float32");
+  return reinterpret_cast<float*>(base + table[layer].offset);
+}
+
+std::vector<float> WeightFile::to_float(int layer) const {
+  const char* block = base + table[layer].offset;
+  std::vector<float> res(count(layer));
+  if (dtype(layer) == FLOAT32) {
+    memcpy(res.data(), block, res.size() * sizeof(float));
+  } else {
+    const cl_half* halves = reinterpret_cast<const cl_half*>(block);
+    for (size_t j = 0; j < res.size(); j++)
+      res[j] = cl_half_to_float(halves[j]);
+  }
+  return res;
+}
+
+bool WeightFile::verify() const {
+  return checksum(base + sizeof(Header), base + length) == header->checksum;
+}
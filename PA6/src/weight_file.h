@@ -0,0 +1,81 @@
+#ifndef SRC_WEIGHT_FILE_H_
+#define SRC_WEIGHT_FILE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Versioned, memory-mapped container for network parameters.
+//
+// Layout (little endian):
+//   header   magic "E408WGT\0", version, n_layer, alignment, checksum
+//   table    n_layer x { offset, count, dtype }
+//   payload  one block per layer, each starting on an `alignment` boundary
+//
+// The checksum is FNV-1a over the table and the payload. Opening a file only
+// maps it and validates the header and table; float32 blocks are then used in
+// place (see Layer::bind_parameters), so loading costs O(1) plus page faults.
+// The checksum is only recomputed on request (verify()), since that reads the
+// whole file; convert_weights checks every file it writes.
+// The mapping is private copy-on-write: layers may update their parameters
+// without touching the file.
+class WeightFile {
+ public:
+  enum DType { FLOAT32 = 0, FLOAT16 = 1 };
+
+  static const uint32_t VERSION = 1;
+  static const uint32_t ALIGNMENT = 64;
+
+  explicit WeightFile(const std::string& filename);
+  ~WeightFile();
+
+  /// True if filename starts with the container magic
+  static bool is_weight_file(const std::string& filename);
+  /// Serialize per-layer parameters into a container
+  static void write(const std::string& filename,
+                    const std::vector< std::vector<float> >& param,
+                    DType dtype = FLOAT32);
+
+  int n_layer() const { return header->n_layer; }
+  int count(int layer) const { return int(table[layer].count); }
+  DType dtype(int layer) const { return DType(table[layer].dtype); }
+  /// Pointer to a FLOAT32 block inside the mapping
+  float* data(int layer);
+  /// Decode any block to float32
+  std::vector<float> to_float(int layer) const;
+  /// Recompute the checksum over table and payload
+  bool verify() const;
+
+ private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_layer;
+    uint32_t alignment;
+    uint32_t reserved;
+    uint64_t checksum;
+  };
+  struct Entry {
+    uint64_t offset;
+    uint32_t count;
+    uint32_t dtype;
+  };
+
+  char* base;
+  size_t length;
+  const Header* header;
+  const Entry* table;
+#ifdef _WIN32
+  void* file_handle;
+  void* mapping_handle;
+#endif
+
+  void unmap();
+  static uint64_t checksum(const char* begin, const char* end);
+  static size_t dtype_size(uint32_t dtype);
+
+  WeightFile(const WeightFile&);
+  WeightFile& operator=(const WeightFile&);
+};
+
+#endif  // SRC_WEIGHT_FILE_H_
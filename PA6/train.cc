@@ -0,0 +1,107 @@
+#include "ece408net.h"
+
+#include <chrono>
+#include <thread>
+
+#include "src/trainer.h"
+
+// Seconds for one epoch over data with the given number of threads
+double time_epoch(MNIST& dataset, int batch_size, int n_thread) {
+  ParallelTrainer trainer(buildNetwork_CPU, n_thread);
+  SGD opt(0.001, 5e-4, 0.9, true);
+  auto start_time = std::chrono::high_resolution_clock::now();
+  trainer.train_epoch(dataset.train_data, dataset.train_labels, batch_size, opt);
+  auto end_time = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(end_time - start_time).count();
+}
+
+void scaling(int n_train, int batch_size) {
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_train_data(n_train);
+  std::cout<<"Done"<<std::endl;
+
+  const int max_thread = std::max(1u, std::thread::hardware_concurrency());
+  double base = 0;
+  std::cout<<"threads  epoch (s)  epochs/s  speedup  efficiency"<<std::endl;
+  // Powers of two, then the full machine if it is not one of them
+  for (int n_thread = 1; n_thread <= max_thread;
+       n_thread = n_thread < max_thread && n_thread * 2 > max_thread
+                      ? max_thread : n_thread * 2) {
+    const double seconds = time_epoch(dataset, batch_size, n_thread);
+    if (n_thread == 1)
+      base = seconds;
+    printf("%7d  %9.3f  %8.4f  %7.2f  %10.2f\n", n_thread, seconds,
+           1 / seconds, base / seconds, base / seconds / n_thread);
+  }
+}
+
+void train(int n_epoch, int batch_size, int n_thread, int n_train) {
+
+  std::cout<<"Loading fashion-mnist data...";
+  MNIST dataset("./data/");
+  dataset.read_train_data(n_train);
+  dataset.read_test_data(-1);
+  std::cout<<"Done"<<std::endl;
+
+  ParallelTrainer trainer(buildNetwork_CPU, n_thread);
+  SGD opt(0.001, 5e-4, 0.9, true);
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (int epoch = 0; epoch < n_epoch; epoch++) {
+    auto epoch_start = std::chrono::high_resolution_clock::now();
+    float loss = trainer.train_epoch(dataset.train_data, dataset.train_labels,
+                                     batch_size, opt);
+    auto epoch_end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> epoch_time = (epoch_end-epoch_start);
+    float acc = trainer.evaluate(dataset.test_data, dataset.test_labels);
+    std::cout<<"Epoch "<<epoch<<": loss "<<loss<<", test accuracy "<<acc
+             <<", "<<epoch_time.count()<<" s"<<std::endl;
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> total = (end_time-start_time);
+  std::cout<<std::endl;
+  std::cout<<"Epochs/s: "<<n_epoch / total.count()<<std::endl;
+
+  // Save in the legacy format so m1/m2 (and make weights) can load it
+  Network dnn;
+  buildNetwork_CPU(dnn);
+  dnn.set_parameters(trainer.get_parameters());
+  dnn.save_parameters("./build/weights-trained.bin");
+}
+
+int main(int argc, char* argv[]) {
+
+  // ./train scaling [n_train] [batch]: one epoch per thread count
+  if(argc >= 2 && std::string(argv[1]) == "scaling"){
+    int n_train = argc >= 3 ? atoi(argv[2]) : 6000;
+    int batch_size = argc >= 4 ? atoi(argv[3]) : 128;
+    scaling(n_train, batch_size);
+    return 0;
+  }
+
+  // ./train <epochs> <batch> <threads> [n_train]
+  int n_epoch = 5;
+  int batch_size = 128;
+  int n_thread = std::max(1u, std::thread::hardware_concurrency());
+  int n_train = -1;
+  if(argc >= 2){
+    n_epoch = atoi(argv[1]);
+  }
+  if(argc >= 3){
+    batch_size = atoi(argv[2]);
+  }
+  if(argc >= 4){
+    n_thread = atoi(argv[3]);
+  }
+  if(argc >= 5){
+    n_train = atoi(argv[4]);
+  }
+
+  std::cout<<"Epochs: "<<n_epoch<<", batch size: "<<batch_size
+           <<", threads: "<<n_thread<<std::endl;
+  train(n_epoch, batch_size, n_thread, n_train);
+
+  return 0;
+}
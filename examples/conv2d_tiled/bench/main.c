@@ -0,0 +1,326 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "device.h"
+#include "../../opencl_utils.h"
+
+#define ITERATIONS 10 // Timed launches per kernel, after one warm-up
+#define MAX_GRID 16   // Entries per list on the command line
+
+// The naive kernel is the reference every tiled strategy is checked against
+enum { NAIVE, TYPE1, TYPE2, TYPE3, NUM_STRATEGIES };
+static const char *STRATEGY_NAMES[NUM_STRATEGIES] = {"conv", "type1", "type2", "type3"};
+
+typedef struct {
+    int H, W;
+} Shape;
+
+typedef struct {
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue queue;
+} Device;
+
+// Builds one strategy's kernel.cl, found in the directory named after it
+static cl_kernel buildStrategy(const Device *dev, int strategy, const char *options) {
+    char path[64];
+    snprintf(path, sizeof(path), "../%s/kernel.cl", STRATEGY_NAMES[strategy]);
+    const char *source = loadKernelSource(path, NULL);
+
+    cl_int err;
+    cl_program program = clCreateProgramWithSource(dev->context, 1, &source, NULL, &err);
+    checkErr(err, "clCreateProgramWithSource");
+    err = clBuildProgram(program, 1, &dev->device, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        size_t log_size;
+        clGetProgramBuildInfo(program, dev->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *log = (char*) malloc(log_size);
+        clGetProgramBuildInfo(program, dev->device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+        fprintf(stderr, "Build error in %s (%s):\n%s\n", path, options, log);
+        free(log);
+        exit(EXIT_FAILURE);
+    }
+    cl_kernel kernel = clCreateKernel(program, strategy == NAIVE ? "conv2d" : "conv_forward_kernel", &err);
+    checkErr(err, "clCreateKernel");
+    clReleaseProgram(program); // the kernel keeps it alive
+    free((void*)source);
+    return kernel;
+}
+
+// Work-group edge each strategy launches with; the naive kernel leaves it to the runtime
+static size_t groupEdge(int strategy, int K, int tile_width) {
+    switch (strategy) {
+    case TYPE1:
+    case TYPE3:
+        return tile_width;
+    case TYPE2:
+        return tile_width + 2 * (K / 2); // one work-item per input element, halo included
+    default:
+        return 0;
+    }
+}
+
+// Sets the arguments of a strategy's kernel and enqueues it, launched the way its own main.c does
+static void launchStrategy(const Device *dev, int strategy, cl_kernel kernel, cl_mem d_x, cl_mem d_mask,
+                           cl_mem d_y, int H, int W, int K, int tile_width, cl_event *event) {
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    // Output tiles along each axis; the naive kernel has no tiles
+    const unsigned int W_grid = tile_width ? (W_out + tile_width - 1) / tile_width : 0;
+    const unsigned int H_grid = tile_width ? (H_out + tile_width - 1) / tile_width : 0;
+    const size_t edge = groupEdge(strategy, K, tile_width);
+
+    cl_int err;
+    if (strategy == NAIVE) {
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_x);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_mask);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_y);
+    } else {
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_y);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_x);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_mask);
+    }
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &H);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &W);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
+    if (strategy == TYPE3) {
+        err |= clSetKernelArg(kernel, 6, sizeof(unsigned int), &W_grid);
+        err |= clSetKernelArg(kernel, 7, sizeof(unsigned int), &H_grid);
+    }
+    checkErr(err, "clSetKernelArg");
+
+    switch (strategy) {
+    case NAIVE: {
+        size_t global[2] = {W_out, H_out};
+        err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, NULL, global, NULL, 0, NULL, event);
+        break;
+    }
+    case TYPE2: {
+        // Group 1 walks the output tiles in row-major order
+        size_t local[3] = {edge, edge, 1};
+        size_t global[3] = {edge, edge * W_grid * H_grid, 1};
+        err = clEnqueueNDRangeKernel(dev->queue, kernel, 3, NULL, global, local, 0, NULL, event);
+        break;
+    }
+    default: {
+        size_t local[2] = {edge, edge};
+        size_t global[2] = {edge * W_grid, edge * H_grid};
+        err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, NULL, global, local, 0, NULL, event);
+        break;
+    }
+    }
+    checkErr(err, "clEnqueueNDRangeKernel");
+}
+
+// Average kernel time in ms over ITERATIONS launches
+static double timeStrategy(const Device *dev, int strategy, cl_kernel kernel, cl_mem d_x, cl_mem d_mask,
+                           cl_mem d_y, int H, int W, int K, int tile_width) {
+    double total_ms = 0;
+    for (int i = 0; i <= ITERATIONS; i++) {
+        cl_event event;
+        cl_ulong start, end;
+        launchStrategy(dev, strategy, kernel, d_x, d_mask, d_y, H, W, K, tile_width, &event);
+        checkErr(clWaitForEvents(1, &event), "clWaitForEvents");
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        clReleaseEvent(event);
+        if (i > 0) // the first launch pays for the warm-up
+            total_ms += (end - start) * 1e-6;
+    }
+    return total_ms / ITERATIONS;
+}
+
+// Checks one strategy against the naive kernel's output ref, then times it and prints its row.
+// The naive kernel itself passes ref NULL, and its output is read into y.
+// Returns whether the outputs matched.
+static int runStrategy(const Device *dev, int strategy, cl_kernel kernel, cl_mem d_x, cl_mem d_mask, cl_mem d_y,
+                       int H, int W, int K, int tile_width, float *y, const float *ref, float ref_max) {
+    const int H_out = H - K + 1;
+    const int W_out = W - K + 1;
+    const size_t out_count = (size_t)H_out * W_out;
+
+    // NaN marks outputs the kernel never wrote
+    const float unwritten = NAN;
+    checkErr(clEnqueueFillBuffer(dev->queue, d_y, &unwritten, sizeof(float), 0, sizeof(float) * out_count,
+                                 0, NULL, NULL), "clEnqueueFillBuffer");
+    launchStrategy(dev, strategy, kernel, d_x, d_mask, d_y, H, W, K, tile_width, NULL);
+    checkErr(clEnqueueReadBuffer(dev->queue, d_y, CL_TRUE, 0, sizeof(float) * out_count, y, 0, NULL, NULL),
+             "clEnqueueReadBuffer");
+    float max_diff = 0;
+    for (size_t i = 0; ref && i < out_count; i++) {
+        const float diff = fabsf(y[i] - ref[i]);
+        max_diff = isnan(diff) ? INFINITY : fmaxf(max_diff, diff);
+    }
+    const int valid = max_diff <= 1e-5f * ref_max;
+
+    // Multiply-adds, and the traffic of reading each input and writing each output once
+    const double ms = timeStrategy(dev, strategy, kernel, d_x, d_mask, d_y, H, W, K, tile_width);
+    const double flops = 2.0 * K * K * out_count;
+    const double bytes = sizeof(float) * ((double)H * W + out_count + K * K);
+    printf("%s,%d,%d,%d,", STRATEGY_NAMES[strategy], H, W, K);
+    if (tile_width)
+        printf("%d", tile_width);
+    printf(",%.4f,%.2f,%.2f,%g,%d\n", ms, flops / (ms * 1e6), bytes / (ms * 1e6), max_diff, valid);
+    fflush(stdout);
+    return valid;
+}
+
+// Why a strategy cannot run this configuration, or NULL if it can
+static const char *unsupported(const Device *dev, int strategy, cl_kernel kernel, int K, int tile_width) {
+    const size_t edge = groupEdge(strategy, K, tile_width);
+    size_t max_group_size;
+    clGetKernelWorkGroupInfo(kernel, dev->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size),
+                             &max_group_size, NULL);
+    if (edge * edge > max_group_size)
+        return "work-group too large for the device";
+    return NULL;
+}
+
+// Parses a comma-separated list of ints into values, returning how many there were
+static int parseList(const char *arg, int *values) {
+    int count = 0;
+    char *copy = strdup(arg);
+    for (char *token = strtok(copy, ","); token && count < MAX_GRID; token = strtok(NULL, ","))
+        values[count++] = atoi(token);
+    free(copy);
+    return count;
+}
+
+// Like parseList, for HxW shapes; a single number is a square image
+static int parseShapes(const char *arg, Shape *shapes) {
+    int count = 0;
+    char *copy = strdup(arg);
+    for (char *token = strtok(copy, ","); token && count < MAX_GRID; token = strtok(NULL, ",")) {
+        shapes[count].H = atoi(token);
+        const char *x = strchr(token, 'x');
+        shapes[count].W = x ? atoi(x + 1) : shapes[count].H;
+        count++;
+    }
+    free(copy);
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+
+    // ./run [HxW,...] [K,...] [TILE_WIDTH,...]
+    Shape shapes[MAX_GRID];
+    int Ks[MAX_GRID], tile_widths[MAX_GRID];
+    int num_shapes = parseShapes(argc >= 2 ? argv[1] : "256,1024,4096", shapes);
+    int num_Ks = parseList(argc >= 3 ? argv[2] : "3,5,7", Ks);
+    int num_tiles = parseList(argc >= 4 ? argv[3] : "8,16,32", tile_widths);
+    for (int i = 0; i < num_tiles; i++) {
+        if (tile_widths[i] < 1) {
+            fprintf(stderr, "Usage: %s [HxW,...] [K,...] [TILE_WIDTH,...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    srand(500);
+
+    // PLATFORM_INDEX and DEVICE_INDEX pick the device, as for the PAs
+    cl_int err;
+    Device dev;
+    int platform_index = -1, device_index = -1;
+    checkErr(OclSelectDevice(&dev.device, &platform_index, &device_index, OCL_DEVICE_TYPE), "OclSelectDevice");
+    dev.context = clCreateContext(NULL, 1, &dev.device, NULL, NULL, &err);
+    checkErr(err, "clCreateContext");
+#ifdef __APPLE__
+    dev.queue = clCreateCommandQueue(dev.context, dev.device, CL_QUEUE_PROFILING_ENABLE, &err);
+#else
+    const cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+    dev.queue = clCreateCommandQueueWithProperties(dev.context, dev.device, properties, &err);
+#endif
+    checkErr(err, "clCreateCommandQueueWithProperties");
+    cl_kernel naive = buildStrategy(&dev, NAIVE, "");
+
+    // Rows go to stdout, so `./run > results.csv` keeps only the table
+    printf("strategy,H,W,K,tile_width,ms,gflops,gbps,max_abs_diff,valid\n");
+    int failures = 0;
+    for (int k = 0; k < num_Ks; k++) {
+        const int K = Ks[k];
+        if (K < 1) {
+            fprintf(stderr, "Skipping K=%d\n", K);
+            continue;
+        }
+
+        // R and TILE_WIDTH are build options, so each K and tile width is its own program
+        cl_kernel tiled[MAX_GRID][NUM_STRATEGIES];
+        for (int t = 0; t < num_tiles; t++) {
+            char options[64];
+            snprintf(options, sizeof(options), "-DTILE_WIDTH=%d -DR=%d", tile_widths[t], K / 2);
+            for (int s = TYPE1; s < NUM_STRATEGIES; s++)
+                tiled[t][s] = buildStrategy(&dev, s, options);
+        }
+
+        for (int i = 0; i < num_shapes; i++) {
+            const int H = shapes[i].H, W = shapes[i].W;
+            if (H < K || W < K) {
+                fprintf(stderr, "Skipping %dx%d: smaller than K=%d\n", H, W, K);
+                continue;
+            }
+            const int H_out = H - K + 1;
+            const int W_out = W - K + 1;
+            const size_t out_count = (size_t)H_out * W_out;
+
+            // Small integers, so every order of summation gives the same floats
+            float *h_x = (float*) malloc(sizeof(float) * H * W);
+            float *h_mask = (float*) malloc(sizeof(float) * K * K);
+            float *h_ref = (float*) malloc(sizeof(float) * out_count);
+            float *h_y = (float*) malloc(sizeof(float) * out_count);
+            if (!h_x || !h_mask || !h_ref || !h_y) {
+                fprintf(stderr, "Failed to allocate a %dx%d image\n", H, W);
+                exit(EXIT_FAILURE);
+            }
+            for (int j = 0; j < H * W; j++)
+                h_x[j] = rand() % 10;
+            for (int j = 0; j < K * K; j++)
+                h_mask[j] = rand() % 10;
+
+            cl_mem d_x = clCreateBuffer(dev.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                        sizeof(float) * H * W, h_x, &err);
+            checkErr(err, "clCreateBuffer(d_x)");
+            cl_mem d_mask = clCreateBuffer(dev.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                           sizeof(float) * K * K, h_mask, &err);
+            checkErr(err, "clCreateBuffer(d_mask)");
+            cl_mem d_y = clCreateBuffer(dev.context, CL_MEM_WRITE_ONLY, sizeof(float) * out_count, NULL, &err);
+            checkErr(err, "clCreateBuffer(d_y)");
+
+            runStrategy(&dev, NAIVE, naive, d_x, d_mask, d_y, H, W, K, 0, h_ref, NULL, 0);
+            float ref_max = 0;
+            for (size_t j = 0; j < out_count; j++)
+                ref_max = fmaxf(ref_max, fabsf(h_ref[j]));
+
+            for (int t = 0; t < num_tiles; t++) {
+                for (int s = TYPE1; s < NUM_STRATEGIES; s++) {
+                    const char *reason = unsupported(&dev, s, tiled[t][s], K, tile_widths[t]);
+                    if (reason) {
+                        fprintf(stderr, "Skipping %s %dx%d K=%d TILE_WIDTH=%d: %s\n", STRATEGY_NAMES[s],
+                                H, W, K, tile_widths[t], reason);
+                        continue;
+                    }
+                    failures += !runStrategy(&dev, s, tiled[t][s], d_x, d_mask, d_y, H, W, K, tile_widths[t],
+                                             h_y, h_ref, ref_max);
+                }
+            }
+
+            clReleaseMemObject(d_x);
+            clReleaseMemObject(d_mask);
+            clReleaseMemObject(d_y);
+            free(h_x);
+            free(h_mask);
+            free(h_ref);
+            free(h_y);
+        }
+
+        for (int t = 0; t < num_tiles; t++)
+            for (int s = TYPE1; s < NUM_STRATEGIES; s++)
+                clReleaseKernel(tiled[t][s]);
+    }
+
+    clReleaseKernel(naive);
+    clReleaseCommandQueue(dev.queue);
+    clReleaseContext(dev.context);
+    if (failures)
+        fprintf(stderr, "%d configurations differ from the naive kernel\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -66,8 +66,12 @@ void opencl_setup(OpenCL *ocl, char*kernelName, char*kernelPath, char*buildOptio
     ocl->context = clCreateContext(NULL, 1, &ocl->device, NULL, NULL, &err);
     checkErr(err, "clCreateContext");
     
+#ifdef __APPLE__
     ocl->queue = clCreateCommandQueue(ocl->context, ocl->device, 0, &err);
-    checkErr(err, "clCreateCommandQueue");
+#else
+    ocl->queue = clCreateCommandQueueWithProperties(ocl->context, ocl->device, NULL, &err);
+#endif
+    checkErr(err, "clCreateCommandQueueWithProperties");
     
     // 4. Create and build the program
     size_t kernelSize;
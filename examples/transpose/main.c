@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "device.h"
+#include "transpose.h"
+#include "../opencl_utils.h"
+
+#define ITERATIONS 20 // Timed launches per kernel, after one warm-up
+
+static const char *TYPE_NAMES[] = {"int", "float", "half"};
+
+// Shape of the OclEnqueueTranspose* functions, so timeKernel can run any of them
+typedef cl_int (*Launch)(OclTranspose *t, cl_command_queue queue, cl_mem a, cl_mem b,
+                         int batch, int rows, int cols, cl_event *event);
+
+static cl_int launchInPlace(OclTranspose *t, cl_command_queue queue, cl_mem a, cl_mem b,
+                            int batch, int rows, int cols, cl_event *event) {
+    return OclEnqueueTransposeInPlace(t, queue, a, batch, rows, event);
+}
+
+// Average kernel time in ms over ITERATIONS launches
+static double timeKernel(Launch launch, OclTranspose *t, cl_command_queue queue, cl_mem a, cl_mem b,
+                         int batch, int rows, int cols) {
+    double total_ms = 0;
+    for (int i = 0; i <= ITERATIONS; i++) {
+        cl_event event;
+        cl_ulong start, end;
+        checkErr(launch(t, queue, a, b, batch, rows, cols, &event), "launch");
+        checkErr(clWaitForEvents(1, &event), "clWaitForEvents");
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        clReleaseEvent(event);
+        if (i > 0) // the first launch pays for the warm-up
+            total_ms += (end - start) * 1e-6;
+    }
+    return total_ms / ITERATIONS;
+}
+
+// Number of elements of output that differ from the transpose of input
+static size_t countMismatches(const char *input, const char *output, int batch, int rows, int cols,
+                              size_t element_size) {
+    size_t mismatches = 0;
+    for (int b = 0; b < batch; b++) {
+        const size_t plane = (size_t)b * rows * cols;
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                if (memcmp(input + (plane + (size_t)r * cols + c) * element_size,
+                           output + (plane + (size_t)c * rows + r) * element_size, element_size) != 0)
+                    mismatches++;
+    }
+    return mismatches;
+}
+
+// Checks and times one element type, printing a row of the table
+static void benchmarkType(cl_context context, cl_device_id device, cl_command_queue queue,
+                          OclTransposeType type, int batch, int rows, int cols) {
+    OclTranspose t;
+    checkErr(OclCreateTranspose(&t, context, device, type), "OclCreateTranspose");
+    checkErr(OclTuneTranspose(&t, rows, cols), "OclTuneTranspose");
+
+    // Random bytes: the kernels only move elements, so any bit pattern checks them
+    const size_t size = (size_t)batch * rows * cols * t.element_size;
+    char *h_input = (char *)malloc(size);
+    char *h_output = (char *)malloc(size);
+    if (!h_input || !h_output) {
+        fprintf(stderr, "Failed to allocate %zu byte matrices\n", size);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < size; i++)
+        h_input[i] = (char)rand();
+
+    cl_int err;
+    cl_mem d_input = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, h_input, &err);
+    checkErr(err, "clCreateBuffer(d_input)");
+    cl_mem d_output = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, &err);
+    checkErr(err, "clCreateBuffer(d_output)");
+
+    checkErr(OclEnqueueTranspose(&t, queue, d_input, d_output, batch, rows, cols, NULL), "OclEnqueueTranspose");
+    checkErr(clEnqueueReadBuffer(queue, d_output, CL_TRUE, 0, size, h_output, 0, NULL, NULL), "clEnqueueReadBuffer");
+    size_t mismatches = countMismatches(h_input, h_output, batch, rows, cols, t.element_size);
+
+    // In place on a copy of the input, which the timed runs below keep transposing
+    double in_place_ms = 0;
+    if (rows == cols) {
+        checkErr(clEnqueueWriteBuffer(queue, d_output, CL_TRUE, 0, size, h_input, 0, NULL, NULL), "clEnqueueWriteBuffer");
+        checkErr(OclEnqueueTransposeInPlace(&t, queue, d_output, batch, rows, NULL), "OclEnqueueTransposeInPlace");
+        checkErr(clEnqueueReadBuffer(queue, d_output, CL_TRUE, 0, size, h_output, 0, NULL, NULL), "clEnqueueReadBuffer");
+        mismatches += countMismatches(h_input, h_output, batch, rows, cols, t.element_size);
+        in_place_ms = timeKernel(launchInPlace, &t, queue, d_output, NULL, batch, rows, cols);
+    }
+
+    const double transpose_ms = timeKernel(OclEnqueueTranspose, &t, queue, d_input, d_output, batch, rows, cols);
+    const double copy_ms = timeKernel(OclEnqueueTransposeCopy, &t, queue, d_input, d_output, batch, rows, cols);
+
+    // Every kernel reads and writes each element once
+    const double gb = 2.0 * size * 1e-9;
+    printf("%-6s %5zu %12.1f ", TYPE_NAMES[type], t.tile_dim, gb / (transpose_ms * 1e-3));
+    if (rows == cols)
+        printf("%12.1f ", gb / (in_place_ms * 1e-3));
+    else
+        printf("%12s ", "-");
+    printf("%10.1f %8.0f%% %10zu\n", gb / (copy_ms * 1e-3), 100.0 * copy_ms / transpose_ms, mismatches);
+
+    clReleaseMemObject(d_input);
+    clReleaseMemObject(d_output);
+    OclReleaseTranspose(&t);
+    free(h_input);
+    free(h_output);
+}
+
+int main(int argc, char *argv[]) {
+
+    // ./run [rows] [cols] [batch] [int|float|half|all]
+    int rows = argc >= 2 ? atoi(argv[1]) : 4096;
+    int cols = argc >= 3 ? atoi(argv[2]) : rows;
+    int batch = argc >= 4 ? atoi(argv[3]) : 1;
+    const char *type_name = argc >= 5 ? argv[4] : "all";
+    if (rows < 1 || cols < 1 || batch < 1) {
+        fprintf(stderr, "Usage: %s [rows] [cols] [batch] [int|float|half|all]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int first_type = -1, last_type = -1;
+    for (int i = 0; i < 3; i++)
+        if (strcmp(type_name, TYPE_NAMES[i]) == 0)
+            first_type = last_type = i;
+    if (strcmp(type_name, "all") == 0) {
+        first_type = OCL_TRANSPOSE_INT;
+        last_type = OCL_TRANSPOSE_HALF;
+    }
+    if (first_type < 0) {
+        fprintf(stderr, "Unknown element type '%s'\n", type_name);
+        return EXIT_FAILURE;
+    }
+
+    // PLATFORM_INDEX and DEVICE_INDEX pick the device, as for the PAs
+    cl_int err;
+    cl_device_id device;
+    int platform_index = -1, device_index = -1;
+    checkErr(OclSelectDevice(&device, &platform_index, &device_index, OCL_DEVICE_TYPE), "OclSelectDevice");
+    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+    checkErr(err, "clCreateContext");
+#ifdef __APPLE__
+    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+#else
+    const cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+    cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, properties, &err);
+#endif
+    checkErr(err, "clCreateCommandQueueWithProperties");
+
+    printf("%d x %d, batch %d; GB/s counts one read and one write per element\n", rows, cols, batch);
+    printf("%-6s %5s %12s %12s %10s %9s %10s\n", "type", "tile", "transpose", "in place", "copy",
+           "vs copy", "mismatches");
+    for (int type = first_type; type <= last_type; type++)
+        benchmarkType(context, device, queue, (OclTransposeType)type, batch, rows, cols);
+
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return EXIT_SUCCESS;
+}
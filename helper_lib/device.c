@@ -98,6 +98,13 @@ cl_int OclGetDeviceWithFallback(cl_device_id* device_id, cl_device_type device_t
 }
 
 cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type) {
+    *platform_index = -1;
+    *device_index = -1;
+
+    return OclSelectDevice(device_id, platform_index, device_index, device_type);
+}
+
+cl_int OclSelectDevice(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type) {
     OclPlatformProp *platforms = NULL;
     cl_int err;
 
@@ -113,26 +120,45 @@ cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index
         return CL_DEVICE_NOT_FOUND;
     }
 
-    // Handle loading index from environment variables.
+    // Handle loading index from environment variables, unless the caller already asked for one.
     char* platform_index_str = getenv("PLATFORM_INDEX");
     char* device_index_str = getenv("DEVICE_INDEX");
 
-    *platform_index = -1;
-    *device_index = -1;
-
-    if (platform_index_str) {
+    if (*platform_index < 0 && platform_index_str) {
         *platform_index = atoi(platform_index_str);
     }
 
-    if (device_index_str) {
+    if (*device_index < 0 && device_index_str) {
         *device_index = atoi(device_index_str);
     }
 
-    // If we are missing either index, search instead based off of the requested device type.
-    if (*platform_index == -1 || *device_index == -1) {
-        *platform_index = -1;
-        *device_index = -1;
+    // A device index alone refers to the first platform.
+    if (*platform_index < 0 && *device_index >= 0) {
+        *platform_index = 0;
+    }
 
+    if (*platform_index >= (int)num_platforms ||
+        (*platform_index >= 0 && *device_index >= (int)platforms[*platform_index].num_devices)) {
+        fprintf(stderr, "No OpenCL device %d on platform %d (%u platforms found)\n", *device_index, *platform_index, num_platforms);
+        err = CL_INVALID_VALUE;
+    }
+    else if (*platform_index >= 0 && platforms[*platform_index].num_devices == 0) {
+        fprintf(stderr, "OpenCL platform %d has no devices\n", *platform_index);
+        err = CL_DEVICE_NOT_FOUND;
+    }
+    else if (*platform_index >= 0) {
+        // With only a platform, look for the requested device type on it and fall back to its first device.
+        if (*device_index < 0) {
+            *device_index = 0;
+            for (int j = platforms[*platform_index].num_devices - 1; j >= 0; j--) {
+                if (*platforms[*platform_index].devices[j].type == device_type) {
+                    *device_index = j;
+                }
+            }
+        }
+    }
+    else {
+        // Neither index was requested, so search based off of the requested device type.
         for (int i = 0; i < num_platforms; i++) {
             for (int j = 0; j < platforms[i].num_devices; j++) {
                 if (*platforms[i].devices[j].type == device_type) {
@@ -141,23 +167,27 @@ cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index
                 }
             }
         }
+
+        if (*platform_index == -1) {
+            printf("\033[33mCould not find a %s or other requested device. Defaulting to first available device...\033[0m\n", OclDeviceTypeString(device_type));
+
+            // If we got here, there is not a device which matches the requested device type.  Just return the first device.
+            *platform_index = 0;
+            *device_index = 0;
+        }
     }
 
-    if (*platform_index != -1 && *device_index != -1) {
+    if (err == CL_SUCCESS) {
         *device_id = platforms[*platform_index].devices[*device_index].device_id;
         printf("Running on:\n\tPlatform: %s\n\tDevice: %s\n\n", platforms[*platform_index].name, platforms[*platform_index].devices[*device_index].name);
-
-        return CL_SUCCESS;
     }
 
-    printf("\033[33mCould not find a %s or other requested device. Defaulting to first available device...\033[0m\n", OclDeviceTypeString(device_type));
-
-    // If we got here, there is not a device which matches the requested device type.  Just return the first device.
-    *device_id = platforms[0].devices[0].device_id;
-    *platform_index = 0;
-    *device_index = 0;
+    for (cl_uint i = 0; i < num_platforms; i++) {
+        OclFreePlatformProp(&platforms[i]);
+    }
+    free(platforms);
 
-    return CL_SUCCESS;
+    return err;
 }
 
 cl_int OclFindDevices(const cl_platform_id platform_id, const OclDeviceProp **devices,
@@ -309,6 +339,7 @@ cl_int OclFindPlatforms(const OclPlatformProp **platforms, cl_uint *num_platform
 cl_int OclFreeDeviceProp(OclDeviceProp *device)
 {
     free(device->name);
+    free(device->type);
     free(device->max_compute_units);
     free(device->global_mem_size);
     free(device->max_constant_buffer_size);
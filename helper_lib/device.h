@@ -80,6 +80,21 @@ cl_int OclGetDeviceWithFallback(cl_device_id* device_id, cl_device_type device_t
  */
 cl_int OclGetDeviceInfoWithFallback(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type);
 
+/**
+ * @brief Finds the OpenCL device at the requested platform and device index, or one matching the specified type.
+ * An index below 0 is not requested, and is read from the PLATFORM_INDEX or DEVICE_INDEX environment variable if that is set.
+ * With only a platform index, the first device of the specified type on that platform is used, or else its first device.
+ * With neither, this searches like OclGetDeviceInfoWithFallback.
+ *
+ * @param device_id A pointer to the block of memory to store the device ID for the selected device.
+ * @param platform_index The requested platform index or -1, and on return the platform index of the selected device.
+ * @param device_index The requested device index or -1, and on return the device index of the selected device.
+ * @param device_type The type of device to look for.
+ *
+ * @return CL_SUCCESS if a valid device is found.  CL_INVALID_VALUE if a requested index is out of range, or another error otherwise.
+ */
+cl_int OclSelectDevice(cl_device_id* device_id, int* platform_index, int* device_index, cl_device_type device_type);
+
 /**
  * @brief Finds all OpenCL platforms and devices, and get their respective properties.
  * Internally calls OclFindDevices.
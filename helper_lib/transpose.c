@@ -0,0 +1,352 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "transpose.h"
+
+// Timed launches per tile size in OclTuneTranspose, after one warm-up
+#define TUNE_RUNS 5
+
+// Work-group edges OclCreateTranspose and OclTuneTranspose choose from
+static const size_t TILE_DIMS[] = {32, 16, 8};
+#define NUM_TILE_DIMS (sizeof(TILE_DIMS) / sizeof(TILE_DIMS[0]))
+
+// Built with -DT=<element type>. The tile edge is the work-group edge, and
+// the tiles are __local arguments sized by the host, so no size is baked in.
+// Each tile row is padded by one element so the column reads of the second
+// half do not all land in the same local memory bank.
+static const char *TRANSPOSE_SOURCE =
+    "#define PLANE(rows, cols) ((size_t)(rows) * (cols) * get_global_id(2))\n"
+    "\n"
+    "__kernel void transpose(__global const T *input, __global T *output, int rows, int cols,\n"
+    "                        __local T *tile) {\n"
+    "    const int tile_dim = get_local_size(0);\n"
+    "    const int lx = get_local_id(0);\n"
+    "    const int ly = get_local_id(1);\n"
+    "    input += PLANE(rows, cols);\n"
+    "    output += PLANE(rows, cols);\n"
+    "\n"
+    "    int x = get_group_id(0) * tile_dim + lx;\n"
+    "    int y = get_group_id(1) * tile_dim + ly;\n"
+    "    if (x < cols && y < rows) {\n"
+    "        tile[ly * (tile_dim + 1) + lx] = input[(size_t)y * cols + x];\n"
+    "    }\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    x = get_group_id(1) * tile_dim + lx;\n"
+    "    y = get_group_id(0) * tile_dim + ly;\n"
+    "    if (x < rows && y < cols) {\n"
+    "        output[(size_t)y * rows + x] = tile[lx * (tile_dim + 1) + ly];\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// The group at tile (gy, gx) above the diagonal swaps it with tile (gx, gy);\n"
+    "// groups below the diagonal have nothing to do.\n"
+    "__kernel void transposeSquare(__global T *data, int n, __local T *tiles) {\n"
+    "    const int gx = get_group_id(0);\n"
+    "    const int gy = get_group_id(1);\n"
+    "    if (gx < gy) {\n"
+    "        return;\n"
+    "    }\n"
+    "    const int tile_dim = get_local_size(0);\n"
+    "    const int lx = get_local_id(0);\n"
+    "    const int ly = get_local_id(1);\n"
+    "    __local T *upper = tiles;\n"
+    "    __local T *lower = tiles + tile_dim * (tile_dim + 1);\n"
+    "    data += PLANE(n, n);\n"
+    "\n"
+    "    const int ux = gx * tile_dim + lx, uy = gy * tile_dim + ly;\n"
+    "    const int lox = gy * tile_dim + lx, loy = gx * tile_dim + ly;\n"
+    "    if (ux < n && uy < n) {\n"
+    "        upper[ly * (tile_dim + 1) + lx] = data[(size_t)uy * n + ux];\n"
+    "    }\n"
+    "    if (lox < n && loy < n) {\n"
+    "        lower[ly * (tile_dim + 1) + lx] = data[(size_t)loy * n + lox];\n"
+    "    }\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    // on the diagonal both tiles are the same one, and both writes agree\n"
+    "    if (ux < n && uy < n) {\n"
+    "        data[(size_t)uy * n + ux] = lower[lx * (tile_dim + 1) + ly];\n"
+    "    }\n"
+    "    if (lox < n && loy < n) {\n"
+    "        data[(size_t)loy * n + lox] = upper[lx * (tile_dim + 1) + ly];\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "__kernel void transposeCopy(__global const T *input, __global T *output, int rows, int cols) {\n"
+    "    const int x = get_global_id(0);\n"
+    "    const int y = get_global_id(1);\n"
+    "    if (x < cols && y < rows) {\n"
+    "        const size_t i = PLANE(rows, cols) + (size_t)y * cols + x;\n"
+    "        output[i] = input[i];\n"
+    "    }\n"
+    "}\n";
+
+/**
+ * @brief Checks whether both transpose kernels can run with tile_dim x tile_dim work-groups.
+ *
+ * @param transpose A transpose with its kernels built.
+ * @param tile_dim The work-group edge to check.
+ *
+ * @return true if the work-group size and both of transposeSquare's tiles fit the device.
+ */
+static bool OclTileFits(const OclTranspose *transpose, size_t tile_dim)
+{
+    size_t max_item_sizes[3];
+    cl_ulong local_mem_size;
+    if (clGetDeviceInfo(transpose->device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_item_sizes),
+                        max_item_sizes, NULL) != CL_SUCCESS ||
+        clGetDeviceInfo(transpose->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_size),
+                        &local_mem_size, NULL) != CL_SUCCESS)
+        return false;
+    if (tile_dim > max_item_sizes[0] || tile_dim > max_item_sizes[1])
+        return false;
+    if (2 * tile_dim * (tile_dim + 1) * transpose->element_size > local_mem_size)
+        return false;
+
+    cl_kernel kernels[] = {transpose->transpose, transpose->transpose_square};
+    for (int i = 0; i < 2; i++)
+    {
+        size_t group_size;
+        if (clGetKernelWorkGroupInfo(kernels[i], transpose->device, CL_KERNEL_WORK_GROUP_SIZE,
+                                     sizeof(group_size), &group_size, NULL) != CL_SUCCESS ||
+            tile_dim * tile_dim > group_size)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Enqueues one of the transpose kernels over a batch of rows x cols tiles.
+ *
+ * @param transpose A transpose from OclCreateTranspose.
+ * @param kernel The kernel, with its arguments set.
+ * @param queue The command queue to enqueue on.
+ * @param batch The number of matrices.
+ * @param rows Rows of each input matrix.
+ * @param cols Columns of each input matrix.
+ * @param event Set to the kernel's event if not NULL.
+ *
+ * @return CL_SUCCESS if the kernel is enqueued.  An error otherwise.
+ */
+static cl_int OclEnqueueTiles(const OclTranspose *transpose, cl_kernel kernel, cl_command_queue queue,
+                              int batch, int rows, int cols, cl_event *event)
+{
+    const size_t tile_dim = transpose->tile_dim;
+    size_t global_size[3] = {
+        (cols + tile_dim - 1) / tile_dim * tile_dim,
+        (rows + tile_dim - 1) / tile_dim * tile_dim,
+        batch
+    };
+    size_t local_size[3] = {tile_dim, tile_dim, 1};
+    return clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global_size, local_size, 0, NULL, event);
+}
+
+cl_int OclCreateTranspose(OclTranspose *transpose, cl_context context, cl_device_id device_id,
+                          OclTransposeType type)
+{
+    cl_int status;
+    const char *options;
+    switch (type)
+    {
+    case OCL_TRANSPOSE_INT:
+        options = "-DT=int";
+        transpose->element_size = sizeof(cl_int);
+        break;
+    case OCL_TRANSPOSE_FLOAT:
+        options = "-DT=float";
+        transpose->element_size = sizeof(cl_float);
+        break;
+    case OCL_TRANSPOSE_HALF:
+        options = "-DT=ushort";
+        transpose->element_size = sizeof(cl_half);
+        break;
+    default:
+        return CL_INVALID_VALUE;
+    }
+    transpose->context = context;
+    transpose->device = device_id;
+    transpose->type = type;
+    transpose->transpose = transpose->transpose_square = transpose->copy = NULL;
+
+    transpose->program = clCreateProgramWithSource(context, 1, &TRANSPOSE_SOURCE, NULL, &status);
+    if (status != CL_SUCCESS)
+        return status;
+    status = clBuildProgram(transpose->program, 1, &device_id, options, NULL, NULL);
+    if (status != CL_SUCCESS)
+    {
+        size_t log_size;
+        clGetProgramBuildInfo(transpose->program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *log = (char *)malloc(log_size);
+        if (log)
+        {
+            clGetProgramBuildInfo(transpose->program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+            fprintf(stderr, "Transpose build error:\n%s\n", log);
+            free(log);
+        }
+        clReleaseProgram(transpose->program);
+        transpose->program = NULL;
+        return status;
+    }
+
+    transpose->transpose = clCreateKernel(transpose->program, "transpose", &status);
+    if (status == CL_SUCCESS)
+        transpose->transpose_square = clCreateKernel(transpose->program, "transposeSquare", &status);
+    if (status == CL_SUCCESS)
+        transpose->copy = clCreateKernel(transpose->program, "transposeCopy", &status);
+    if (status != CL_SUCCESS)
+    {
+        OclReleaseTranspose(transpose);
+        return status;
+    }
+
+    transpose->tile_dim = 1;
+    for (size_t i = 0; i < NUM_TILE_DIMS; i++)
+    {
+        if (OclTileFits(transpose, TILE_DIMS[i]))
+        {
+            transpose->tile_dim = TILE_DIMS[i];
+            break;
+        }
+    }
+    return CL_SUCCESS;
+}
+
+cl_int OclTuneTranspose(OclTranspose *transpose, int rows, int cols)
+{
+    if (rows < 1 || cols < 1)
+        return CL_INVALID_VALUE;
+
+    cl_int status;
+#ifdef __APPLE__
+    cl_command_queue queue = clCreateCommandQueue(transpose->context, transpose->device,
+                                                  CL_QUEUE_PROFILING_ENABLE, &status);
+#else
+    const cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+    cl_command_queue queue = clCreateCommandQueueWithProperties(transpose->context, transpose->device,
+                                                                properties, &status);
+#endif
+    if (status != CL_SUCCESS)
+        return status;
+    const size_t size = (size_t)rows * cols * transpose->element_size;
+    cl_mem input = clCreateBuffer(transpose->context, CL_MEM_READ_ONLY, size, NULL, &status);
+    if (status != CL_SUCCESS)
+    {
+        clReleaseCommandQueue(queue);
+        return status;
+    }
+    cl_mem output = clCreateBuffer(transpose->context, CL_MEM_WRITE_ONLY, size, NULL, &status);
+    if (status != CL_SUCCESS)
+    {
+        clReleaseMemObject(input);
+        clReleaseCommandQueue(queue);
+        return status;
+    }
+
+    const size_t default_tile_dim = transpose->tile_dim;
+    size_t best_tile_dim = 0;
+    cl_ulong best_ns = 0;
+    for (size_t i = 0; i < NUM_TILE_DIMS; i++)
+    {
+        if (!OclTileFits(transpose, TILE_DIMS[i]))
+            continue;
+        transpose->tile_dim = TILE_DIMS[i];
+
+        cl_ulong total_ns = 0;
+        for (int run = 0; run <= TUNE_RUNS && status == CL_SUCCESS; run++)
+        {
+            cl_event event;
+            status = OclEnqueueTranspose(transpose, queue, input, output, 1, rows, cols, &event);
+            if (status != CL_SUCCESS)
+                break;
+            cl_ulong start = 0, end = 0;
+            status = clWaitForEvents(1, &event);
+            if (status == CL_SUCCESS)
+                status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+            if (status == CL_SUCCESS)
+                status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+            clReleaseEvent(event);
+            if (run > 0) // the first launch pays for the warm-up
+                total_ns += end - start;
+        }
+        if (status != CL_SUCCESS)
+            break;
+        if (best_tile_dim == 0 || total_ns < best_ns)
+        {
+            best_tile_dim = TILE_DIMS[i];
+            best_ns = total_ns;
+        }
+    }
+
+    transpose->tile_dim = best_tile_dim ? best_tile_dim : default_tile_dim;
+    clReleaseMemObject(input);
+    clReleaseMemObject(output);
+    clReleaseCommandQueue(queue);
+    if (best_tile_dim == 0)
+        return status != CL_SUCCESS ? status : CL_INVALID_WORK_GROUP_SIZE;
+    return CL_SUCCESS;
+}
+
+cl_int OclEnqueueTranspose(OclTranspose *transpose, cl_command_queue queue, cl_mem input, cl_mem output,
+                           int batch, int rows, int cols, cl_event *event)
+{
+    if (batch < 1 || rows < 1 || cols < 1)
+        return CL_INVALID_VALUE;
+
+    const size_t tile_size = transpose->tile_dim * (transpose->tile_dim + 1) * transpose->element_size;
+    cl_int status = clSetKernelArg(transpose->transpose, 0, sizeof(cl_mem), &input);
+    status |= clSetKernelArg(transpose->transpose, 1, sizeof(cl_mem), &output);
+    status |= clSetKernelArg(transpose->transpose, 2, sizeof(int), &rows);
+    status |= clSetKernelArg(transpose->transpose, 3, sizeof(int), &cols);
+    status |= clSetKernelArg(transpose->transpose, 4, tile_size, NULL);
+    if (status != CL_SUCCESS)
+        return CL_INVALID_KERNEL_ARGS;
+    return OclEnqueueTiles(transpose, transpose->transpose, queue, batch, rows, cols, event);
+}
+
+cl_int OclEnqueueTransposeInPlace(OclTranspose *transpose, cl_command_queue queue, cl_mem data,
+                                  int batch, int n, cl_event *event)
+{
+    if (batch < 1 || n < 1)
+        return CL_INVALID_VALUE;
+
+    const size_t tile_size = transpose->tile_dim * (transpose->tile_dim + 1) * transpose->element_size;
+    cl_int status = clSetKernelArg(transpose->transpose_square, 0, sizeof(cl_mem), &data);
+    status |= clSetKernelArg(transpose->transpose_square, 1, sizeof(int), &n);
+    status |= clSetKernelArg(transpose->transpose_square, 2, 2 * tile_size, NULL);
+    if (status != CL_SUCCESS)
+        return CL_INVALID_KERNEL_ARGS;
+    return OclEnqueueTiles(transpose, transpose->transpose_square, queue, batch, n, n, event);
+}
+
+cl_int OclEnqueueTransposeCopy(OclTranspose *transpose, cl_command_queue queue, cl_mem input, cl_mem output,
+                               int batch, int rows, int cols, cl_event *event)
+{
+    if (batch < 1 || rows < 1 || cols < 1)
+        return CL_INVALID_VALUE;
+
+    cl_int status = clSetKernelArg(transpose->copy, 0, sizeof(cl_mem), &input);
+    status |= clSetKernelArg(transpose->copy, 1, sizeof(cl_mem), &output);
+    status |= clSetKernelArg(transpose->copy, 2, sizeof(int), &rows);
+    status |= clSetKernelArg(transpose->copy, 3, sizeof(int), &cols);
+    if (status != CL_SUCCESS)
+        return CL_INVALID_KERNEL_ARGS;
+    return OclEnqueueTiles(transpose, transpose->copy, queue, batch, rows, cols, event);
+}
+
+cl_int OclReleaseTranspose(OclTranspose *transpose)
+{
+    cl_int status = CL_SUCCESS;
+    cl_kernel *kernels[] = {&transpose->transpose, &transpose->transpose_square, &transpose->copy};
+    for (int i = 0; i < 3; i++)
+    {
+        if (*kernels[i] && clReleaseKernel(*kernels[i]) != CL_SUCCESS)
+            status = CL_INVALID_KERNEL;
+        *kernels[i] = NULL;
+    }
+    if (transpose->program && clReleaseProgram(transpose->program) != CL_SUCCESS)
+        status = CL_INVALID_PROGRAM;
+    transpose->program = NULL;
+    return status;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#define CL_TARGET_OPENCL_VERSION 300 // Use OpenCL 3.0
+#include <CL/cl.h>
+#endif
+
+/**
+ * @brief Element types the transpose kernels are built for.
+ * Half elements are only moved, never converted, so devices without cl_khr_fp16 can transpose them too.
+ */
+typedef enum _OclTransposeType
+{
+    OCL_TRANSPOSE_INT,
+    OCL_TRANSPOSE_FLOAT,
+    OCL_TRANSPOSE_HALF
+} OclTransposeType;
+
+/**
+ * @brief Tiled matrix transpose for one element type on one device.
+ * Matrix sizes are kernel arguments, so one build serves every shape.
+ * Batches are stored back to back: batch x rows x cols in, batch x cols x rows out.
+ */
+typedef struct _OclTranspose
+{
+    cl_context context;
+    cl_device_id device;
+    OclTransposeType type;
+    size_t element_size;
+    size_t tile_dim; // work-groups are tile_dim x tile_dim; set by OclTuneTranspose
+    cl_program program;
+    cl_kernel transpose;
+    cl_kernel transpose_square;
+    cl_kernel copy;
+} OclTranspose;
+
+/**
+ * @brief Builds the transpose kernels for an element type, and picks the largest tile the device fits.
+ *
+ * @param transpose The transpose to initialize.
+ * @param context The context buffers passed to it will belong to.
+ * @param device_id The device it will run on.
+ * @param type The element type.
+ *
+ * @return CL_SUCCESS if the kernels are built.  An error otherwise, with the build log printed.
+ */
+cl_int OclCreateTranspose(OclTranspose *transpose, cl_context context, cl_device_id device_id,
+                          OclTransposeType type);
+
+/**
+ * @brief Times every tile size the device fits on a rows x cols transpose, and keeps the fastest.
+ * Uses its own profiling queue and scratch buffers.
+ *
+ * @param transpose A transpose from OclCreateTranspose.
+ * @param rows Rows of the matrix to tune on.
+ * @param cols Columns of the matrix to tune on.
+ *
+ * @return CL_SUCCESS if at least one tile size ran.  An error otherwise, leaving tile_dim unchanged.
+ */
+cl_int OclTuneTranspose(OclTranspose *transpose, int rows, int cols);
+
+/**
+ * @brief Enqueues output = transpose of every rows x cols matrix in input.
+ * input and output must not overlap.
+ *
+ * @param transpose A transpose from OclCreateTranspose.
+ * @param queue The command queue to enqueue on.
+ * @param input batch x rows x cols elements.
+ * @param output batch x cols x rows elements.
+ * @param batch The number of matrices.
+ * @param rows Rows of each input matrix.
+ * @param cols Columns of each input matrix.
+ * @param event Set to the kernel's event if not NULL.
+ *
+ * @return CL_SUCCESS if the kernel is enqueued.  An error otherwise.
+ */
+cl_int OclEnqueueTranspose(OclTranspose *transpose, cl_command_queue queue, cl_mem input, cl_mem output,
+                           int batch, int rows, int cols, cl_event *event);
+
+/**
+ * @brief Enqueues an in-place transpose of every n x n matrix in data.
+ * Each work-group swaps a tile with its mirror across the diagonal.
+ *
+ * @param transpose A transpose from OclCreateTranspose.
+ * @param queue The command queue to enqueue on.
+ * @param data batch x n x n elements.
+ * @param batch The number of matrices.
+ * @param n Rows and columns of each matrix.
+ * @param event Set to the kernel's event if not NULL.
+ *
+ * @return CL_SUCCESS if the kernel is enqueued.  An error otherwise.
+ */
+cl_int OclEnqueueTransposeInPlace(OclTranspose *transpose, cl_command_queue queue, cl_mem data,
+                                  int batch, int n, cl_event *event);
+
+/**
+ * @brief Enqueues a plain copy of batch x rows x cols elements, launched like OclEnqueueTranspose.
+ * It moves the same bytes with coalesced reads and writes, which makes it the bandwidth to measure a transpose against.
+ *
+ * @return CL_SUCCESS if the kernel is enqueued.  An error otherwise.
+ */
+cl_int OclEnqueueTransposeCopy(OclTranspose *transpose, cl_command_queue queue, cl_mem input, cl_mem output,
+                               int batch, int rows, int cols, cl_event *event);
+
+/**
+ * @brief Releases the kernels and program of a transpose.
+ *
+ * @param transpose A transpose from OclCreateTranspose.
+ *
+ * @return CL_SUCCESS if and only if everything is released.
+ */
+cl_int OclReleaseTranspose(OclTranspose *transpose);
+
+#ifdef __cplusplus
+}
+#endif